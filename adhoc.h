@@ -4,8 +4,11 @@
 #include <stdbool.h>
 #include "hashmap.h"
 #include "adhoc_types.h"
+#include "optimize.h"
 #include "c.h"
 #include "javascript.h"
+#include "vm.h"
+#include "format.h"
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-parameter"
 #pragma clang diagnostic ignored "-Wswitch"
@@ -40,14 +43,34 @@ char ADHOC_TARGET_LANGUAGE[30];
 bool ADHOC_OUPUT_COLOR = false;
 bool ADHOC_DEBUG_INFO = false;
 bool ADHOC_EXECUTABLE = false;
+bool ADHOC_RUN = false;
+bool ADHOC_INSTRUMENT = false;
+char ADHOC_PROFILE_FILE[100];
+char ADHOC_SOURCE_MAP[100];
+bool ADHOC_TRACE = false;
+bool ADHOC_HEAP_PROFILE = false;
+int ADHOC_FORMAT = 0;
+int ADHOC_THREAD_COUNT = -1;
+int ADHOC_GRAIN_SIZE = -1;
+int ADHOC_INLINE_SIZE = -1;
+int ADHOC_NATIVE_HEAT = -1;
 hashMap_uint ADHOC_ESTIMATED_NODE_COUNT = 100;
 
+// The lexer reads an input file through yyin rather than a reopened stdin,
+// which a program run with --run may still prompt on
+extern FILE* yyin;
+FILE* adhoc_inputFile = NULL;
+char* adhoc_inputName = "stdin";
+
 // A hashMap of language module locations
 hashMap* moduleMap;
 // A hashMap of all the AST nodes
 hashMap* nodeMap;
 // A placeholder node during AST building
 ASTnode* readNode,* ASTroot;
+// The distinct struct layouts, in the order they were first seen
+ASTnode** adhoc_layouts = NULL;
+int adhoc_countLayouts = 0, adhoc_sizeLayouts = 0;
 
 // Check if a file is accessible in a particular mode
 bool fileAcc(char* path, char* mode){
@@ -55,11 +78,11 @@ bool fileAcc(char* path, char* mode){
 	return (f=fopen(path, mode)) && !fclose(f);
 }
 
-// Get a node's index in its parent
-int adhoc_getNodeIndexOfChild(ASTnode* p, ASTnode* c){
-	int i = -1;
-	while(++i < p->countChildren) if(p->children[i] == c) return i;
-	return -1;
+// Get what system action names are prefixed with in the target language
+const char* adhoc_libraryPrepend(){
+	if(!strcmp(ADHOC_TARGET_LANGUAGE, "c")) return "adhoc_";
+	if(!strcmp(ADHOC_TARGET_LANGUAGE, "javascript")) return "Adhoc.";
+	return "";
 }
 
 // A walkable simple print function
@@ -87,14 +110,7 @@ void adhoc_renameNode(ASTnode* n, int d, char* errBuf){
 	if(!strcmp(n->package, "System")){
 		char* buf = malloc(strlen(n->name)+1);
 		strcpy(buf, n->name);
-		char* libraryPrepend;
-		if(!strcmp(ADHOC_TARGET_LANGUAGE, "c")){
-			libraryPrepend = "adhoc_";
-		}else if(!strcmp(ADHOC_TARGET_LANGUAGE, "javascript")){
-			libraryPrepend = "Adhoc.";
-		}else{
-			libraryPrepend = "";
-		}
+		const char* libraryPrepend = adhoc_libraryPrepend();
 		int prependLen = strlen(libraryPrepend);
 		n->name = realloc(n->name, strlen(n->name)+prependLen+1);
 		strcpy(n->name, libraryPrepend);
@@ -103,6 +119,163 @@ void adhoc_renameNode(ASTnode* n, int d, char* errBuf){
 	}
 }
 
+// Check whether two struct literals have the same fields, in the same order
+bool adhoc_sameLayout(ASTnode* a, ASTnode* b){
+	int i;
+	if(a->countChildren != b->countChildren) return false;
+	for(i=0; i<a->countChildren; ++i){
+		if(strcmp(a->children[i]->value, b->children[i]->value)) return false;
+		if(a->children[i]->children[0]->dataType
+				!= b->children[i]->children[0]->dataType
+			) return false;
+		if(a->children[i]->children[0]->layout
+				!= b->children[i]->children[0]->layout
+			) return false;
+	}
+	return true;
+}
+
+// Give a struct literal its field layout. Literals with identical fields
+// share the layout of the first one, so they compile to the same C struct
+void adhoc_layoutStruct(ASTnode* n, char* errBuf){
+	int i, j;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->which != LITERAL_STRNG){
+			adhoc_errorNode = n->children[i];
+			sprintf(errBuf, "Node %d: Struct field names must be strings", n->children[i]->id);
+			return;
+		}
+		for(j=0; j<i; ++j){
+			if(strcmp(n->children[i]->value, n->children[j]->value)) continue;
+			adhoc_errorNode = n->children[i];
+			sprintf(errBuf, "Node %d: Struct field '%s' is given twice"
+				,n->children[i]->id
+				,n->children[i]->value
+			);
+			return;
+		}
+	}
+	for(i=0; i<adhoc_countLayouts; ++i){
+		if(!adhoc_sameLayout(n, adhoc_layouts[i])) continue;
+		n->layout = adhoc_layouts[i];
+		return;
+	}
+	if(adhoc_countLayouts == adhoc_sizeLayouts){
+		adhoc_sizeLayouts = (adhoc_sizeLayouts ? adhoc_sizeLayouts*2 : 4);
+		adhoc_layouts = realloc(adhoc_layouts, adhoc_sizeLayouts*sizeof(ASTnode*));
+	}
+	adhoc_layouts[adhoc_countLayouts++] = n;
+	n->layout = n;
+}
+
+// Resolve a struct field access to the field's slot in the struct's layout
+void adhoc_resolveField(ASTnode* n, char* errBuf){
+	int i;
+	ASTnode* layout = n->children[0]->layout;
+	if(!layout){
+		adhoc_errorNode = n;
+		sprintf(errBuf, "Struct field being accessed before struct was given contents.");
+		return;
+	}
+	if(n->children[1]->which != LITERAL_STRNG){
+		adhoc_errorNode = n->children[1];
+		sprintf(errBuf, "Node %d: Struct fields must be accessed by name", n->children[1]->id);
+		return;
+	}
+	for(i=0; i<layout->countChildren; ++i){
+		if(strcmp(layout->children[i]->value, n->children[1]->value)) continue;
+		n->dataType = layout->children[i]->children[0]->dataType;
+		n->childDataType = layout->children[i]->children[0]->childDataType;
+		n->layout = layout->children[i]->children[0]->layout;
+		return;
+	}
+	adhoc_errorNode = n->children[1];
+	sprintf(errBuf, "Node %d: Struct has no field '%s'"
+		,n->children[1]->id
+		,n->children[1]->value
+	);
+}
+
+// Check whether two CASE labels of the same type would match the same value
+bool adhoc_sameLabel(ASTnode* a, ASTnode* b){
+	switch(a->dataType){
+	case TYPE_INT:
+		return atoi(a->value) == atoi(b->value);
+	case TYPE_BOOL:
+		return (!strcmp(a->value, "true") || atoi(a->value))
+			== (!strcmp(b->value, "true") || atoi(b->value));
+	default:
+		return !strcmp(a->value, b->value);
+	}
+}
+
+// Check that a SWITCH is on an int, bool or string, and that its CASEs are
+// labelled with distinct literals of that type. Only one may have no label,
+// making it the default
+void adhoc_checkSwitch(ASTnode* n, char* errBuf){
+	int i, j, k, l;
+	ASTnode* cond = NULL,* label,* c;
+	bool hasDefault = false, hasLabel;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == CONDITION) cond = n->children[i];
+	}
+	if(!cond){
+		adhoc_errorNode = n;
+		sprintf(errBuf, "Node %d: SWITCH has no condition", n->id);
+		return;
+	}
+	if(cond->dataType != TYPE_INT
+			&& cond->dataType != TYPE_BOOL
+			&& cond->dataType != TYPE_STRNG
+		){
+		adhoc_errorNode = cond;
+		sprintf(errBuf, "Node %d: SWITCH conditions must be ints, bools or strings", cond->id);
+		return;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		c = n->children[i];
+		if(c == cond) continue;
+		if(c->which != CONTROL_CASE){
+			adhoc_errorNode = c;
+			sprintf(errBuf, "Node %d: SWITCH may only contain CASEs", c->id);
+			return;
+		}
+		hasLabel = false;
+		for(j=0; j<c->countChildren; ++j){
+			label = c->children[j];
+			if(label->childType != CASE) continue;
+			hasLabel = true;
+			if(label->nodeType != LITERAL || label->dataType != cond->dataType){
+				adhoc_errorNode = label;
+				sprintf(errBuf, "Node %d: CASE labels must be literals of the SWITCH condition's type"
+					,label->id
+				);
+				return;
+			}
+
+			// No two labels may match the same value
+			for(k=0; k<=i; ++k){
+				if(n->children[k] == cond) continue;
+				for(l=0; l<(k==i ? j : n->children[k]->countChildren); ++l){
+					if(n->children[k]->children[l]->childType != CASE) continue;
+					if(!adhoc_sameLabel(label, n->children[k]->children[l])) continue;
+					adhoc_errorNode = label;
+					sprintf(errBuf, "Node %d: Duplicate CASE label", label->id);
+					return;
+				}
+			}
+		}
+		if(!hasLabel){
+			if(hasDefault){
+				adhoc_errorNode = c;
+				sprintf(errBuf, "Node %d: SWITCH has more than one default CASE", c->id);
+				return;
+			}
+			hasDefault = true;
+		}
+	}
+}
+
 // Post-walkable function for determining the data-Type of a node
 void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 	int i;
@@ -111,8 +284,6 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 	case GROUP_SERIAL:
 	case CONTROL_IF:
 	case CONTROL_LOOP:
-	case CONTROL_SWITCH:
-	case CONTROL_CASE:
 	case CONTROL_FORK:
 	case CONTROL_CNTNU:
 	case CONTROL_BREAK:
@@ -120,16 +291,33 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 		n->childDataType = TYPE_VOID;
 		break;
 
+	case CONTROL_SWITCH:
+		n->dataType = TYPE_VOID;
+		n->childDataType = TYPE_VOID;
+		adhoc_checkSwitch(n, errBuf);
+		break;
+
+	case CONTROL_CASE:
+		n->dataType = TYPE_VOID;
+		n->childDataType = TYPE_VOID;
+		if(!n->parent || n->parent->which != CONTROL_SWITCH){
+			adhoc_errorNode = n;
+			sprintf(errBuf, "Node %d: CASE must be inside a SWITCH", n->id);
+		}
+		break;
+
 	case ACTION_DEFIN:
 		for(i=0; i<n->countChildren; ++i){
 			if(n->children[i]->which != CONTROL_RETRN) continue;
 			if(n->dataType != TYPE_VOID){
 				n->dataType = n->children[i]->dataType;
 				n->childDataType = n->children[i]->childDataType;
+				n->layout = n->children[i]->layout;
 			}
 			if(n->children[i]->dataType==TYPE_MIXED || n->dataType!=n->children[i]->dataType){
 				n->dataType = n->children[i]->dataType;
 				n->childDataType = n->children[i]->childDataType;
+				n->layout = n->children[i]->layout;
 				break;
 			}
 		}
@@ -139,6 +327,7 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 		if(n->reference){
 			n->dataType = n->reference->dataType;
 			n->childDataType = n->reference->childDataType;
+			n->layout = n->reference->layout;
 		}
 		break;
 
@@ -146,6 +335,7 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 		if(n->countChildren){
 			n->dataType = n->children[0]->dataType;
 			n->childDataType = n->children[0]->childDataType;
+			n->layout = n->children[0]->layout;
 		}
 		break;
 
@@ -180,6 +370,12 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 		break;
 
 	case OPERATOR_ARIND:
+		// Struct fields were laid out with the struct's literal
+		if(n->children[0]->dataType == TYPE_STRCT){
+			adhoc_resolveField(n, errBuf);
+			break;
+		}
+
 		// If the array hasn't been given a type, report an error
 		if(n->children[0]->childDataType == TYPE_VOID){
 			adhoc_errorNode = n;
@@ -188,6 +384,7 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 
 		// Get the type from the array being referenced
 		n->dataType = n->children[0]->childDataType;
+		n->layout = n->children[0]->layout;
 		break;
 
 	case OPERATOR_TRNIF:
@@ -195,6 +392,7 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 			n->children[1]->dataType
 			,n->children[2]->dataType
 		);
+		n->layout = n->children[1]->layout;
 		break;
 
 	case ASSIGNMENT_INCPR:
@@ -205,10 +403,23 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 		break;
 
 	case ASSIGNMENT_EQUAL:
+		// Struct fields keep the type they were laid out with
+		if(n->children[0]->which == OPERATOR_ARIND
+				&& n->children[0]->children[0]->dataType == TYPE_STRCT
+				&& n->children[0]->dataType != n->children[1]->dataType
+			){
+			adhoc_errorNode = n;
+			sprintf(errBuf, "Node %d: Struct field '%s' cannot change type"
+				,n->id
+				,n->children[0]->children[1]->value
+			);
+		}
 		n->dataType = n->children[1]->dataType;
 		n->childDataType = n->children[1]->childDataType;
+		n->layout = n->children[1]->layout;
 		n->children[0]->dataType = n->dataType;
 		n->children[0]->childDataType = n->childDataType;
+		n->children[0]->layout = n->layout;
 		break;
 
 	case ASSIGNMENT_PLUS:
@@ -231,6 +442,7 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 			)){
 			n->dataType = n->children[0]->dataType;
 			n->childDataType = n->children[0]->childDataType;
+			n->layout = n->children[0]->layout;
 		}else if(n->childType==STORAGE && (
 				n->parent->which == ASSIGNMENT_INCPR
 				|| n->parent->which == ASSIGNMENT_INCPS
@@ -239,6 +451,7 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 			)){
 			n->dataType = n->reference->dataType;
 			n->childDataType = n->reference->childDataType;
+			n->layout = n->reference->layout;
 		}
 		break;
 
@@ -246,6 +459,7 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 		if(n->reference){
 			n->dataType = n->reference->dataType;
 			n->childDataType = n->reference->childDataType;
+			n->layout = n->reference->layout;
 		}else{
 			adhoc_errorNode = n;
 			sprintf(errBuf, "Variable being accessed before it was given a value.");
@@ -271,12 +485,23 @@ void adhoc_determineType(ASTnode* n, int d, char* errBuf){
 				sprintf(errBuf, "Literal array not given a child datatype.");
 			}
 		}
+		if(n->countChildren) n->layout = n->children[0]->children[0]->layout;
 		break;
 	case LITERAL_HASH:
 		n->dataType = TYPE_HASH;
+		if(!n->childDataType){
+			if(n->countChildren){
+				n->childDataType = n->children[0]->children[0]->dataType;
+			}else{
+				adhoc_errorNode = n;
+				sprintf(errBuf, "Literal hash not given a child datatype.");
+			}
+		}
+		if(n->countChildren) n->layout = n->children[0]->children[0]->layout;
 		break;
 	case LITERAL_STRCT:
 		n->dataType = TYPE_STRCT;
+		adhoc_layoutStruct(n, errBuf);
 		break;
 	}
 }
@@ -329,6 +554,24 @@ void adhoc_handleCLIVariable(char* var, char* val, char* errBuf){
 		ADHOC_EXECUTABLE = true;
 		return;
 	}
+	// Logic file format variable
+	if(!strcmp(var, "format")){
+		if(!val || atoi(val) < 1 || atoi(val) > FMT_VERSION){
+			sprintf(errBuf, "Format must be logic file version 1 or 2");
+			return;
+		}
+		ADHOC_FORMAT = atoi(val);
+		return;
+	}
+	// Grain size variable
+	if(!strcmp(var, "grain")){
+		if(!val || atoi(val) <= 0){
+			sprintf(errBuf, "Grain size must be a positive number of iterations");
+			return;
+		}
+		ADHOC_GRAIN_SIZE = atoi(val);
+		return;
+	}
 	// Help variable
 	if(!strcmp(var, "help")){
 		ADHOC_INFO_ONLY = true;
@@ -336,18 +579,61 @@ void adhoc_handleCLIVariable(char* var, char* val, char* errBuf){
 		printf("[1mDESCRIPTION[22m\n\tParses a programming logic file and generates source code in a target\n\tlanguage. Expects a FILENAME (typically with extension '.adh') which\n\tcontains a representation of programming logic. If no FILENAME is\n\tprovided, ADHOC takes its input from stdin. So you can, for instance,\n\tsend logic content in via a pipe:\n\t\tcat foo.adh | adhoc -l c\n\t\t./logic_script.sh | adhoc -l sh -o other_script.sh\n\n");
 		printf("[1mUSAGE SYNOPSIS[22m\n\tadhoc [ARGUMENT]... [FILENAME]\n\n");
 		printf("[1mARGUMENTS[22m\n");
+		printf("\t-a, --allocations\n\t\tMark which node each statement of generated C belongs to.\n\t\tCompiled with ADHOC_HEAP_PROFILE defined and linked with\n\t\tlibadhoc_heap.a, executables charge the heap their data uses to the\n\t\tnodes that made or grew it, and write the structs, bytes, live bytes\n\t\tand peak bytes of each node when they exit: to the file named by\n\t\tADHOC_HEAP_FILE in the environment, or adhoc.heap. Otherwise the\n\t\tmarks compile to nothing.\n\n");
 		printf("\t-c [1;4mfilename[22;24m, --config=[1;4mfilename[22;24m\n\t\tUse [1;4mfilename[22;24m as ADHOC's configuration file instead of the\n\t\tdefault adhoc.ini file.\n\n");
 		printf("\t-d, --debug\n\t\tPrint out debug information while parsing the file.\n\n");
 		printf("\t-e, --executable\n\t\tIn addition to generating the target language code from the\n\t\tinput logic, ADHOC will also include code necessary to execute\n\t\tthe output program (e.g. when generating C code, it will include\n\t\ta 'main()' function).\n\n");
+		printf("\t-f [1;4mn[22;24m, --format=[1;4mn[22;24m\n\t\tWrite the input logic back out as a version [1;4mn[22;24m logic file (1 or\n\t\t2) instead of generating code. Version 2 files hold each string\n\t\tonce and pack their fields, so they are smaller and load faster.\n\t\tEither version can be read.\n\n");
+		printf("\t-g [1;4mn[22;24m, --grain=[1;4mn[22;24m\n\t\tRun parallel loops in chunks of at least [1;4mn[22;24m iterations. This\n\t\toverrides the value set for ADHOC_GRAIN_SIZE in the config file.\n\n");
 		printf("\t-h, --help\n\t\tPrint this usage information.\n\n");
+		printf("\t-i [1;4mn[22;24m, --inline=[1;4mn[22;24m\n\t\tCopy actions of at most [1;4mn[22;24m nodes into the places that call\n\t\tthem (0 to never inline). This overrides the value set for\n\t\tADHOC_INLINE_SIZE in the config file.\n\n");
+		printf("\t-j [1;4mn[22;24m, --jobs=[1;4mn[22;24m\n\t\tHave executables run FORK branches and parallel loops on [1;4mn[22;24m\n\t\tthreads (0 for one per core). This overrides the value set for\n\t\tADHOC_THREAD_COUNT in the config file.\n\n");
 		printf("\t-l [1;4mlang[22;24m, --language=[1;4mlang[22;24m\n\t\tSet the target language for code generation to [1;4mlang[22;24m. This\n\t\toverrides the value set for ADHOC_TARGET_LANGUAGE in the config\n\t\tfile.\n\n");
+		printf("\t-m, --instrument\n\t\tHave executables count how their IFs, loops and calls run, and\n\t\twrite the counts to a profile when they exit: the file named by\n\t\tADHOC_PROFILE in the environment, or adhoc.profile. Actions are\n\t\tnot inlined, so each call is counted.\n\n");
+		printf("\t-n [1;4mn[22;24m, --native=[1;4mn[22;24m\n\t\tWhen running with --run, compile an action to native code once\n\t\tit has been called, or has looped, [1;4mn[22;24m times (0 to never). Only\n\t\tx86-64 is supported. This overrides the value set for\n\t\tADHOC_NATIVE_HEAT in the config file.\n\n");
 		printf("\t-o [1;4mfilename[22;24m, --outfile=[1;4mfilename[22;24m\n\t\tDirects generated target code to [1;4mfilename[22;24m instead of stdout.\n\t\tSimilar to adhoc ... > [1;4mfilename[22;24m, but won't affect version info,\n\t\tetc.\n\n");
+		printf("\t-p [1;4mfilename[22;24m, --profile=[1;4mfilename[22;24m\n\t\tUse a profile written by an executable built with --instrument\n\t\tto guide optimization: calls it found hot may be inlined when\n\t\tlarger, calls that never ran are not, and conditions are hinted\n\t\twith the way they usually went.\n\n");
+		printf("\t-r, --run\n\t\tRun the input logic instead of generating code for it. Actions\n\t\tare compiled to bytecode for ADHOC's interpreter, which uses the\n\t\tsame library as generated C code.\n\n");
+		printf("\t-s [1;4mfilename[22;24m, --sourcemap=[1;4mfilename[22;24m\n\t\tMark each line of generated C with the node it came from, in\n\t\t#line directives that give the node's id for a line number, and\n\t\twrite a JSON map of which lines came from which nodes to\n\t\t[1;4mfilename[22;24m. Profiles taken with perf can be summed up by node\n\t\twith adhoc_perf.\n\n");
+		printf("\t-t, --trace\n\t\tMark where each action, fork branch and parallel loop chunk of\n\t\tgenerated C starts. Compiled with ADHOC_TRACE defined, executables\n\t\trecord when each starts and ends on each thread, and write them as\n\t\tChrome trace events when they exit: to the file named by\n\t\tADHOC_TRACE_FILE in the environment, or adhoc.trace.json.\n\t\tOtherwise the marks compile to nothing.\n\n");
 		printf("\t-v, --version\n\t\tPrint ADHOC version information.\n\n");
 		printf("[1mLICENSE[22m\n");
 		printf("\tOpen Source Under GPL v3 2014\n");
 		printf("\tMore info at: https://github.com/pieman72/adhoc\n\n");
 		return;
 	}
+	// Inline size variable
+	if(!strcmp(var, "inline")){
+		if(!val || atoi(val) < 0){
+			sprintf(errBuf, "Inline size must be 0 or a positive number of nodes");
+			return;
+		}
+		ADHOC_INLINE_SIZE = atoi(val);
+		return;
+	}
+	// Thread count variable
+	if(!strcmp(var, "jobs")){
+		if(!val || atoi(val) < 0){
+			sprintf(errBuf, "Thread count must be 0 or a positive number");
+			return;
+		}
+		ADHOC_THREAD_COUNT = atoi(val);
+		return;
+	}
+	// Instrument variable
+	if(!strcmp(var, "instrument")){
+		ADHOC_INSTRUMENT = true;
+		return;
+	}
+	// Native code heat variable
+	if(!strcmp(var, "native")){
+		if(!val || atoi(val) < 0){
+			sprintf(errBuf, "Native heat must be 0 or a positive number");
+			return;
+		}
+		ADHOC_NATIVE_HEAT = atoi(val);
+		return;
+	}
 	// Language variable
 	if(!strcmp(var, "language")){
 		memset(ADHOC_TARGET_LANGUAGE, 0, 30);
@@ -361,6 +647,41 @@ void adhoc_handleCLIVariable(char* var, char* val, char* errBuf){
 		}
 		return;
 	}
+	// Profile variable
+	if(!strcmp(var, "profile")){
+		if(!val || !strlen(val)){
+			sprintf(errBuf, "Profile must name a file");
+			return;
+		}
+		memset(ADHOC_PROFILE_FILE, 0, 100);
+		strncpy(ADHOC_PROFILE_FILE, val, 99);
+		return;
+	}
+	// Source map variable
+	if(!strcmp(var, "sourcemap")){
+		if(!val || !strlen(val)){
+			sprintf(errBuf, "Source map must name a file");
+			return;
+		}
+		memset(ADHOC_SOURCE_MAP, 0, 100);
+		strncpy(ADHOC_SOURCE_MAP, val, 99);
+		return;
+	}
+	// Heap profile variable
+	if(!strcmp(var, "allocations")){
+		ADHOC_HEAP_PROFILE = true;
+		return;
+	}
+	// Trace variable
+	if(!strcmp(var, "trace")){
+		ADHOC_TRACE = true;
+		return;
+	}
+	// Run variable
+	if(!strcmp(var, "run")){
+		ADHOC_RUN = true;
+		return;
+	}
 	// Version information variable
 	if(!strcmp(var, "version")){
 		ADHOC_INFO_ONLY = true;
@@ -374,12 +695,23 @@ void adhoc_handleCLIVariable(char* var, char* val, char* errBuf){
 void adhoc_handleCLIFlag(char flag, char* val, char* errBuf){
 	// Switch converts command line flags into full length variables
 	switch(flag){
+		case 'a': adhoc_handleCLIVariable("allocations", val, errBuf); return;
 		case 'c': adhoc_handleCLIVariable("config", val, errBuf); return;
 		case 'd': adhoc_handleCLIVariable("debug", val, errBuf); return;
 		case 'e': adhoc_handleCLIVariable("executable", val, errBuf); return;
+		case 'f': adhoc_handleCLIVariable("format", val, errBuf); return;
+		case 'g': adhoc_handleCLIVariable("grain", val, errBuf); return;
 		case 'h': adhoc_handleCLIVariable("help", val, errBuf); return;
+		case 'i': adhoc_handleCLIVariable("inline", val, errBuf); return;
+		case 'j': adhoc_handleCLIVariable("jobs", val, errBuf); return;
 		case 'l': adhoc_handleCLIVariable("language", val, errBuf); return;
+		case 'm': adhoc_handleCLIVariable("instrument", val, errBuf); return;
+		case 'n': adhoc_handleCLIVariable("native", val, errBuf); return;
 		case 'o': adhoc_handleCLIVariable("outfile", val, errBuf); return;
+		case 'p': adhoc_handleCLIVariable("profile", val, errBuf); return;
+		case 'r': adhoc_handleCLIVariable("run", val, errBuf); return;
+		case 's': adhoc_handleCLIVariable("sourcemap", val, errBuf); return;
+		case 't': adhoc_handleCLIVariable("trace", val, errBuf); return;
 		case 'v': adhoc_handleCLIVariable("version", val, errBuf); return;
 		default: sprintf(errBuf, "Unknown CLI flag: '-%c'", flag); return;
 	}
@@ -403,6 +735,22 @@ void adhoc_handleConfigVariable(char* var, char* val, char* errBuf){
 		ADHOC_OUPUT_COLOR = !strcmp(val, "true");
 		return;
 	}
+	if(!strcmp(var, "ADHOC_THREAD_COUNT") && ADHOC_THREAD_COUNT < 0){
+		ADHOC_THREAD_COUNT = atoi(val);
+		return;
+	}
+	if(!strcmp(var, "ADHOC_GRAIN_SIZE") && ADHOC_GRAIN_SIZE < 0){
+		ADHOC_GRAIN_SIZE = atoi(val);
+		return;
+	}
+	if(!strcmp(var, "ADHOC_INLINE_SIZE") && ADHOC_INLINE_SIZE < 0){
+		ADHOC_INLINE_SIZE = atoi(val);
+		return;
+	}
+	if(!strcmp(var, "ADHOC_NATIVE_HEAT") && ADHOC_NATIVE_HEAT < 0){
+		ADHOC_NATIVE_HEAT = atoi(val);
+		return;
+	}
 }
 
 // Function to store the locations of various language modules
@@ -455,12 +803,13 @@ void adhoc_init(int argc, char** argv, char* errBuf){
 				adhoc_handleCLIFlag(argv[i][1], NULL, errBuf);
 			}
 			if(strlen(errBuf)) return;
-		// The last argument should hold the file to be parsed. If so, reroute stdin
+		// The last argument should hold the file to be parsed. If so, lex from it
 		}else if(i==argc-1){
-			if(!freopen(argv[i], "r", stdin)){
+			if(!(yyin = adhoc_inputFile = fopen(argv[i], "r"))){
 				sprintf(errBuf, "Could not open file for parsing: %-40s", argv[i]);
 				return;
 			}
+			adhoc_inputName = argv[i];
 		// Argument given in the wrong form
 		}else{
 			sprintf(errBuf, "Unknown argument: %30s. Use 'adhoc -h' for help.", argv[i]);
@@ -556,8 +905,9 @@ void adhoc_insertNode(ASTnode* n){
 		return;
 	}
 
-	// If the parent has no children, allocate the children array
-	if(!parent->countChildren){
+	// If the parent has no children array, allocate one. Version 2 logic
+	// files give the size up front
+	if(!parent->sizeChildren){
 		parent->children = malloc(sizeof(ASTnode*));
 		parent->sizeChildren = 1;
 	// If the parent is full of children, double the children array
@@ -580,6 +930,22 @@ void adhoc_insertNode(ASTnode* n){
 	}
 }
 
+// Read the input if it is a version 2 logic file. Returns false if it is
+// version 1, which is left for the grammar to parse
+bool adhoc_readCompact(char* errBuf){
+	FILE* in = adhoc_inputFile ? adhoc_inputFile : stdin;
+	int version = fmt_version(in, errBuf);
+	if(version == 1) return false;
+	if(version) fmt_read(in, adhoc_insertNode, errBuf);
+	return true;
+}
+
+// Write the logic back out, as read, in another version of logic file
+void adhoc_convert(char* errBuf){
+	if(ADHOC_FORMAT == 1) fmt_writeV1(ASTroot, stdout, errBuf);
+	else fmt_writeV2(ASTroot, stdout, errBuf);
+}
+
 // Validate and optimize the abstract syntax tree
 void adhoc_validate(char* errBuf){
 	if(ADHOC_DEBUG_INFO){
@@ -609,6 +975,40 @@ void adhoc_validate(char* errBuf){
 	adhoc_treePostWalk(adhoc_determineType, ASTroot, 0, errBuf);
 	if(strlen(errBuf)) return;
 
+	// Give actions a typed copy for each set of argument types they take
+	opt_specializeActions(ASTroot, &nodeMap, adhoc_determineType, errBuf);
+	if(strlen(errBuf)) return;
+
+	// Hint what a profile of earlier runs found hot
+	if(strlen(ADHOC_PROFILE_FILE)){
+		opt_applyProfile(ADHOC_PROFILE_FILE, nodeMap, errBuf);
+		if(strlen(errBuf)) return;
+	}
+
+	// Copy small actions into the places that call them. Instrumented
+	// executables keep every call, so the ids they count stay those of the
+	// actions as written
+	opt_libraryPrepend = adhoc_libraryPrepend();
+	if(ADHOC_INLINE_SIZE >= 0) opt_inlineSize = ADHOC_INLINE_SIZE;
+	if(ADHOC_INSTRUMENT) opt_inlineSize = 0;
+	opt_inlineActions(ASTroot, &nodeMap);
+
+	// Fold constant expressions into literals
+	adhoc_treePostWalk(opt_foldNode, ASTroot, 0, errBuf);
+	if(strlen(errBuf)) return;
+
+	// Prune code that can never run and variables that are never read
+	opt_eliminateDeadCode(ASTroot);
+
+	// Loop actions that call themselves as their last step
+	opt_eliminateTailCalls(ASTroot, &nodeMap);
+
+	// Work out what loops repeat on every pass once, ahead of them
+	opt_hoistInvariants(ASTroot, &nodeMap);
+
+	// Trade powers and power-of-two arithmetic for cheaper operations
+	opt_reduceStrength(ASTroot, &nodeMap);
+
 	// Final check for all node info
 	// TODO
 	adhoc_treeWalk(adhoc_finalCheckNode, ASTroot, 0, errBuf);
@@ -616,10 +1016,51 @@ void adhoc_validate(char* errBuf){
 
 // Generate the target language code
 void adhoc_generate(char* errBuf){
-	if(!strcmp(ADHOC_TARGET_LANGUAGE, "c")){
-		lang_c_init(ASTroot, stdout, nodeMap, ADHOC_EXECUTABLE, errBuf);
-		printf("\n");
-		lang_c_gen(ASTroot, stdout, nodeMap, ADHOC_EXECUTABLE, errBuf);
+	FILE* out = stdout;
+	FILE* map = NULL;
+	if(ADHOC_INSTRUMENT && (ADHOC_RUN || !ADHOC_EXECUTABLE || strcmp(ADHOC_TARGET_LANGUAGE, "c"))){
+		sprintf(errBuf, "Only C executables (-l c -e) can be instrumented");
+		return;
+	}
+	if(strlen(ADHOC_SOURCE_MAP) && (ADHOC_RUN || strcmp(ADHOC_TARGET_LANGUAGE, "c"))){
+		sprintf(errBuf, "Only C code (-l c) can be mapped back to its nodes");
+		return;
+	}
+	if(ADHOC_TRACE && (ADHOC_RUN || strcmp(ADHOC_TARGET_LANGUAGE, "c"))){
+		sprintf(errBuf, "Only C code (-l c) can be traced");
+		return;
+	}
+	if(ADHOC_HEAP_PROFILE && (ADHOC_RUN || strcmp(ADHOC_TARGET_LANGUAGE, "c"))){
+		sprintf(errBuf, "Only C code (-l c) can profile the heap");
+		return;
+	}
+	if(ADHOC_RUN){
+		if(ADHOC_NATIVE_HEAT >= 0) vm_nativeHeat = ADHOC_NATIVE_HEAT;
+		vm_run(ASTroot, nodeMap, adhoc_libraryPrepend(), ADHOC_DEBUG_INFO, errBuf);
+	}else if(!strcmp(ADHOC_TARGET_LANGUAGE, "c")){
+		lang_c_threads = ADHOC_THREAD_COUNT;
+		lang_c_grain = ADHOC_GRAIN_SIZE;
+		lang_c_instrument = ADHOC_INSTRUMENT;
+		lang_c_traced = ADHOC_TRACE;
+		lang_c_heap = ADHOC_HEAP_PROFILE;
+		// Mapped code is held back until the lines it lands on are known
+		if(strlen(ADHOC_SOURCE_MAP)){
+			if(!(map = fopen(ADHOC_SOURCE_MAP, "w")) || !(out = tmpfile())){
+				sprintf(errBuf, "Could not open file for writing: %-45s", ADHOC_SOURCE_MAP);
+				if(map) fclose(map);
+				return;
+			}
+			lang_c_source = adhoc_inputName;
+		}
+		lang_c_init(ASTroot, out, nodeMap, ADHOC_EXECUTABLE, errBuf);
+		fprintf(out, "\n");
+		lang_c_gen(ASTroot, out, nodeMap, ADHOC_EXECUTABLE, errBuf);
+		if(map){
+			rewind(out);
+			lang_c_writeSourceMap(out, stdout, map, nodeMap);
+			fclose(out);
+			fclose(map);
+		}
 	}else if(!strcmp(ADHOC_TARGET_LANGUAGE, "javascript")){
 		lang_javascript_init(ASTroot, stdout, nodeMap, ADHOC_EXECUTABLE, errBuf);
 		printf("\n");
@@ -634,6 +1075,8 @@ void adhoc_free(){
 	hashMap_destroy(nodeMap, adhoc_destroyNode);
 	hashMap_destroy(moduleMap, adhoc_destroyItemLocation);
 	adhoc_destroyNode(readNode);
+	free(adhoc_layouts);
+	if(adhoc_inputFile) fclose(adhoc_inputFile);
 }
 
 #pragma clang diagnostic pop
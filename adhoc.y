@@ -72,16 +72,19 @@ int main(int argc, char** argv){
 		,(ADHOC_OUPUT_COLOR ? "[39m" : "")
 	);
 
-	// Parse the input file/stream
+	// Parse the input file/stream. Version 2 logic files are read directly
 	FILE* outRedir;
-	int parseResult;
-	outRedir = stdout;
-	stdout = fopen("/dev/null", "w");
-	parseResult = yyparse();
-	fclose(stdout);
-	stdout = outRedir;
-	// Clean up parse lookahead
-	yylex_destroy(); // <-- WOW This was hard to find!
+	int parseResult = 0;
+	if(!adhoc_readCompact(processResult)){
+		outRedir = stdout;
+		stdout = fopen("/dev/null", "w");
+		parseResult = yyparse();
+		fclose(stdout);
+		stdout = outRedir;
+		// Clean up parse lookahead
+		yylex_destroy(); // <-- WOW This was hard to find!
+	}
+	if(strlen(processResult)) return yyerror(processResult);
 	if(parseResult) return yyerror("Parse failed");
 	time_parse = clock();
 	if(ADHOC_DEBUG_INFO) fprintf(stderr, "-- %s(time)%s Parse: %s%.2f%ss --\n"
@@ -92,6 +95,14 @@ int main(int argc, char** argv){
 		,(ADHOC_OUPUT_COLOR ? "[39m" : "")
 	);
 
+	// Converting between logic file versions needs only the tree as read
+	if(ADHOC_FORMAT){
+		adhoc_convert(processResult);
+		if(strlen(processResult)) return yyerror(processResult);
+		adhoc_free();
+		return 0;
+	}
+
 	// Validate and optimize the parse tree
 	adhoc_validate(processResult);
 	if(strlen(processResult)) return yyerror(processResult);
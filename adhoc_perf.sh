@@ -0,0 +1,103 @@
+#!/bin/sh
+# Sum up the samples in `perf script` output by the ADHOC node they fell in.
+#
+#	adhoc_perf [-g] map.json [perf.txt]
+#
+# map.json is the source map written by `adhoc -s map.json` alongside the C
+# code the profiled executable was compiled from. Give perf script the
+# srcline field, e.g.
+#
+#	perf record ./test && perf script -F ip,srcline | adhoc_perf map.json
+#
+# Each source line reported counts as one sample. With -g, the samples come
+# from `perf record -g` and are separated by blank lines, and each is
+# charged to the innermost of its frames that came from a node, so time
+# spent in libadhoc counts toward the node that called into it.
+
+CALLCHAIN=0
+if [ "$1" = "-g" ]; then
+	CALLCHAIN=1
+	shift
+fi
+if [ -z "$1" ]; then
+	echo "Usage: adhoc_perf [-g] map.json [perf.txt]" >&2
+	exit 1
+fi
+MAP=$1
+shift
+if [ $# -eq 0 ]; then
+	set -- -
+fi
+
+awk -v callchain=$CALLCHAIN '
+	# Pull a field out of one range of the map
+	function field(line, name){
+		if(!match(line, "\"" name "\": (\"([^\"\\\\]|\\\\.)*\"|[0-9-]+)")) return ""
+		line = substr(line, RSTART + length(name) + 4, RLENGTH - length(name) - 4)
+		if(line ~ /^"/) line = substr(line, 2, length(line) - 2)
+		gsub(/\\/, "", line)
+		return line
+	}
+
+	# perf gives only the last part of a path, unless told otherwise
+	function base(path){
+		sub(/.*\//, "", path)
+		return path
+	}
+
+	# Charge a sample to a node, or to nothing from the logic file
+	function charge(id){
+		if(id == "") id = "other"
+		++samples[id]
+		++total
+	}
+
+	# The map names the logic file, and gives each node seen
+	FNR == NR {
+		if(!source && $0 ~ /"source":/) source = base(field($0, "source"))
+		if($0 ~ /"from":/){
+			id = field($0, "id")
+			kind[id] = field($0, "kind")
+			package[id] = field($0, "package")
+			name[id] = field($0, "name")
+		}
+		next
+	}
+
+	# A blank line ends a sample with its callchain
+	callchain && /^[ \t]*$/ {
+		if(open && !found) charge("")
+		open = found = 0
+		next
+	}
+
+	# Source lines are file:line, and lines of the logic file are node ids
+	/^[ \t]*[^ \t]+:[0-9]+[ \t]*$/ {
+		sub(/^[ \t]+/, "")
+		sub(/[ \t]+$/, "")
+		n = split($0, at, ":")
+		file = substr($0, 1, length($0) - length(at[n]) - 1)
+		id = (base(file) == source ? at[n] : "")
+		if(!callchain){
+			charge(id)
+		}else if(!found && id != ""){
+			charge(id)
+			found = 1
+		}
+		open = 1
+		next
+	}
+	callchain { open = 1 }
+
+	END {
+		if(callchain && open && !found) charge("")
+		if(!total){
+			print "No samples with source lines were found" > "/dev/stderr"
+			exit 1
+		}
+		printf "%10s %7s  %-8s %-12s %-16s %s\n", "samples", "%", "node", "kind", "package", "name"
+		for(id in samples){
+			printf "%10d %6.2f%%  %-8s %-12s %-16s %s\n", samples[id], 100 * samples[id] / total, id, kind[id], package[id], name[id] | "sort -rn"
+		}
+	}
+' "$MAP" "$@"
@@ -89,7 +89,7 @@ typedef enum adhoc_nodeChildType {
 } nodeChildType;
 
 // Data types
-typedef enum adhoc_dataType {
+typedef enum adhoc_nodeDataType {
 	TYPE_VOID	// 0
 	,TYPE_BOOL	// 1
 	,TYPE_INT	// 2
@@ -254,6 +254,73 @@ float operatorPrecedence[] = {
 	,15 // ASSIGNMENT_AND
 };
 
+// What System actions do besides return a value. Pure ones only read
+// their arguments, output ones also write them out, and the rest may
+// change what their arguments hold
+typedef enum adhoc_systemEffect {
+	EFFECT_NULL		// 0
+	,EFFECT_PURE	// 1
+	,EFFECT_OUTPUT	// 2
+	,EFFECT_CHANGE	// 3
+} systemEffect;
+
+// System action names, before any prefix for the target language
+const char* adhoc_systemAction_names[] = {
+	"type"
+	,"size"
+	,"count"
+	,"toString"
+	,"print"
+	,"println"
+	,"prompt"
+	,"append_to_string"
+	,"concat"
+	,"substring"
+	,"splice_string"
+	,"find_in_string"
+	,"find_all_in_string"
+	,"count_occurrences"
+	,"isset_array"
+	,"append_to_array"
+	,"find_max_value"
+	,"find_max_value_index"
+	,"find_min_value"
+	,"find_min_value_index"
+	,"sum_array"
+	,"count_greater_than"
+	,"isset_hash"
+	,"remove_from_hash"
+	,NULL
+};
+
+// Effects of System actions, in the same order as their names
+systemEffect adhoc_systemAction_effects[] = {
+	EFFECT_PURE // type
+	,EFFECT_PURE // size
+	,EFFECT_PURE // count
+	,EFFECT_PURE // toString
+	,EFFECT_OUTPUT // print
+	,EFFECT_OUTPUT // println
+	,EFFECT_CHANGE // prompt
+	,EFFECT_CHANGE // append_to_string
+	,EFFECT_PURE // concat
+	,EFFECT_PURE // substring
+	,EFFECT_CHANGE // splice_string
+	,EFFECT_PURE // find_in_string
+	,EFFECT_PURE // find_all_in_string
+	,EFFECT_PURE // count_occurrences
+	,EFFECT_PURE // isset_array
+	,EFFECT_CHANGE // append_to_array
+	,EFFECT_PURE // find_max_value
+	,EFFECT_PURE // find_max_value_index
+	,EFFECT_PURE // find_min_value
+	,EFFECT_PURE // find_min_value_index
+	,EFFECT_PURE // sum_array
+	,EFFECT_PURE // count_greater_than
+	,EFFECT_PURE // isset_hash
+	,EFFECT_CHANGE // remove_from_hash
+};
+
 // An abstract syntax tree node for use during parsing
 typedef struct ASTnode {
 	int id;
@@ -262,12 +329,18 @@ typedef struct ASTnode {
 	struct ASTnode* parent;
 	struct ASTnode* scope;
 	struct ASTnode* reference;
+	struct ASTnode* layout;
 	nodeType nodeType;
 	nodeWhich which;
 	nodeChildType childType;
 	dataType dataType;
 	dataType childDataType;
 	bool defined;
+	bool borrowed;
+	bool local;
+	bool bitwise;
+	signed char expect;
+	signed char heat;
 	char* package;
 	char* name;
 	char* value;
@@ -291,12 +364,18 @@ ASTnode* adhoc_createBlankNode(){
 	ret->parent = NULL;
 	ret->scope = NULL;
 	ret->reference = NULL;
+	ret->layout = NULL;
 	ret->nodeType = TYPE_NULL;
 	ret->which = WHICH_NULL;
 	ret->childType = CHILD_NULL;
 	ret->dataType = TYPE_VOID;
 	ret->childDataType = TYPE_VOID;
 	ret->defined = false;
+	ret->borrowed = false;
+	ret->local = false;
+	ret->bitwise = false;
+	ret->expect = 0;
+	ret->heat = 0;
 	ret->package = NULL;
 	ret->name = NULL;
 	ret->value = NULL;
@@ -363,6 +442,13 @@ void adhoc_treeWalk(walk_func f, ASTnode* n, int d, char* errBuf){
 	}
 }
 
+// Get a node's index in its parent
+int adhoc_getNodeIndexOfChild(ASTnode* p, ASTnode* c){
+	int i = -1;
+	while(++i < p->countChildren) if(p->children[i] == c) return i;
+	return -1;
+}
+
 // Walk an AST in post-order with a function to perform on each node
 void adhoc_treePostWalk(walk_func f, ASTnode* n, int d, char* errBuf){
 	int i;
@@ -435,6 +521,18 @@ bool needsParens(ASTnode* n){
 	}
 }
 
+// Find what a call does if it is to a System action, given the prefix its
+// name took for the target language. Other calls are taken to change things
+systemEffect adhoc_getSystemEffect(ASTnode* n, const char* prepend){
+	int i, len = strlen(prepend);
+	if(n->which != ACTION_CALL || strcmp(n->package, "System")) return EFFECT_CHANGE;
+	if(strncmp(n->name, prepend, len)) return EFFECT_CHANGE;
+	for(i=0; adhoc_systemAction_names[i]; ++i){
+		if(!strcmp(n->name+len, adhoc_systemAction_names[i])) return adhoc_systemAction_effects[i];
+	}
+	return EFFECT_CHANGE;
+}
+
 // Find the scope where a variable name v was first defined above scope s
 ASTnode* adhoc_findScope(char* v, ASTnode* s){
 	int i;
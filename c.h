@@ -2,6 +2,7 @@
 #define C_H
 #include <stdlib.h>
 #include <stdbool.h>
+#include <ctype.h>
 #include "hashmap.h"
 #include "adhoc_types.h"
 #pragma clang diagnostic push
@@ -18,6 +19,54 @@ ASTnode* scope;
 ASTnode** functions;
 int countFuncs, sizeFuncs;
 
+// Keep the node map around so calls can be matched to their definitions
+hashMap* lang_c_nodeMap;
+
+// Threads and grain size for parallel code (negative when not set)
+int lang_c_threads = -1;
+int lang_c_grain = -1;
+
+// Whether executables count their branches, loops and calls for a profile,
+// the nodes counted, and the counter of each node by id (offset by one so
+// 0 means none)
+bool lang_c_instrument = false;
+ASTnode** lang_c_counted;
+int lang_c_countCounted, lang_c_sizeCounted;
+int* lang_c_counters;
+
+// Whether actions, fork branches and parallel loop chunks are traced
+bool lang_c_traced = false;
+
+// Whether statements mark the node they belong to, for heap profiles
+bool lang_c_heap = false;
+
+// The logic file #line directives name, when generated code is mapped back
+// to the nodes it came from (NULL when not)
+const char* lang_c_source = NULL;
+
+// The most items an array literal keeps in the stack frame of its action
+// when it does not escape it. Larger ones keep only their header there
+int lang_c_localItems = 64;
+
+// The local variables a value has been stored to while tracing where it goes
+typedef struct lang_c_trace {
+	ASTnode** vars;
+	int count, size;
+} lang_c_trace;
+
+// What a counted loop's body does with variables, to see if it can run in
+// parallel. Seen variables are kept in the order the body first uses them
+typedef struct lang_c_loopInfo {
+	ASTnode* counter;
+	ASTnode* step;
+	ASTnode** seen;
+	bool* privates;
+	int countSeen, sizeSeen;
+	ASTnode** arrays;
+	int countArrays, sizeArrays;
+	bool parallel;
+} lang_c_loopInfo;
+
 // Headers for master functions
 void lang_c_initialize(ASTnode*, short, FILE*, hashMap*, char*);
 void lang_c_generate(bool, ASTnode*, short, FILE*, hashMap*, char*);
@@ -39,6 +88,7 @@ void lang_c_printTypeName(ASTnode* n, FILE* o){
 	if(n->dataType==TYPE_STRNG
 			|| n->dataType==TYPE_ARRAY
 			|| n->dataType==TYPE_HASH
+			|| n->dataType==TYPE_STRCT
 		){
 		fprintf(o, "adhoc_data*");
 		return;
@@ -46,6 +96,113 @@ void lang_c_printTypeName(ASTnode* n, FILE* o){
 	fprintf(o, "%s", adhoc_dataType_names[n->dataType]);
 }
 
+// Find the highest id of any node in a node map
+int lang_c_maxId(hashMap* nodes){
+	hashMap_uint i;
+	int ret = 0;
+	for(i=0; i<nodes->size; ++i){
+		if(nodes->items[i] && ((ASTnode*)nodes->items[i]->value)->id > ret){
+			ret = ((ASTnode*)nodes->items[i]->value)->id;
+		}
+	}
+	return ret;
+}
+
+// Find the counter of a node in an instrumented executable, or -1
+int lang_c_counterOf(ASTnode* n){
+	return (lang_c_counters ? lang_c_counters[n->id]-1 : -1);
+}
+
+// Give a counter to each IF, each loop with a condition, and each call to a
+// user action
+void lang_c_numberCounters(ASTnode* n){
+	int i;
+	bool counted = false;
+	switch(n->which){
+	case CONTROL_IF:
+		counted = true;
+		break;
+	case CONTROL_LOOP:
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType == CONDITION) counted = true;
+		}
+		break;
+	case ACTION_CALL:
+		counted = strcmp(n->package, "System");
+		break;
+	case ACTION_DEFIN:
+		counted = (n->parent != NULL);
+		break;
+	}
+	if(counted){
+		if(lang_c_countCounted == lang_c_sizeCounted){
+			lang_c_sizeCounted = (lang_c_sizeCounted ? lang_c_sizeCounted*2 : 8);
+			lang_c_counted = realloc(lang_c_counted, lang_c_sizeCounted*sizeof(ASTnode*));
+		}
+		lang_c_counted[lang_c_countCounted++] = n;
+		lang_c_counters[n->id] = lang_c_countCounted;
+	}
+	for(i=0; i<n->countChildren; ++i) lang_c_numberCounters(n->children[i]);
+}
+
+// Declare the counters of an instrumented executable, with the id and kind
+// of the node each pair counts. Each array ends with a spare entry, so none
+// is ever empty
+void lang_c_declareCounters(FILE* outFile){
+	int i;
+	fprintf(outFile, "\n// Profile counters\n");
+	fprintf(outFile, "unsigned long long adhoc_profileCounts[%d];\n", 2*lang_c_countCounted+2);
+	fprintf(outFile, "const int adhoc_profileIds[] = {");
+	for(i=0; i<lang_c_countCounted; ++i) fprintf(outFile, "%d, ", lang_c_counted[i]->id);
+	fprintf(outFile, "0};\nconst char adhoc_profileKinds[] = \"");
+	for(i=0; i<lang_c_countCounted; ++i){
+		switch(lang_c_counted[i]->which){
+		case CONTROL_IF: fprintf(outFile, "I"); break;
+		case CONTROL_LOOP: fprintf(outFile, "L"); break;
+		default: fprintf(outFile, "C"); break;
+		}
+	}
+	fprintf(outFile, "\";\n");
+}
+
+// Print what goes around a condition: its counter in an instrumented
+// executable, and the hint a profile gave it. Returns how many parentheses
+// must close after it
+int lang_c_openCondition(ASTnode* n, FILE* outFile){
+	int ret = 0, k = lang_c_counterOf(n);
+	if(k >= 0){
+		fprintf(outFile, "adhoc_countBranch(adhoc_profileCounts+%d, ", 2*k);
+		++ret;
+	}
+	if(n->expect){
+		fprintf(outFile, "adhoc_%slikely(", (n->expect > 0 ? "" : "un"));
+		++ret;
+	}
+	return ret;
+}
+
+// Runtime names for data types
+const char* lang_c_dataTypeName(dataType t){
+	switch(t){
+	case TYPE_BOOL: return "DATA_BOOL";
+	case TYPE_INT: return "DATA_INT";
+	case TYPE_FLOAT: return "DATA_FLOAT";
+	case TYPE_STRNG: return "DATA_STRING";
+	case TYPE_ARRAY: return "DATA_ARRAY";
+	case TYPE_HASH: return "DATA_HASH";
+	case TYPE_STRCT: return "DATA_STRUCT";
+	default: return "DATA_VOID";
+	}
+}
+
+// C member name for a struct field
+void lang_c_printFieldName(const char* name, FILE* o){
+	fprintf(o, "f_");
+	for(; *name; ++name){
+		fputc((isalnum((unsigned char)*name) ? *name : '_'), o);
+	}
+}
+
 // C default values for data types
 void lang_c_printTypeDefault(ASTnode* n, FILE* o){
 	fprintf(o, "%s", adhoc_dataType_defaults[n->dataType]);
@@ -56,6 +213,1073 @@ void lang_c_indent(short i, FILE* o){
 	if(i>=0) fprintf(o, "%.*s", i, "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t");
 }
 
+// Print a string as a quoted literal, which C and JSON read alike
+void lang_c_printQuoted(const char* s, FILE* o){
+	fprintf(o, "\"");
+	for(; s && *s; ++s){
+		if(*s == '"' || *s == '\\') fprintf(o, "\\");
+		fprintf(o, "%c", *s);
+	}
+	fprintf(o, "\"");
+}
+
+// Point the lines that follow at a node by its id, when mapping generated
+// code back to the logic file. The id stands in for a line number
+void lang_c_markLine(int id, FILE* o){
+	if(!lang_c_source) return;
+	fprintf(o, "#line %d ", id);
+	lang_c_printQuoted(lang_c_source, o);
+	fprintf(o, "\n");
+}
+
+// Mark the node that allocations made from here on are charged to, in
+// executables that profile the heap
+void lang_c_markSite(ASTnode* n, short indent, FILE* o){
+	if(!lang_c_heap) return;
+	lang_c_indent(indent, o);
+	fprintf(o, "ADHOC_HEAP_SITE(%d);\n", n->id);
+}
+
+// Start an action, fork branch or parallel loop chunk in executables that
+// trace or profile the heap
+void lang_c_markStart(ASTnode* n, const char* name, short indent, FILE* o){
+	if(lang_c_traced){
+		lang_c_indent(indent, o);
+		fprintf(o, "ADHOC_TRACE_SPAN(%d, \"%s\");\n", n->id, name);
+	}
+	if(lang_c_heap){
+		lang_c_indent(indent, o);
+		fprintf(o, "ADHOC_HEAP_ACTION(%d);\n", n->id);
+	}
+}
+
+// Check whether a data type is held through a reference counted adhoc_data*
+bool lang_c_isComplex(dataType t){
+	switch(t){
+	case TYPE_STRNG:
+	case TYPE_ARRAY:
+	case TYPE_HASH:
+	case TYPE_STRCT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Check whether an expression yields a value that a variable already holds
+bool lang_c_isHeld(ASTnode* n){
+	switch(n->which){
+	case VARIABLE_EVAL:
+		return n->reference != NULL;
+	case LITERAL_ARRAY:
+	case LITERAL_HASH:
+	case LITERAL_STRCT:
+		return true;
+	case LITERAL_STRNG:
+		return n->local;
+	default:
+		return false;
+	}
+}
+
+// Check if an array's elements can use the typed scalar accessors
+bool lang_c_isTypedArray(ASTnode* n){
+	switch(n->childDataType){
+	case TYPE_BOOL:
+	case TYPE_INT:
+	case TYPE_FLOAT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Hash keys are passed to the runtime as a string key and an int key
+void lang_c_generate_hashKey(ASTnode* k, FILE* outFile, hashMap* nodes, char* errBuf){
+	switch(k->dataType){
+	case TYPE_STRNG:
+		lang_c_generate(false, k, 0, outFile, nodes, errBuf);
+		fprintf(outFile, ", 0");
+		break;
+	case TYPE_INT:
+	case TYPE_BOOL:
+		fprintf(outFile, "NULL, ");
+		lang_c_generate(false, k, 0, outFile, nodes, errBuf);
+		break;
+	default:
+		adhoc_errorNode = k;
+		sprintf(errBuf, "Node %d: Hash keys must be strings or integers", k->id);
+	}
+}
+
+// Check whether an index operator is a struct field that holds a scalar
+bool lang_c_isScalarField(ASTnode* n){
+	return n->children[0]->dataType == TYPE_STRCT && !lang_c_isComplex(n->dataType);
+}
+
+// Print a struct field as a member of the struct's generated C type
+void lang_c_generate_field(ASTnode* n, FILE* outFile, hashMap* nodes, char* errBuf){
+	fprintf(outFile, "ADHOC_FIELD(adhoc_struct%d, ", n->children[0]->layout->id);
+	lang_c_generate(false, n->children[0], 0, outFile, nodes, errBuf);
+	fprintf(outFile, ", ");
+	lang_c_printFieldName(n->children[1]->value, outFile);
+	fprintf(outFile, ")");
+}
+
+// Print the index of an array index operator, or the key for hashes
+void lang_c_generate_index(ASTnode* n, FILE* outFile, hashMap* nodes, char* errBuf){
+	if(n->children[0]->dataType == TYPE_HASH){
+		lang_c_generate_hashKey(n->children[1], outFile, nodes, errBuf);
+	}else{
+		lang_c_generate(false, n->children[1], 0, outFile, nodes, errBuf);
+	}
+}
+
+// Print the operator and right side of arithmetic done bitwise, where the
+// right side is a power of two: a shift for multiplies and divides, and a
+// mask for modulo
+void lang_c_generate_bitwise(ASTnode* n, FILE* outFile){
+	int v = atoi(n->children[1]->value), k;
+	const char* assign = (n->nodeType == ASSIGNMENT ? "=" : "");
+	for(k=0; (1<<k) < v; ++k);
+	switch(n->which){
+	case OPERATOR_TIMES:
+	case ASSIGNMENT_TIMES:
+		fprintf(outFile, " <<%s %d", assign, k);
+		break;
+	case OPERATOR_DIVBY:
+	case ASSIGNMENT_DIVBY:
+		fprintf(outFile, " >>%s %d", assign, k);
+		break;
+	default:
+		fprintf(outFile, " &%s %d", assign, v-1);
+	}
+}
+
+// Get the function that raises a number to a power: pow for floats, and
+// exponentiation by squaring for ints
+const char* lang_c_powerAction(ASTnode* n, char* errBuf){
+	switch(n->dataType){
+	case TYPE_FLOAT:
+		return "pow";
+	case TYPE_INT:
+		return "adhoc_ipow";
+	default:
+		adhoc_errorNode = n;
+		sprintf(errBuf, "Node %d: Only ints and floats can be raised to a power", n->id);
+		return "";
+	}
+}
+
+// Get the needle action for a string search whose target is a literal
+const char* lang_c_needleAction(ASTnode* n){
+	if(n->which != ACTION_CALL
+			|| strcmp(n->package, "System")
+			|| n->countChildren < 2
+			|| n->children[1]->which != LITERAL_STRNG
+		) return NULL;
+	if(!strcmp(n->name, "adhoc_find_in_string")) return "adhoc_find_needle";
+	if(!strcmp(n->name, "adhoc_find_all_in_string")) return "adhoc_find_all_needle";
+	if(!strcmp(n->name, "adhoc_count_occurrences")) return "adhoc_count_needle";
+	return NULL;
+}
+
+// Print the start of a string search, using the hoisted needle for literals
+void lang_c_printStringSearch(ASTnode* n, FILE* outFile){
+	const char* needleAction = lang_c_needleAction(n);
+	if(needleAction){
+		fprintf(outFile, "%s%s("
+			,needleAction
+			,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+		);
+	}else{
+		fprintf(outFile, "%s%s("
+			,n->name
+			,(lang_c_isHeld(n->children[0]) && lang_c_isHeld(n->children[1])
+				? "_borrowed" : "")
+		);
+	}
+}
+
+// Declare a needle outside all actions for each search of a literal target
+void lang_c_declareNeedles(ASTnode* n, FILE* outFile, bool* found){
+	int i;
+	if(lang_c_needleAction(n)){
+		if(!*found) fprintf(outFile, "\n// Search needles for literal targets\n");
+		*found = true;
+		fprintf(outFile, "static adhoc_needle needle%d = ADHOC_NEEDLE(\"%s\");\n"
+			,n->children[1]->id
+			,n->children[1]->value
+		);
+	}
+	for(i=0; i<n->countChildren; ++i){
+		lang_c_declareNeedles(n->children[i], outFile, found);
+	}
+}
+
+// Find a SWITCH's condition
+ASTnode* lang_c_switchCondition(ASTnode* n){
+	int i;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == CONDITION) return n->children[i];
+	}
+	return NULL;
+}
+
+// Declare a label table outside all actions for each SWITCH on a string,
+// with at least twice as many slots as labels
+void lang_c_declareSwitches(ASTnode* n, FILE* outFile){
+	int i, j, count = 0, slots = 2;
+	ASTnode* c;
+	for(i=0; i<n->countChildren; ++i){
+		lang_c_declareSwitches(n->children[i], outFile);
+	}
+	if(n->which != CONTROL_SWITCH || lang_c_switchCondition(n)->dataType != TYPE_STRNG) return;
+	fprintf(outFile, "\n// Labels of string SWITCH node %d\n", n->id);
+	for(i=0; i<n->countChildren; ++i){
+		c = n->children[i];
+		if(c->which != CONTROL_CASE) continue;
+		for(j=0; j<c->countChildren; ++j){
+			if(c->children[j]->childType != CASE) continue;
+			if(!count++){
+				fprintf(outFile, "static const adhoc_switchLabel adhoc_switch%d_labels[] = {", n->id);
+			}else{
+				fprintf(outFile, ", ");
+			}
+			fprintf(outFile, "ADHOC_SWITCH_LABEL(\"%s\")", c->children[j]->value);
+		}
+	}
+	if(count) fprintf(outFile, "};\n");
+	while(slots < count*2) slots *= 2;
+	fprintf(outFile, "static adhoc_switchSlot adhoc_switch%d_slots[%d];\n", n->id, slots);
+	fprintf(outFile, "static adhoc_switchTable adhoc_switch%d = ADHOC_SWITCH_TABLE(", n->id);
+	if(count) fprintf(outFile, "adhoc_switch%d_labels", n->id);
+	else fprintf(outFile, "NULL");
+	fprintf(outFile, ", %d, adhoc_switch%d_slots);\n", count, n->id);
+}
+
+// Declare a C struct for each distinct struct layout. Complex fields come
+// first and bools last, so the members pack without padding
+void lang_c_declareStructs(ASTnode* n, FILE* outFile){
+	int i, j;
+	if(n->which == LITERAL_STRCT && n->layout == n){
+		fprintf(outFile, "\n// Struct layout of node %d\n", n->id);
+		fprintf(outFile, "typedef struct adhoc_struct%d {\n", n->id);
+		lang_c_indent(1, outFile);
+		fprintf(outFile, "const adhoc_structLayout* layout;\n");
+		for(j=0; j<3; ++j){
+			for(i=0; i<n->countChildren; ++i){
+				switch(n->children[i]->children[0]->dataType){
+				case TYPE_BOOL: if(j!=2) continue; break;
+				case TYPE_INT:
+				case TYPE_FLOAT: if(j!=1) continue; break;
+				default: if(j!=0) continue;
+				}
+				lang_c_indent(1, outFile);
+				lang_c_printTypeName(n->children[i]->children[0], outFile);
+				fprintf(outFile, " ");
+				lang_c_printFieldName(n->children[i]->value, outFile);
+				fprintf(outFile, ";\n");
+			}
+		}
+		fprintf(outFile, "} adhoc_struct%d;\n", n->id);
+
+		// The runtime layout lists the fields in their declared order
+		fprintf(outFile, "static const char* adhoc_struct%d_names[] = {", n->id);
+		for(i=0; i<n->countChildren; ++i){
+			fprintf(outFile, "%s\"%s\"", (i ? ", " : ""), n->children[i]->value);
+		}
+		fprintf(outFile, "};\n");
+		fprintf(outFile, "static const adhoc_dataType adhoc_struct%d_types[] = {", n->id);
+		for(i=0; i<n->countChildren; ++i){
+			fprintf(outFile, "%s%s"
+				,(i ? ", " : "")
+				,lang_c_dataTypeName(n->children[i]->children[0]->dataType)
+			);
+		}
+		fprintf(outFile, "};\n");
+		fprintf(outFile, "static const int adhoc_struct%d_offsets[] = {", n->id);
+		for(i=0; i<n->countChildren; ++i){
+			fprintf(outFile, "%soffsetof(adhoc_struct%d, ", (i ? ", " : ""), n->id);
+			lang_c_printFieldName(n->children[i]->value, outFile);
+			fprintf(outFile, ")");
+		}
+		fprintf(outFile, "};\n");
+		fprintf(outFile, "static const adhoc_structLayout adhoc_struct%d_layout = {\n", n->id);
+		lang_c_indent(1, outFile);
+		fprintf(outFile, "sizeof(adhoc_struct%d), %d, adhoc_struct%d_names, adhoc_struct%d_types, adhoc_struct%d_offsets\n"
+			,n->id
+			,n->countChildren
+			,n->id
+			,n->id
+			,n->id
+		);
+		fprintf(outFile, "};\n");
+	}
+	for(i=0; i<n->countChildren; ++i){
+		lang_c_declareStructs(n->children[i], outFile);
+	}
+}
+
+// Check whether a subtree uses (or if store, assigns) a scope var
+bool lang_c_usesVar(ASTnode* n, ASTnode* v, bool store){
+	int i;
+	if(n == v || (n->nodeType == VARIABLE && n->reference == v)){
+		if(!store || n->which == VARIABLE_ASIGN) return true;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(lang_c_usesVar(n->children[i], v, store)) return true;
+	}
+	return false;
+}
+
+// Find where a subtree changes the data a variable holds, by storing to one
+// of its items or passing it to a System action that changes it
+ASTnode* lang_c_changesData(ASTnode* n, ASTnode* v){
+	int i;
+	ASTnode* p,* ret;
+	if(n->which == OPERATOR_ARIND && n->childType == STORAGE){
+		for(p=n->children[0]; p->which==OPERATOR_ARIND; p=p->children[0]);
+		if(p->nodeType == VARIABLE && p->reference == v) return n;
+	}
+	if(n->which == ACTION_CALL && !strcmp(n->package, "System")
+			&& adhoc_getSystemEffect(n, "adhoc_") == EFFECT_CHANGE
+		){
+		for(i=0; i<n->countChildren; ++i){
+			p = n->children[i];
+			if(p->nodeType == VARIABLE && p->reference == v) return n;
+		}
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if((ret = lang_c_changesData(n->children[i], v))) return ret;
+	}
+	return NULL;
+}
+
+// Check whether a scope var must be shared with the branches of a fork
+bool lang_c_isForkCapture(ASTnode* fork, ASTnode* v){
+	if(v->which != VARIABLE_ASIGN && v->nodeType != LITERAL) return false;
+	if(!v->name || !strlen(v->name)) return false;
+	return lang_c_usesVar(fork, v, false);
+}
+
+// Check that a fork branch can run as a task of its own
+void lang_c_checkForkBranch(ASTnode* n, ASTnode* fork, char* errBuf){
+	int i;
+	ASTnode* p;
+	if(n->which == ACTION_DEFIN) return;
+	if(n->which == CONTROL_RETRN){
+		adhoc_errorNode = n;
+		sprintf(errBuf, "Node %d: Cannot return from inside a FORK branch", n->id);
+		return;
+	}
+	if(n->which == CONTROL_BREAK || n->which == CONTROL_CNTNU){
+		for(p=n->parent; p!=fork; p=p->parent){
+			if(p->which == CONTROL_LOOP) break;
+			if(p->which == CONTROL_SWITCH && n->which == CONTROL_BREAK) break;
+		}
+		if(p == fork){
+			adhoc_errorNode = n;
+			sprintf(errBuf, "Node %d: Cannot %s out of a FORK branch"
+				,n->id
+				,adhoc_nodeWhich_names[n->which]
+			);
+			return;
+		}
+	}
+	for(i=0; i<n->countChildren; ++i){
+		lang_c_checkForkBranch(n->children[i], fork, errBuf);
+		if(strlen(errBuf)) return;
+	}
+}
+
+// Declare a task function for each branch of every fork, along with a
+// struct of pointers to the variables the branches share. Each branch
+// works on local copies and writes back the variables it assigns
+void lang_c_declareForks(ASTnode* n, FILE* outFile, hashMap* nodes, char* errBuf){
+	int i, j, k;
+	char name[40];
+	bool hasEnv = false, assigned;
+	ASTnode* v,* w;
+	for(i=0; i<n->countChildren; ++i){
+		lang_c_declareForks(n->children[i], outFile, nodes, errBuf);
+		if(strlen(errBuf)) return;
+	}
+	if(n->which != CONTROL_FORK) return;
+	for(i=0; i<n->countChildren; ++i){
+		lang_c_checkForkBranch(n->children[i], n, errBuf);
+		if(strlen(errBuf)) return;
+	}
+
+	// Branches write back what they assign as they finish, so only one may
+	// assign each shared variable, or the last to finish would win
+	for(i=0; i<n->scope->countScopeVars; ++i){
+		v = n->scope->scopeVars[i];
+		if(!lang_c_isForkCapture(n, v)) continue;
+		for(j=0,assigned=false; j<n->countChildren; ++j){
+			if(!lang_c_usesVar(n->children[j], v, true)) continue;
+			if(assigned){
+				adhoc_errorNode = n->children[j];
+				sprintf(errBuf, "Node %d: Two FORK branches assign %.40s", n->children[j]->id, v->name);
+				return;
+			}
+			assigned = true;
+		}
+	}
+
+	// The data a variable holds is shared rather than copied, so a branch
+	// that changes it must be the only one to use it. Changing it can move
+	// it, so even reading it from another branch is unsafe
+	for(i=0; i<n->scope->countScopeVars; ++i){
+		v = n->scope->scopeVars[i];
+		if(!lang_c_isForkCapture(n, v)) continue;
+		for(j=0; j<n->countChildren; ++j){
+			if(!(w = lang_c_changesData(n->children[j], v))) continue;
+			for(k=0; k<n->countChildren; ++k){
+				if(k == j || !lang_c_usesVar(n->children[k], v, false)) continue;
+				adhoc_errorNode = w;
+				sprintf(errBuf, "Node %d: FORK branch changes %.24s, which another uses", w->id, v->name);
+				return;
+			}
+		}
+	}
+
+	// Declare the shared variables
+	for(i=0; i<n->scope->countScopeVars; ++i){
+		v = n->scope->scopeVars[i];
+		if(!lang_c_isForkCapture(n, v)) continue;
+		if(!hasEnv){
+			fprintf(outFile, "\n// Variables shared by the branches of fork node %d\n", n->id);
+			fprintf(outFile, "typedef struct adhoc_fork%d_env {\n", n->id);
+			hasEnv = true;
+		}
+		lang_c_indent(1, outFile);
+		lang_c_printTypeName(v, outFile);
+		fprintf(outFile, "* %s;\n", v->name);
+	}
+	if(hasEnv) fprintf(outFile, "} adhoc_fork%d_env;\n", n->id);
+
+	// Declare the branches
+	scope = n->scope;
+	for(j=0; j<n->countChildren; ++j){
+		lang_c_markLine(n->id, outFile);
+		fprintf(outFile, "\n// Branch %d of fork node %d\n", j+1, n->id);
+		fprintf(outFile, "static void adhoc_fork%d_%d(void* adhoc_arg){\n", n->id, j);
+		sprintf(name, "fork %d branch %d", n->id, j+1);
+		lang_c_markStart(n, name, 1, outFile);
+		if(hasEnv){
+			lang_c_indent(1, outFile);
+			fprintf(outFile, "adhoc_fork%d_env* adhoc_env = adhoc_arg;\n", n->id);
+		}
+		for(i=0; i<n->scope->countScopeVars; ++i){
+			v = n->scope->scopeVars[i];
+			if(!lang_c_isForkCapture(n, v)) continue;
+			if(!lang_c_usesVar(n->children[j], v, false)) continue;
+			lang_c_indent(1, outFile);
+			lang_c_printTypeName(v, outFile);
+			fprintf(outFile, " %s = *adhoc_env->%s;\n", v->name, v->name);
+		}
+		lang_c_generate(false, n->children[j], 1, outFile, nodes, errBuf);
+		for(i=0; i<n->scope->countScopeVars; ++i){
+			v = n->scope->scopeVars[i];
+			if(!lang_c_isForkCapture(n, v)) continue;
+			if(!lang_c_usesVar(n->children[j], v, true)) continue;
+			lang_c_indent(1, outFile);
+			fprintf(outFile, "*adhoc_env->%s = %s;\n", v->name, v->name);
+		}
+		fprintf(outFile, "}\n");
+	}
+}
+
+// Find the variable that a storage or evaluation node refers to
+ASTnode* lang_c_variableOf(ASTnode* n){
+	return n->reference ? n->reference : n;
+}
+
+// Check whether a data type is a scalar that can be copied freely
+bool lang_c_isScalar(dataType t){
+	return t == TYPE_BOOL || t == TYPE_INT || t == TYPE_FLOAT;
+}
+
+// Check whether a node evaluates a loop's counter
+bool lang_c_isCounter(ASTnode* n, lang_c_loopInfo* info){
+	return n->which == VARIABLE_EVAL && lang_c_variableOf(n) == info->counter;
+}
+
+// Find a variable among those a loop body has used, or -1
+int lang_c_loopSeen(lang_c_loopInfo* info, ASTnode* v){
+	int i;
+	for(i=0; i<info->countSeen; ++i) if(info->seen[i] == v) return i;
+	return -1;
+}
+
+// Record the first use of a variable in a loop body
+void lang_c_loopSee(lang_c_loopInfo* info, ASTnode* v, bool private){
+	if(info->countSeen == info->sizeSeen){
+		info->sizeSeen = (info->sizeSeen ? info->sizeSeen*2 : 4);
+		info->seen = realloc(info->seen, info->sizeSeen*sizeof(ASTnode*));
+		info->privates = realloc(info->privates, info->sizeSeen*sizeof(bool));
+	}
+	info->seen[info->countSeen] = v;
+	info->privates[info->countSeen++] = private;
+}
+
+// A loop body may only assign variables that every iteration sets before
+// reading, and only while not nested in a condition. Those become private
+// to each iteration
+void lang_c_loopStore(lang_c_loopInfo* info, ASTnode* n, short depth){
+	ASTnode* v = lang_c_variableOf(n);
+	int i = lang_c_loopSeen(info, v);
+	if(v == info->counter){
+		info->parallel = false;
+	}else if(i < 0){
+		if(depth || !lang_c_isScalar(n->dataType)) info->parallel = false;
+		else lang_c_loopSee(info, v, true);
+	}else if(!info->privates[i]){
+		info->parallel = false;
+	}
+}
+
+// Scan a loop body in the order it runs, checking each iteration is
+// independent of the others
+void lang_c_scanLoopBody(lang_c_loopInfo* info, ASTnode* n, short depth){
+	int i;
+	ASTnode* v;
+	if(!info->parallel) return;
+	switch(n->which){
+	case ACTION_DEFIN:
+	case ACTION_CALL:
+	case CONTROL_SWITCH:
+	case CONTROL_CASE:
+	case CONTROL_FORK:
+	case CONTROL_CNTNU:
+	case CONTROL_BREAK:
+	case CONTROL_RETRN:
+	case LITERAL_ARRAY:
+	case LITERAL_HASH:
+	case LITERAL_STRCT:
+		info->parallel = false;
+		return;
+
+	case ASSIGNMENT_EQUAL:
+		lang_c_scanLoopBody(info, n->children[1], depth);
+		if(n->children[0]->which != OPERATOR_ARIND){
+			lang_c_loopStore(info, n->children[0], depth);
+			return;
+		}
+
+		// Arrays may only be written once per iteration, at the counter
+		v = n->children[0]->children[0];
+		if(depth
+				|| n->childType != STATEMENT
+				|| v->which != VARIABLE_EVAL
+				|| !lang_c_isTypedArray(v)
+				|| !lang_c_isCounter(n->children[0]->children[1], info)
+			){
+			info->parallel = false;
+			return;
+		}
+		v = lang_c_variableOf(v);
+		for(i=0; i<info->countArrays && info->arrays[i]!=v; ++i);
+		if(i < info->countArrays) return;
+		if(info->countArrays == info->sizeArrays){
+			info->sizeArrays = (info->sizeArrays ? info->sizeArrays*2 : 4);
+			info->arrays = realloc(info->arrays, info->sizeArrays*sizeof(ASTnode*));
+		}
+		info->arrays[info->countArrays++] = v;
+		return;
+
+	case ASSIGNMENT_INCPR:
+	case ASSIGNMENT_INCPS:
+	case ASSIGNMENT_DECPR:
+	case ASSIGNMENT_DECPS:
+	case ASSIGNMENT_NEGPR:
+	case ASSIGNMENT_NEGPS:
+	case ASSIGNMENT_PLUS:
+	case ASSIGNMENT_MINUS:
+	case ASSIGNMENT_TIMES:
+	case ASSIGNMENT_DIVBY:
+	case ASSIGNMENT_MOD:
+	case ASSIGNMENT_EXP:
+	case ASSIGNMENT_OR:
+	case ASSIGNMENT_AND:
+		// Updates read the variable first, so it must already be private
+		if(n->countChildren > 1) lang_c_scanLoopBody(info, n->children[1], depth);
+		i = lang_c_loopSeen(info, lang_c_variableOf(n->children[0]));
+		if(n->children[0]->which != VARIABLE_ASIGN || i < 0 || !info->privates[i]){
+			info->parallel = false;
+		}
+		return;
+
+	case VARIABLE_ASIGN:
+		// Initialization of an inner loop's counter
+		for(i=0; i<n->countChildren; ++i){
+			lang_c_scanLoopBody(info, n->children[i], depth);
+		}
+		lang_c_loopStore(info, n, depth);
+		return;
+
+	case VARIABLE_EVAL:
+		v = lang_c_variableOf(n);
+		if(v != info->counter && lang_c_loopSeen(info, v) < 0){
+			lang_c_loopSee(info, v, false);
+		}
+		return;
+
+	case CONTROL_IF:
+	case CONTROL_LOOP:
+		// Only the initialization and condition are sure to run
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType == INITIALIZATION){
+				lang_c_scanLoopBody(info, n->children[i], depth);
+			}
+		}
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType == CONDITION){
+				lang_c_scanLoopBody(info, n->children[i], depth);
+			}
+		}
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType == INITIALIZATION) continue;
+			if(n->children[i]->childType == CONDITION) continue;
+			lang_c_scanLoopBody(info, n->children[i], depth+1);
+		}
+		return;
+
+	default:
+		for(i=0; i<n->countChildren; ++i){
+			lang_c_scanLoopBody(info, n->children[i], depth);
+		}
+	}
+}
+
+// Check whether an array variable may share its array with another one.
+// Only variables that are always given fresh array literals cannot
+bool lang_c_mayAlias(ASTnode* v, ASTnode* n){
+	int i;
+	if(n == v && n->childType == PARAMETER) return true;
+	if(n->which == ASSIGNMENT_EQUAL
+			&& lang_c_variableOf(n->children[0]) == v
+			&& n->children[1]->which != LITERAL_ARRAY
+		) return true;
+	if(n->which == VARIABLE_ASIGN
+			&& n->childType == INITIALIZATION
+			&& lang_c_variableOf(n) == v
+		) return true;
+	for(i=0; i<n->countChildren; ++i){
+		if(lang_c_mayAlias(v, n->children[i])) return true;
+	}
+	return false;
+}
+
+// Check that written arrays are only read at the counter, so no iteration
+// reads what another writes
+bool lang_c_loopReadsOwn(lang_c_loopInfo* info, ASTnode* n){
+	int i;
+	ASTnode* v;
+	if(n->which == OPERATOR_ARIND
+			&& n->children[0]->which == VARIABLE_EVAL
+			&& !lang_c_isCounter(n->children[1], info)
+		){
+		v = lang_c_variableOf(n->children[0]);
+		for(i=0; i<info->countArrays; ++i){
+			if(v == info->arrays[i]) return false;
+			if(v->childDataType != info->arrays[i]->childDataType) continue;
+			if(lang_c_mayAlias(v, v->scope) || lang_c_mayAlias(info->arrays[i], v->scope)){
+				return false;
+			}
+		}
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(!lang_c_loopReadsOwn(info, n->children[i])) return false;
+	}
+	return true;
+}
+
+// Check that a loop's bound is the same on every iteration. It may only
+// call pure System actions
+bool lang_c_loopInvariant(lang_c_loopInfo* info, ASTnode* n){
+	int i;
+	if(n->nodeType == ASSIGNMENT) return false;
+	if(n->nodeType == ACTION && adhoc_getSystemEffect(n, "adhoc_") != EFFECT_PURE) return false;
+	if(n->which == VARIABLE_EVAL){
+		i = lang_c_loopSeen(info, lang_c_variableOf(n));
+		if(lang_c_variableOf(n) == info->counter) return false;
+		if(i >= 0 && info->privates[i]) return false;
+		for(i=0; i<info->countArrays; ++i){
+			if(lang_c_variableOf(n) == info->arrays[i]) return false;
+		}
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(!lang_c_loopInvariant(info, n->children[i])) return false;
+	}
+	return true;
+}
+
+// Find the initialization, condition, or step of a loop
+ASTnode* lang_c_loopPart(ASTnode* loop, nodeChildType t){
+	int i;
+	for(i=0; i<loop->countChildren; ++i){
+		if(loop->children[i]->childType == t) return loop->children[i];
+	}
+	return NULL;
+}
+
+// Work out whether a loop counts from a start to a fixed bound, one at a
+// time, with iterations that can run in any order. Free with lang_c_freeLoopInfo
+lang_c_loopInfo* lang_c_analyzeLoop(ASTnode* loop){
+	int i;
+	lang_c_loopInfo* info = calloc(1, sizeof(lang_c_loopInfo));
+	ASTnode* init = lang_c_loopPart(loop, INITIALIZATION);
+	ASTnode* cond = lang_c_loopPart(loop, CONDITION);
+	ASTnode* step = loop->children[loop->countChildren-1];
+
+	// The loop must be for(i = start; i < bound; ){ ... i++; }
+	if(!init || !cond || init->which != VARIABLE_ASIGN || init->dataType != TYPE_INT) return info;
+	info->counter = lang_c_variableOf(init);
+	if(cond->which != OPERATOR_LESTN && cond->which != OPERATOR_LESEQ) return info;
+	if(!lang_c_isCounter(cond->children[0], info)) return info;
+	if(step->childType != STATEMENT) return info;
+	if(step->which == ASSIGNMENT_INCPS || step->which == ASSIGNMENT_INCPR){
+		if(lang_c_variableOf(step->children[0]) != info->counter) return info;
+	}else if(step->which == ASSIGNMENT_PLUS){
+		if(lang_c_variableOf(step->children[0]) != info->counter) return info;
+		if(step->children[1]->which != LITERAL_INT || atoi(step->children[1]->value) != 1) return info;
+	}else return info;
+	info->step = step;
+
+	// Every other statement in the body must keep to its own iteration
+	info->parallel = true;
+	for(i=0; i<loop->countChildren; ++i){
+		if(loop->children[i] == init || loop->children[i] == cond) continue;
+		if(loop->children[i] == step) continue;
+		lang_c_scanLoopBody(info, loop->children[i], 0);
+	}
+	if(!info->parallel) return info;
+	info->parallel = lang_c_loopReadsOwn(info, loop)
+		&& lang_c_loopInvariant(info, cond->children[1]);
+	return info;
+}
+
+// Free the results of a loop analysis
+void lang_c_freeLoopInfo(lang_c_loopInfo* info){
+	free(info->seen);
+	free(info->privates);
+	free(info->arrays);
+	free(info);
+}
+
+// Check whether a scope var must be shared with a parallel loop's iterations
+bool lang_c_isLoopCapture(ASTnode* loop, lang_c_loopInfo* info, ASTnode* v){
+	return v != info->counter && lang_c_isForkCapture(loop, v);
+}
+
+// Check whether a variable is private to each iteration of a parallel loop
+bool lang_c_isLoopPrivate(lang_c_loopInfo* info, ASTnode* v){
+	int i = lang_c_loopSeen(info, v);
+	return i >= 0 && info->privates[i];
+}
+
+// Declare a function for the iterations of each parallel loop, along with a
+// struct of pointers to the variables they share. The iteration that ends
+// the loop writes back the variables private to each iteration
+void lang_c_declareLoops(ASTnode* n, FILE* outFile, hashMap* nodes, char* errBuf){
+	int i;
+	char name[40];
+	ASTnode* v;
+	lang_c_loopInfo* info;
+	for(i=0; i<n->countChildren; ++i){
+		lang_c_declareLoops(n->children[i], outFile, nodes, errBuf);
+		if(strlen(errBuf)) return;
+	}
+	if(n->which != CONTROL_LOOP) return;
+	info = lang_c_analyzeLoop(n);
+	if(!info->parallel){
+		lang_c_freeLoopInfo(info);
+		return;
+	}
+
+	// Declare the shared variables
+	lang_c_markLine(n->id, outFile);
+	fprintf(outFile, "\n// Variables shared by the iterations of loop node %d\n", n->id);
+	fprintf(outFile, "typedef struct adhoc_loop%d_env {\n", n->id);
+	lang_c_indent(1, outFile);
+	fprintf(outFile, "int adhoc_end;\n");
+	for(i=0; i<n->scope->countScopeVars; ++i){
+		v = n->scope->scopeVars[i];
+		if(!lang_c_isLoopCapture(n, info, v)) continue;
+		lang_c_indent(1, outFile);
+		lang_c_printTypeName(v, outFile);
+		fprintf(outFile, "* %s;\n", v->name);
+	}
+	fprintf(outFile, "} adhoc_loop%d_env;\n", n->id);
+
+	// Declare the iterations
+	scope = n->scope;
+	fprintf(outFile, "\n// Iterations of loop node %d, run in parallel\n", n->id);
+	fprintf(outFile, "static void adhoc_loop%d(int adhoc_from, int adhoc_to, void* adhoc_arg){\n", n->id);
+	sprintf(name, "loop %d", n->id);
+	lang_c_markStart(n, name, 1, outFile);
+	lang_c_indent(1, outFile);
+	fprintf(outFile, "adhoc_loop%d_env* adhoc_env = adhoc_arg;\n", n->id);
+	lang_c_indent(1, outFile);
+	fprintf(outFile, "int %s;\n", info->counter->name);
+	for(i=0; i<n->scope->countScopeVars; ++i){
+		v = n->scope->scopeVars[i];
+		if(!lang_c_isLoopCapture(n, info, v)) continue;
+		lang_c_indent(1, outFile);
+		lang_c_printTypeName(v, outFile);
+		if(lang_c_isLoopPrivate(info, v)) fprintf(outFile, " %s = 0;\n", v->name);
+		else fprintf(outFile, " %s = *adhoc_env->%s;\n", v->name, v->name);
+	}
+	for(i=0; i<n->countScopeVars; ++i){
+		if(n->scopeVars[i] == info->counter) continue;
+		lang_c_indent(1, outFile);
+		lang_c_printTypeName(n->scopeVars[i], outFile);
+		fprintf(outFile, " %s;\n", n->scopeVars[i]->name);
+	}
+	lang_c_indent(1, outFile);
+	fprintf(outFile, "for(%s = adhoc_from; %s < adhoc_to; ++%s){\n"
+		,info->counter->name
+		,info->counter->name
+		,info->counter->name
+	);
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == INITIALIZATION) continue;
+		if(n->children[i]->childType == CONDITION) continue;
+		if(n->children[i] == info->step) continue;
+		lang_c_generate(false, n->children[i], 2, outFile, nodes, errBuf);
+	}
+	lang_c_indent(1, outFile);
+	fprintf(outFile, "}\n");
+	for(i=0; i<info->countSeen && !info->privates[i]; ++i);
+	if(i < info->countSeen){
+		lang_c_indent(1, outFile);
+		fprintf(outFile, "if(adhoc_to == adhoc_env->adhoc_end){\n");
+		for(; i<info->countSeen; ++i){
+			if(!info->privates[i]) continue;
+			lang_c_indent(2, outFile);
+			fprintf(outFile, "*adhoc_env->%s = %s;\n", info->seen[i]->name, info->seen[i]->name);
+		}
+		lang_c_indent(1, outFile);
+		fprintf(outFile, "}\n");
+	}
+	fprintf(outFile, "}\n");
+	lang_c_freeLoopInfo(info);
+}
+
+// Check if a variable can share a held value instead of taking its own ref
+bool lang_c_isAliasSource(ASTnode* v, ASTnode* src){
+	if(!lang_c_isHeld(src)) return false;
+	if(src->which != VARIABLE_EVAL) return src->scope == v->scope;
+	return src->reference != v && src->reference->scope == v->scope;
+}
+
+// Walkable ownership seeding: assume complex params and locals can borrow
+void lang_c_markOwnership(ASTnode* n, int d, char* errBuf){
+	if(n->which != VARIABLE_ASIGN || !lang_c_isComplex(n->dataType)) return;
+
+	// Parameters of actions with call sites may borrow the caller's reference
+	if(n->childType == PARAMETER){
+		n->borrowed = n->parent->which == ACTION_DEFIN && n->parent->parent != NULL;
+
+	// Named locals may alias other held values in the same action
+	}else if(n->defined && !n->reference && strlen(n->name)){
+		n->borrowed = true;
+	}
+}
+
+// Walkable ownership check: drop borrowing wherever it cannot be proven
+void lang_c_clearOwnership(ASTnode* n, int d, char* errBuf){
+	int i;
+	ASTnode* def,* v;
+	switch(n->which){
+	case ACTION_CALL:
+		// Every call must pass an already-held value to a borrowed param
+		if(!strcmp(n->package, "System")) break;
+		def = (ASTnode*) hashMap_retrieve(lang_c_nodeMap, n->refId);
+		if(!def || def->which != ACTION_DEFIN) break;
+		for(i=0; i<n->countChildren && i<def->countChildren; ++i){
+			if(def->children[i]->childType != PARAMETER) break;
+			if(!lang_c_isHeld(n->children[i])) def->children[i]->borrowed = false;
+		}
+		break;
+
+	case ACTION_DEFIN:
+		// A nested definition is also a call, with arguments under its params
+		if(!n->parent) break;
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType != PARAMETER) break;
+			if(!n->children[i]->countChildren
+					|| !lang_c_isHeld(n->children[i]->children[0])
+				) n->children[i]->borrowed = false;
+		}
+		break;
+
+	case VARIABLE_ASIGN:
+		// Parameters keep borrowing only if they are never reassigned
+		if(n->childType == PARAMETER) break;
+		v = lang_c_variableOf(n);
+		if(!v->borrowed) break;
+		if(v->childType == PARAMETER){
+			v->borrowed = false;
+			break;
+		}
+
+		// Locals keep borrowing only if every store is another held value
+		if(n->childType != STORAGE
+				|| n->parent->which != ASSIGNMENT_EQUAL
+				|| !lang_c_isAliasSource(v, n->parent->children[1])
+			) v->borrowed = false;
+		break;
+	}
+}
+
+// Check whether a store into n can skip taking its own reference
+bool lang_c_isBorrowedStore(ASTnode* n){
+	return n->which == VARIABLE_ASIGN && lang_c_variableOf(n)->borrowed;
+}
+
+bool lang_c_readEscapes(ASTnode* n, ASTnode* v, ASTnode* scope, lang_c_trace* t);
+
+// Check whether a value can outlive the action that makes it, given a place
+// it is used. It must not be returned, stored into a container or a
+// variable of another action, or handed to an action that could keep it.
+// Local variables it is stored to are traced in turn
+bool lang_c_escapes(ASTnode* u, ASTnode* scope, lang_c_trace* t){
+	int i;
+	ASTnode* p = u->parent,* v;
+	if(u->childType == STATEMENT || u->childType == IF || u->childType == ELSE) return false;
+	switch(p->which){
+	case ASSIGNMENT_EQUAL:
+		v = p->children[0];
+		if(v->which != VARIABLE_ASIGN) return true;
+		v = lang_c_variableOf(v);
+		if(v->scope != scope || v->childType == PARAMETER) return true;
+		if(lang_c_escapes(p, scope, t)) return true;
+		for(i=0; i<t->count; ++i) if(t->vars[i] == v) return false;
+		if(t->count == t->size){
+			t->size = (t->size ? t->size*2 : 4);
+			t->vars = realloc(t->vars, t->size*sizeof(ASTnode*));
+		}
+		t->vars[t->count++] = v;
+		return lang_c_readEscapes(scope, v, scope, t);
+
+	// Indexing into a container reads it, but an index may become a key
+	case OPERATOR_ARIND:
+		return u != p->children[0];
+
+	case OPERATOR_EQUIV:
+	case OPERATOR_NOTEQ:
+		return false;
+
+	// Actions that change things may only change the value itself
+	case ACTION_CALL:
+		if(strcmp(p->package, "System")) return true;
+		return adhoc_getSystemEffect(p, "adhoc_") == EFFECT_CHANGE
+			&& adhoc_getNodeIndexOfChild(p, u) > 0;
+
+	default:
+		return true;
+	}
+}
+
+// Check whether any read of a local variable lets its value escape. Nested
+// actions run in frames of their own, so reads from them always do
+bool lang_c_readEscapes(ASTnode* n, ASTnode* v, ASTnode* scope, lang_c_trace* t){
+	int i;
+	if(n->which == ACTION_DEFIN && n != scope) return lang_c_usesVar(n, v, false);
+	if(n->which == VARIABLE_EVAL && n->reference == v) return lang_c_escapes(n, scope, t);
+	for(i=0; i<n->countChildren; ++i){
+		if(lang_c_readEscapes(n->children[i], v, scope, t)) return true;
+	}
+	return false;
+}
+
+// Declare the temporary for a container literal that lives in the stack
+// frame of its action. Small arrays and structs keep their items there too
+void lang_c_declareLocal(ASTnode* n, short indent, FILE* outFile){
+	bool inlineItems = n->which == LITERAL_STRCT || (
+		n->which == LITERAL_ARRAY
+		&& n->countChildren > 0
+		&& n->countChildren <= lang_c_localItems
+	);
+	if(inlineItems){
+		lang_c_indent(indent, outFile);
+		if(n->which == LITERAL_STRCT){
+			fprintf(outFile, "adhoc_struct%d %s_items = {0};\n", n->layout->id, n->name);
+		}else{
+			switch(n->childDataType){
+			case TYPE_BOOL: fprintf(outFile, "bool"); break;
+			case TYPE_INT: fprintf(outFile, "int"); break;
+			case TYPE_FLOAT: fprintf(outFile, "float"); break;
+			default: fprintf(outFile, "adhoc_data*");
+			}
+			fprintf(outFile, " %s_items[%d] = {0};\n", n->name, n->countChildren);
+			lang_c_indent(indent, outFile);
+			fprintf(outFile, "char %s_map[%d] = {0};\n"
+				,n->name
+				,(n->countChildren-1)/8+1
+			);
+		}
+	}
+	lang_c_indent(indent, outFile);
+	fprintf(outFile, "adhoc_data %s_local;\n", n->name);
+	lang_c_indent(indent, outFile);
+	lang_c_printTypeName(n, outFile);
+	switch(n->which){
+	case LITERAL_ARRAY:
+		fprintf(outFile, " %s = adhoc_localArray(&%s_local, %s, %d, "
+			,n->name
+			,n->name
+			,lang_c_dataTypeName(n->childDataType)
+			,n->countChildren
+		);
+		if(inlineItems) fprintf(outFile, "%s_items, %s_map);\n", n->name, n->name);
+		else fprintf(outFile, "NULL, NULL);\n");
+		break;
+	case LITERAL_HASH:
+		fprintf(outFile, " %s = adhoc_localHash(&%s_local, %s, %d);\n"
+			,n->name
+			,n->name
+			,lang_c_dataTypeName(n->childDataType)
+			,n->countChildren
+		);
+		break;
+	case LITERAL_STRCT:
+		fprintf(outFile, " %s = adhoc_localStruct(&%s_local, &adhoc_struct%d_layout, &%s_items);\n"
+			,n->name
+			,n->name
+			,n->layout->id
+			,n->name
+		);
+		break;
+	}
+}
+
+// Walkable escape analysis: container literals that never leave their
+// action live in its stack frame, as do string literals that System actions
+// only read
+void lang_c_markLocals(ASTnode* n, int d, char* errBuf){
+	lang_c_trace t = {NULL, 0, 0};
+	systemEffect effect;
+	switch(n->which){
+	case LITERAL_ARRAY:
+	case LITERAL_HASH:
+	case LITERAL_STRCT:
+		if(!n->scope || !strlen(n->name)) break;
+		n->local = !lang_c_escapes(n, n->scope, &t);
+		free(t.vars);
+		break;
+
+	case LITERAL_STRNG:
+		if(!n->parent || n->parent->which != ACTION_CALL) break;
+		effect = adhoc_getSystemEffect(n->parent, "adhoc_");
+		n->local = effect == EFFECT_PURE || effect == EFFECT_OUTPUT;
+		break;
+	}
+}
+
 // Generating Null nodes should just throw an error
 void lang_c_generate_null(bool isInit, ASTnode* n, short indent, FILE* outFile, hashMap* nodes, char* errBuf){
 	adhoc_errorNode = n->parent;
@@ -154,6 +1378,7 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 
 			// Open the body block
 			fprintf(outFile, "{\n");
+			lang_c_markStart(n, n->name, indent+1, outFile);
 
 			// Increment references on complex parameters
 			for(k=0; k<n->countChildren; ++k){
@@ -170,6 +1395,9 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 				}
 				if(!isComplex) continue;
 
+				// Borrowed parameters are already held by every caller
+				if(n->children[k]->borrowed) continue;
+
 				// Add reference incrementer
 				lang_c_indent(indent+1, outFile);
 				fprintf(outFile, "adhoc_referenceData(%s);\n"
@@ -179,7 +1407,6 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 			if(k) fprintf(outFile, "\n");
 
 			// Print declarations for any scope vars
-			char* dt;
 			bool declCommented = false;
 			for(j=0; j<n->countScopeVars; ++j){
 				// Skip parameters and unnamed vars
@@ -193,15 +1420,43 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 					declCommented = true;
 				}
 
-				// Handle different datatypes differently
-				switch(n->scopeVars[j]->dataType){
-				case TYPE_STRNG:
+				// Literals on the heap are charged to their own nodes
+				if(n->scopeVars[j]->nodeType == LITERAL && !n->scopeVars[j]->local && lang_c_isComplex(n->scopeVars[j]->dataType)){
+					lang_c_markSite(n->scopeVars[j], indent+1, outFile);
+				}
+
+				// Handle different datatypes differently
+				switch(n->scopeVars[j]->dataType){
+				case TYPE_STRNG:
+					lang_c_indent(indent+1, outFile);
+					lang_c_printTypeName(n->scopeVars[j], outFile);
+					if(n->scopeVars[j]->nodeType == LITERAL){
+						fprintf(outFile, " %s = adhoc_createString(\"%s\");\n"
+							,n->scopeVars[j]->name
+							,n->scopeVars[j]->value
+						);
+					}else{
+						fprintf(outFile, " %s = NULL;\n"
+							,n->scopeVars[j]->name
+						);
+					}
+					break;
+
+				case TYPE_ARRAY:
+				case TYPE_HASH:
+					// Handle declaration of temporaries for array and hash literals
+					if(n->scopeVars[j]->nodeType == LITERAL && n->scopeVars[j]->local){
+						lang_c_declareLocal(n->scopeVars[j], indent+1, outFile);
+						break;
+					}
 					lang_c_indent(indent+1, outFile);
 					lang_c_printTypeName(n->scopeVars[j], outFile);
 					if(n->scopeVars[j]->nodeType == LITERAL){
-						fprintf(outFile, " %s = adhoc_createString(\"%s\");\n"
+						fprintf(outFile, " %s = adhoc_referenceData(adhoc_create%s(%s, %d));\n"
 							,n->scopeVars[j]->name
-							,n->scopeVars[j]->value
+							,(n->scopeVars[j]->dataType == TYPE_HASH ? "Hash" : "Array")
+							,lang_c_dataTypeName(n->scopeVars[j]->childDataType)
+							,n->scopeVars[j]->countChildren
 						);
 					}else{
 						fprintf(outFile, " %s = NULL;\n"
@@ -210,25 +1465,18 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 					}
 					break;
 
-				case TYPE_ARRAY:
-					// Handle declaration of temporaries for array literals
+				case TYPE_STRCT:
+					// Handle declaration of temporaries for struct literals
+					if(n->scopeVars[j]->nodeType == LITERAL && n->scopeVars[j]->local){
+						lang_c_declareLocal(n->scopeVars[j], indent+1, outFile);
+						break;
+					}
 					lang_c_indent(indent+1, outFile);
 					lang_c_printTypeName(n->scopeVars[j], outFile);
 					if(n->scopeVars[j]->nodeType == LITERAL){
-						switch(n->scopeVars[j]->childDataType){
-						case TYPE_BOOL: dt = "DATA_BOOL"; break;
-						case TYPE_INT: dt = "DATA_INT"; break;
-						case TYPE_FLOAT: dt = "DATA_FLOAT"; break;
-						case TYPE_STRNG: dt = "DATA_STRING"; break;
-						case TYPE_ARRAY: dt = "DATA_ARRAY"; break;
-						case TYPE_HASH: dt = "DATA_HASH"; break;
-						case TYPE_STRCT: dt = "DATA_STRUCT"; break;
-						default: dt = "DATA_VOID"; break;
-						}
-						fprintf(outFile, " %s = adhoc_referenceData(adhoc_createArray(%s, %d));\n"
+						fprintf(outFile, " %s = adhoc_referenceData(adhoc_createStruct(&adhoc_struct%d_layout));\n"
 							,n->scopeVars[j]->name
-							,dt
-							,n->scopeVars[j]->countChildren
+							,n->scopeVars[j]->layout->id
 						);
 					}else{
 						fprintf(outFile, " %s = NULL;\n"
@@ -266,6 +1514,9 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 				);
 			}
 
+			// Releasing the scope is the cost of the action itself
+			lang_c_markLine(n->id, outFile);
+
 			// Reduce the ref counts on all complex vars in scope before ending
 			if(n->children[n->countChildren-1]->which != CONTROL_RETRN){
 				bool derefCommented = false;
@@ -284,6 +1535,9 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 					}
 					if(!isComplex) continue;
 
+					// Borrowed vars never took a reference of their own
+					if(n->scopeVars[i]->borrowed) continue;
+
 					// Reduce the reference count
 					if(!derefCommented){
 						fprintf(outFile, "\n");
@@ -357,7 +1611,9 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 				case TYPE_STRCT:
 					isComplex = true;
 				}
-				if(isComplex) fprintf(outFile, "adhoc_sizeC(");
+				if(isComplex) fprintf(outFile, "adhoc_sizeC%s("
+					,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+				);
 				else fprintf(outFile, "adhoc_sizeS(");
 
 			// count - Returns the count of items in one argument
@@ -389,7 +1645,9 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 					fprintf(outFile, "adhoc_toStringS(DATA_FLOAT, ");
 					break;
 				default:
-					fprintf(outFile, "adhoc_toStringC(");
+					fprintf(outFile, "adhoc_toStringC%s("
+						,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+					);
 				}
 
 			// print - Prints arbitrarily many arguments
@@ -425,16 +1683,16 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 					fprintf(outFile, "adhoc_prompt(");
 					switch(n->children[0]->dataType){
 					case TYPE_BOOL:
-						fprintf(outFile, "DATA_BOOL, ");
+						fprintf(outFile, "DATA_BOOL, &");
 						break;
 					case TYPE_INT:
-						fprintf(outFile, "DATA_INT, ");
+						fprintf(outFile, "DATA_INT, &");
 						break;
 					case TYPE_FLOAT:
-						fprintf(outFile, "DATA_FLOAT, ");
+						fprintf(outFile, "DATA_FLOAT, &");
 						break;
 					case TYPE_STRNG:
-						fprintf(outFile, "DATA_STRING, ");
+						fprintf(outFile, "DATA_STRING, &");
 						break;
 					default:
 						fprintf(outFile, "DATA_VOID, ");
@@ -539,7 +1797,10 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 						,n->children[2]->id
 					);
 				}
-				fprintf(outFile, "%s(", n->name);
+				fprintf(outFile, "%s%s("
+					,n->name
+					,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+				);
 
 			// splice string - patches first with second from index of length
 			}else if(!strcmp(n->name, "adhoc_splice_string")){
@@ -575,7 +1836,15 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 						,n->children[3]->id
 					);
 				}
-				fprintf(outFile, "%s(", n->name);
+				fprintf(outFile, "%s%s%s("
+					,n->name
+					,(n->childType == STATEMENT
+							|| n->childType == IF
+							|| n->childType == ELSE
+						? "_discard" : "")
+					,(lang_c_isHeld(n->children[0]) && lang_c_isHeld(n->children[1])
+						? "_borrowed" : "")
+				);
 
 			// find in string - gets first instance in string of substring
 			}else if(!strcmp(n->name, "adhoc_find_in_string")){
@@ -595,7 +1864,47 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 						,n->children[1]->id
 					);
 				}
-				fprintf(outFile, "%s(", n->name);
+				lang_c_printStringSearch(n, outFile);
+
+			// find all in string - gets every instance in string of substring
+			}else if(!strcmp(n->name, "adhoc_find_all_in_string")){
+				if(n->children[0]->dataType != TYPE_STRNG){
+					adhoc_errorNode = n->children[0];
+					sprintf(
+						errBuf
+						,"Node %d: First parameter to 'find all in string' must be a string"
+						,n->children[0]->id
+					);
+				}
+				if(n->children[1]->dataType != TYPE_STRNG){
+					adhoc_errorNode = n->children[1];
+					sprintf(
+						errBuf
+						,"Node %d: Second parameter to 'find all in string' must be a string"
+						,n->children[1]->id
+					);
+				}
+				lang_c_printStringSearch(n, outFile);
+
+			// count occurrences - counts the instances in string of substring
+			}else if(!strcmp(n->name, "adhoc_count_occurrences")){
+				if(n->children[0]->dataType != TYPE_STRNG){
+					adhoc_errorNode = n->children[0];
+					sprintf(
+						errBuf
+						,"Node %d: First parameter to 'count occurrences' must be a string"
+						,n->children[0]->id
+					);
+				}
+				if(n->children[1]->dataType != TYPE_STRNG){
+					adhoc_errorNode = n->children[1];
+					sprintf(
+						errBuf
+						,"Node %d: Second parameter to 'count occurrences' must be a string"
+						,n->children[1]->id
+					);
+				}
+				lang_c_printStringSearch(n, outFile);
 
 			// isset array - checks whether an index is used in an array
 			}else if(!strcmp(n->name, "adhoc_isset_array")){
@@ -668,9 +1977,10 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 						,n->children[0]->id
 					);
 				}
-				fprintf(outFile, "*(%s*)%s("
-					,adhoc_dataType_names[n->children[0]->dataType]
+				fprintf(outFile, "*(%s*)%s%s("
+					,adhoc_dataType_names[n->children[0]->childDataType]
 					,n->name
+					,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
 				);
 
 			// find max value index - finds the index of the max value in an array
@@ -683,10 +1993,102 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 						,n->children[0]->id
 					);
 				}
-				fprintf(outFile, "%s("
+				fprintf(outFile, "%s%s("
+					,n->name
+					,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+				);
+
+			// find min value - finds the min value in an array
+			}else if(!strcmp(n->name, "adhoc_find_min_value")){
+				if(n->children[0]->dataType != TYPE_ARRAY){
+					adhoc_errorNode = n->children[0];
+					sprintf(
+						errBuf
+						,"Node %d: First parameter to 'find min value' must be an array"
+						,n->children[0]->id
+					);
+				}
+				fprintf(outFile, "*(%s*)%s%s("
+					,adhoc_dataType_names[n->children[0]->childDataType]
+					,n->name
+					,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+				);
+
+			// find min value index - finds the index of the min value in an array
+			}else if(!strcmp(n->name, "adhoc_find_min_value_index")){
+				if(n->children[0]->dataType != TYPE_ARRAY){
+					adhoc_errorNode = n->children[0];
+					sprintf(
+						errBuf
+						,"Node %d: First parameter to 'find min value index' must be an array"
+						,n->children[0]->id
+					);
+				}
+				fprintf(outFile, "%s%s("
+					,n->name
+					,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+				);
+
+			// sum array - adds up the items of an int or float array
+			}else if(!strcmp(n->name, "adhoc_sum_array")){
+				if(n->children[0]->dataType != TYPE_ARRAY
+						|| (n->children[0]->childDataType != TYPE_INT
+							&& n->children[0]->childDataType != TYPE_FLOAT)
+					){
+					adhoc_errorNode = n->children[0];
+					sprintf(
+						errBuf
+						,"Node %d: First parameter to 'sum array' must be an int or float array"
+						,n->children[0]->id
+					);
+				}
+				fprintf(outFile, "(%s)%s%s("
+					,adhoc_dataType_names[n->children[0]->childDataType]
+					,n->name
+					,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+				);
+
+			// count greater than - counts the items of an array above a threshold
+			}else if(!strcmp(n->name, "adhoc_count_greater_than")){
+				if(n->children[0]->dataType != TYPE_ARRAY
+						|| (n->children[0]->childDataType != TYPE_INT
+							&& n->children[0]->childDataType != TYPE_FLOAT)
+					){
+					adhoc_errorNode = n->children[0];
+					sprintf(
+						errBuf
+						,"Node %d: First parameter to 'count greater than' must be an int or float array"
+						,n->children[0]->id
+					);
+				}
+				if(n->children[1]->dataType != n->children[0]->childDataType){
+					adhoc_errorNode = n->children[1];
+					sprintf(
+						errBuf
+						,"Node %d: Second parameter to 'count greater than' must match the array's type"
+						,n->children[1]->id
+					);
+				}
+				fprintf(outFile, "%s%s("
 					,n->name
+					,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
 				);
 
+			// isset hash / remove from hash - check or drop a key of a hash
+			}else if(!strcmp(n->name, "adhoc_isset_hash")
+					|| !strcmp(n->name, "adhoc_remove_from_hash")
+				){
+				if(n->children[0]->dataType != TYPE_HASH){
+					adhoc_errorNode = n->children[0];
+					sprintf(
+						errBuf
+						,"Node %d: First parameter to '%s' must be a hash"
+						,n->children[0]->id
+						,(strcmp(n->name, "adhoc_isset_hash") ? "remove from hash" : "isset hash")
+					);
+				}
+				fprintf(outFile, "%s(", n->name);
+
 			// Unrecognized library function!
 			}else{
 				adhoc_errorNode = n;
@@ -698,8 +2100,12 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 				);
 			}
 
-		// If not a library function, then make a regular call
+		// If not a library function, then make a regular call. Instrumented
+		// executables count it first
 		}else{
+			if((k = lang_c_counterOf(n)) >= 0){
+				fprintf(outFile, "(adhoc_count(adhoc_profileCounts+%d), ", 2*k);
+			}
 			fprintf(outFile, "%s(", n->name);
 		}
 
@@ -713,6 +2119,16 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 					lang_c_indent(indent+1, outFile);
 					if(i) fprintf(outFile, ",");
 				}else if(i) fprintf(outFile, ", ");
+				if(i==1 && lang_c_needleAction(n)){
+					fprintf(outFile, "&needle%d", n->children[i]->id);
+					continue;
+				}
+				if(i==1 && n->children[0]->dataType == TYPE_HASH
+						&& !strcmp(n->package, "System")
+					){
+					lang_c_generate_hashKey(n->children[i], outFile, nodes, errBuf);
+					continue;
+				}
 				lang_c_generate(
 					false
 					,n->children[i]
@@ -730,6 +2146,7 @@ void lang_c_generate_action(bool isInit, bool defin, ASTnode* n, short indent, F
 			lang_c_indent(indent, outFile);
 		}
 		fprintf(outFile, ")");
+		if(strcmp(n->package, "System") && lang_c_counterOf(n) >= 0) fprintf(outFile, ")");
 
 		// If this is the end of a statement, add a semicolon
 		if(n->childType == STATEMENT
@@ -765,9 +2182,55 @@ void lang_c_generate_group(bool isInit, ASTnode* n, short indent, FILE* outFile,
 	}
 }
 
+// Start a parallel loop's iterations on the thread pool, leaving the counter
+// where the plain loop would have
+void lang_c_generate_parallelLoop(ASTnode* n, lang_c_loopInfo* info, short indent, FILE* outFile, hashMap* nodes, char* errBuf){
+	int i;
+	ASTnode* cond = lang_c_loopPart(n, CONDITION);
+	lang_c_indent(indent, outFile);
+	lang_c_generate(false, lang_c_loopPart(n, INITIALIZATION), 0, outFile, nodes, errBuf);
+	fprintf(outFile, ";\n");
+	lang_c_indent(indent, outFile);
+	fprintf(outFile, "{\n");
+	lang_c_indent(indent+1, outFile);
+	fprintf(outFile, "adhoc_loop%d_env adhoc_env = {(", n->id);
+	lang_c_generate(false, cond->children[1], 0, outFile, nodes, errBuf);
+	fprintf(outFile, ")%s", (cond->which == OPERATOR_LESEQ ? "+1" : ""));
+	for(i=0; i<n->scope->countScopeVars; ++i){
+		if(!lang_c_isLoopCapture(n, info, n->scope->scopeVars[i])) continue;
+		fprintf(outFile, ", &%s", n->scope->scopeVars[i]->name);
+	}
+	fprintf(outFile, "};\n");
+
+	// Grow the written arrays up front so no iteration reallocates them
+	for(i=0; i<info->countArrays; ++i){
+		lang_c_indent(indent+1, outFile);
+		fprintf(outFile, "adhoc_mapRange(%s, %s, adhoc_env.adhoc_end);\n"
+			,info->arrays[i]->name
+			,info->counter->name
+		);
+	}
+	lang_c_indent(indent+1, outFile);
+	fprintf(outFile, "adhoc_parallelFor(%s, adhoc_env.adhoc_end, %d, adhoc_loop%d, &adhoc_env);\n"
+		,info->counter->name
+		,(lang_c_grain > 0 ? lang_c_grain : 0)
+		,n->id
+	);
+	lang_c_indent(indent+1, outFile);
+	fprintf(outFile, "if(adhoc_env.adhoc_end > %s) %s = adhoc_env.adhoc_end;\n"
+		,info->counter->name
+		,info->counter->name
+	);
+	lang_c_indent(indent, outFile);
+	fprintf(outFile, "}\n");
+}
+
 // Controls vary greatly
 void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFile, hashMap* nodes, char* errBuf){
-	int i;
+	int i,j,k;
+	bool hasLabel, hasBody;
+	ASTnode* cond,* c;
+	lang_c_loopInfo* info;
 	bool isComplex;
 	switch(n->which){
 	case CONTROL_IF:
@@ -791,6 +2254,7 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 		fprintf(outFile, "if(");
 
 		// Print the condition
+		k = lang_c_openCondition(n, outFile);
 		for(i=0; i<n->countChildren; ++i){
 			if(n->children[i]->childType == CONDITION){
 				lang_c_generate(
@@ -804,6 +2268,7 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 				break;
 			}
 		}
+		for(; k>0; --k) fprintf(outFile, ")");
 
 		// Close the 'if' line
 		fprintf(outFile, "){\n");
@@ -868,6 +2333,22 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 			fprintf(outFile, " %s;\n", n->scopeVars[i]->name);
 		}
 
+		// Loops with independent iterations run them on the thread pool
+		info = lang_c_analyzeLoop(n);
+		if(info->parallel){
+			lang_c_generate_parallelLoop(n, info, indent, outFile, nodes, errBuf);
+			lang_c_freeLoopInfo(info);
+			break;
+		}
+		lang_c_freeLoopInfo(info);
+
+		// Loops a profile found hot, that usually go around again, are
+		// worth unrolling
+		if(n->heat > 0 && n->expect > 0){
+			lang_c_indent(indent, outFile);
+			fprintf(outFile, "#pragma GCC unroll 4\n");
+		}
+
 		// Open for statement
 		lang_c_indent(indent, outFile);
 		fprintf(outFile, "for(");
@@ -893,6 +2374,7 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 		for(i=0; i<n->countChildren; ++i){
 			if(n->children[i]->childType == CONDITION){
 				// Generate condition
+				k = lang_c_openCondition(n, outFile);
 				lang_c_generate(
 					false
 					,n->children[i]
@@ -901,6 +2383,7 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 					,nodes
 					,errBuf
 				);
+				for(; k>0; --k) fprintf(outFile, ")");
 				break;
 			}
 		}
@@ -942,7 +2425,32 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 			break;
 		}
 
-		sprintf(errBuf, "SWITCH statements are not implemented yet :(");
+		// Strings are matched against the SWITCH's label table first, so
+		// each of their labels becomes its index in that table
+		cond = lang_c_switchCondition(n);
+		lang_c_indent(indent, outFile);
+		if(cond->dataType == TYPE_STRNG){
+			fprintf(outFile, "switch(adhoc_switchString%s(&adhoc_switch%d, "
+				,(lang_c_isHeld(cond) ? "_borrowed" : "")
+				,n->id
+			);
+			lang_c_generate(false, cond, 0, outFile, nodes, errBuf);
+			fprintf(outFile, ")){\n");
+		}else{
+			fprintf(outFile, "switch(");
+			lang_c_generate(false, cond, 0, outFile, nodes, errBuf);
+			fprintf(outFile, "){\n");
+		}
+
+		// Print each CASE's labels, then its statements
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i] == cond) continue;
+			lang_c_generate(false, n->children[i], indent, outFile, nodes, errBuf);
+		}
+
+		// Close the switch block
+		lang_c_indent(indent, outFile);
+		fprintf(outFile, "}\n");
 		break;
 
 	case CONTROL_CASE:
@@ -960,7 +2468,52 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 			break;
 		}
 
-		sprintf(errBuf, "CASE statements are not implemented yet :(");
+		// Labels on strings are numbered across the whole SWITCH
+		cond = lang_c_switchCondition(n->parent);
+		k = 0;
+		for(i=0; n->parent->children[i]!=n; ++i){
+			c = n->parent->children[i];
+			if(c == cond) continue;
+			for(j=0; j<c->countChildren; ++j){
+				if(c->children[j]->childType == CASE) ++k;
+			}
+		}
+
+		// Print the labels, or 'default' if there are none
+		hasLabel = false;
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType != CASE) continue;
+			hasLabel = true;
+			lang_c_indent(indent, outFile);
+			if(cond->dataType == TYPE_STRNG){
+				fprintf(outFile, "case %d:\n", k++);
+			}else{
+				fprintf(outFile, "case ");
+				lang_c_generate(false, n->children[i], 0, outFile, nodes, errBuf);
+				fprintf(outFile, ":\n");
+			}
+		}
+		if(!hasLabel){
+			lang_c_indent(indent, outFile);
+			fprintf(outFile, "default:\n");
+		}
+
+		// Print the statements
+		hasBody = false;
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType == CASE) continue;
+			hasBody = true;
+			lang_c_generate(false, n->children[i], indent+1, outFile, nodes, errBuf);
+		}
+
+		// A label cannot end the block, so the last CASE needs a statement
+		for(i=adhoc_getNodeIndexOfChild(n->parent, n)+1; i<n->parent->countChildren; ++i){
+			if(n->parent->children[i] != cond) break;
+		}
+		if(!hasBody && i == n->parent->countChildren){
+			lang_c_indent(indent+1, outFile);
+			fprintf(outFile, "break;\n");
+		}
 		break;
 
 	case CONTROL_FORK:
@@ -979,7 +2532,31 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 			break;
 		}
 
-		sprintf(errBuf, "FORK statements are not implemented yet :(");
+		// Run the branches as tasks on the thread pool, and wait for them
+		lang_c_indent(indent, outFile);
+		fprintf(outFile, "{\n");
+		for(i=0,j=0; i<n->scope->countScopeVars; ++i){
+			if(!lang_c_isForkCapture(n, n->scope->scopeVars[i])) continue;
+			if(!j++){
+				lang_c_indent(indent+1, outFile);
+				fprintf(outFile, "adhoc_fork%d_env adhoc_env = {", n->id);
+			}else fprintf(outFile, ", ");
+			fprintf(outFile, "&%s", n->scope->scopeVars[i]->name);
+		}
+		if(j) fprintf(outFile, "};\n");
+		lang_c_indent(indent+1, outFile);
+		fprintf(outFile, "adhoc_taskFunc adhoc_branches[] = {");
+		for(i=0; i<n->countChildren; ++i){
+			fprintf(outFile, "%sadhoc_fork%d_%d", (i ? ", " : ""), n->id, i);
+		}
+		fprintf(outFile, "};\n");
+		lang_c_indent(indent+1, outFile);
+		fprintf(outFile, "adhoc_forkJoin(%d, adhoc_branches, %s);\n"
+			,n->countChildren
+			,(j ? "&adhoc_env" : "NULL")
+		);
+		lang_c_indent(indent, outFile);
+		fprintf(outFile, "}\n");
 		break;
 
 	case CONTROL_CNTNU:
@@ -1089,6 +2666,9 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 			}
 			if(!isComplex) continue;
 
+			// Borrowed vars never took a reference of their own
+			if(n->scope->scopeVars[i]->borrowed) continue;
+
 			// Leave a note
 			if(!derefCommented){
 				fprintf(outFile, "\n");
@@ -1112,7 +2692,7 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 		// Print the actual return
 		if(retVarComplex){
 			lang_c_indent(indent, outFile);
-			fprintf(outFile, "--%s->refs;\n", n->name);
+			fprintf(outFile, "adhoc_releaseData(%s);\n", n->name);
 		}
 		lang_c_indent(indent, outFile);
 		fprintf(outFile, "return");
@@ -1139,13 +2719,14 @@ void lang_c_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFil
 // Generation rules for operators
 void lang_c_generate_operator(bool isInit, ASTnode* n, short indent, FILE* outFile, hashMap* nodes, char* errBuf){
 	int i;
-	bool isComplex, parens;
+	bool isComplex, isHash, inPlace, parens;
 	if(isInit){
 		for(i=0; i<n->countChildren; ++i){
 			lang_c_initialize(n->children[i], indent, outFile, nodes, errBuf);
 		}
 	}else{
-		parens = needsParens(n);
+		// Shifts and masks bind looser than the arithmetic they stand for
+		parens = needsParens(n) || (n->bitwise && n->parent->nodeType == OPERATOR);
 		if(n->childType == STATEMENT) lang_c_indent(indent, outFile);
 		if(parens) fprintf(outFile, "(");
 		switch(n->which){
@@ -1154,6 +2735,29 @@ void lang_c_generate_operator(bool isInit, ASTnode* n, short indent, FILE* outFi
 				lang_c_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
 				break;
 			case OPERATOR_ARIND:
+				// Struct fields are members of the struct's generated C type
+				if(n->children[0]->dataType == TYPE_STRCT){
+					if(!lang_c_isScalarField(n)
+							&& n->childType==STORAGE
+							&& n->parent->which==ASSIGNMENT_EQUAL
+						){
+						fprintf(outFile, "adhoc_setField(&");
+						lang_c_generate_field(n, outFile, nodes, errBuf);
+						fprintf(outFile, ", ");
+						lang_c_generate(
+							false
+							,n->parent->children[1]
+							,0
+							,outFile
+							,nodes
+							,errBuf
+						);
+						fprintf(outFile, ")");
+					}else{
+						lang_c_generate_field(n, outFile, nodes, errBuf);
+					}
+					break;
+				}
 				isComplex = false;
 				switch(n->children[0]->childDataType){
 				case TYPE_STRNG:
@@ -1162,18 +2766,34 @@ void lang_c_generate_operator(bool isInit, ASTnode* n, short indent, FILE* outFi
 				case TYPE_STRCT:
 					isComplex = true;
 				}
-				if(n->childType==STORAGE && n->parent->which==ASSIGNMENT_EQUAL){
-					fprintf(outFile, "adhoc_assignArrayData(%s, "
+				isHash = n->children[0]->dataType == TYPE_HASH;
+				if(n->childType==STORAGE && n->parent->which==ASSIGNMENT_EQUAL
+						&& lang_c_isTypedArray(n->children[0])
+						&& lang_c_isHeld(n->children[0])
+					){
+					fprintf(outFile, "adhoc_%sset_%s(%s, "
+						,(isHash ? "hash_" : "")
+						,adhoc_dataType_names[n->children[0]->childDataType]
 						,n->children[0]->name
 					);
+					lang_c_generate_index(n, outFile, nodes, errBuf);
+					fprintf(outFile, ", ");
 					lang_c_generate(
 						false
-						,n->children[1]
+						,n->parent->children[1]
 						,0
 						,outFile
 						,nodes
 						,errBuf
 					);
+					fprintf(outFile, ")");
+				}else if(n->childType==STORAGE && n->parent->which==ASSIGNMENT_EQUAL){
+					fprintf(outFile, "adhoc_assign%sData%s(%s, "
+						,(isHash ? "Hash" : "Array")
+						,(lang_c_isHeld(n->children[0]) ? "_borrowed" : "")
+						,n->children[0]->name
+					);
+					lang_c_generate_index(n, outFile, nodes, errBuf);
 					fprintf(outFile, ", ");
 					if(isComplex){
 						lang_c_generate(
@@ -1198,14 +2818,39 @@ void lang_c_generate_operator(bool isInit, ASTnode* n, short indent, FILE* outFi
 					}
 					fprintf(outFile, ")");
 				}else{
-					if(!isComplex){
-						fprintf(outFile, "*(");
-						lang_c_printTypeName(n, outFile);
-						fprintf(outFile, "*)");
+					// Other stores update the item in place, through a pointer
+					inPlace = lang_c_isTypedArray(n->children[0])
+						&& n->childType==STORAGE;
+					if(inPlace){
+						fprintf(outFile, "(*adhoc_%sref_%s("
+							,(isHash ? "hash_" : "")
+							,adhoc_dataType_names[n->children[0]->childDataType]
+						);
+					}else if(lang_c_isTypedArray(n->children[0])){
+						fprintf(outFile, "adhoc_%sget_%s("
+							,(isHash ? "hash_" : "")
+							,adhoc_dataType_names[n->children[0]->childDataType]
+						);
+					}else if(isHash){
+						if(!isComplex){
+							adhoc_errorNode = n;
+							sprintf(
+								errBuf
+								,"Node %d: Hash items must all share one type"
+								,n->id
+							);
+						}
+						fprintf(outFile, "adhoc_getCHashData(");
+					}else{
+						if(!isComplex){
+							fprintf(outFile, "*(");
+							lang_c_printTypeName(n, outFile);
+							fprintf(outFile, "*)");
+						}
+						fprintf(outFile, "adhoc_get%sArrayData("
+							,(isComplex ? "C" : "S")
+						);
 					}
-					fprintf(outFile, "adhoc_get%sArrayData("
-						,(isComplex ? "C" : "S")
-					);
 					lang_c_generate(
 						false
 						,n->children[0]
@@ -1215,15 +2860,8 @@ void lang_c_generate_operator(bool isInit, ASTnode* n, short indent, FILE* outFi
 						,errBuf
 					);
 					fprintf(outFile, ", ");
-					lang_c_generate(
-						false
-						,n->children[1]
-						,0
-						,outFile
-						,nodes
-						,errBuf
-					);
-					fprintf(outFile, ")");
+					lang_c_generate_index(n, outFile, nodes, errBuf);
+					fprintf(outFile, (inPlace ? "))" : ")"));
 				}
 				break;
 			case OPERATOR_PLUS:
@@ -1232,16 +2870,19 @@ void lang_c_generate_operator(bool isInit, ASTnode* n, short indent, FILE* outFi
 			case OPERATOR_DIVBY:
 			case OPERATOR_MOD:
 				lang_c_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
+				if(n->bitwise){
+					lang_c_generate_bitwise(n, outFile);
+					break;
+				}
 				fprintf(outFile, " %s ", adhoc_nodeWhich_names[n->which]);
 				lang_c_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
 				break;
-			case OPERATOR_EXP: // TODO
-				adhoc_errorNode = n;
-				sprintf(
-					errBuf
-					,"%s"
-					,"Exponentiation is not currently implemented for C"
-				);
+			case OPERATOR_EXP:
+				fprintf(outFile, "%s(", lang_c_powerAction(n, errBuf));
+				lang_c_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, ", ");
+				lang_c_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, ")");
 				break;
 			case OPERATOR_OR:
 			case OPERATOR_AND:
@@ -1307,7 +2948,9 @@ void lang_c_generate_assignment(bool isInit, ASTnode* n, short indent, FILE* out
 				break;
 			case ASSIGNMENT_EQUAL:
 				lang_c_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
-				if(n->children[0]->which == OPERATOR_ARIND) break;
+				if(n->children[0]->which == OPERATOR_ARIND
+						&& !lang_c_isScalarField(n->children[0])
+					) break;
 				fprintf(outFile, " %s ", adhoc_nodeWhich_names[n->which]);
 				isComplex = false;
 				switch(n->children[1]->dataType){
@@ -1317,6 +2960,7 @@ void lang_c_generate_assignment(bool isInit, ASTnode* n, short indent, FILE* out
 				case TYPE_STRCT:
 					isComplex = true;
 				}
+				if(isComplex && lang_c_isBorrowedStore(n->children[0])) isComplex = false;
 				if(isComplex) fprintf(outFile, "adhoc_referenceData(");
 				lang_c_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
 				if(isComplex) fprintf(outFile, ")");
@@ -1326,13 +2970,27 @@ void lang_c_generate_assignment(bool isInit, ASTnode* n, short indent, FILE* out
 			case ASSIGNMENT_TIMES:
 			case ASSIGNMENT_DIVBY:
 			case ASSIGNMENT_MOD:
-			case ASSIGNMENT_EXP:
 			case ASSIGNMENT_OR:
 			case ASSIGNMENT_AND:
 				lang_c_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
+				if(n->bitwise){
+					lang_c_generate_bitwise(n, outFile);
+					break;
+				}
 				fprintf(outFile, " %s ", adhoc_nodeWhich_names[n->which]);
 				lang_c_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
 				break;
+			// The optimizer makes powers stored to variables plain assignments,
+			// which leaves powers stored to items. These are raised through a
+			// pointer, so the item's index is only worked out once
+			case ASSIGNMENT_EXP:
+				if(!*lang_c_powerAction(n, errBuf)) break;
+				fprintf(outFile, "adhoc_%spowAt(&", (n->dataType == TYPE_INT ? "i" : ""));
+				lang_c_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, ", ");
+				lang_c_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, ")");
+				break;
 			case ASSIGNMENT_NEGPR:
 			case ASSIGNMENT_NEGPS:
 				sprintf(
@@ -1446,7 +3104,10 @@ void lang_c_generate_literal(bool isInit, ASTnode* n, short indent, FILE* outFil
 				fprintf(outFile, "%s", n->value);
 				break;
 			case LITERAL_STRNG:
-				fprintf(outFile, "adhoc_createString(\"%s\")", n->value);
+				fprintf(outFile, "%s(\"%s\")"
+					,(n->local ? "ADHOC_LOCAL_STRING" : "adhoc_createString")
+					,n->value
+				);
 				break;
 			case LITERAL_ARRAY:
 			case LITERAL_HASH:
@@ -1474,9 +3135,38 @@ void lang_c_initialize(ASTnode* n, short indent, FILE* outFile, hashMap* nodes,
 // Function to generate code from an AST node
 void lang_c_generate(bool defin, ASTnode* n, short indent, FILE* outFile, hashMap* nodes, char* errBuf){
 	int i,j;
-	bool isComplex;
+	bool isComplex, isHash;
+	// Statements and action definitions start lines of their own
+	if(defin && n->nodeType == ACTION) lang_c_markLine(n->id, outFile);
+	else if(indent > 0 && (n->childType == STATEMENT || n->childType == IF || n->childType == ELSE)){
+		lang_c_markLine(n->id, outFile);
+		lang_c_markSite(n, indent, outFile);
+	}
 	for(i=0; i<n->countCmplxVals; ++i){
+		isHash = n->cmplxVals[i]->which == LITERAL_HASH;
 		for(j=0; j<n->cmplxVals[i]->countChildren; ++j){
+			// Struct fields are set directly on the generated C struct
+			if(n->cmplxVals[i]->which == LITERAL_STRCT){
+				isComplex = lang_c_isComplex(n->cmplxVals[i]->children[j]->children[0]->dataType);
+				lang_c_indent(indent, outFile);
+				if(isComplex) fprintf(outFile, "adhoc_setField(&");
+				fprintf(outFile, "ADHOC_FIELD(adhoc_struct%d, %s, "
+					,n->cmplxVals[i]->layout->id
+					,n->cmplxVals[i]->name
+				);
+				lang_c_printFieldName(n->cmplxVals[i]->children[j]->value, outFile);
+				fprintf(outFile, ")%s", (isComplex ? ", " : " = "));
+				lang_c_generate(
+					false
+					,n->cmplxVals[i]->children[j]->children[0]
+					,0
+					,outFile
+					,nodes
+					,errBuf
+				);
+				fprintf(outFile, "%s;\n", (isComplex ? ")" : ""));
+				continue;
+			}
 			isComplex = false;
 			switch(n->cmplxVals[i]->children[j]->children[0]->dataType){
 			case TYPE_STRNG:
@@ -1486,11 +3176,25 @@ void lang_c_generate(bool defin, ASTnode* n, short indent, FILE* outFile, hashMa
 				isComplex = true;
 			}
 			lang_c_indent(indent, outFile);
-			fprintf(outFile, "adhoc_assignArrayData(%s, %d, "
-				,n->cmplxVals[i]->name
-				,atoi(n->cmplxVals[i]->children[j]->value)
-			);
-			if(!isComplex) fprintf(outFile, "NULL, ");
+			if(lang_c_isTypedArray(n->cmplxVals[i])){
+				fprintf(outFile, "adhoc_%sset_%s(%s, "
+					,(isHash ? "hash_" : "")
+					,adhoc_dataType_names[n->cmplxVals[i]->childDataType]
+					,n->cmplxVals[i]->name
+				);
+			}else{
+				fprintf(outFile, "adhoc_assign%sData_borrowed(%s, "
+					,(isHash ? "Hash" : "Array")
+					,n->cmplxVals[i]->name
+				);
+			}
+			if(isHash){
+				lang_c_generate_hashKey(n->cmplxVals[i]->children[j], outFile, nodes, errBuf);
+			}else{
+				fprintf(outFile, "%d", atoi(n->cmplxVals[i]->children[j]->value));
+			}
+			fprintf(outFile, ", ");
+			if(!isComplex && !lang_c_isTypedArray(n->cmplxVals[i])) fprintf(outFile, "NULL, ");
 			lang_c_generate(
 				false
 				,n->cmplxVals[i]->children[j]->children[0]
@@ -1522,14 +3226,30 @@ void lang_c_init(ASTnode* n, FILE* outFile, hashMap* nodes, bool exec, char* err
 	sizeFuncs = 2;
 	functions = realloc(functions, sizeFuncs * sizeof(ASTnode*));
 	if(exec){
-		fprintf(outFile, "#include <stdlib.h>\n#include <stdbool.h>\n#include <string.h>\n#include <libadhoc.h>\n");
+		fprintf(outFile, "#include <stdlib.h>\n#include <stddef.h>\n#include <stdbool.h>\n#include <string.h>\n#include <math.h>\n#include <libadhoc.h>\n");
 	}
 	lang_c_initialize(n, 0, outFile, nodes, errBuf);
+	if(strlen(errBuf)) return;
+
+	// Find which complex values can borrow a reference instead of taking one
+	lang_c_nodeMap = nodes;
+	adhoc_treeWalk(lang_c_markOwnership, n, 0, errBuf);
+	adhoc_treeWalk(lang_c_clearOwnership, n, 0, errBuf);
+
+	// Find which literals can live in the stack frame of their action
+	adhoc_treeWalk(lang_c_markLocals, n, 0, errBuf);
+
+	// Number the nodes an instrumented executable counts
+	if(lang_c_instrument){
+		lang_c_countCounted = 0;
+		lang_c_counters = calloc(lang_c_maxId(nodes)+1, sizeof(int));
+		lang_c_numberCounters(n);
+	}
 }
 // Hook function for generalized code generation
 void lang_c_gen(ASTnode* n, FILE* outFile, hashMap* nodes, bool exec, char* errBuf){
 	int i;
-	bool isComplex;
+	bool isComplex, hasNeedles = false;
 	if(exec){
 		// Print definitions for global vars
 		if(n->countChildren && n->children[0]->childType == PARAMETER){
@@ -1541,6 +3261,21 @@ void lang_c_gen(ASTnode* n, FILE* outFile, hashMap* nodes, bool exec, char* errB
 			}
 		}
 	}
+	// Instrumented executables declare their counters before anything counts
+	if(lang_c_counters) lang_c_declareCounters(outFile);
+	// Lay out the struct types before any action uses them
+	lang_c_declareStructs(n, outFile);
+	// Parallel loops and fork branches become task functions of their own
+	lang_c_declareLoops(n, outFile, nodes, errBuf);
+	if(!strlen(errBuf)) lang_c_declareForks(n, outFile, nodes, errBuf);
+	if(strlen(errBuf)){
+		free(functions);
+		return;
+	}
+	// Hoist literal search targets out of every action and loop
+	lang_c_declareNeedles(n, outFile, &hasNeedles);
+	// String SWITCHes each get a table of their labels
+	lang_c_declareSwitches(n, outFile);
 	for(i=0; i<countFuncs; ++i){
 		lang_c_generate(true, functions[i], 0, outFile, nodes, errBuf);
 	}
@@ -1556,8 +3291,17 @@ void lang_c_gen(ASTnode* n, FILE* outFile, hashMap* nodes, bool exec, char* errB
 		}
 
 		// To make an executable, we need som boilerplate
+		lang_c_markLine(n->id, outFile);
 		fprintf(outFile, "\n// Main function for execution\n");
 		fprintf(outFile, "int main(int argc, char **argv){\n");
+		if(lang_c_counters){
+			lang_c_indent(1, outFile);
+			fprintf(outFile, "adhoc_profileAtExit(adhoc_profileCounts, adhoc_profileIds, adhoc_profileKinds, %d);\n", lang_c_countCounted);
+		}
+		if(lang_c_threads > 0){
+			lang_c_indent(1, outFile);
+			fprintf(outFile, "adhoc_setThreadCount(%d);\n", lang_c_threads);
+		}
 		lang_c_indent(1, outFile);
 		if(isComplex) fprintf(outFile, "adhoc_unreferenceData(");
 		fprintf(outFile, "%s()", n->name);
@@ -1568,6 +3312,77 @@ void lang_c_gen(ASTnode* n, FILE* outFile, hashMap* nodes, bool exec, char* errB
 		fprintf(outFile, "}\n");
 	}
 	free(functions);
+	free(lang_c_counted);
+	free(lang_c_counters);
+	lang_c_counted = NULL;
+	lang_c_counters = NULL;
+	lang_c_sizeCounted = 0;
+}
+
+// Add a range of generated lines, all under one node, to a source map
+void lang_c_mapRange(FILE* mapFile, hashMap* nodes, int id, int from, int to, bool* more){
+	ASTnode* n = (ASTnode*) hashMap_retrieve(nodes, id);
+	if(!n || !from) return;
+	fprintf(mapFile, "%s\n\t\t{\"from\": %d, \"to\": %d, \"id\": %d, \"kind\": \"%s\", \"package\": "
+		,(*more ? "," : "")
+		,from
+		,to
+		,id
+		,adhoc_nodeWhich_names[n->which]
+	);
+	lang_c_printQuoted(n->package, mapFile);
+	fprintf(mapFile, ", \"name\": ");
+	lang_c_printQuoted(n->name, mapFile);
+	fprintf(mapFile, "}");
+	*more = true;
+}
+
+// Copy generated code to where it is going, and write a JSON map from the
+// lines it lands on to the nodes named by its #line directives. A directive
+// only names the line after it, so every further line of code under one
+// gets a directive of its own, and debuggers and profilers see a node's id
+// on each of its lines rather than the id plus an offset
+void lang_c_writeSourceMap(FILE* code, FILE* outFile, FILE* mapFile, hashMap* nodes){
+	int c, i, len, size = 128, line = 1, id = -1, from = 0, to = 0;
+	bool first = false, more = false;
+	char* buf = malloc(size);
+	fprintf(mapFile, "{\n\t\"source\": ");
+	lang_c_printQuoted(lang_c_source, mapFile);
+	fprintf(mapFile, ",\n\t\"ranges\": [");
+	for(;;){
+		// Read in a whole line, to see what it holds before copying it
+		for(len=0; (c = getc(code)) != EOF && c != '\n'; buf[len++] = c){
+			if(len+1 >= size) buf = realloc(buf, size *= 2);
+		}
+		if(c == EOF && !len) break;
+		buf[len] = '\0';
+		for(i=0; isspace(buf[i]); ++i);
+
+		// Directives start a new range when they name a different node
+		if(!strncmp(buf, "#line ", 6)){
+			if(atoi(buf+6) != id){
+				lang_c_mapRange(mapFile, nodes, id, from, to, &more);
+				id = atoi(buf+6);
+				from = 0;
+			}
+			first = true;
+
+		// Lines of code extend the range, blank lines and comments don't
+		}else if(id >= 0 && buf[i] && strncmp(buf+i, "//", 2)){
+			if(!first){
+				lang_c_markLine(id, outFile);
+				++line;
+			}
+			first = false;
+			if(!from) from = line;
+			to = line;
+		}
+		fprintf(outFile, "%s\n", buf);
+		++line;
+	}
+	lang_c_mapRange(mapFile, nodes, id, from, to, &more);
+	fprintf(mapFile, "\n\t]\n}\n");
+	free(buf);
 }
 
 #pragma clang diagnostic pop
@@ -0,0 +1,337 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hashmap.h"
+#include "adhoc_types.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+
+
+//-------------------//
+//    Logic Files    //
+//-------------------//
+// A version 1 logic file is a run of node records: eight 3-byte fields (id,
+// parent id, reference id, node type, which, child type, data type, child
+// data type) then three quoted strings (package, name, value), with "NULL"
+// for an empty string. The grammar parses these.
+//
+// A version 2 logic file starts with the magic bytes and a version number,
+// then gives each distinct string once, then the nodes with their parents
+// ahead of their children:
+//
+//	magic		0xAD 'A' 'D' 'H'
+//	version		varint
+//	strings		varint count, then each as a varint length and its bytes
+//	nodes		varint count, then each as:
+//		id, parent id, reference id		varints
+//		node type << 4 | child type		1 byte
+//		has children << 7 | which		1 byte
+//		data type << 4 | child data type	1 byte
+//		package, name, value			varint indexes into the strings
+//		count of children			varint, if it has children
+//
+// Varints give 7 bits to a byte, lowest first, with the high bit set on all
+// but the last. String index 0 is the empty string, so stored strings count
+// from 1. Strings are kept as the grammar reads them, escapes and all.
+
+// The bytes a version 2 logic file starts with. A version 1 file starts with
+// the id of its first node, which would need to be over 11 million for it to
+// start the same way
+const unsigned char fmt_magic[] = {0xAD, 'A', 'D', 'H'};
+#define FMT_VERSION 2
+
+// The longest string the version 1 lexer can hold
+#define FMT_V1_STRING 1023
+
+// A table of distinct strings, numbered from 1 in the order first seen, and
+// an open-addressed index of them
+typedef struct fmt_strings {
+	const char** strs;
+	int countStrs;
+	int sizeStrs;
+	int* slots;
+	int sizeSlots;
+} fmt_strings;
+
+// Find the slot a string is in, or would go in
+int fmt_slot(fmt_strings* t, const char* s){
+	int i = hashMap_hashString((void*) s) & (t->sizeSlots-1);
+	while(t->slots[i] && strcmp(t->strs[t->slots[i]], s)) i = (i+1) & (t->sizeSlots-1);
+	return i;
+}
+
+// Number a string, adding it to the table if it is new
+int fmt_addString(fmt_strings* t, const char* s){
+	if(!s || !*s) return 0;
+	int i = fmt_slot(t, s);
+	if(t->slots[i]) return t->slots[i];
+
+	// Keep the index at most half full
+	if(2*(t->countStrs+1) >= t->sizeSlots){
+		int j;
+		free(t->slots);
+		t->sizeSlots *= 2;
+		t->slots = calloc(t->sizeSlots, sizeof(int));
+		for(j=1; j<=t->countStrs; ++j) t->slots[fmt_slot(t, t->strs[j])] = j;
+		i = fmt_slot(t, s);
+	}
+	if(t->countStrs+1 == t->sizeStrs){
+		t->sizeStrs *= 2;
+		t->strs = realloc(t->strs, t->sizeStrs*sizeof(char*));
+	}
+	t->strs[++t->countStrs] = s;
+	t->slots[i] = t->countStrs;
+	return t->countStrs;
+}
+
+// Write an unsigned varint
+void fmt_putVarint(unsigned int v, FILE* out){
+	while(v >= 0x80){
+		fputc((v & 0x7F) | 0x80, out);
+		v >>= 7;
+	}
+	fputc(v, out);
+}
+
+// Read an unsigned varint. Returns false at the end of the file
+bool fmt_getVarint(unsigned int* v, FILE* in){
+	int c, shift = 0;
+	*v = 0;
+	do{
+		if((c = getc(in)) == EOF || shift > 28) return false;
+		*v |= (unsigned int)(c & 0x7F) << shift;
+		shift += 7;
+	}while(c & 0x80);
+	return true;
+}
+
+// Number a node's strings, and count it and the nodes below it
+int fmt_collect(ASTnode* n, fmt_strings* t){
+	int i, ret = 1;
+	fmt_addString(t, n->package);
+	fmt_addString(t, n->name);
+	fmt_addString(t, n->value);
+	for(i=0; i<n->countChildren; ++i) ret += fmt_collect(n->children[i], t);
+	return ret;
+}
+
+// Write a node and the nodes below it in version 2
+void fmt_writeNode(ASTnode* n, fmt_strings* t, FILE* out, char* errBuf){
+	int i;
+	if(n->nodeType > 15 || n->childType > 15 || n->which > 127
+			|| n->dataType > 15 || n->childDataType > 15){
+		sprintf(errBuf, "Node %d has a type a version 2 logic file can not hold", n->id);
+		return;
+	}
+	fmt_putVarint(n->id, out);
+	fmt_putVarint(n->parentId, out);
+	fmt_putVarint(n->refId, out);
+	fputc(n->nodeType << 4 | n->childType, out);
+	fputc((n->countChildren ? 0x80 : 0) | n->which, out);
+	fputc(n->dataType << 4 | n->childDataType, out);
+	fmt_putVarint(fmt_addString(t, n->package), out);
+	fmt_putVarint(fmt_addString(t, n->name), out);
+	fmt_putVarint(fmt_addString(t, n->value), out);
+	if(n->countChildren) fmt_putVarint(n->countChildren, out);
+	for(i=0; i<n->countChildren; ++i){
+		fmt_writeNode(n->children[i], t, out, errBuf);
+		if(strlen(errBuf)) return;
+	}
+}
+
+// Write a tree as a version 2 logic file
+void fmt_writeV2(ASTnode* root, FILE* out, char* errBuf){
+	int i, countNodes = 0;
+	fmt_strings t;
+	t.sizeStrs = 64;
+	t.strs = malloc(t.sizeStrs*sizeof(char*));
+	t.countStrs = 0;
+	t.sizeSlots = 128;
+	t.slots = calloc(t.sizeSlots, sizeof(int));
+	if(root) countNodes = fmt_collect(root, &t);
+
+	// Header and string table
+	fwrite(fmt_magic, 1, sizeof(fmt_magic), out);
+	fmt_putVarint(FMT_VERSION, out);
+	fmt_putVarint(t.countStrs, out);
+	for(i=1; i<=t.countStrs; ++i){
+		fmt_putVarint(strlen(t.strs[i]), out);
+		fputs(t.strs[i], out);
+	}
+
+	// Nodes
+	fmt_putVarint(countNodes, out);
+	if(root) fmt_writeNode(root, &t, out, errBuf);
+	free(t.strs);
+	free(t.slots);
+}
+
+// Write one 3-byte field of a version 1 record
+bool fmt_putField(int v, FILE* out){
+	if(v < 0 || v > 0xFFFFFF || (v >> 16) == '"') return false;
+	fputc(v >> 16, out);
+	fputc((v >> 8) & 0xFF, out);
+	fputc(v & 0xFF, out);
+	return true;
+}
+
+// Write one quoted string of a version 1 record
+bool fmt_putString(const char* s, FILE* out){
+	if(!s || !*s) s = "NULL";
+	if(strlen(s) > FMT_V1_STRING) return false;
+	fprintf(out, "\"%s\"", s);
+	return true;
+}
+
+// Write a tree as a version 1 logic file
+void fmt_writeV1(ASTnode* n, FILE* out, char* errBuf){
+	int i;
+	if(!n) return;
+	if(!fmt_putField(n->id, out)
+			|| !fmt_putField(n->parentId, out)
+			|| !fmt_putField(n->refId, out)
+			|| !fmt_putField(n->nodeType, out)
+			|| !fmt_putField(n->which, out)
+			|| !fmt_putField(n->childType, out)
+			|| !fmt_putField(n->dataType, out)
+			|| !fmt_putField(n->childDataType, out)
+			|| !fmt_putString(n->package, out)
+			|| !fmt_putString(n->name, out)
+			|| !fmt_putString(n->value, out)
+		){
+		sprintf(errBuf, "Node %d does not fit in a version 1 logic file", n->id);
+		return;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		fmt_writeV1(n->children[i], out, errBuf);
+		if(strlen(errBuf)) return;
+	}
+}
+
+// Check which version of logic file is being read, reading past the magic
+// bytes of a version 2 file. Returns 0 if the file is not one ADHOC reads
+int fmt_version(FILE* in, char* errBuf){
+	unsigned int i, version;
+	int c = getc(in);
+	if(c != fmt_magic[0]){
+		ungetc(c, in);
+		return 1;
+	}
+	for(i=1; i<sizeof(fmt_magic); ++i){
+		if(getc(in) != fmt_magic[i]){
+			sprintf(errBuf, "Input is not a logic file");
+			return 0;
+		}
+	}
+	if(!fmt_getVarint(&version, in) || version < 2 || version > FMT_VERSION){
+		sprintf(errBuf, "Logic file version %u is not one this ADHOC reads", version);
+		return 0;
+	}
+	return version;
+}
+
+// Copy a string from the table for a node to own
+char* fmt_string(char** strs, unsigned int count, FILE* in, char* errBuf){
+	unsigned int i;
+	char* ret;
+	if(!fmt_getVarint(&i, in)){
+		sprintf(errBuf, "Logic file ends partway through a node");
+		return NULL;
+	}
+	if(i > count){
+		sprintf(errBuf, "Logic file names string %u of only %u", i, count);
+		return NULL;
+	}
+	ret = malloc(strlen(strs[i])+1);
+	strcpy(ret, strs[i]);
+	return ret;
+}
+
+// Read the rest of a version 2 logic file, handing each node to insert as it
+// is read. Nodes with children have their children arrays sized up front
+void fmt_read(FILE* in, void (*insert)(ASTnode*), char* errBuf){
+	unsigned int i, countStrs, countNodes, len, v[3];
+	char** strs = NULL;
+	ASTnode* n;
+	int types, which, dataTypes;
+
+	// Load the string table
+	if(!fmt_getVarint(&countStrs, in)){
+		sprintf(errBuf, "Logic file ends before its strings");
+		return;
+	}
+	strs = calloc(countStrs+1, sizeof(char*));
+	strs[0] = "";
+	for(i=1; i<=countStrs; ++i){
+		if(!fmt_getVarint(&len, in)
+				|| !(strs[i] = malloc(len+1))
+				|| fread(strs[i], 1, len, in) != len
+			){
+			sprintf(errBuf, "Logic file ends partway through its strings");
+			countStrs = i;
+			goto done;
+		}
+		strs[i][len] = '\0';
+	}
+
+	// Read each node
+	if(!fmt_getVarint(&countNodes, in)){
+		sprintf(errBuf, "Logic file ends before its nodes");
+		goto done;
+	}
+	for(; countNodes; --countNodes){
+		if(!fmt_getVarint(&v[0], in)
+				|| !fmt_getVarint(&v[1], in)
+				|| !fmt_getVarint(&v[2], in)
+			){
+			sprintf(errBuf, "Logic file ends partway through a node");
+			goto done;
+		}
+		n = adhoc_createBlankNode();
+		n->id = v[0];
+		n->parentId = v[1];
+		n->refId = v[2];
+		types = getc(in);
+		which = getc(in);
+		dataTypes = getc(in);
+		if(types == EOF || which == EOF || dataTypes == EOF){
+			sprintf(errBuf, "Logic file ends partway through a node");
+			adhoc_destroyNode(n);
+			goto done;
+		}
+		n->nodeType = types >> 4;
+		n->childType = types & 0x0F;
+		n->which = which & 0x7F;
+		n->dataType = dataTypes >> 4;
+		n->childDataType = dataTypes & 0x0F;
+		if(!(n->package = fmt_string(strs, countStrs, in, errBuf))
+				|| !(n->name = fmt_string(strs, countStrs, in, errBuf))
+				|| !(n->value = fmt_string(strs, countStrs, in, errBuf))
+			){
+			adhoc_destroyNode(n);
+			goto done;
+		}
+		if(which & 0x80){
+			if(!fmt_getVarint(&len, in) || len > 0xFFFF){
+				sprintf(errBuf, "Logic file gives node %d a bad count of children", n->id);
+				adhoc_destroyNode(n);
+				goto done;
+			}
+			if(len){
+				n->sizeChildren = len;
+				n->children = malloc(len*sizeof(ASTnode*));
+			}
+		}
+		insert(n);
+	}
+
+done:
+	for(i=1; i<=countStrs; ++i) free(strs[i]);
+	free(strs);
+}
+
+#pragma clang diagnostic pop
+#endif
@@ -225,6 +225,7 @@ void lang_javascript_generate_group(bool isInit, ASTnode* n, short indent, FILE*
 // Controls vary greatly
 void lang_javascript_generate_control(bool isInit, ASTnode* n, short indent, FILE* outFile, hashMap* nodes, char* errBuf){
 	int i;
+	bool isDefault;
 	switch(n->which){
 	case CONTROL_IF:
 		// Nothing to do on initialization
@@ -337,7 +338,26 @@ void lang_javascript_generate_control(bool isInit, ASTnode* n, short indent, FIL
 			break;
 		}
 
-		sprintf(errBuf, "SWITCH statements are not implemented yet :(");
+		// Print the opening of the 'switch' block
+		lang_javascript_indent(indent, outFile);
+		fprintf(outFile, "switch(");
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType == CONDITION){
+				lang_javascript_generate(false, n->children[i], -1, outFile, nodes, errBuf);
+				break;
+			}
+		}
+		fprintf(outFile, "){\n");
+
+		// Print each CASE's labels, then its statements
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType == CONDITION) continue;
+			lang_javascript_generate(false, n->children[i], indent, outFile, nodes, errBuf);
+		}
+
+		// Close the 'switch' block
+		lang_javascript_indent(indent, outFile);
+		fprintf(outFile, "}\n");
 		break;
 
 	case CONTROL_CASE:
@@ -349,7 +369,26 @@ void lang_javascript_generate_control(bool isInit, ASTnode* n, short indent, FIL
 			break;
 		}
 
-		sprintf(errBuf, "CASE statements are not implemented yet :(");
+		// Print the labels, or 'default' if there are none
+		isDefault = true;
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType != CASE) continue;
+			lang_javascript_indent(indent, outFile);
+			fprintf(outFile, "case ");
+			lang_javascript_generate(false, n->children[i], -1, outFile, nodes, errBuf);
+			fprintf(outFile, ":\n");
+			isDefault = false;
+		}
+		if(isDefault){
+			lang_javascript_indent(indent, outFile);
+			fprintf(outFile, "default:\n");
+		}
+
+		// Print the statements
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->childType == CASE) continue;
+			lang_javascript_generate(false, n->children[i], indent+1, outFile, nodes, errBuf);
+		}
 		break;
 
 	case CONTROL_FORK:
@@ -447,7 +486,6 @@ void lang_javascript_generate_operator(bool isInit, ASTnode* n, short indent, FI
 			case OPERATOR_TIMES:
 			case OPERATOR_DIVBY:
 			case OPERATOR_MOD:
-			case OPERATOR_EXP:
 			case OPERATOR_OR:
 			case OPERATOR_AND:
 			case OPERATOR_EQUIV:
@@ -460,6 +498,13 @@ void lang_javascript_generate_operator(bool isInit, ASTnode* n, short indent, FI
 				fprintf(outFile, " %s ", adhoc_nodeWhich_names[n->which]);
 				lang_javascript_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
 				break;
+			case OPERATOR_EXP:
+				fprintf(outFile, "Math.pow(");
+				lang_javascript_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, ", ");
+				lang_javascript_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, ")");
+				break;
 			case OPERATOR_TRNIF:
 				lang_javascript_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
 				fprintf(outFile, " ? ");
@@ -526,13 +571,32 @@ void lang_javascript_generate_assignment(bool isInit, ASTnode* n, short indent,
 			case ASSIGNMENT_TIMES:
 			case ASSIGNMENT_DIVBY:
 			case ASSIGNMENT_MOD:
-			case ASSIGNMENT_EXP:
 			case ASSIGNMENT_OR:
 			case ASSIGNMENT_AND:
 				lang_javascript_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
 				fprintf(outFile, " %s ", adhoc_nodeWhich_names[n->which]);
 				lang_javascript_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
 				break;
+			// An item raised to a power is raised by a function given its
+			// container and index, so each is only worked out once
+			case ASSIGNMENT_EXP:
+				if(n->children[0]->which == OPERATOR_ARIND){
+					fprintf(outFile, "(function(o, k, e){ return o[k] = Math.pow(o[k], e); })(");
+					lang_javascript_generate(false, n->children[0]->children[0], indent+1, outFile, nodes, errBuf);
+					fprintf(outFile, ", ");
+					lang_javascript_generate(false, n->children[0]->children[1], indent+1, outFile, nodes, errBuf);
+					fprintf(outFile, ", ");
+					lang_javascript_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
+					fprintf(outFile, ")");
+					break;
+				}
+				lang_javascript_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, " = Math.pow(");
+				lang_javascript_generate(false, n->children[0], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, ", ");
+				lang_javascript_generate(false, n->children[1], indent+1, outFile, nodes, errBuf);
+				fprintf(outFile, ")");
+				break;
 			case ASSIGNMENT_NEGPR:
 			case ASSIGNMENT_NEGPS:
 				sprintf(
@@ -3,31 +3,71 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
-#include "hashmap.h"
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
 #include "libadhoc.h"
-
-const ushort DATA_MAP_BIT_FIELD_SIZE = 8;
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <x86intrin.h>
+#define ADHOC_X86_KERNELS
+#endif
+
+// Libraries built with ADHOC_HEAP_PROFILE charge the heap each data struct
+// uses to the node that made or last grew it (see Heap Profiles)
+#ifdef ADHOC_HEAP_PROFILE
+static void adhoc_heapTrack(adhoc_data* d);
+static void adhoc_heapForget(adhoc_data* d);
+#define ADHOC_HEAP_TRACK(d) adhoc_heapTrack(d)
+#define ADHOC_HEAP_FORGET(d) adhoc_heapForget(d)
+#else
+#define ADHOC_HEAP_TRACK(d) ((void)0)
+#define ADHOC_HEAP_FORGET(d) ((void)0)
+#endif
 
 
 //-----------------------//
 //    Data Allocation    //
 //-----------------------//
 
-// Create a referenced data struct
-adhoc_data* adhoc_createData(adhoc_dataType t, void* d, adhoc_dataType c, int n){
-	adhoc_data* ret = malloc(sizeof(adhoc_data));
+// Fill in a data struct with no references yet, all of it on the heap
+static void adhoc_initData(adhoc_data* ret, adhoc_dataType t, void* d, adhoc_dataType c, int n){
 	ret->refs = 0;
 	ret->type = t;
 	ret->data = d;
 	ret->dataType = c;
 	ret->countData = 0;
 	ret->sizeData = n;
+	ret->capacityData = n;
+	ret->mappedData = NULL;
+	ret->local = 0;
+}
+
+// Get the size of each item in an array of a type
+static short adhoc_arrayItemSize(adhoc_dataType t){
+	switch(t){
+	case DATA_BOOL: return sizeof(bool);
+	case DATA_INT: return sizeof(int);
+	case DATA_FLOAT: return sizeof(float);
+	default:
+		return sizeof(adhoc_data*);
+	}
+}
+
+// Create a referenced data struct
+adhoc_data* adhoc_createData(adhoc_dataType t, void* d, adhoc_dataType c, int n){
+	adhoc_data* ret = malloc(sizeof(adhoc_data));
+	adhoc_initData(ret, t, d, c, n);
 	if(t == DATA_ARRAY){
 		int size = (n-1)/DATA_MAP_BIT_FIELD_SIZE+1;
 		ret->mappedData = calloc(size, sizeof(void*));
-	}else{
-		ret->mappedData = NULL;
 	}
+	// Hashes and structs are charged once they are filled in
+	if(t != DATA_HASH && t != DATA_STRUCT) ADHOC_HEAP_TRACK(ret);
 	return ret;
 }
 
@@ -43,57 +83,134 @@ adhoc_data* adhoc_createString(char* s){
 
 // Create a new array and return its reference
 adhoc_data* adhoc_createArray(adhoc_dataType t, int n){
-	short s;
-	switch(t){
-	case DATA_BOOL: s = sizeof(bool); break;
-	case DATA_INT: s = sizeof(int); break;
-	case DATA_FLOAT: s = sizeof(float); break;
-	default:
-		s = sizeof(adhoc_data*);
-	}
 	return adhoc_createData(
 		DATA_ARRAY
-		,calloc(n, s)
+		,calloc(n, adhoc_arrayItemSize(t))
 		,t
 		,n
 	);
 }
 
+// Create a new struct with zeroed fields and return its reference
+adhoc_data* adhoc_createStruct(const adhoc_structLayout* layout){
+	adhoc_data* ret = adhoc_createData(
+		DATA_STRUCT
+		,calloc(1, layout->size)
+		,DATA_VOID
+		,layout->countFields
+	);
+	ADHOC_STRUCT_LAYOUT(ret) = layout;
+	ADHOC_HEAP_TRACK(ret);
+	return ret;
+}
+
+// Set up an array in a caller's stack frame, held by that frame. Its items
+// and map may be zeroed stack storage too, or NULL to put them on the heap
+adhoc_data* adhoc_localArray(adhoc_data* d, adhoc_dataType t, int n, void* items, char* map){
+	adhoc_initData(d, DATA_ARRAY, items, t, n);
+	d->refs = 1;
+	d->local = DATA_LOCAL_HEADER;
+	if(items){
+		d->mappedData = map;
+		d->local |= DATA_LOCAL_ITEMS;
+	}else{
+		d->data = calloc(n, adhoc_arrayItemSize(t));
+		d->mappedData = calloc((n-1)/DATA_MAP_BIT_FIELD_SIZE+1, sizeof(void*));
+		ADHOC_HEAP_TRACK(d);
+	}
+	return d;
+}
+
+// Set up a struct in a caller's stack frame with zeroed stack storage for
+// its fields, held by that frame
+adhoc_data* adhoc_localStruct(adhoc_data* d, const adhoc_structLayout* layout, void* fields){
+	adhoc_initData(d, DATA_STRUCT, fields, DATA_VOID, layout->countFields);
+	ADHOC_STRUCT_LAYOUT(d) = layout;
+	d->refs = 1;
+	d->local = DATA_LOCAL_HEADER | DATA_LOCAL_ITEMS;
+	return d;
+}
+
+// Wrap a string constant of n bytes (with its terminator) in a data struct
+// in a caller's stack frame, held by that frame. Nothing may change it
+adhoc_data* adhoc_localString(adhoc_data* d, const char* s, int n){
+	adhoc_initData(d, DATA_STRING, (char*) s, DATA_VOID, n);
+	d->refs = 1;
+	d->local = DATA_LOCAL_HEADER | DATA_LOCAL_ITEMS;
+	return d;
+}
+
 
 //--------------------------//
 //    Reference Counting    //
 //--------------------------//
 
+// Number of forks running. While any are, data may be shared between
+// threads, so reference counts are updated atomically
+static int adhoc_runningForks = 0;
+
+// Check whether reference counts need to be updated atomically
+static inline bool adhoc_threaded(){
+	return __atomic_load_n(&adhoc_runningForks, __ATOMIC_RELAXED) > 0;
+}
+
 // Add a reference to a referenced data struct
 adhoc_data* adhoc_referenceData(adhoc_data* d){
-	++d->refs;
+	if(adhoc_threaded()) __atomic_add_fetch(&d->refs, 1, __ATOMIC_RELAXED);
+	else ++d->refs;
+	return d;
+}
+
+// Remove a reference without deleting, handing the data to a caller
+adhoc_data* adhoc_releaseData(adhoc_data* d){
+	if(adhoc_threaded()) __atomic_sub_fetch(&d->refs, 1, __ATOMIC_RELEASE);
+	else --d->refs;
 	return d;
 }
 
 // Add an item to a referenced data array struct
-void adhoc_assignArrayData(adhoc_data* arr, int i, void* item, float primVal){
+void adhoc_assignArrayData(adhoc_data* arr, int i, void* item, double primVal){
 	adhoc_referenceData(arr);
+	adhoc_assignArrayData_borrowed(arr, i, item, primVal);
+	adhoc_unreferenceData(arr);
+}
 
-	// If the new index is beyond the bounds of the array, grow the array
+// Mark arr[from] through arr[to-1] as set, growing the array first
+void adhoc_mapRange(adhoc_data* arr, int from, int to){
+	int i;
+	if(from < 0) from = 0;
+	if(to <= from) return;
+	if(to > arr->sizeData) adhoc_growArray(arr, to-1);
+	for(i=from; i<to; ++i) adhoc_mapIndex(arr, i);
+}
+
+// Grow an array so that index i is within its bounds. Items kept in a stack
+// frame move to the heap
+void adhoc_growArray(adhoc_data* arr, int i){
 	int newSize = (arr->sizeData ? arr->sizeData : 1);
 	while(i >= newSize) newSize *= 2;
-	if(newSize > arr->sizeData){
-		short s;
-		switch(arr->dataType){
-		case DATA_BOOL: s = sizeof(bool); break;
-		case DATA_INT: s = sizeof(int); break;
-		case DATA_FLOAT: s = sizeof(float); break;
-		default:
-			s = sizeof(adhoc_data*);
-		}
+	if(newSize <= arr->sizeData) return;
+	short s = adhoc_arrayItemSize(arr->dataType);
+	int oldMapSize = (arr->sizeData-1)/DATA_MAP_BIT_FIELD_SIZE+1;
+	int newMapSize = (newSize-1)/DATA_MAP_BIT_FIELD_SIZE+1;
+	if(arr->local & DATA_LOCAL_ITEMS){
+		arr->data = memcpy(malloc(s*newSize), arr->data, s*arr->sizeData);
+		arr->mappedData = memcpy(malloc(newMapSize), arr->mappedData, oldMapSize);
+		arr->local &= ~DATA_LOCAL_ITEMS;
+	}else{
 		arr->data = realloc(arr->data, s*newSize);
-		memset(arr->data+(arr->sizeData*s), 0, (newSize - arr->sizeData)*s);
-		int oldMapSize = (arr->sizeData-1)/DATA_MAP_BIT_FIELD_SIZE+1;
-		int newMapSize = (newSize-1)/DATA_MAP_BIT_FIELD_SIZE+1;
 		arr->mappedData = realloc(arr->mappedData, newMapSize);
-		memset(arr->mappedData+oldMapSize, 0, newMapSize-oldMapSize);
-		arr->sizeData = newSize;
 	}
+	memset(arr->data+(arr->sizeData*s), 0, (newSize - arr->sizeData)*s);
+	memset(arr->mappedData+oldMapSize, 0, newMapSize-oldMapSize);
+	arr->sizeData = newSize;
+	ADHOC_HEAP_TRACK(arr);
+}
+
+// Add an item to an array the caller already holds a reference to
+void adhoc_assignArrayData_borrowed(adhoc_data* arr, int i, void* item, double primVal){
+	// If the new index is beyond the bounds of the array, grow the array
+	if(i >= arr->sizeData) adhoc_growArray(arr, i);
 
 	// Assign the new value to the index
 	switch(arr->dataType){
@@ -129,13 +246,14 @@ void adhoc_assignArrayData(adhoc_data* arr, int i, void* item, float primVal){
 		*(arr->mappedData+i/DATA_MAP_BIT_FIELD_SIZE)
 			|= (1<<(i%DATA_MAP_BIT_FIELD_SIZE));
 	}
-
-	adhoc_unreferenceData(arr);
 }
 
 // Remove a reference to a referenced data struct and delete it if last
 adhoc_data* adhoc_unreferenceData(adhoc_data* d){
-	if(!d || --d->refs > 0) return d;
+	if(!d) return d;
+	if(adhoc_threaded()){
+		if(__atomic_sub_fetch(&d->refs, 1, __ATOMIC_ACQ_REL) > 0) return d;
+	}else if(--d->refs > 0) return d;
 	int i, cleared;
 	switch(d->type){
 	case DATA_VOID:
@@ -143,7 +261,6 @@ adhoc_data* adhoc_unreferenceData(adhoc_data* d){
 	case DATA_INT:
 	case DATA_FLOAT:
 	case DATA_STRING:
-		free(d->data);
 		break;
 	case DATA_ARRAY:
 		switch(d->dataType){
@@ -160,17 +277,48 @@ adhoc_data* adhoc_unreferenceData(adhoc_data* d){
 				++cleared;
 			}
 		}
-		free(d->data);
-		free(d->mappedData);
 		break;
 	case DATA_HASH:
-		// TODO
+		for(i=0; i<d->sizeData; ++i){
+			if((signed char)d->mappedData[i] < 0) continue;
+			adhoc_hashSlot* slot = ((adhoc_hashSlot*)d->data)+i;
+			adhoc_unreferenceData(slot->strKey);
+			switch(d->dataType){
+			case DATA_STRING:
+			case DATA_ARRAY:
+			case DATA_HASH:
+			case DATA_STRUCT:
+				adhoc_unreferenceData(slot->value.cmplxVal);
+			default:
+				break;
+			}
+		}
 		break;
 	case DATA_STRUCT:
-		// TODO
+		;const adhoc_structLayout* layout = ADHOC_STRUCT_LAYOUT(d);
+		for(i=0; i<layout->countFields; ++i){
+			switch(layout->types[i]){
+			case DATA_STRING:
+			case DATA_ARRAY:
+			case DATA_HASH:
+			case DATA_STRUCT:
+				adhoc_unreferenceData(
+					*(adhoc_data**)((char*)d->data + layout->offsets[i])
+				);
+			default:
+				break;
+			}
+		}
 		break;
 	}
-	free(d);
+
+	// Free what is on the heap, leaving what a stack frame keeps
+	ADHOC_HEAP_FORGET(d);
+	if(!(d->local & DATA_LOCAL_ITEMS)){
+		free(d->data);
+		free(d->mappedData);
+	}
+	if(!(d->local & DATA_LOCAL_HEADER)) free(d);
 	return NULL;
 }
 
@@ -220,6 +368,883 @@ adhoc_data* adhoc_getCArrayData(adhoc_data* arr, int i){
 }
 
 
+//-------------------//
+//    Hash Tables    //
+//-------------------//
+// A hash keeps its slots in data and one control byte per slot in
+// mappedData. Slots come in aligned groups of ADHOC_HASH_GROUP, and a probe
+// checks a whole group's control bytes at once (with SSE2 where available)
+// before touching any slot. A control byte is ADHOC_HASH_EMPTY, or
+// ADHOC_HASH_DELETED, or holds the low 7 bits of the slot's hash. sizeData
+// is the slot count, countData the live entries, and capacityData the
+// number of empty slots that may still be filled before the table rehashes.
+#define ADHOC_HASH_GROUP 16
+#define ADHOC_HASH_EMPTY ((char)0x80)
+#define ADHOC_HASH_DELETED ((char)0xFE)
+
+// Hash n bytes (FNV-1a)
+static unsigned int adhoc_hashBytes(const unsigned char* s, int n){
+	unsigned int h = 2166136261u;
+	int i;
+	for(i=0; i<n; ++i){
+		h ^= s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Hash a string key by its stored length
+static unsigned int adhoc_hashString(adhoc_data* key){
+	return adhoc_hashBytes(key->data, key->sizeData-1);
+}
+
+// Hash an integer key (murmur3 finalizer)
+static unsigned int adhoc_hashInt(int key){
+	unsigned int h = key;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// Bitmask of the slots in a group whose control byte equals c
+static inline unsigned int adhoc_matchGroup(const char* ctrl, char c){
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+	unsigned int i, ret = 0;
+	for(i=0; i<ADHOC_HASH_GROUP; ++i) if(ctrl[i] == c) ret |= 1<<i;
+	return ret;
+#endif
+}
+
+// Bitmask of the slots in a group which are empty or deleted
+static inline unsigned int adhoc_matchFree(const char* ctrl){
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+	unsigned int i, ret = 0;
+	for(i=0; i<ADHOC_HASH_GROUP; ++i) if((signed char)ctrl[i] < 0) ret |= 1<<i;
+	return ret;
+#endif
+}
+
+// Check whether a slot holds the given key
+static inline bool adhoc_hashKeyMatches(adhoc_hashSlot* slot, adhoc_data* strKey, int intKey){
+	if(!strKey) return !slot->strKey && slot->intKey == intKey;
+	return slot->strKey
+		&& slot->strKey->sizeData == strKey->sizeData
+		&& !memcmp(slot->strKey->data, strKey->data, strKey->sizeData-1);
+}
+
+// Allocate the slots and control bytes for a hash of a given slot count
+static void adhoc_allocHash(adhoc_data* hash, int slots){
+	hash->data = calloc(slots, sizeof(adhoc_hashSlot));
+	hash->mappedData = memset(malloc(slots), ADHOC_HASH_EMPTY, slots);
+	hash->sizeData = slots;
+	hash->capacityData = slots/8*7 - hash->countData;
+	ADHOC_HEAP_TRACK(hash);
+}
+
+// Create a new hash and return its reference
+adhoc_data* adhoc_createHash(adhoc_dataType t, int n){
+	int slots = ADHOC_HASH_GROUP;
+	while(slots/8*7 < n) slots *= 2;
+	adhoc_data* ret = adhoc_createData(DATA_HASH, NULL, t, 0);
+	adhoc_allocHash(ret, slots);
+	return ret;
+}
+
+// Set up a hash in a caller's stack frame, held by that frame
+adhoc_data* adhoc_localHash(adhoc_data* d, adhoc_dataType t, int n){
+	int slots = ADHOC_HASH_GROUP;
+	while(slots/8*7 < n) slots *= 2;
+	adhoc_initData(d, DATA_HASH, NULL, t, 0);
+	d->refs = 1;
+	d->local = DATA_LOCAL_HEADER;
+	adhoc_allocHash(d, slots);
+	return d;
+}
+
+// Find the slot for a key in a hash, or the slot to insert it into if asked
+static adhoc_hashSlot* adhoc_probeHash(adhoc_data* hash, adhoc_data* strKey, int intKey, unsigned int h, bool insert){
+	adhoc_hashSlot* slots = hash->data;
+	int groups = hash->sizeData/ADHOC_HASH_GROUP, g = (h>>7) & (groups-1), k, free = -1;
+	char tag = h & 0x7F;
+	unsigned int bits;
+	for(k=0; k<groups; ++k){
+		const char* ctrl = hash->mappedData + g*ADHOC_HASH_GROUP;
+		bits = adhoc_matchGroup(ctrl, tag);
+		while(bits){
+			adhoc_hashSlot* slot = slots + g*ADHOC_HASH_GROUP + __builtin_ctz(bits);
+			if(slot->hash == h && adhoc_hashKeyMatches(slot, strKey, intKey)) return slot;
+			bits &= bits-1;
+		}
+		if(insert && free < 0 && (bits = adhoc_matchFree(ctrl))){
+			free = g*ADHOC_HASH_GROUP + __builtin_ctz(bits);
+		}
+		if(adhoc_matchGroup(ctrl, ADHOC_HASH_EMPTY)) break;
+		g = (g + k + 1) & (groups-1);
+	}
+	if(free < 0) return NULL;
+
+	// Claim the free slot for the new key
+	if(hash->mappedData[free] == ADHOC_HASH_EMPTY) --hash->capacityData;
+	hash->mappedData[free] = tag;
+	++hash->countData;
+	adhoc_hashSlot* slot = slots + free;
+	memset(slot, 0, sizeof(adhoc_hashSlot));
+	slot->hash = h;
+	slot->intKey = intKey;
+	if(strKey){
+		char* keyData = memcpy(malloc(strKey->sizeData), strKey->data, strKey->sizeData);
+		slot->strKey = adhoc_referenceData(
+			adhoc_createData(DATA_STRING, keyData, DATA_VOID, strKey->sizeData)
+		);
+	}
+	return slot;
+}
+
+// Rebuild a hash into a new slot count, dropping deleted slots
+static void adhoc_rehash(adhoc_data* hash, int slots){
+	adhoc_hashSlot* oldSlots = hash->data;
+	char* oldCtrl = hash->mappedData;
+	int i, oldSize = hash->sizeData, g, k, groups = slots/ADHOC_HASH_GROUP;
+	adhoc_allocHash(hash, slots);
+	for(i=0; i<oldSize; ++i){
+		if((signed char)oldCtrl[i] < 0) continue;
+		unsigned int h = oldSlots[i].hash, bits;
+		for(g=(h>>7)&(groups-1),k=0; !(bits = adhoc_matchFree(hash->mappedData+g*ADHOC_HASH_GROUP)); ++k){
+			g = (g + k + 1) & (groups-1);
+		}
+		bits = g*ADHOC_HASH_GROUP + __builtin_ctz(bits);
+		hash->mappedData[bits] = h & 0x7F;
+		((adhoc_hashSlot*)hash->data)[bits] = oldSlots[i];
+	}
+	free(oldSlots);
+	free(oldCtrl);
+}
+
+// Locate a key's slot in a hash, or NULL if the key is not set
+adhoc_hashSlot* adhoc_findHashSlot(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	if(!strKey) return adhoc_probeHash(hash, NULL, intKey, adhoc_hashInt(intKey), false);
+	adhoc_referenceData(strKey);
+	adhoc_hashSlot* ret = adhoc_probeHash(hash, strKey, 0, adhoc_hashString(strKey), false);
+	adhoc_unreferenceData(strKey);
+	return ret;
+}
+
+// Locate a key's slot in a hash, adding a zeroed one if the key is not set
+adhoc_hashSlot* adhoc_insertHashSlot(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	if(strKey) adhoc_referenceData(strKey);
+	unsigned int h = (strKey ? adhoc_hashString(strKey) : adhoc_hashInt(intKey));
+	adhoc_hashSlot* ret = adhoc_probeHash(hash, strKey, intKey, h, false);
+	if(!ret){
+		// Grow when live entries fill over half the usable slots, else just
+		// sweep out the deleted ones
+		if(!hash->capacityData){
+			adhoc_rehash(hash, hash->sizeData * (hash->countData*16 > hash->sizeData*7 ? 2 : 1));
+		}
+		ret = adhoc_probeHash(hash, strKey, intKey, h, true);
+	}
+	if(strKey) adhoc_unreferenceData(strKey);
+	return ret;
+}
+
+// Add an item to a referenced hash
+void adhoc_assignHashData(adhoc_data* hash, adhoc_data* strKey, int intKey, void* item, double primVal){
+	adhoc_referenceData(hash);
+	adhoc_assignHashData_borrowed(hash, strKey, intKey, item, primVal);
+	adhoc_unreferenceData(hash);
+}
+
+// Add an item to a hash the caller already holds a reference to
+void adhoc_assignHashData_borrowed(adhoc_data* hash, adhoc_data* strKey, int intKey, void* item, double primVal){
+	adhoc_hashSlot* slot = adhoc_insertHashSlot(hash, strKey, intKey);
+	switch(hash->dataType){
+	case DATA_VOID:
+		break;
+	case DATA_BOOL:
+		slot->value.boolVal = (bool)primVal;
+		break;
+	case DATA_INT:
+		slot->value.intVal = (int)primVal;
+		break;
+	case DATA_FLOAT:
+		slot->value.floatVal = (float)primVal;
+		break;
+	case DATA_STRING:
+	case DATA_ARRAY:
+	case DATA_HASH:
+	case DATA_STRUCT:
+		// Reference the new item before dropping the old, in case they match
+		adhoc_referenceData((adhoc_data*)item);
+		adhoc_unreferenceData(slot->value.cmplxVal);
+		slot->value.cmplxVal = (adhoc_data*)item;
+		break;
+	}
+}
+
+// Get the complex data stored under a key in a hash
+adhoc_data* adhoc_getCHashData(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	adhoc_hashSlot* slot = adhoc_findHashSlot(hash, strKey, intKey);
+	return slot ? slot->value.cmplxVal : NULL;
+}
+
+// Remove a key and its item from a hash. Returns whether it was set
+bool adhoc_deleteHashData(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	adhoc_hashSlot* slot = adhoc_findHashSlot(hash, strKey, intKey);
+	if(!slot) return false;
+	int i = slot - (adhoc_hashSlot*)hash->data;
+	adhoc_unreferenceData(slot->strKey);
+	switch(hash->dataType){
+	case DATA_STRING:
+	case DATA_ARRAY:
+	case DATA_HASH:
+	case DATA_STRUCT:
+		adhoc_unreferenceData(slot->value.cmplxVal);
+	default:
+		break;
+	}
+
+	// Groups are probed whole and a probe stops at any group with an empty
+	// slot, so if this group has one no probe ever passed through it
+	const char* ctrl = hash->mappedData + i/ADHOC_HASH_GROUP*ADHOC_HASH_GROUP;
+	if(adhoc_matchGroup(ctrl, ADHOC_HASH_EMPTY)){
+		hash->mappedData[i] = ADHOC_HASH_EMPTY;
+		++hash->capacityData;
+	}else{
+		hash->mappedData[i] = ADHOC_HASH_DELETED;
+	}
+	--hash->countData;
+	return true;
+}
+
+// Step to the next live slot of a hash after prev (or the first if NULL)
+adhoc_hashSlot* adhoc_nextHashSlot(adhoc_data* hash, adhoc_hashSlot* prev){
+	int i = (prev ? prev - (adhoc_hashSlot*)hash->data + 1 : 0);
+	while(i < hash->sizeData){
+		int g = i/ADHOC_HASH_GROUP*ADHOC_HASH_GROUP;
+		unsigned int bits = ~adhoc_matchFree(hash->mappedData+g) & 0xFFFF;
+		bits &= ~0u << (i-g);
+		if(bits) return (adhoc_hashSlot*)hash->data + g + __builtin_ctz(bits);
+		i = g + ADHOC_HASH_GROUP;
+	}
+	return NULL;
+}
+
+
+//-----------------------//
+//    String Switches    //
+//-----------------------//
+
+// Length bit of a switch table. Lengths past 63 share the last bit
+static inline unsigned long long adhoc_switchLength(int n){
+	return 1ull << (n < 63 ? n : 63);
+}
+
+// Hash a switch table's labels into its slots. The first thread to get
+// here fills them while any others wait
+static void adhoc_buildSwitch(adhoc_switchTable* table){
+	int i, j, mask = table->sizeSlots-1, state = 0;
+	if(!__atomic_compare_exchange_n(&table->state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)){
+		while(__atomic_load_n(&table->state, __ATOMIC_ACQUIRE) != 2) sched_yield();
+		return;
+	}
+	for(i=0; i<table->countLabels; ++i){
+		unsigned int h = adhoc_hashBytes((const unsigned char*)table->labels[i].data, table->labels[i].length);
+		for(j=h&mask; table->slots[j].label; j=(j+1)&mask);
+		table->slots[j].hash = h;
+		table->slots[j].label = i+1;
+		table->lengths |= adhoc_switchLength(table->labels[i].length);
+	}
+	__atomic_store_n(&table->state, 2, __ATOMIC_RELEASE);
+}
+
+// Find which label of a switch table a string matches, or -1 if none
+int adhoc_switchString(adhoc_switchTable* table, adhoc_data* s){
+	adhoc_referenceData(s);
+	int ret = adhoc_switchString_borrowed(table, s);
+	adhoc_unreferenceData(s);
+	return ret;
+}
+
+// Find which label of a switch table a string the caller holds matches
+int adhoc_switchString_borrowed(adhoc_switchTable* table, adhoc_data* s){
+	int i, n = s->sizeData-1, mask = table->sizeSlots-1;
+	unsigned int h;
+	if(__atomic_load_n(&table->state, __ATOMIC_ACQUIRE) != 2) adhoc_buildSwitch(table);
+
+	// Strings of a length no label has can skip hashing entirely
+	if(!(table->lengths & adhoc_switchLength(n))) return -1;
+	h = adhoc_hashString(s);
+	for(i=h&mask; table->slots[i].label; i=(i+1)&mask){
+		const adhoc_switchLabel* label = &table->labels[table->slots[i].label-1];
+		if(table->slots[i].hash == h
+				&& label->length == n
+				&& !memcmp(label->data, s->data, n)
+			) return table->slots[i].label-1;
+	}
+	return -1;
+}
+
+
+//-------------------//
+//    Thread Pool    //
+//-------------------//
+
+// Fork branches run as tasks on a small work-stealing pool. Each thread,
+// including the one that first forks, owns a deque of tasks: it pushes and
+// pops its own at the tail, while idle threads steal from the head of the
+// others'. A forking thread keeps running tasks until its branches are done
+typedef struct adhoc_task {
+	adhoc_taskFunc run;
+	void* arg;
+	int* pending;
+} adhoc_task;
+
+typedef struct adhoc_deque {
+	pthread_mutex_t lock;
+	adhoc_task* tasks;
+	int head;
+	int count;
+	int size;
+} adhoc_deque;
+
+static int adhoc_poolThreads = 0;
+static int adhoc_poolSize = 0;
+static adhoc_deque* adhoc_deques = NULL;
+static pthread_t* adhoc_workers = NULL;
+static __thread int adhoc_workerId = 0;
+
+// Idle workers sleep until tasks are queued anywhere in the pool
+static pthread_mutex_t adhoc_poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t adhoc_poolWake = PTHREAD_COND_INITIALIZER;
+static int adhoc_poolQueued = 0;
+static bool adhoc_poolStopping = false;
+
+// Push a task onto the tail of a deque
+static void adhoc_pushTask(adhoc_deque* q, adhoc_task t){
+	int i;
+	pthread_mutex_lock(&q->lock);
+	if(q->count == q->size){
+		int newSize = (q->size ? q->size*2 : 16);
+		adhoc_task* tasks = malloc(newSize*sizeof(adhoc_task));
+		for(i=0; i<q->count; ++i) tasks[i] = q->tasks[(q->head+i) % q->size];
+		free(q->tasks);
+		q->tasks = tasks;
+		q->head = 0;
+		q->size = newSize;
+	}
+	q->tasks[(q->head + q->count++) % q->size] = t;
+	pthread_mutex_unlock(&q->lock);
+}
+
+// Take a task from the tail of a deque (own) or its head (stealing)
+static bool adhoc_takeTask(adhoc_deque* q, adhoc_task* t, bool steal){
+	bool ret = false;
+	pthread_mutex_lock(&q->lock);
+	if(q->count){
+		if(steal){
+			*t = q->tasks[q->head];
+			q->head = (q->head+1) % q->size;
+			--q->count;
+		}else{
+			*t = q->tasks[(q->head + --q->count) % q->size];
+		}
+		ret = true;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return ret;
+}
+
+// Find a task to run, from this thread's deque first and then the others'
+static bool adhoc_findTask(adhoc_task* t){
+	int i;
+	bool found = adhoc_takeTask(adhoc_deques+adhoc_workerId, t, false);
+	for(i=1; !found && i<adhoc_poolSize; ++i){
+		found = adhoc_takeTask(
+			adhoc_deques + (adhoc_workerId+i) % adhoc_poolSize
+			,t
+			,true
+		);
+	}
+	if(found) __atomic_sub_fetch(&adhoc_poolQueued, 1, __ATOMIC_RELAXED);
+	return found;
+}
+
+// Run a task and mark it done for its fork
+static void adhoc_runTask(adhoc_task* t){
+	t->run(t->arg);
+	__atomic_sub_fetch(t->pending, 1, __ATOMIC_RELEASE);
+}
+
+// Pool threads run tasks until the pool is stopped
+static void* adhoc_poolWorker(void* id){
+	adhoc_task t;
+	bool stopping = false;
+	adhoc_workerId = (int)(intptr_t)id;
+	while(!stopping){
+		if(adhoc_findTask(&t)){
+			adhoc_runTask(&t);
+			continue;
+		}
+		pthread_mutex_lock(&adhoc_poolLock);
+		while(!adhoc_poolStopping
+				&& !__atomic_load_n(&adhoc_poolQueued, __ATOMIC_ACQUIRE)
+			) pthread_cond_wait(&adhoc_poolWake, &adhoc_poolLock);
+		stopping = adhoc_poolStopping;
+		pthread_mutex_unlock(&adhoc_poolLock);
+	}
+	return NULL;
+}
+
+// Stop the pool threads and free the deques
+static void adhoc_stopPool(){
+	int i;
+	pthread_mutex_lock(&adhoc_poolLock);
+	adhoc_poolStopping = true;
+	pthread_cond_broadcast(&adhoc_poolWake);
+	pthread_mutex_unlock(&adhoc_poolLock);
+	for(i=1; i<adhoc_poolSize; ++i) pthread_join(adhoc_workers[i-1], NULL);
+	for(i=0; i<adhoc_poolSize; ++i){
+		pthread_mutex_destroy(&adhoc_deques[i].lock);
+		free(adhoc_deques[i].tasks);
+	}
+	free(adhoc_deques);
+	free(adhoc_workers);
+	adhoc_poolSize = 0;
+}
+
+// Start the pool threads the first time something forks
+static void adhoc_startPool(){
+	int i, n = adhoc_poolThreads;
+	char* env = getenv("ADHOC_THREADS");
+	if(n <= 0 && env) n = atoi(env);
+	if(n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(n <= 0) n = 1;
+	adhoc_poolSize = n;
+	adhoc_deques = calloc(n, sizeof(adhoc_deque));
+	for(i=0; i<n; ++i) pthread_mutex_init(&adhoc_deques[i].lock, NULL);
+	adhoc_workers = malloc(n*sizeof(pthread_t));
+	for(i=1; i<n; ++i){
+		pthread_create(&adhoc_workers[i-1], NULL, adhoc_poolWorker, (void*)(intptr_t)i);
+	}
+	atexit(adhoc_stopPool);
+}
+
+// Set how many threads the pool runs with
+void adhoc_setThreadCount(int n){
+	adhoc_poolThreads = n;
+}
+
+// Run tasks in parallel, and return once all are done
+static void adhoc_joinTasks(int count, adhoc_task* tasks){
+	int i, pending = count;
+	adhoc_task t;
+	if(!adhoc_poolSize) adhoc_startPool();
+	__atomic_add_fetch(&adhoc_runningForks, 1, __ATOMIC_SEQ_CST);
+
+	// Queue every task but the first, where idle threads can steal them
+	for(i=count-1; i>0; --i){
+		tasks[i].pending = &pending;
+		adhoc_pushTask(adhoc_deques+adhoc_workerId, tasks[i]);
+	}
+	if(count > 1){
+		pthread_mutex_lock(&adhoc_poolLock);
+		__atomic_add_fetch(&adhoc_poolQueued, count-1, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&adhoc_poolWake);
+		pthread_mutex_unlock(&adhoc_poolLock);
+	}
+
+	// Run the first task here, then help with any others until all are done
+	tasks[0].run(tasks[0].arg);
+	__atomic_sub_fetch(&pending, 1, __ATOMIC_RELEASE);
+	while(__atomic_load_n(&pending, __ATOMIC_ACQUIRE)){
+		if(adhoc_findTask(&t)) adhoc_runTask(&t);
+		else sched_yield();
+	}
+	__atomic_sub_fetch(&adhoc_runningForks, 1, __ATOMIC_SEQ_CST);
+}
+
+// Run count tasks in parallel, each given arg, and return once all are done
+void adhoc_forkJoin(int count, adhoc_taskFunc* tasks, void* arg){
+	int i;
+	if(count <= 0) return;
+	adhoc_task t[count];
+	for(i=0; i<count; ++i){
+		t[i].run = tasks[i];
+		t[i].arg = arg;
+	}
+	adhoc_joinTasks(count, t);
+}
+
+// A chunk of a parallel loop's iterations
+typedef struct adhoc_range {
+	adhoc_rangeFunc body;
+	void* arg;
+	int from;
+	int to;
+} adhoc_range;
+
+// Run a chunk of a parallel loop as a task
+static void adhoc_runRange(void* r){
+	adhoc_range* range = r;
+	range->body(range->from, range->to, range->arg);
+}
+
+// Run the iterations from <= i < to in parallel, in chunks of at least
+// grain iterations (but no more than a few chunks per thread)
+void adhoc_parallelFor(int from, int to, int grain, adhoc_rangeFunc body, void* arg){
+	int i, chunks;
+	long long n = (long long)to - from;
+	if(n <= 0) return;
+	if(grain <= 0) grain = ADHOC_DEFAULT_GRAIN;
+	if(!adhoc_poolSize) adhoc_startPool();
+	chunks = (int)(n/grain < adhoc_poolSize*4 ? n/grain : adhoc_poolSize*4);
+	if(chunks <= 1 || adhoc_poolSize == 1){
+		body(from, to, arg);
+		return;
+	}
+	adhoc_range ranges[chunks];
+	adhoc_task t[chunks];
+	for(i=0; i<chunks; ++i){
+		ranges[i].body = body;
+		ranges[i].arg = arg;
+		ranges[i].from = from + (int)(n*i/chunks);
+		ranges[i].to = from + (int)(n*(i+1)/chunks);
+		t[i].run = adhoc_runRange;
+		t[i].arg = ranges+i;
+	}
+	adhoc_joinTasks(chunks, t);
+}
+
+
+//----------------//
+//    Profiles    //
+//----------------//
+
+// The counts of an instrumented executable, written when it exits
+static unsigned long long* adhoc_profileCounts;
+static const int* adhoc_profileIds;
+static const char* adhoc_profileKinds;
+static int adhoc_profileCount;
+
+// Write one line per node counted: its id, its kind, and its two counts
+static void adhoc_writeProfile(){
+	int i;
+	const char* path = getenv("ADHOC_PROFILE");
+	FILE* f = fopen((path && *path ? path : "adhoc.profile"), "w");
+	if(!f){
+		fprintf(stderr, "Could not write profile %s\n", (path && *path ? path : "adhoc.profile"));
+		return;
+	}
+	for(i=0; i<adhoc_profileCount; ++i){
+		fprintf(f, "%d %c %llu %llu\n"
+			,adhoc_profileIds[i]
+			,adhoc_profileKinds[i]
+			,adhoc_profileCounts[2*i]
+			,adhoc_profileCounts[2*i+1]
+		);
+	}
+	fclose(f);
+}
+
+// Write an instrumented executable's counts when it exits
+void adhoc_profileAtExit(unsigned long long* counts, const int* ids, const char* kinds, int count){
+	adhoc_profileCounts = counts;
+	adhoc_profileIds = ids;
+	adhoc_profileKinds = kinds;
+	adhoc_profileCount = count;
+	atexit(adhoc_writeProfile);
+}
+
+
+//---------------//
+//    Tracing    //
+//---------------//
+
+// The events each thread keeps. Once it has more, its oldest are dropped
+#define ADHOC_TRACE_EVENTS 65536
+
+// An action entered, with its name, or left, without one
+typedef struct adhoc_traceEvent {
+	unsigned long long tick;
+	const char* name;
+	int id;
+} adhoc_traceEvent;
+
+// The ring of one thread's events, kept in a list of every thread's
+typedef struct adhoc_traceRing {
+	adhoc_traceEvent events[ADHOC_TRACE_EVENTS];
+	unsigned long long count;
+	int thread;
+	struct adhoc_traceRing* next;
+} adhoc_traceRing;
+
+static __thread adhoc_traceRing* adhoc_traceOwn = NULL;
+static adhoc_traceRing* adhoc_traceRings = NULL;
+static int adhoc_traceThreads = 0;
+static pthread_mutex_t adhoc_traceLock = PTHREAD_MUTEX_INITIALIZER;
+
+// When the first event was recorded, by the tick and by the clock
+static unsigned long long adhoc_traceStartTick;
+static struct timespec adhoc_traceStart;
+
+// Events are timed by the x86 time stamp counter where there is one, which
+// takes a few nanoseconds to read, and otherwise by the monotonic clock in
+// nanoseconds. Ticks are turned into time when the trace is written
+static inline unsigned long long adhoc_traceTick(){
+#ifdef ADHOC_X86_KERNELS
+	return __rdtsc();
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1000000000ULL + t.tv_nsec;
+#endif
+}
+
+// Write every thread's events as Chrome trace events, in microseconds
+static void adhoc_writeTrace(){
+	unsigned long long i, end = adhoc_traceTick();
+	double perTick, elapsed;
+	struct timespec now;
+	adhoc_traceRing* r;
+	adhoc_traceEvent* e;
+	bool first = true;
+	int pid = (int) getpid();
+	const char* path = getenv("ADHOC_TRACE_FILE");
+	FILE* f = fopen((path && *path ? path : "adhoc.trace.json"), "w");
+	if(!f){
+		fprintf(stderr, "Could not write trace %s\n", (path && *path ? path : "adhoc.trace.json"));
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - adhoc_traceStart.tv_sec)*1e9 + (now.tv_nsec - adhoc_traceStart.tv_nsec);
+	perTick = (end > adhoc_traceStartTick ? elapsed / (end - adhoc_traceStartTick) : 1.0);
+	pthread_mutex_lock(&adhoc_traceLock);
+	fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+	for(r=adhoc_traceRings; r; r=r->next){
+		i = (r->count > ADHOC_TRACE_EVENTS ? r->count - ADHOC_TRACE_EVENTS : 0);
+		for(; i<r->count; ++i){
+			e = r->events + (i & (ADHOC_TRACE_EVENTS-1));
+			fprintf(f, "%s\n{\"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d"
+				,(first ? "" : ",")
+				,(e->name ? 'B' : 'E')
+				,(e->tick - adhoc_traceStartTick) * perTick / 1000.0
+				,pid
+				,r->thread
+			);
+			if(e->name) fprintf(f, ", \"name\": \"%s\", \"args\": {\"node\": %d}", e->name, e->id);
+			fprintf(f, "}");
+			first = false;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	pthread_mutex_unlock(&adhoc_traceLock);
+	fclose(f);
+}
+
+// Give the running thread a ring of its own. The first one starts the clock
+static adhoc_traceRing* adhoc_traceJoin(){
+	adhoc_traceRing* r = calloc(1, sizeof(adhoc_traceRing));
+	pthread_mutex_lock(&adhoc_traceLock);
+	if(!adhoc_traceRings){
+		clock_gettime(CLOCK_MONOTONIC, &adhoc_traceStart);
+		adhoc_traceStartTick = adhoc_traceTick();
+		atexit(adhoc_writeTrace);
+	}
+	r->thread = adhoc_traceThreads++;
+	r->next = adhoc_traceRings;
+	adhoc_traceRings = r;
+	pthread_mutex_unlock(&adhoc_traceLock);
+	return adhoc_traceOwn = r;
+}
+
+// Record that the running thread entered an action
+int adhoc_traceEnter(int id, const char* name){
+	adhoc_traceRing* r = adhoc_traceOwn;
+	adhoc_traceEvent* e;
+	if(!r) r = adhoc_traceJoin();
+	e = r->events + (r->count++ & (ADHOC_TRACE_EVENTS-1));
+	e->tick = adhoc_traceTick();
+	e->name = name;
+	e->id = id;
+	return id;
+}
+
+// Record that the running thread left an action
+void adhoc_traceExit(int* id){
+	adhoc_traceRing* r = adhoc_traceOwn;
+	adhoc_traceEvent* e;
+	if(!r) r = adhoc_traceJoin();
+	e = r->events + (r->count++ & (ADHOC_TRACE_EVENTS-1));
+	e->tick = adhoc_traceTick();
+	e->name = NULL;
+	e->id = *id;
+}
+
+
+//---------------------//
+//    Heap Profiles    //
+//---------------------//
+#ifdef ADHOC_HEAP_PROFILE
+
+// The node whose code is running on each thread
+__thread int adhoc_heapSite = 0;
+
+// What the data structs made or grown by one node hold on the heap: how
+// many were made and grown, how many bytes that took in all, and how many
+// are still held now and at most
+typedef struct adhoc_heapStats {
+	unsigned long long allocations;
+	unsigned long long growths;
+	unsigned long long bytes;
+	long long live;
+	long long peak;
+} adhoc_heapStats;
+
+// Each data struct on the heap, with the node it is charged to and for how
+// many bytes, kept in a table by address
+typedef struct adhoc_heapEntry {
+	adhoc_data* d;
+	int site;
+	long long bytes;
+	struct adhoc_heapEntry* next;
+} adhoc_heapEntry;
+
+#define ADHOC_HEAP_BUCKETS 65536
+
+static adhoc_heapEntry** adhoc_heapTable = NULL;
+static adhoc_heapStats* adhoc_heapSites = NULL;
+static int adhoc_heapSizeSites = 0;
+static long long adhoc_heapLive = 0;
+static long long adhoc_heapPeak = 0;
+static pthread_mutex_t adhoc_heapLock = PTHREAD_MUTEX_INITIALIZER;
+
+// The bytes a data struct holds on the heap, besides other data it refers to
+static long long adhoc_heapSize(adhoc_data* d){
+	long long n = (d->local & DATA_LOCAL_HEADER ? 0 : sizeof(adhoc_data));
+	if(d->local & DATA_LOCAL_ITEMS) return n;
+	switch(d->type){
+	case DATA_STRING:
+		return n + d->capacityData;
+	case DATA_ARRAY:
+		return n + (long long) d->sizeData*adhoc_arrayItemSize(d->dataType) + (d->sizeData-1)/DATA_MAP_BIT_FIELD_SIZE+1;
+	case DATA_HASH:
+		return n + (long long) d->sizeData*(sizeof(adhoc_hashSlot)+1);
+	case DATA_STRUCT:
+		return n + (d->data ? ADHOC_STRUCT_LAYOUT(d)->size : 0);
+	default:
+		return n + (d->data ? adhoc_arrayItemSize(d->type) : 0);
+	}
+}
+
+// Find a data struct's entry, and where the table points at it
+static adhoc_heapEntry** adhoc_heapFind(adhoc_data* d){
+	adhoc_heapEntry** e = adhoc_heapTable + (((uintptr_t) d >> 4) & (ADHOC_HEAP_BUCKETS-1));
+	while(*e && (*e)->d != d) e = &(*e)->next;
+	return e;
+}
+
+// Write one line per node that made data: its id, how many structs it made
+// and grew, the bytes that took, and the bytes still held at exit and at most
+static void adhoc_writeHeap(){
+	int i;
+	const char* path = getenv("ADHOC_HEAP_FILE");
+	FILE* f = fopen((path && *path ? path : "adhoc.heap"), "w");
+	if(!f){
+		fprintf(stderr, "Could not write heap profile %s\n", (path && *path ? path : "adhoc.heap"));
+		return;
+	}
+	pthread_mutex_lock(&adhoc_heapLock);
+	fprintf(f, "# peak %lld live %lld\n", adhoc_heapPeak, adhoc_heapLive);
+	fprintf(f, "# node allocations growths bytes live peak\n");
+	for(i=0; i<adhoc_heapSizeSites; ++i){
+		if(!adhoc_heapSites[i].allocations && !adhoc_heapSites[i].growths) continue;
+		fprintf(f, "%d %llu %llu %llu %lld %lld\n"
+			,i
+			,adhoc_heapSites[i].allocations
+			,adhoc_heapSites[i].growths
+			,adhoc_heapSites[i].bytes
+			,adhoc_heapSites[i].live
+			,adhoc_heapSites[i].peak
+		);
+	}
+	pthread_mutex_unlock(&adhoc_heapLock);
+	fclose(f);
+}
+
+// Charge a data struct that was just made, or just changed size, to the
+// node running now
+static void adhoc_heapTrack(adhoc_data* d){
+	int site = (adhoc_heapSite > 0 ? adhoc_heapSite : 0);
+	long long size = adhoc_heapSize(d);
+	adhoc_heapEntry** e;
+	adhoc_heapStats* s;
+	pthread_mutex_lock(&adhoc_heapLock);
+	if(!adhoc_heapTable){
+		adhoc_heapTable = calloc(ADHOC_HEAP_BUCKETS, sizeof(adhoc_heapEntry*));
+		atexit(adhoc_writeHeap);
+	}
+	if(site >= adhoc_heapSizeSites){
+		int newSize = (adhoc_heapSizeSites ? adhoc_heapSizeSites : 256);
+		while(site >= newSize) newSize *= 2;
+		adhoc_heapSites = realloc(adhoc_heapSites, newSize*sizeof(adhoc_heapStats));
+		memset(adhoc_heapSites+adhoc_heapSizeSites, 0, (newSize-adhoc_heapSizeSites)*sizeof(adhoc_heapStats));
+		adhoc_heapSizeSites = newSize;
+	}
+	s = adhoc_heapSites + site;
+
+	// New data counts as made here, data that grew moves here with its bytes
+	e = adhoc_heapFind(d);
+	if(!*e){
+		*e = calloc(1, sizeof(adhoc_heapEntry));
+		(*e)->d = d;
+		++s->allocations;
+		s->bytes += size;
+	}else{
+		adhoc_heapSites[(*e)->site].live -= (*e)->bytes;
+		adhoc_heapLive -= (*e)->bytes;
+		if(size > (*e)->bytes){
+			++s->growths;
+			s->bytes += size - (*e)->bytes;
+		}
+	}
+	(*e)->site = site;
+	(*e)->bytes = size;
+	s->live += size;
+	if(s->live > s->peak) s->peak = s->live;
+	adhoc_heapLive += size;
+	if(adhoc_heapLive > adhoc_heapPeak) adhoc_heapPeak = adhoc_heapLive;
+	pthread_mutex_unlock(&adhoc_heapLock);
+}
+
+// Stop charging a data struct that is being freed
+static void adhoc_heapForget(adhoc_data* d){
+	adhoc_heapEntry** e;
+	adhoc_heapEntry* gone;
+	pthread_mutex_lock(&adhoc_heapLock);
+	if(adhoc_heapTable && *(e = adhoc_heapFind(d))){
+		gone = *e;
+		*e = gone->next;
+		adhoc_heapSites[gone->site].live -= gone->bytes;
+		adhoc_heapLive -= gone->bytes;
+		free(gone);
+	}
+	pthread_mutex_unlock(&adhoc_heapLock);
+}
+
+// Put a caller's node back when an action it called ends
+void adhoc_heapRestore(int* site){
+	adhoc_heapSite = *site;
+}
+
+#endif
+
 //------------------------------//
 //    Library API Functionss    //
 //------------------------------//
@@ -238,11 +1263,16 @@ int adhoc_sizeS(float item){
 // Returns the size (in bytes) of one complex argument's data array
 int adhoc_sizeC(adhoc_data* item){
 	adhoc_referenceData(item);
-	int ret = item->sizeData - (item->type==DATA_STRING?1:0);
+	int ret = adhoc_sizeC_borrowed(item);
 	adhoc_unreferenceData(item);
 	return ret;
 }
 
+// Returns the size of a complex argument the caller already holds
+int adhoc_sizeC_borrowed(adhoc_data* item){
+	return item->sizeData - (item->type==DATA_STRING?1:0);
+}
+
 // Returns the count of items in one simple argument (always 1)
 int adhoc_countS(float item){
 	return sizeof(item)/sizeof(float);
@@ -269,7 +1299,13 @@ adhoc_data* adhoc_toStringS(adhoc_dataType t, float item){
 // Convert any wrapped datatype to a wrapped string
 adhoc_data* adhoc_toStringC(adhoc_data* item){
 	adhoc_referenceData(item);
+	adhoc_data* ret = adhoc_toStringC_borrowed(item);
+	adhoc_unreferenceData(item);
+	return ret;
+}
 
+// Convert a wrapped datatype the caller already holds to a wrapped string
+adhoc_data* adhoc_toStringC_borrowed(adhoc_data* item){
 	// Create an output buffer
 	int size = 256,len;
 	char* buf = malloc(size);
@@ -333,7 +1369,7 @@ adhoc_data* adhoc_toStringC(adhoc_data* item){
 			case DATA_STRUCT:
 				// Get one item in the array
 				;adhoc_data* cItem = adhoc_getCArrayData(item, i);
-				str = adhoc_referenceData(adhoc_toStringC(cItem));
+				str = adhoc_referenceData(adhoc_toStringC_borrowed(cItem));
 				break;
 			}
 
@@ -355,18 +1391,110 @@ adhoc_data* adhoc_toStringC(adhoc_data* item){
 
 			// Drop references
 			adhoc_unreferenceData(str);
-			++checked;
+			++checked;
+		}
+		if(size<total+2) buf = realloc(buf,(size*=2));
+		buf[total++]=']';
+		buf[total]='\0';
+		break;
+
+	// Handle hashes
+	case DATA_HASH:
+		;adhoc_hashSlot* slot = NULL;
+		adhoc_data* keyStr = NULL;
+		total = 1;
+		buf[0] = '{';
+		buf[1] = '\0';
+		// Loop through the live slots, printing each key and its item
+		while((slot = adhoc_nextHashSlot(item, slot))){
+			keyStr = adhoc_referenceData(slot->strKey
+				? slot->strKey
+				: adhoc_toStringS(DATA_INT, slot->intKey)
+			);
+			switch(item->dataType){
+			case DATA_BOOL:
+				str = adhoc_toStringS(DATA_BOOL, slot->value.boolVal);
+				break;
+			case DATA_INT:
+				str = adhoc_toStringS(DATA_INT, slot->value.intVal);
+				break;
+			case DATA_FLOAT:
+				str = adhoc_toStringS(DATA_FLOAT, slot->value.floatVal);
+				break;
+			case DATA_STRING:
+			case DATA_ARRAY:
+			case DATA_HASH:
+			case DATA_STRUCT:
+				str = adhoc_toStringC_borrowed(slot->value.cmplxVal);
+				break;
+			default:
+				str = adhoc_createString("<<VOID>>");
+			}
+			adhoc_referenceData(str);
+
+			// Add "key: item" and a comma if needed
+			len = keyStr->sizeData-1 + 2 + str->sizeData-1 + 2;
+			while(size<total+len+2) buf = realloc(buf,(size*=2));
+			total += sprintf(buf+total, "%s%s: %s"
+				,(total>1 ? ", " : "")
+				,(char*)keyStr->data
+				,(char*)str->data
+			);
+			adhoc_unreferenceData(keyStr);
+			adhoc_unreferenceData(str);
+		}
+		buf[total++]='}';
+		buf[total]='\0';
+		break;
+
+	// Handle structs
+	case DATA_STRUCT:
+		;const adhoc_structLayout* layout = ADHOC_STRUCT_LAYOUT(item);
+		total = 1;
+		buf[0] = '{';
+		buf[1] = '\0';
+		// Loop through the fields in the order they were declared
+		for(i=0; i<layout->countFields; ++i){
+			void* field = (char*)item->data + layout->offsets[i];
+			switch(layout->types[i]){
+			case DATA_BOOL:
+				str = adhoc_toStringS(DATA_BOOL, *(bool*)field);
+				break;
+			case DATA_INT:
+				str = adhoc_toStringS(DATA_INT, *(int*)field);
+				break;
+			case DATA_FLOAT:
+				str = adhoc_toStringS(DATA_FLOAT, *(float*)field);
+				break;
+			case DATA_STRING:
+			case DATA_ARRAY:
+			case DATA_HASH:
+			case DATA_STRUCT:
+				str = (*(adhoc_data**)field
+					? adhoc_toStringC_borrowed(*(adhoc_data**)field)
+					: adhoc_createString("<<VOID>>")
+				);
+				break;
+			default:
+				str = adhoc_createString("<<VOID>>");
+			}
+			adhoc_referenceData(str);
+
+			// Add "name: item" and a comma if needed
+			len = strlen(layout->names[i]) + 2 + str->sizeData-1 + 2;
+			while(size<total+len+2) buf = realloc(buf,(size*=2));
+			total += sprintf(buf+total, "%s%s: %s"
+				,(i ? ", " : "")
+				,layout->names[i]
+				,(char*)str->data
+			);
+			adhoc_unreferenceData(str);
 		}
-		if(size<total+2) buf = realloc(buf,(size*=2));
-		buf[total++]=']';
+		buf[total++]='}';
 		buf[total]='\0';
 		break;
-
-	case DATA_HASH: snprintf(buf, size, "<<HASH>>"); break;
-	case DATA_STRUCT: snprintf(buf, size, "<<STRUCT>>"); break;
 	}
 
-	adhoc_unreferenceData(item);
 	adhoc_data* ret = adhoc_createString(buf);
 	free(buf);
 	return ret;
@@ -417,7 +1545,7 @@ void adhoc_print(char* format, ...){
 		case '_':
 			// Fetch a complex item
 			;adhoc_data* dat = adhoc_referenceData(va_arg(args, adhoc_data*));
-			adhoc_data* datStr = adhoc_referenceData(adhoc_toStringC(dat));
+			adhoc_data* datStr = adhoc_referenceData(adhoc_toStringC_borrowed(dat));
 			adhoc_unreferenceData(dat);
 			printf("%s", (char*)adhoc_getData(datStr));
 			adhoc_unreferenceData(datStr);
@@ -435,7 +1563,62 @@ void adhoc_print(char* format, ...){
 	va_end(args);
 }
 
+// Prompt for type-verified input for a variable. v points at the variable,
+// which keeps its value if input runs out, and lines that do not parse as
+// its type are asked for again
+void adhoc_prompt(adhoc_dataType t, void* v){
+	char* line = NULL;
+	char* end;
+	size_t size = 0;
+	ssize_t len;
+	long i;
+	double f;
+	while((len = getline(&line, &size, stdin)) >= 0){
+		while(len && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+		if(t == DATA_BOOL && (!strcmp(line, "true") || !strcmp(line, "1"))){
+			*(bool*)v = true;
+			break;
+		}
+		if(t == DATA_BOOL && (!strcmp(line, "false") || !strcmp(line, "0"))){
+			*(bool*)v = false;
+			break;
+		}
+		if(t == DATA_INT && len){
+			i = strtol(line, &end, 10);
+			if(!*end && i >= INT_MIN && i <= INT_MAX){
+				*(int*)v = i;
+				break;
+			}
+		}
+		if(t == DATA_FLOAT && len){
+			f = strtod(line, &end);
+			if(!*end){
+				*(float*)v = f;
+				break;
+			}
+		}
+		if(t == DATA_STRING){
+			adhoc_data* old = *(adhoc_data**)v;
+			*(adhoc_data**)v = adhoc_referenceData(adhoc_createString(line));
+			adhoc_unreferenceData(old);
+			break;
+		}
+		if(t != DATA_BOOL && t != DATA_INT && t != DATA_FLOAT) break;
+	}
+	free(line);
+}
+
 //-- STRINGS --//
+// Make room for size bytes in a string, growing its capacity geometrically
+void adhoc_reserveString(adhoc_data* s, int size){
+	if(size <= s->capacityData) return;
+	int newCapacity = s->capacityData*2;
+	if(newCapacity < size) newCapacity = size;
+	s->data = realloc(s->data, newCapacity);
+	s->capacityData = newCapacity;
+	ADHOC_HEAP_TRACK(s);
+}
+
 // Append one argument to an existing string
 void adhoc_append_to_string(char* format, adhoc_data* baseString, ...){
 	adhoc_referenceData(baseString);
@@ -472,7 +1655,7 @@ void adhoc_append_to_string(char* format, adhoc_data* baseString, ...){
 	case '_':
 		// Fetch a complex item
 		;adhoc_data* dat = adhoc_referenceData(va_arg(args, adhoc_data*));
-		str = adhoc_referenceData(adhoc_toStringC(dat));
+		str = adhoc_referenceData(adhoc_toStringC_borrowed(dat));
 		adhoc_unreferenceData(dat);
 		break;
 	default:
@@ -481,10 +1664,12 @@ void adhoc_append_to_string(char* format, adhoc_data* baseString, ...){
 		break;
 	}
 
-	// Append str to baseString
+	// Append str to baseString. They may be the same string, whose ending NUL
+	// is overwritten by its own first byte, so the NUL is put back after
 	len = baseString->sizeData-1 + str->sizeData;
-	baseString->data = realloc(baseString->data, len);
-	memcpy(baseString->data+baseString->sizeData-1, str->data, str->sizeData);
+	adhoc_reserveString(baseString, len);
+	memmove(baseString->data+baseString->sizeData-1, str->data, str->sizeData-1);
+	((char*)baseString->data)[len-1] = '\0';
 	baseString->sizeData = len;
 	adhoc_unreferenceData(str);
 	adhoc_unreferenceData(baseString);
@@ -546,7 +1731,7 @@ adhoc_data* adhoc_concat(char* format, ...){
 		case '_':
 			// Fetch a complex item
 			;adhoc_data* dat = adhoc_referenceData(va_arg(args, adhoc_data*));
-			newItem = adhoc_referenceData(adhoc_toStringC(dat));
+			newItem = adhoc_referenceData(adhoc_toStringC_borrowed(dat));
 			adhoc_unreferenceData(dat);
 			break;
 		default:
@@ -558,8 +1743,8 @@ adhoc_data* adhoc_concat(char* format, ...){
 		// Copy into the output string
 		newLen += newItem->sizeData-1;
 		while(newSize < newLen) newSize <<= 1;
-		if(newSize > str->sizeData)
-			str->data = realloc(str->data, (str->sizeData=newSize));
+		if(newSize > str->capacityData)
+			str->data = realloc(str->data, (str->capacityData=newSize));
 		memcpy((char*)str->data+len-1, (char*)newItem->data, newLen-len+1);
 		len = newLen;
 		adhoc_unreferenceData(newItem);
@@ -573,15 +1758,23 @@ adhoc_data* adhoc_concat(char* format, ...){
 
 	// Return the string with all the concatenations
 	str->data = realloc(str->data, newLen);
+	str->sizeData = str->capacityData = newLen;
+	ADHOC_HEAP_TRACK(str);
 	return str;
 }
 
 // Copy from s starting at start and running for length
 adhoc_data* adhoc_substring(adhoc_data* baseString, int index, int length){
 	adhoc_referenceData(baseString);
+	adhoc_data* ret = adhoc_substring_borrowed(baseString, index, length);
+	adhoc_unreferenceData(baseString);
+	return ret;
+}
+
+// Copy from a string the caller already holds, starting at index for length
+adhoc_data* adhoc_substring_borrowed(adhoc_data* baseString, int index, int length){
 	++length;
 	if(index>=baseString->sizeData || length<1){
-		adhoc_unreferenceData(baseString);
 		return adhoc_createString("");
 	}
 	if(index+length >= baseString->sizeData)
@@ -589,7 +1782,6 @@ adhoc_data* adhoc_substring(adhoc_data* baseString, int index, int length){
 	char* data = malloc(length);
 	memcpy(data, baseString->data+index, length);
 	data[length-1] = '\0';
-	adhoc_unreferenceData(baseString);
 	return adhoc_createData(DATA_STRING, data, DATA_VOID, length);
 }
 
@@ -597,57 +1789,318 @@ adhoc_data* adhoc_substring(adhoc_data* baseString, int index, int length){
 adhoc_data* adhoc_splice_string(adhoc_data* baseString, adhoc_data* replacement, int index, int length){
 	adhoc_referenceData(baseString);
 	adhoc_referenceData(replacement);
-	adhoc_data* ret = adhoc_substring(baseString, index, length);
-	if(index >= baseString->sizeData){
-		adhoc_unreferenceData(baseString);
-		adhoc_unreferenceData(replacement);
-		return ret;
-	}
-	int newLen = baseString->sizeData - ret->sizeData + replacement->sizeData;
-	int carryOverLen = (index+length < baseString->sizeData-1)
-		? baseString->sizeData-1 - (index+length)
-		: 0;
-	char* tempBuffer = NULL;
-	if(carryOverLen){
-		tempBuffer = memcpy(
-			malloc(carryOverLen)
-			,baseString->data+index+length
-			,carryOverLen
-		);
-	}
-	memcpy(
-		baseString->data+index
-		,replacement->data
-		,replacement->sizeData-1
-	);
-	if(carryOverLen){
-		memcpy(
-			baseString->data+index+replacement->sizeData-1
-			,tempBuffer
-			,carryOverLen
-		);
-		free(tempBuffer);
-	}
-	baseString->sizeData = newLen;
-	baseString->data = realloc(baseString->data, newLen);
-	((char*)(baseString->data))[newLen-1] = '\0';
+	adhoc_data* ret = adhoc_splice_string_borrowed(baseString, replacement, index, length);
 	adhoc_unreferenceData(baseString);
 	adhoc_unreferenceData(replacement);
 	return ret;
 }
 
+// Splice into a string with a replacement, both already held by the caller
+adhoc_data* adhoc_splice_string_borrowed(adhoc_data* baseString, adhoc_data* replacement, int index, int length){
+	adhoc_data* ret = adhoc_substring_borrowed(baseString, index, length);
+	adhoc_splice_string_discard_borrowed(baseString, replacement, index, length);
+	return ret;
+}
+
+// Patch the replacement over the base string at index, dropping what is replaced
+void adhoc_splice_string_discard(adhoc_data* baseString, adhoc_data* replacement, int index, int length){
+	adhoc_referenceData(baseString);
+	adhoc_referenceData(replacement);
+	adhoc_splice_string_discard_borrowed(baseString, replacement, index, length);
+	adhoc_unreferenceData(baseString);
+	adhoc_unreferenceData(replacement);
+}
+
+// Splice without keeping the replaced text, both strings already held
+void adhoc_splice_string_discard_borrowed(adhoc_data* baseString, adhoc_data* replacement, int index, int length){
+	int baseLen = baseString->sizeData-1;
+	int replaceLen = replacement->sizeData-1;
+	if(index<0 || index>baseLen) return;
+	if(length<0) length = 0;
+	if(length > baseLen-index) length = baseLen-index;
+
+	// Splicing a string into itself needs the replacement kept aside
+	char* replaceData = replacement->data;
+	if(replacement == baseString) replaceData = memcpy(malloc(replaceLen), replaceData, replaceLen);
+
+	// Slide the tail (and terminator) into place, then drop the replacement in
+	adhoc_reserveString(baseString, baseLen-length+replaceLen+1);
+	memmove(
+		(char*)baseString->data+index+replaceLen
+		,(char*)baseString->data+index+length
+		,baseLen-index-length+1
+	);
+	memcpy((char*)baseString->data+index, replaceData, replaceLen);
+	baseString->sizeData = baseLen-length+replaceLen+1;
+	if(replaceData != replacement->data) free(replaceData);
+}
+
 // Finds the first occurrence of targetsString in baseString
 int adhoc_find_in_string(adhoc_data* baseString, adhoc_data* targetsString){
 	adhoc_referenceData(baseString);
 	adhoc_referenceData(targetsString);
-	int ret = -1;
-	char* loc = strstr((char*)baseString->data, (char*)targetsString->data);
-	if(loc) ret = loc - (char*)baseString->data;
+	int ret = adhoc_find_in_string_borrowed(baseString, targetsString);
+	adhoc_unreferenceData(baseString);
+	adhoc_unreferenceData(targetsString);
+	return ret;
+}
+
+// Finds targetsString in baseString, both already held by the caller
+int adhoc_find_in_string_borrowed(adhoc_data* baseString, adhoc_data* targetsString){
+	adhoc_needle needle = ADHOC_NEEDLE_OF(targetsString);
+	return adhoc_find_needle_borrowed(baseString, &needle);
+}
+
+// Finds every occurrence of targetsString in baseString as an array of indices
+adhoc_data* adhoc_find_all_in_string(adhoc_data* baseString, adhoc_data* targetsString){
+	adhoc_referenceData(baseString);
+	adhoc_referenceData(targetsString);
+	adhoc_data* ret = adhoc_find_all_in_string_borrowed(baseString, targetsString);
+	adhoc_unreferenceData(baseString);
+	adhoc_unreferenceData(targetsString);
+	return ret;
+}
+
+// Finds every targetsString in baseString, both already held by the caller
+adhoc_data* adhoc_find_all_in_string_borrowed(adhoc_data* baseString, adhoc_data* targetsString){
+	adhoc_needle needle = ADHOC_NEEDLE_OF(targetsString);
+	return adhoc_find_all_needle_borrowed(baseString, &needle);
+}
+
+// Counts the occurrences of targetsString in baseString
+int adhoc_count_occurrences(adhoc_data* baseString, adhoc_data* targetsString){
+	adhoc_referenceData(baseString);
+	adhoc_referenceData(targetsString);
+	int ret = adhoc_count_occurrences_borrowed(baseString, targetsString);
 	adhoc_unreferenceData(baseString);
 	adhoc_unreferenceData(targetsString);
 	return ret;
 }
 
+// Counts targetsString in baseString, both already held by the caller
+int adhoc_count_occurrences_borrowed(adhoc_data* baseString, adhoc_data* targetsString){
+	adhoc_needle needle = ADHOC_NEEDLE_OF(targetsString);
+	return adhoc_count_needle_borrowed(baseString, &needle);
+}
+
+//-- STRING SEARCH --//
+// Searches use the strings' stored lengths rather than NUL terminators.
+// Single-byte needles go straight to memchr, and needles up to
+// ADHOC_SHORT_NEEDLE bytes filter candidate positions by their first and
+// last byte, 16 positions at a time with SSE2 where available. Longer ones
+// use the Two-Way algorithm, whose critical factorization is worked out
+// once per adhoc_needle and kept for later searches.
+#define ADHOC_SHORT_NEEDLE 32
+
+// Maximal suffix of x under the normal or reversed byte order
+static int adhoc_maxSuffix(const unsigned char* x, int m, int* period, bool reversed){
+	int ms = -1, j = 0, k = 1, p = 1;
+	while(j+k < m){
+		unsigned char a = x[j+k], b = x[ms+k];
+		if(reversed ? a > b : a < b){
+			j += k;
+			k = 1;
+			p = j - ms;
+		}else if(a == b){
+			if(k != p){
+				++k;
+			}else{
+				j += p;
+				k = 1;
+			}
+		}else{
+			ms = j;
+			j = ms+1;
+			k = p = 1;
+		}
+	}
+	*period = p;
+	return ms;
+}
+
+// Work out a needle's critical factorization for Two-Way searches. The
+// first thread to get here works it out while any others wait
+void adhoc_compileNeedle(adhoc_needle* needle){
+	const unsigned char* x = (const unsigned char*)needle->data;
+	int m = needle->length, p, q, state = 0;
+	if(!__atomic_compare_exchange_n(&needle->state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)){
+		while(__atomic_load_n(&needle->state, __ATOMIC_ACQUIRE) != 2) sched_yield();
+		return;
+	}
+	int i = adhoc_maxSuffix(x, m, &p, false);
+	int j = adhoc_maxSuffix(x, m, &q, true);
+	if(i > j){
+		needle->critPos = i;
+		needle->period = p;
+	}else{
+		needle->critPos = j;
+		needle->period = q;
+	}
+	// If the left half doesn't repeat with that period, shift by as much as
+	// the factorization guarantees is safe instead
+	needle->periodic = !memcmp(x, x+needle->period, needle->critPos+1);
+	if(!needle->periodic){
+		int l = needle->critPos+1, r = m-needle->critPos-1;
+		needle->period = (l > r ? l : r) + 1;
+	}
+	__atomic_store_n(&needle->state, 2, __ATOMIC_RELEASE);
+}
+
+// Two-Way search of y[from, n) for a compiled needle
+static int adhoc_searchTwoWay(const unsigned char* y, int n, adhoc_needle* needle, int from){
+	const unsigned char* x = (const unsigned char*)needle->data;
+	int m = needle->length, ell = needle->critPos, i, j = from, memory = -1;
+	int per = needle->period;
+	if(needle->periodic){
+		while(j <= n-m){
+			i = (ell > memory ? ell : memory) + 1;
+			while(i < m && x[i] == y[i+j]) ++i;
+			if(i >= m){
+				i = ell;
+				while(i > memory && x[i] == y[i+j]) --i;
+				if(i <= memory) return j;
+				j += per;
+				memory = m - per - 1;
+			}else{
+				j += i - ell;
+				memory = -1;
+			}
+		}
+	}else{
+		while(j <= n-m){
+			i = ell+1;
+			while(i < m && x[i] == y[i+j]) ++i;
+			if(i >= m){
+				i = ell;
+				while(i >= 0 && x[i] == y[i+j]) --i;
+				if(i < 0) return j;
+				j += per;
+			}else{
+				j += i - ell;
+			}
+		}
+	}
+	return -1;
+}
+
+// First/last byte filtered search of y[from, n) for a short needle
+static int adhoc_searchShort(const unsigned char* y, int n, const unsigned char* x, int m, int from){
+	int j = from;
+	unsigned char first = x[0], last = x[m-1];
+#ifdef __SSE2__
+	const __m128i vFirst = _mm_set1_epi8(first);
+	const __m128i vLast = _mm_set1_epi8(last);
+	for(; j+m-1+16 <= n; j+=16){
+		__m128i a = _mm_loadu_si128((const __m128i*)(y+j));
+		__m128i b = _mm_loadu_si128((const __m128i*)(y+j+m-1));
+		int bits = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(a, vFirst)
+			,_mm_cmpeq_epi8(b, vLast)
+		));
+		while(bits){
+			int k = __builtin_ctz(bits);
+			if(!memcmp(y+j+k+1, x+1, m-2)) return j+k;
+			bits &= bits-1;
+		}
+	}
+#endif
+	for(; j <= n-m; ++j){
+		const unsigned char* hit = memchr(y+j, first, n-m-j+1);
+		if(!hit) return -1;
+		j = hit - y;
+		if(y[j+m-1] == last && !memcmp(y+j+1, x+1, m-2)) return j;
+	}
+	return -1;
+}
+
+// Search y[from, n) for a needle, compiling it on first use if it is long
+static int adhoc_searchNeedle(const char* y, int n, adhoc_needle* needle, int from){
+	int m = needle->length;
+	if(m == 0) return (from <= n ? from : -1);
+	if(m > n-from) return -1;
+	if(m == 1){
+		const char* hit = memchr(y+from, needle->data[0], n-from);
+		return hit ? hit - y : -1;
+	}
+	if(m <= ADHOC_SHORT_NEEDLE){
+		return adhoc_searchShort(
+			(const unsigned char*)y
+			,n
+			,(const unsigned char*)needle->data
+			,m
+			,from
+		);
+	}
+	if(__atomic_load_n(&needle->state, __ATOMIC_ACQUIRE) != 2) adhoc_compileNeedle(needle);
+	return adhoc_searchTwoWay((const unsigned char*)y, n, needle, from);
+}
+
+// Finds the first occurrence of a compiled needle in baseString
+int adhoc_find_needle(adhoc_data* baseString, adhoc_needle* needle){
+	adhoc_referenceData(baseString);
+	int ret = adhoc_find_needle_borrowed(baseString, needle);
+	adhoc_unreferenceData(baseString);
+	return ret;
+}
+
+// Finds a compiled needle in a baseString the caller already holds
+int adhoc_find_needle_borrowed(adhoc_data* baseString, adhoc_needle* needle){
+	return adhoc_searchNeedle(baseString->data, baseString->sizeData-1, needle, 0);
+}
+
+// Finds every non-overlapping occurrence of a compiled needle in baseString
+adhoc_data* adhoc_find_all_needle(adhoc_data* baseString, adhoc_needle* needle){
+	adhoc_referenceData(baseString);
+	adhoc_data* ret = adhoc_find_all_needle_borrowed(baseString, needle);
+	adhoc_unreferenceData(baseString);
+	return ret;
+}
+
+// Finds every compiled needle in a baseString the caller already holds
+adhoc_data* adhoc_find_all_needle_borrowed(adhoc_data* baseString, adhoc_needle* needle){
+	adhoc_data* ret = adhoc_createArray(DATA_INT, 1);
+	int n = baseString->sizeData-1, at = 0, count = 0;
+	if(!needle->length) return ret;
+	while((at = adhoc_searchNeedle(baseString->data, n, needle, at)) >= 0){
+		adhoc_set_int(ret, count++, at);
+		at += needle->length;
+	}
+	return ret;
+}
+
+// Counts the non-overlapping occurrences of a compiled needle in baseString
+int adhoc_count_needle(adhoc_data* baseString, adhoc_needle* needle){
+	adhoc_referenceData(baseString);
+	int ret = adhoc_count_needle_borrowed(baseString, needle);
+	adhoc_unreferenceData(baseString);
+	return ret;
+}
+
+// Counts a compiled needle in a baseString the caller already holds
+int adhoc_count_needle_borrowed(adhoc_data* baseString, adhoc_needle* needle){
+	int n = baseString->sizeData-1, at = 0, count = 0;
+	if(!needle->length) return 0;
+	while((at = adhoc_searchNeedle(baseString->data, n, needle, at)) >= 0){
+		++count;
+		at += needle->length;
+	}
+	return count;
+}
+
+//-- HASHES --//
+// Check whether a key is set in a hash
+bool adhoc_isset_hash(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	return adhoc_findHashSlot(hash, strKey, intKey) != NULL;
+}
+
+// Remove a key and its item from a hash
+bool adhoc_remove_from_hash(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	adhoc_referenceData(hash);
+	bool ret = adhoc_deleteHashData(hash, strKey, intKey);
+	adhoc_unreferenceData(hash);
+	return ret;
+}
+
 //-- ARRAYS --//
 // Check whether arr[i] has been set
 bool adhoc_isset_array(adhoc_data* arr, int i){
@@ -683,20 +2136,20 @@ void adhoc_append_to_array(char* format, adhoc_data* baseArray, ...){
 	switch(format[1]){
 	case 'b':
 		// Fetch a boolean primative
-		adhoc_assignArrayData(baseArray, pos, NULL, va_arg(args, int));
+		adhoc_assignArrayData_borrowed(baseArray, pos, NULL, va_arg(args, int));
 		break;
 	case 'd':
 		// Fetch an integer primative
-		adhoc_assignArrayData(baseArray, pos, NULL, va_arg(args, int));
+		adhoc_assignArrayData_borrowed(baseArray, pos, NULL, va_arg(args, int));
 		break;
 	case 'f':
 		// Fetch a float primative
-		adhoc_assignArrayData(baseArray, pos, NULL, va_arg(args, double));
+		adhoc_assignArrayData_borrowed(baseArray, pos, NULL, va_arg(args, double));
 		break;
 	case 's':
 	case '_':
 		// Fetch a string or other complex item
-		adhoc_assignArrayData(baseArray, pos, va_arg(args, adhoc_data*), 0);
+		adhoc_assignArrayData_borrowed(baseArray, pos, va_arg(args, adhoc_data*), 0);
 		break;
 	default:
 		// Handle other cases
@@ -710,75 +2163,542 @@ void adhoc_append_to_array(char* format, adhoc_data* baseArray, ...){
 	adhoc_unreferenceData(baseArray);
 }
 
-// Find the max value in an array
-void* adhoc_find_max_value(adhoc_data* inputArray){
-	adhoc_referenceData(inputArray);
+//-- ARRAY REDUCTIONS --//
+// Reductions over int and float arrays walk the data one mappedData byte
+// (DATA_MAP_BIT_FIELD_SIZE indices) at a time. Fully-set blocks are reduced
+// straight from the dense data and partially-set blocks mask their unset
+// lanes, so holes never cost a per-element isset check. On x86 the AVX2 or
+// SSE2 kernel is chosen on first use; everywhere else the scalar one is used.
+
+// Operations supported by the reduction kernels
+typedef enum adhoc_reduceOp {
+	REDUCE_MAX
+	,REDUCE_MIN
+	,REDUCE_SUM
+	,REDUCE_COUNT_GT
+	,REDUCE_FIND
+} adhoc_reduceOp;
+
+// Kernel signatures: reduce n items (a whole number of blocks for SIMD ones)
+typedef long long (*adhoc_intKernel)(const int*, const char*, int, adhoc_reduceOp, int);
+typedef double (*adhoc_floatKernel)(const float*, const char*, int, adhoc_reduceOp, float);
+static adhoc_intKernel adhoc_reduceIntKernel = NULL;
+static adhoc_floatKernel adhoc_reduceFloatKernel = NULL;
+
+// Check one bit of a mappedData block
+#define ADHOC_MAPPED(map, i) \
+	((map)[(i)/DATA_MAP_BIT_FIELD_SIZE] & (1<<((i)%DATA_MAP_BIT_FIELD_SIZE)))
+
+// Scalar int kernel, used as the fallback and for trailing partial blocks
+static long long adhoc_reduceInt_scalar(const int* data, const char* map, int n, adhoc_reduceOp op, int arg){
+	long long ret;
+	int i;
+	switch(op){
+	case REDUCE_MAX:
+		for(ret=INT_MIN,i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i) && data[i] > ret) ret = data[i];
+		return ret;
+	case REDUCE_MIN:
+		for(ret=INT_MAX,i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i) && data[i] < ret) ret = data[i];
+		return ret;
+	case REDUCE_SUM:
+		for(ret=0,i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i)) ret += data[i];
+		return ret;
+	case REDUCE_COUNT_GT:
+		for(ret=0,i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i) && data[i] > arg) ++ret;
+		return ret;
+	case REDUCE_FIND:
+		for(i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i) && data[i] == arg) return i;
+		return -1;
+	}
+	return 0;
+}
 
-	int index = adhoc_find_max_value_index(inputArray);
-	void* result = adhoc_getSArrayData(inputArray, index);
+// Scalar float kernel, used as the fallback and for trailing partial blocks
+static double adhoc_reduceFloat_scalar(const float* data, const char* map, int n, adhoc_reduceOp op, float arg){
+	double ret;
+	int i;
+	switch(op){
+	case REDUCE_MAX:
+		for(ret=-INFINITY,i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i) && data[i] > ret) ret = data[i];
+		return ret;
+	case REDUCE_MIN:
+		for(ret=INFINITY,i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i) && data[i] < ret) ret = data[i];
+		return ret;
+	case REDUCE_SUM:
+		for(ret=0,i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i)) ret += data[i];
+		return ret;
+	case REDUCE_COUNT_GT:
+		for(ret=0,i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i) && data[i] > arg) ++ret;
+		return ret;
+	case REDUCE_FIND:
+		for(i=0; i<n; ++i)
+			if(ADHOC_MAPPED(map, i) && data[i] == arg) return i;
+		return -1;
+	}
+	return 0;
+}
 
-	adhoc_unreferenceData(inputArray);
-	return result;
+#ifdef ADHOC_X86_KERNELS
+// Expand the low four bits of a map byte into an SSE2 lane mask
+__attribute__((target("sse2")))
+static inline __m128i adhoc_laneMask128(int bits){
+	const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+	return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), lanes), lanes);
 }
 
-// Find the index of the max value in an array
-int adhoc_find_max_value_index(adhoc_data* inputArray){
-	adhoc_referenceData(inputArray);
+// Pick lanes of a where the mask is set and lanes of b elsewhere
+__attribute__((target("sse2")))
+static inline __m128i adhoc_select128(__m128i m, __m128i a, __m128i b){
+	return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
 
-	int i, count, bestIndex=-1;
-	bool bestBool = false;
-	int bestInt = 0;
-	float bestFloat = 0;
-	void* tempData;
-	int arrCount = adhoc_countC(inputArray);
-	int arrSize = adhoc_sizeC(inputArray);
-	if(arrCount<1){
-		adhoc_unreferenceData(inputArray);
-		return bestIndex;
-	}
-
-	for(i=0,count=0; i<arrSize&&count<arrCount; ++i){
-		if(!adhoc_isset_array(inputArray, i)) continue;
-		tempData = adhoc_getSArrayData(inputArray, i);
-		if(bestIndex == -1){
-			bestIndex = i;
-			switch(inputArray->dataType){
-			case DATA_BOOL: bestBool = *(bool*)tempData; break;
-			case DATA_INT: bestInt = *(int*)tempData; break;
-			case DATA_FLOAT: bestFloat = *(float*)tempData; break;
-			default:
-				adhoc_unreferenceData(inputArray);
-				return -1;
+// SSE2 int kernel over whole blocks, as two 4-lane halves per block
+__attribute__((target("sse2")))
+static long long adhoc_reduceInt_sse2(const int* data, const char* map, int n, adhoc_reduceOp op, int arg){
+	int b, j, bits, blocks = n/DATA_MAP_BIT_FIELD_SIZE;
+	long long ret = 0;
+	__m128i acc, v, m, t;
+	int outInt[4];
+	long long outLong[2];
+	switch(op){
+	case REDUCE_MAX:
+	case REDUCE_MIN:
+		acc = _mm_set1_epi32(op==REDUCE_MAX ? INT_MIN : INT_MAX);
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			for(j=0; j<2 && bits; ++j, bits>>=4){
+				if(!(bits & 0xF)) continue;
+				v = _mm_loadu_si128((const __m128i*)(data+b*8+j*4));
+				if((bits & 0xF) != 0xF) v = adhoc_select128(adhoc_laneMask128(bits), v, acc);
+				m = (op==REDUCE_MAX ? _mm_cmpgt_epi32(v, acc) : _mm_cmpgt_epi32(acc, v));
+				acc = adhoc_select128(m, v, acc);
+			}
+		}
+		_mm_storeu_si128((__m128i*)outInt, acc);
+		ret = outInt[0];
+		for(j=1; j<4; ++j){
+			if(op==REDUCE_MAX ? outInt[j] > ret : outInt[j] < ret) ret = outInt[j];
+		}
+		return ret;
+	case REDUCE_SUM:
+		acc = _mm_setzero_si128();
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			for(j=0; j<2 && bits; ++j, bits>>=4){
+				if(!(bits & 0xF)) continue;
+				v = _mm_loadu_si128((const __m128i*)(data+b*8+j*4));
+				if((bits & 0xF) != 0xF) v = _mm_and_si128(v, adhoc_laneMask128(bits));
+				t = _mm_srai_epi32(v, 31);
+				acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, t));
+				acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, t));
 			}
 		}
+		_mm_storeu_si128((__m128i*)outLong, acc);
+		return outLong[0] + outLong[1];
+	case REDUCE_COUNT_GT:
+	case REDUCE_FIND:
+		t = _mm_set1_epi32(arg);
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			if(!bits) continue;
+			v = _mm_loadu_si128((const __m128i*)(data+b*8));
+			m = _mm_loadu_si128((const __m128i*)(data+b*8+4));
+			if(op == REDUCE_COUNT_GT){
+				bits &= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, t)))
+					| _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(m, t)))<<4;
+				ret += __builtin_popcount(bits);
+			}else{
+				bits &= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, t)))
+					| _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(m, t)))<<4;
+				if(bits) return b*DATA_MAP_BIT_FIELD_SIZE + __builtin_ctz(bits);
+			}
+		}
+		return (op == REDUCE_FIND ? -1 : ret);
+	}
+	return 0;
+}
 
-		switch(inputArray->dataType){
-		case DATA_BOOL:
-			;bool tempBool = *(bool*)tempData;
-			if(tempBool && !bestBool){
-				bestBool = true;
-				bestIndex = i;
+// SSE2 float kernel over whole blocks, as two 4-lane halves per block
+__attribute__((target("sse2")))
+static double adhoc_reduceFloat_sse2(const float* data, const char* map, int n, adhoc_reduceOp op, float arg){
+	int b, j, bits, blocks = n/DATA_MAP_BIT_FIELD_SIZE;
+	double ret = 0;
+	__m128 acc, v, w, m;
+	__m128d sum;
+	float outFloat[4];
+	double outDouble[2];
+	switch(op){
+	case REDUCE_MAX:
+	case REDUCE_MIN:
+		acc = _mm_set1_ps(op==REDUCE_MAX ? -INFINITY : INFINITY);
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			for(j=0; j<2 && bits; ++j, bits>>=4){
+				if(!(bits & 0xF)) continue;
+				v = _mm_loadu_ps(data+b*8+j*4);
+				if((bits & 0xF) != 0xF){
+					m = _mm_castsi128_ps(adhoc_laneMask128(bits));
+					v = _mm_or_ps(_mm_and_ps(m, v), _mm_andnot_ps(m, acc));
+				}
+				acc = (op==REDUCE_MAX ? _mm_max_ps(acc, v) : _mm_min_ps(acc, v));
 			}
-			break;
-		case DATA_INT:
-			;int tempInt = *(int*)tempData;
-			if(tempInt > bestInt){
-				bestInt = tempInt;
-				bestIndex = i;
+		}
+		_mm_storeu_ps(outFloat, acc);
+		ret = outFloat[0];
+		for(j=1; j<4; ++j){
+			if(op==REDUCE_MAX ? outFloat[j] > ret : outFloat[j] < ret) ret = outFloat[j];
+		}
+		return ret;
+	case REDUCE_SUM:
+		sum = _mm_setzero_pd();
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			for(j=0; j<2 && bits; ++j, bits>>=4){
+				if(!(bits & 0xF)) continue;
+				v = _mm_loadu_ps(data+b*8+j*4);
+				if((bits & 0xF) != 0xF) v = _mm_and_ps(v, _mm_castsi128_ps(adhoc_laneMask128(bits)));
+				sum = _mm_add_pd(sum, _mm_cvtps_pd(v));
+				sum = _mm_add_pd(sum, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
 			}
-			break;
-		case DATA_FLOAT:
-			;float tempFloat = *(float*)tempData;
-			if(tempFloat > bestFloat){
-				bestFloat = tempFloat;
-				bestIndex = i;
+		}
+		_mm_storeu_pd(outDouble, sum);
+		return outDouble[0] + outDouble[1];
+	case REDUCE_COUNT_GT:
+	case REDUCE_FIND:
+		m = _mm_set1_ps(arg);
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			if(!bits) continue;
+			v = _mm_loadu_ps(data+b*8);
+			w = _mm_loadu_ps(data+b*8+4);
+			if(op == REDUCE_COUNT_GT){
+				bits &= _mm_movemask_ps(_mm_cmpgt_ps(v, m))
+					| _mm_movemask_ps(_mm_cmpgt_ps(w, m))<<4;
+				ret += __builtin_popcount(bits);
+			}else{
+				bits &= _mm_movemask_ps(_mm_cmpeq_ps(v, m))
+					| _mm_movemask_ps(_mm_cmpeq_ps(w, m))<<4;
+				if(bits) return b*DATA_MAP_BIT_FIELD_SIZE + __builtin_ctz(bits);
 			}
-			break;
-		default:
-			break;
 		}
+		return (op == REDUCE_FIND ? -1 : ret);
+	}
+	return 0;
+}
+
+// Expand a map byte into an AVX2 lane mask
+__attribute__((target("avx2")))
+static inline __m256i adhoc_laneMask256(int bits){
+	const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lanes), lanes);
+}
+
+// AVX2 int kernel over whole blocks, one 8-lane vector per block
+__attribute__((target("avx2")))
+static long long adhoc_reduceInt_avx2(const int* data, const char* map, int n, adhoc_reduceOp op, int arg){
+	int b, j, bits, blocks = n/DATA_MAP_BIT_FIELD_SIZE;
+	long long ret = 0;
+	__m256i acc, v, t;
+	int outInt[8];
+	long long outLong[4];
+	switch(op){
+	case REDUCE_MAX:
+	case REDUCE_MIN:
+		acc = _mm256_set1_epi32(op==REDUCE_MAX ? INT_MIN : INT_MAX);
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			if(!bits) continue;
+			v = _mm256_loadu_si256((const __m256i*)(data+b*8));
+			if(bits != 0xFF) v = _mm256_blendv_epi8(acc, v, adhoc_laneMask256(bits));
+			acc = (op==REDUCE_MAX ? _mm256_max_epi32(acc, v) : _mm256_min_epi32(acc, v));
+		}
+		_mm256_storeu_si256((__m256i*)outInt, acc);
+		ret = outInt[0];
+		for(j=1; j<8; ++j){
+			if(op==REDUCE_MAX ? outInt[j] > ret : outInt[j] < ret) ret = outInt[j];
+		}
+		return ret;
+	case REDUCE_SUM:
+		acc = _mm256_setzero_si256();
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			if(!bits) continue;
+			v = _mm256_loadu_si256((const __m256i*)(data+b*8));
+			if(bits != 0xFF) v = _mm256_and_si256(v, adhoc_laneMask256(bits));
+			acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+			acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+		}
+		_mm256_storeu_si256((__m256i*)outLong, acc);
+		return outLong[0] + outLong[1] + outLong[2] + outLong[3];
+	case REDUCE_COUNT_GT:
+	case REDUCE_FIND:
+		t = _mm256_set1_epi32(arg);
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			if(!bits) continue;
+			v = _mm256_loadu_si256((const __m256i*)(data+b*8));
+			v = (op==REDUCE_COUNT_GT ? _mm256_cmpgt_epi32(v, t) : _mm256_cmpeq_epi32(v, t));
+			bits &= _mm256_movemask_ps(_mm256_castsi256_ps(v));
+			if(op == REDUCE_COUNT_GT) ret += __builtin_popcount(bits);
+			else if(bits) return b*DATA_MAP_BIT_FIELD_SIZE + __builtin_ctz(bits);
+		}
+		return (op == REDUCE_FIND ? -1 : ret);
+	}
+	return 0;
+}
+
+// AVX2 float kernel over whole blocks, one 8-lane vector per block
+__attribute__((target("avx2")))
+static double adhoc_reduceFloat_avx2(const float* data, const char* map, int n, adhoc_reduceOp op, float arg){
+	int b, j, bits, blocks = n/DATA_MAP_BIT_FIELD_SIZE;
+	double ret = 0;
+	__m256 acc, v, t;
+	__m256d sum;
+	float outFloat[8];
+	double outDouble[4];
+	switch(op){
+	case REDUCE_MAX:
+	case REDUCE_MIN:
+		acc = _mm256_set1_ps(op==REDUCE_MAX ? -INFINITY : INFINITY);
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			if(!bits) continue;
+			v = _mm256_loadu_ps(data+b*8);
+			if(bits != 0xFF) v = _mm256_blendv_ps(acc, v, _mm256_castsi256_ps(adhoc_laneMask256(bits)));
+			acc = (op==REDUCE_MAX ? _mm256_max_ps(acc, v) : _mm256_min_ps(acc, v));
+		}
+		_mm256_storeu_ps(outFloat, acc);
+		ret = outFloat[0];
+		for(j=1; j<8; ++j){
+			if(op==REDUCE_MAX ? outFloat[j] > ret : outFloat[j] < ret) ret = outFloat[j];
+		}
+		return ret;
+	case REDUCE_SUM:
+		sum = _mm256_setzero_pd();
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			if(!bits) continue;
+			v = _mm256_loadu_ps(data+b*8);
+			if(bits != 0xFF) v = _mm256_and_ps(v, _mm256_castsi256_ps(adhoc_laneMask256(bits)));
+			sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+			sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+		}
+		_mm256_storeu_pd(outDouble, sum);
+		return outDouble[0] + outDouble[1] + outDouble[2] + outDouble[3];
+	case REDUCE_COUNT_GT:
+	case REDUCE_FIND:
+		t = _mm256_set1_ps(arg);
+		for(b=0; b<blocks; ++b){
+			bits = (unsigned char)map[b];
+			if(!bits) continue;
+			v = _mm256_loadu_ps(data+b*8);
+			v = (op==REDUCE_COUNT_GT
+				? _mm256_cmp_ps(v, t, _CMP_GT_OQ)
+				: _mm256_cmp_ps(v, t, _CMP_EQ_OQ)
+			);
+			bits &= _mm256_movemask_ps(v);
+			if(op == REDUCE_COUNT_GT) ret += __builtin_popcount(bits);
+			else if(bits) return b*DATA_MAP_BIT_FIELD_SIZE + __builtin_ctz(bits);
+		}
+		return (op == REDUCE_FIND ? -1 : ret);
+	}
+	return 0;
+}
+#endif
+
+// Pick the widest kernels this CPU supports
+static void adhoc_selectReduceKernels(){
+	adhoc_intKernel intKernel = adhoc_reduceInt_scalar;
+	adhoc_floatKernel floatKernel = adhoc_reduceFloat_scalar;
+#ifdef ADHOC_X86_KERNELS
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		intKernel = adhoc_reduceInt_avx2;
+		floatKernel = adhoc_reduceFloat_avx2;
+	}else if(__builtin_cpu_supports("sse2")){
+		intKernel = adhoc_reduceInt_sse2;
+		floatKernel = adhoc_reduceFloat_sse2;
+	}
+#endif
+	adhoc_reduceFloatKernel = floatKernel;
+	adhoc_reduceIntKernel = intKernel;
+}
+
+// Number of leading items worth scanning: up to the last mapped block
+static int adhoc_mappedLimit(adhoc_data* arr){
+	int b = (arr->sizeData-1)/DATA_MAP_BIT_FIELD_SIZE;
+	while(b >= 0 && !arr->mappedData[b]) --b;
+	int limit = (b+1)*DATA_MAP_BIT_FIELD_SIZE;
+	return (limit < arr->sizeData ? limit : arr->sizeData);
+}
+
+// Run an int reduction: SIMD over whole blocks, then scalar over the rest
+static long long adhoc_reduceIntArray(adhoc_data* arr, adhoc_reduceOp op, int arg){
+	if(!adhoc_reduceIntKernel) adhoc_selectReduceKernels();
+	int n = adhoc_mappedLimit(arr);
+	int full = n - n%DATA_MAP_BIT_FIELD_SIZE;
+	long long head = adhoc_reduceIntKernel(arr->data, arr->mappedData, full, op, arg);
+	long long tail = adhoc_reduceInt_scalar(
+		(int*)arr->data+full
+		,arr->mappedData+full/DATA_MAP_BIT_FIELD_SIZE
+		,n-full
+		,op
+		,arg
+	);
+	switch(op){
+	case REDUCE_MAX: return (tail > head ? tail : head);
+	case REDUCE_MIN: return (tail < head ? tail : head);
+	case REDUCE_FIND: return (head>=0 ? head : (tail>=0 ? tail+full : -1));
+	default: return head + tail;
+	}
+}
+
+// Run a float reduction: SIMD over whole blocks, then scalar over the rest
+static double adhoc_reduceFloatArray(adhoc_data* arr, adhoc_reduceOp op, float arg){
+	if(!adhoc_reduceFloatKernel) adhoc_selectReduceKernels();
+	int n = adhoc_mappedLimit(arr);
+	int full = n - n%DATA_MAP_BIT_FIELD_SIZE;
+	double head = adhoc_reduceFloatKernel(arr->data, arr->mappedData, full, op, arg);
+	double tail = adhoc_reduceFloat_scalar(
+		(float*)arr->data+full
+		,arr->mappedData+full/DATA_MAP_BIT_FIELD_SIZE
+		,n-full
+		,op
+		,arg
+	);
+	switch(op){
+	case REDUCE_MAX: return (tail > head ? tail : head);
+	case REDUCE_MIN: return (tail < head ? tail : head);
+	case REDUCE_FIND: return (head>=0 ? head : (tail>=0 ? tail+full : -1));
+	default: return head + tail;
+	}
+}
+
+// Index of the first mapped bool equal to want, else of the first mapped bool
+static int adhoc_findBoolIndex(adhoc_data* arr, bool want){
+	int i, first = -1, n = adhoc_mappedLimit(arr);
+	for(i=0; i<n; ++i){
+		if(!ADHOC_MAPPED(arr->mappedData, i)) continue;
+		if(((bool*)arr->data)[i] == want) return i;
+		if(first == -1) first = i;
+	}
+	return first;
+}
+
+// Index of the first max or min item in an int, float or bool array
+static int adhoc_findExtremeIndex(adhoc_data* arr, adhoc_reduceOp op){
+	if(arr->countData < 1) return -1;
+	switch(arr->dataType){
+	case DATA_BOOL:
+		return adhoc_findBoolIndex(arr, op == REDUCE_MAX);
+	case DATA_INT:
+		return adhoc_reduceIntArray(arr, REDUCE_FIND, adhoc_reduceIntArray(arr, op, 0));
+	case DATA_FLOAT:
+		return adhoc_reduceFloatArray(arr, REDUCE_FIND, adhoc_reduceFloatArray(arr, op, 0));
+	default:
+		return -1;
+	}
+}
+
+// Find the max value in an array
+void* adhoc_find_max_value(adhoc_data* inputArray){
+	adhoc_referenceData(inputArray);
+	void* result = adhoc_find_max_value_borrowed(inputArray);
+	adhoc_unreferenceData(inputArray);
+	return result;
+}
+
+// Find the max value in an array the caller already holds
+void* adhoc_find_max_value_borrowed(adhoc_data* inputArray){
+	int index = adhoc_find_max_value_index_borrowed(inputArray);
+	return adhoc_getSArrayData(inputArray, index);
+}
+
+// Find the index of the max value in an array
+int adhoc_find_max_value_index(adhoc_data* inputArray){
+	adhoc_referenceData(inputArray);
+	int ret = adhoc_find_max_value_index_borrowed(inputArray);
+	adhoc_unreferenceData(inputArray);
+	return ret;
+}
+
+// Find the index of the max value in an array the caller already holds
+int adhoc_find_max_value_index_borrowed(adhoc_data* inputArray){
+	return adhoc_findExtremeIndex(inputArray, REDUCE_MAX);
+}
+
+// Find the min value in an array
+void* adhoc_find_min_value(adhoc_data* inputArray){
+	adhoc_referenceData(inputArray);
+	void* result = adhoc_find_min_value_borrowed(inputArray);
+	adhoc_unreferenceData(inputArray);
+	return result;
+}
+
+// Find the min value in an array the caller already holds
+void* adhoc_find_min_value_borrowed(adhoc_data* inputArray){
+	int index = adhoc_find_min_value_index_borrowed(inputArray);
+	return adhoc_getSArrayData(inputArray, index);
+}
+
+// Find the index of the min value in an array
+int adhoc_find_min_value_index(adhoc_data* inputArray){
+	adhoc_referenceData(inputArray);
+	int ret = adhoc_find_min_value_index_borrowed(inputArray);
+	adhoc_unreferenceData(inputArray);
+	return ret;
+}
+
+// Find the index of the min value in an array the caller already holds
+int adhoc_find_min_value_index_borrowed(adhoc_data* inputArray){
+	return adhoc_findExtremeIndex(inputArray, REDUCE_MIN);
+}
+
+// Sum the items of an int or float array
+double adhoc_sum_array(adhoc_data* inputArray){
+	adhoc_referenceData(inputArray);
+	double ret = adhoc_sum_array_borrowed(inputArray);
+	adhoc_unreferenceData(inputArray);
+	return ret;
+}
+
+// Sum the items of an int or float array the caller already holds
+double adhoc_sum_array_borrowed(adhoc_data* inputArray){
+	switch(inputArray->dataType){
+	case DATA_INT: return adhoc_reduceIntArray(inputArray, REDUCE_SUM, 0);
+	case DATA_FLOAT: return adhoc_reduceFloatArray(inputArray, REDUCE_SUM, 0);
+	default: return 0;
 	}
+}
 
+// Count the items of an int or float array greater than threshold
+int adhoc_count_greater_than(adhoc_data* inputArray, double threshold){
+	adhoc_referenceData(inputArray);
+	int ret = adhoc_count_greater_than_borrowed(inputArray, threshold);
 	adhoc_unreferenceData(inputArray);
-	return bestIndex;
+	return ret;
+}
+
+// Count the items greater than threshold in an array the caller already holds.
+// An int is greater than threshold exactly when it is greater than its floor.
+// Float arrays compare at float precision, with threshold rounded to a float
+int adhoc_count_greater_than_borrowed(adhoc_data* inputArray, double threshold){
+	double t = floor(threshold);
+	switch(inputArray->dataType){
+	case DATA_INT:
+		if(!(t < INT_MAX)) return 0;
+		if(t < INT_MIN) return inputArray->countData;
+		return adhoc_reduceIntArray(inputArray, REDUCE_COUNT_GT, t);
+	case DATA_FLOAT: return adhoc_reduceFloatArray(inputArray, REDUCE_COUNT_GT, threshold);
+	default: return 0;
+	}
 }
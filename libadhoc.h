@@ -21,9 +21,89 @@ typedef struct adhoc_data {
 	adhoc_dataType dataType;
 	int countData;
 	int sizeData;
+	int capacityData;
 	char* mappedData;
+	char local;
 } adhoc_data;
 
+// Flags for the parts of a data struct kept in a caller's stack frame,
+// which are never freed
+#define DATA_LOCAL_HEADER 1
+#define DATA_LOCAL_ITEMS 2
+
+// One key and item slot of a hash (see Hash Tables in libadhoc.c). Integer
+// keys leave strKey NULL
+typedef struct adhoc_hashSlot {
+	unsigned int hash;
+	int intKey;
+	adhoc_data* strKey;
+	union {
+		bool boolVal;
+		int intVal;
+		float floatVal;
+		adhoc_data* cmplxVal;
+	} value;
+} adhoc_hashSlot;
+
+// The fields of a struct type. Each struct is a generated C struct whose
+// first member points back at its layout, so the runtime can find the
+// complex fields to release and the names to print
+typedef struct adhoc_structLayout {
+	int size;
+	int countFields;
+	const char** names;
+	const adhoc_dataType* types;
+	const int* offsets;
+} adhoc_structLayout;
+
+// Get a struct's layout, and a field of a struct through its generated type
+#define ADHOC_STRUCT_LAYOUT(d) (*(const adhoc_structLayout**)(d)->data)
+#define ADHOC_FIELD(T, d, f) (((T*)(d)->data)->f)
+
+// A search target whose Two-Way factorization is worked out on first use
+// and then kept, so repeated searches for it skip that setup. Its state is 0
+// until then, 1 while a thread works it out, and 2 once it is ready
+typedef struct adhoc_needle {
+	const char* data;
+	int length;
+	int state;
+	bool periodic;
+	int critPos;
+	int period;
+} adhoc_needle;
+
+// Initializers for a needle from a string literal or a wrapped string
+#define ADHOC_NEEDLE(s) {(s), sizeof(s)-1, 0, false, 0, 0}
+#define ADHOC_NEEDLE_OF(d) {(d)->data, (d)->sizeData-1, 0, false, 0, 0}
+
+// The labels of a SWITCH on strings. Labels are hashed into the table's
+// slots on first use, after which a string is matched by its length, then
+// its hash, then its bytes
+typedef struct adhoc_switchLabel {
+	const char* data;
+	int length;
+} adhoc_switchLabel;
+typedef struct adhoc_switchSlot {
+	unsigned int hash;
+	int label;
+} adhoc_switchSlot;
+typedef struct adhoc_switchTable {
+	const adhoc_switchLabel* labels;
+	int countLabels;
+	adhoc_switchSlot* slots;
+	int sizeSlots;
+	unsigned long long lengths;
+	int state;
+} adhoc_switchTable;
+
+// Initializers for a switch label from a string literal, and for a table
+// from an array of n labels and an array of (a power of two) slots
+#define ADHOC_SWITCH_LABEL(s) {(s), sizeof(s)-1}
+#define ADHOC_SWITCH_TABLE(l, n, s) {(l), (n), (s), sizeof(s)/sizeof((s)[0]), 0, 0}
+
+// Number of array indices tracked by each byte of an array's mappedData
+#define DATA_MAP_BIT_FIELD_SIZE 8
+
 
 //-----------------------//
 //    Data Allocation    //
@@ -38,6 +118,33 @@ adhoc_data* adhoc_createString(char* s);
 // Create a new array and return its reference
 adhoc_data* adhoc_createArray(adhoc_dataType t, int n);
 
+// Create a new hash with room for n items and return its reference
+adhoc_data* adhoc_createHash(adhoc_dataType t, int n);
+
+// Create a new struct with zeroed fields and return its reference
+adhoc_data* adhoc_createStruct(const adhoc_structLayout* layout);
+
+// Set up an array in a caller's stack frame, held by that frame. Its items
+// and map may be zeroed stack storage too, or NULL to put them on the heap
+adhoc_data* adhoc_localArray(adhoc_data* d, adhoc_dataType t, int n, void* items, char* map);
+
+// Set up a hash in a caller's stack frame, held by that frame
+adhoc_data* adhoc_localHash(adhoc_data* d, adhoc_dataType t, int n);
+
+// Set up a struct in a caller's stack frame with zeroed stack storage for
+// its fields, held by that frame
+adhoc_data* adhoc_localStruct(adhoc_data* d, const adhoc_structLayout* layout, void* fields);
+
+// Wrap a string constant of n bytes (with its terminator) in a data struct
+// in a caller's stack frame, held by that frame. Nothing may change it
+adhoc_data* adhoc_localString(adhoc_data* d, const char* s, int n);
+
+// Wrap a string literal for the duration of the enclosing block
+#define ADHOC_LOCAL_STRING(s) adhoc_localString(&(adhoc_data){0}, (s), sizeof(s))
+
+// Make room for size bytes in a string, growing its capacity geometrically
+void adhoc_reserveString(adhoc_data* s, int size);
+
 
 //--------------------------//
 //    Reference Counting    //
@@ -47,11 +154,17 @@ adhoc_data* adhoc_createArray(adhoc_dataType t, int n);
 adhoc_data* adhoc_referenceData(adhoc_data* d);
 
 // Add an item to a referenced data array struct
-void adhoc_assignArrayData(adhoc_data* arr, int i, void* item, float primVal);
+void adhoc_assignArrayData(adhoc_data* arr, int i, void* item, double primVal);
+
+// Grow an array so that index i is within its bounds
+void adhoc_growArray(adhoc_data* arr, int i);
 
 // Remove a reference to a referenced data struct and delete it if last
 adhoc_data* adhoc_unreferenceData(adhoc_data* d);
 
+// Remove a reference without deleting, handing the data to a caller
+adhoc_data* adhoc_releaseData(adhoc_data* d);
+
 
 //------------------------------//
 //    Accessing Complex Data    //
@@ -67,6 +180,314 @@ void* adhoc_getSArrayData(adhoc_data* arr, int i);
 adhoc_data* adhoc_getCArrayData(adhoc_data* arr, int i);
 
 
+//--------------------------//
+//    Typed Array Access    //
+//--------------------------//
+// Generated code reads and writes bool, int and float arrays through these
+// rather than the void* accessors above, so each element access compiles to
+// a bounds/map check and a direct load or store. Unset indices read as 0.
+
+// Check whether arr[i] is within bounds and has been set
+static inline bool adhoc_isMapped(adhoc_data* arr, int i){
+	return i >= 0 && i < arr->sizeData
+		&& (arr->mappedData[i/DATA_MAP_BIT_FIELD_SIZE]
+			& (1<<(i%DATA_MAP_BIT_FIELD_SIZE)));
+}
+
+// Mark arr[from] through arr[to-1] as set, growing the array first. A
+// parallel loop does this up front so its iterations never grow the array
+void adhoc_mapRange(adhoc_data* arr, int from, int to);
+
+// Mark arr[i] as set, growing the array first if it is out of bounds
+static inline void adhoc_mapIndex(adhoc_data* arr, int i){
+	if(i >= arr->sizeData) adhoc_growArray(arr, i);
+	char* map = arr->mappedData + i/DATA_MAP_BIT_FIELD_SIZE;
+	char bit = 1<<(i%DATA_MAP_BIT_FIELD_SIZE);
+	if(!(*map & bit)){
+		++arr->countData;
+		*map |= bit;
+	}
+}
+
+// Get the bool at a particular index of a bool array
+static inline bool adhoc_get_bool(adhoc_data* arr, int i){
+	return adhoc_isMapped(arr, i) ? ((bool*)arr->data)[i] : false;
+}
+
+// Get the int at a particular index of an int array
+static inline int adhoc_get_int(adhoc_data* arr, int i){
+	return adhoc_isMapped(arr, i) ? ((int*)arr->data)[i] : 0;
+}
+
+// Get the float at a particular index of a float array
+static inline float adhoc_get_float(adhoc_data* arr, int i){
+	return adhoc_isMapped(arr, i) ? ((float*)arr->data)[i] : 0.0;
+}
+
+// Set the bool at a particular index of a bool array
+static inline void adhoc_set_bool(adhoc_data* arr, int i, bool v){
+	adhoc_mapIndex(arr, i);
+	((bool*)arr->data)[i] = v;
+}
+
+// Set the int at a particular index of an int array
+static inline void adhoc_set_int(adhoc_data* arr, int i, int v){
+	adhoc_mapIndex(arr, i);
+	((int*)arr->data)[i] = v;
+}
+
+// Set the float at a particular index of a float array
+static inline void adhoc_set_float(adhoc_data* arr, int i, float v){
+	adhoc_mapIndex(arr, i);
+	((float*)arr->data)[i] = v;
+}
+
+// Get a pointer to the bool at a particular index of a bool array, to update
+// it in place. An unset index is set to false first
+static inline bool* adhoc_ref_bool(adhoc_data* arr, int i){
+	if(!adhoc_isMapped(arr, i)) adhoc_set_bool(arr, i, false);
+	return (bool*)arr->data + i;
+}
+
+// Get a pointer to the int at a particular index of an int array, to update
+// it in place. An unset index is set to 0 first
+static inline int* adhoc_ref_int(adhoc_data* arr, int i){
+	if(!adhoc_isMapped(arr, i)) adhoc_set_int(arr, i, 0);
+	return (int*)arr->data + i;
+}
+
+// Get a pointer to the float at a particular index of a float array, to
+// update it in place. An unset index is set to 0 first
+static inline float* adhoc_ref_float(adhoc_data* arr, int i){
+	if(!adhoc_isMapped(arr, i)) adhoc_set_float(arr, i, 0.0);
+	return (float*)arr->data + i;
+}
+
+
+//-------------------//
+//    Hash Tables    //
+//-------------------//
+// Hashes are keyed by strKey, or by intKey when strKey is NULL
+
+// Locate a key's slot in a hash, or NULL if the key is not set
+adhoc_hashSlot* adhoc_findHashSlot(adhoc_data* hash, adhoc_data* strKey, int intKey);
+
+// Locate a key's slot in a hash, adding a zeroed one if the key is not set
+adhoc_hashSlot* adhoc_insertHashSlot(adhoc_data* hash, adhoc_data* strKey, int intKey);
+
+// Add an item to a referenced hash
+void adhoc_assignHashData(adhoc_data* hash, adhoc_data* strKey, int intKey, void* item, double primVal);
+
+// Add an item to a hash the caller already holds a reference to
+void adhoc_assignHashData_borrowed(adhoc_data* hash, adhoc_data* strKey, int intKey, void* item, double primVal);
+
+// Get the complex data stored under a key in a hash
+adhoc_data* adhoc_getCHashData(adhoc_data* hash, adhoc_data* strKey, int intKey);
+
+// Remove a key and its item from a hash. Returns whether it was set
+bool adhoc_deleteHashData(adhoc_data* hash, adhoc_data* strKey, int intKey);
+
+// Step to the next live slot of a hash after prev (or the first if NULL)
+adhoc_hashSlot* adhoc_nextHashSlot(adhoc_data* hash, adhoc_hashSlot* prev);
+
+// Get the bool stored under a key in a bool hash
+static inline bool adhoc_hash_get_bool(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	adhoc_hashSlot* slot = adhoc_findHashSlot(hash, strKey, intKey);
+	return slot ? slot->value.boolVal : false;
+}
+
+// Get the int stored under a key in an int hash
+static inline int adhoc_hash_get_int(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	adhoc_hashSlot* slot = adhoc_findHashSlot(hash, strKey, intKey);
+	return slot ? slot->value.intVal : 0;
+}
+
+// Get the float stored under a key in a float hash
+static inline float adhoc_hash_get_float(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	adhoc_hashSlot* slot = adhoc_findHashSlot(hash, strKey, intKey);
+	return slot ? slot->value.floatVal : 0.0;
+}
+
+// Set the bool stored under a key in a bool hash
+static inline void adhoc_hash_set_bool(adhoc_data* hash, adhoc_data* strKey, int intKey, bool v){
+	adhoc_insertHashSlot(hash, strKey, intKey)->value.boolVal = v;
+}
+
+// Set the int stored under a key in an int hash
+static inline void adhoc_hash_set_int(adhoc_data* hash, adhoc_data* strKey, int intKey, int v){
+	adhoc_insertHashSlot(hash, strKey, intKey)->value.intVal = v;
+}
+
+// Set the float stored under a key in a float hash
+static inline void adhoc_hash_set_float(adhoc_data* hash, adhoc_data* strKey, int intKey, float v){
+	adhoc_insertHashSlot(hash, strKey, intKey)->value.floatVal = v;
+}
+
+// Get a pointer to the bool stored under a key in a bool hash, to update it
+// in place. An unset key is added as false
+static inline bool* adhoc_hash_ref_bool(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	return &adhoc_insertHashSlot(hash, strKey, intKey)->value.boolVal;
+}
+
+// Get a pointer to the int stored under a key in an int hash, to update it
+// in place. An unset key is added as 0
+static inline int* adhoc_hash_ref_int(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	return &adhoc_insertHashSlot(hash, strKey, intKey)->value.intVal;
+}
+
+// Get a pointer to the float stored under a key in a float hash, to update
+// it in place. An unset key is added as 0
+static inline float* adhoc_hash_ref_float(adhoc_data* hash, adhoc_data* strKey, int intKey){
+	return &adhoc_insertHashSlot(hash, strKey, intKey)->value.floatVal;
+}
+
+
+//-----------------------//
+//    String Switches    //
+//-----------------------//
+
+// Find which label of a switch table a string matches, or -1 if none
+int adhoc_switchString(adhoc_switchTable* table, adhoc_data* s);
+
+
+//---------------//
+//    Structs    //
+//---------------//
+
+// Store a complex item in a struct field, moving the field's reference
+static inline void adhoc_setField(adhoc_data** field, adhoc_data* item){
+	adhoc_referenceData(item);
+	adhoc_unreferenceData(*field);
+	*field = item;
+}
+
+
+//------------------//
+//    Arithmetic    //
+//------------------//
+
+// Raise an int to an int power by squaring. Negative powers truncate toward
+// zero the way int division does
+static inline int adhoc_ipow(int base, int exp){
+	unsigned int ret = 1, b = base;
+	if(exp < 0) return (base == 1 || base == -1) ? (exp % 2 ? base : 1) : 0;
+	for(; exp; exp >>= 1, b *= b){
+		if(exp & 1) ret *= b;
+	}
+	return ret;
+}
+
+// Raise the int or float a pointer points at to a power, storing and giving
+// the result, so an item raised in place is only looked up once
+static inline int adhoc_ipowAt(int* v, int exp){
+	return *v = adhoc_ipow(*v, exp);
+}
+static inline float adhoc_powAt(float* v, double exp){
+	return *v = pow(*v, exp);
+}
+
+
+//-------------------//
+//    Thread Pool    //
+//-------------------//
+
+// One branch of a fork, run on the thread pool with the fork's argument
+typedef void (*adhoc_taskFunc)(void*);
+
+// Set how many threads the pool runs with. 0 uses ADHOC_THREADS from the
+// environment, or one per core. Only takes effect before the first fork
+void adhoc_setThreadCount(int n);
+
+// Run count tasks in parallel, each given arg, and return once all are done
+void adhoc_forkJoin(int count, adhoc_taskFunc* tasks, void* arg);
+
+// The iterations from <= i < to of a parallel loop, given the loop's argument
+typedef void (*adhoc_rangeFunc)(int from, int to, void* arg);
+
+// Iterations per chunk of a parallel loop when none is given
+#define ADHOC_DEFAULT_GRAIN 1024
+
+// Run the iterations from <= i < to in parallel, in chunks of at least
+// grain iterations (or ADHOC_DEFAULT_GRAIN if grain is 0)
+void adhoc_parallelFor(int from, int to, int grain, adhoc_rangeFunc body, void* arg);
+
+
+//----------------//
+//    Profiles    //
+//----------------//
+
+// Count one run of something an instrumented executable counts. Counts may
+// come from any thread, and only need to add up by the end
+static inline void adhoc_count(unsigned long long* c){
+	__atomic_add_fetch(c, 1, __ATOMIC_RELAXED);
+}
+
+// Count which way a condition went, in c[0] if true and c[1] if false
+static inline bool adhoc_countBranch(unsigned long long* c, bool taken){
+	adhoc_count(c + !taken);
+	return taken;
+}
+
+// Write an instrumented executable's counts when it exits: two for each
+// node counted, whose id and kind (I for IF, L for loop, C for call) are
+// given. They go to the file named by ADHOC_PROFILE in the environment, or
+// to adhoc.profile
+void adhoc_profileAtExit(unsigned long long* counts, const int* ids, const char* kinds, int count);
+
+// Hints from a profile about which way a condition usually goes
+#ifdef __GNUC__
+#define adhoc_likely(x) __builtin_expect(!!(x), 1)
+#define adhoc_unlikely(x) __builtin_expect(!!(x), 0)
+#else
+#define adhoc_likely(x) (x)
+#define adhoc_unlikely(x) (x)
+#endif
+
+
+//---------------//
+//    Tracing    //
+//---------------//
+
+// Record that the running thread entered, or left, an action (or a fork
+// branch, or a chunk of a parallel loop). Each thread keeps its latest
+// events in a ring, and all of them are written as Chrome trace events when
+// the executable exits: to the file named by ADHOC_TRACE_FILE in the
+// environment, or to adhoc.trace.json
+int adhoc_traceEnter(int id, const char* name);
+void adhoc_traceExit(int* id);
+
+// Traced executables start each action with ADHOC_TRACE_SPAN, which leaves
+// it again however its scope ends. Unless ADHOC_TRACE is defined when they
+// are compiled, it compiles to nothing
+#if defined(ADHOC_TRACE) && defined(__GNUC__)
+#define ADHOC_TRACE_SPAN(id, name) int adhoc_traced __attribute__((cleanup(adhoc_traceExit))) = adhoc_traceEnter((id), (name))
+#else
+#define ADHOC_TRACE_SPAN(id, name) do{}while(0)
+#endif
+
+
+//---------------------//
+//    Heap Profiles    //
+//---------------------//
+
+// Executables that mark their nodes with ADHOC_HEAP_SITE and
+// ADHOC_HEAP_ACTION, compiled with ADHOC_HEAP_PROFILE defined and linked
+// with libadhoc_heap.a, charge the heap each data struct uses to the node
+// that made or last grew it. They write how many structs each node made and
+// grew, the bytes that took, and the bytes still held at exit and at most
+// when they exit: to the file named by ADHOC_HEAP_FILE in the environment,
+// or to adhoc.heap. Otherwise the marks compile to nothing
+#if defined(ADHOC_HEAP_PROFILE) && defined(__GNUC__)
+extern __thread int adhoc_heapSite;
+void adhoc_heapRestore(int* site);
+#define ADHOC_HEAP_SITE(id) (adhoc_heapSite = (id))
+#define ADHOC_HEAP_ACTION(id) int adhoc_heapCaller __attribute__((cleanup(adhoc_heapRestore))) = adhoc_heapSite; adhoc_heapSite = (id)
+#else
+#define ADHOC_HEAP_SITE(id) ((void)0)
+#define ADHOC_HEAP_ACTION(id) do{}while(0)
+#endif
+
+
 //------------------------------//
 //    Library API Functionss    //
 //------------------------------//
@@ -110,12 +531,39 @@ adhoc_data* adhoc_substring(adhoc_data* baseString, int index, int length);
 // Patch the replacement over the base string at index return what is replaced
 adhoc_data* adhoc_splice_string(adhoc_data* baseString, adhoc_data* replacement, int index, int length);
 
+// Patch the replacement over the base string at index, dropping what is replaced
+void adhoc_splice_string_discard(adhoc_data* baseString, adhoc_data* replacement, int index, int length);
+
 // Finds the first occurrence of targetsString in baseString
 int adhoc_find_in_string(adhoc_data* baseString, adhoc_data* targetsString);
 
+// Finds every occurrence of targetsString in baseString as an array of indices
+adhoc_data* adhoc_find_all_in_string(adhoc_data* baseString, adhoc_data* targetsString);
+
+// Counts the occurrences of targetsString in baseString
+int adhoc_count_occurrences(adhoc_data* baseString, adhoc_data* targetsString);
+
+// Work out a needle's critical factorization for Two-Way searches
+void adhoc_compileNeedle(adhoc_needle* needle);
+
+// Finds the first occurrence of a compiled needle in baseString
+int adhoc_find_needle(adhoc_data* baseString, adhoc_needle* needle);
+
+// Finds every non-overlapping occurrence of a compiled needle in baseString
+adhoc_data* adhoc_find_all_needle(adhoc_data* baseString, adhoc_needle* needle);
+
+// Counts the non-overlapping occurrences of a compiled needle in baseString
+int adhoc_count_needle(adhoc_data* baseString, adhoc_needle* needle);
+
 // Check whether arr[i] has been set
 bool adhoc_isset_array(adhoc_data* arr, int i);
 
+// Check whether a key is set in a hash
+bool adhoc_isset_hash(adhoc_data* hash, adhoc_data* strKey, int intKey);
+
+// Remove a key and its item from a hash
+bool adhoc_remove_from_hash(adhoc_data* hash, adhoc_data* strKey, int intKey);
+
 // Append one item to an existing array
 void adhoc_append_to_array(char* format, adhoc_data* baseArray, ...);
 
@@ -125,4 +573,82 @@ void* adhoc_find_max_value(adhoc_data* inputArray);
 // Find the index of the max value in an array
 int adhoc_find_max_value_index(adhoc_data* inputArray);
 
+// Find the min value in an array
+void* adhoc_find_min_value(adhoc_data* inputArray);
+
+// Find the index of the min value in an array
+int adhoc_find_min_value_index(adhoc_data* inputArray);
+
+// Sum the items of an int or float array
+double adhoc_sum_array(adhoc_data* inputArray);
+
+// Count the items of an int or float array greater than threshold. Float
+// arrays compare at float precision
+int adhoc_count_greater_than(adhoc_data* inputArray, double threshold);
+
+
+//--------------------------//
+//    Borrowing Variants    //
+//--------------------------//
+// These skip the reference/unreference pair on their complex arguments, so
+// they may only be passed values the caller already holds a reference to.
+// Generated code uses them when the ownership analysis proves that.
+
+// Add an item to an array the caller already holds a reference to
+void adhoc_assignArrayData_borrowed(adhoc_data* arr, int i, void* item, double primVal);
+
+// Returns the size of a complex argument the caller already holds
+int adhoc_sizeC_borrowed(adhoc_data* d);
+
+// Convert a wrapped datatype the caller already holds to a wrapped string
+adhoc_data* adhoc_toStringC_borrowed(adhoc_data* d);
+
+// Copy from a string the caller already holds, starting at index for length
+adhoc_data* adhoc_substring_borrowed(adhoc_data* baseString, int index, int length);
+
+// Splice into a string with a replacement, both already held by the caller
+adhoc_data* adhoc_splice_string_borrowed(adhoc_data* baseString, adhoc_data* replacement, int index, int length);
+
+// Splice without keeping the replaced text, both strings already held
+void adhoc_splice_string_discard_borrowed(adhoc_data* baseString, adhoc_data* replacement, int index, int length);
+
+// Find which label of a switch table a string the caller holds matches
+int adhoc_switchString_borrowed(adhoc_switchTable* table, adhoc_data* s);
+
+// Finds targetsString in baseString, both already held by the caller
+int adhoc_find_in_string_borrowed(adhoc_data* baseString, adhoc_data* targetsString);
+
+// Finds every targetsString in baseString, both already held by the caller
+adhoc_data* adhoc_find_all_in_string_borrowed(adhoc_data* baseString, adhoc_data* targetsString);
+
+// Counts targetsString in baseString, both already held by the caller
+int adhoc_count_occurrences_borrowed(adhoc_data* baseString, adhoc_data* targetsString);
+
+// Finds a compiled needle in a baseString the caller already holds
+int adhoc_find_needle_borrowed(adhoc_data* baseString, adhoc_needle* needle);
+
+// Finds every compiled needle in a baseString the caller already holds
+adhoc_data* adhoc_find_all_needle_borrowed(adhoc_data* baseString, adhoc_needle* needle);
+
+// Counts a compiled needle in a baseString the caller already holds
+int adhoc_count_needle_borrowed(adhoc_data* baseString, adhoc_needle* needle);
+
+// Find the max value in an array the caller already holds
+void* adhoc_find_max_value_borrowed(adhoc_data* inputArray);
+
+// Find the index of the max value in an array the caller already holds
+int adhoc_find_max_value_index_borrowed(adhoc_data* inputArray);
+
+// Find the min value in an array the caller already holds
+void* adhoc_find_min_value_borrowed(adhoc_data* inputArray);
+
+// Find the index of the min value in an array the caller already holds
+int adhoc_find_min_value_index_borrowed(adhoc_data* inputArray);
+
+// Sum the items of an int or float array the caller already holds
+double adhoc_sum_array_borrowed(adhoc_data* inputArray);
+
+// Count the items greater than threshold in an array the caller already holds
+int adhoc_count_greater_than_borrowed(adhoc_data* inputArray, double threshold);
+
 #endif
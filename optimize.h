@@ -0,0 +1,1917 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "hashmap.h"
+#include "adhoc_types.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#pragma clang diagnostic ignored "-Wswitch"
+
+// What system action names were prefixed with for the target language
+const char* opt_libraryPrepend = "";
+
+
+//-----------------//
+//    Utilities    //
+//-----------------//
+
+// Check whether a node calls a particular system action
+bool opt_isSystem(ASTnode* n, const char* name){
+	int len = strlen(opt_libraryPrepend);
+	return n->which == ACTION_CALL
+		&& !strcmp(n->package, "System")
+		&& !strncmp(n->name, opt_libraryPrepend, len)
+		&& !strcmp(n->name+len, name);
+}
+
+// Get the value of an int or float literal. Floats that do not parse
+// cleanly (or are not finite) are left alone
+bool opt_number(ASTnode* n, double* v){
+	char* end;
+	if(n->which == LITERAL_INT){
+		*v = atoi(n->value);
+		return true;
+	}
+	if(n->which != LITERAL_FLOAT) return false;
+	*v = strtod(n->value, &end);
+	return end != n->value && !*end && isfinite(*v);
+}
+
+// Get the value of a bool literal, read the way the generators print it
+bool opt_bool(ASTnode* n, bool* v){
+	if(n->which != LITERAL_BOOL) return false;
+	*v = !strcmp(n->value, "true") || (strcmp(n->value, "false") && atoi(n->value));
+	return true;
+}
+
+// Check whether a node is a string literal without escape sequences, so its
+// value is exactly the string it makes
+bool opt_plainString(ASTnode* n){
+	return n->which == LITERAL_STRNG && !strchr(n->value, '\\');
+}
+
+// Turn a node into a literal, dropping its children
+void opt_makeLiteral(ASTnode* n, nodeWhich which, dataType t, char* value){
+	n->nodeType = LITERAL;
+	n->which = which;
+	n->dataType = t;
+	n->childDataType = TYPE_VOID;
+	n->layout = NULL;
+	n->countChildren = 0;
+	free(n->value);
+	n->value = value;
+}
+
+// Turn a node into an int literal, unless the value overflows an int
+void opt_makeInt(ASTnode* n, long long v){
+	char buf[24];
+	if(v < INT_MIN || v > INT_MAX) return;
+	sprintf(buf, "%lld", v);
+	opt_makeLiteral(n, LITERAL_INT, TYPE_INT, strdup(buf));
+}
+
+// Turn a node into a float literal with the shortest digits that read back
+// as the same value
+void opt_makeFloat(ASTnode* n, double v){
+	char buf[40];
+	int p;
+	if(!isfinite(v)) return;
+	for(p=1; p<17; ++p){
+		sprintf(buf, "%.*g", p, v);
+		if(strtod(buf, NULL) == v) break;
+	}
+	sprintf(buf, "%.*g", p, v);
+	if(!strpbrk(buf, ".e")) strcat(buf, ".0");
+	opt_makeLiteral(n, LITERAL_FLOAT, TYPE_FLOAT, strdup(buf));
+}
+
+// Turn a node into a bool literal
+void opt_makeBool(ASTnode* n, bool v){
+	opt_makeLiteral(n, LITERAL_BOOL, TYPE_BOOL, strdup(v ? "true" : "false"));
+}
+
+// Put one node in the place of another under its parent
+void opt_replaceNode(ASTnode* n, ASTnode* with){
+	int i = adhoc_getNodeIndexOfChild(n->parent, n);
+	n->parent->children[i] = with;
+	with->parent = n->parent;
+	with->childType = n->childType;
+}
+
+// Add a node to the end of a list of nodes, doubling the list when full
+void opt_addItem(ASTnode*** list, unsigned short* count, unsigned short* size, ASTnode* n){
+	if(*count == *size){
+		*size = (*size ? *size*2 : 1);
+		*list = realloc(*list, *size*sizeof(ASTnode*));
+	}
+	(*list)[(*count)++] = n;
+}
+
+// Register a complex literal with the statement that initializes it, which
+// is its nearest statement ancestor
+void opt_rehome(ASTnode* v){
+	ASTnode* stmt;
+	for(stmt=v->parent; stmt->childType!=STATEMENT; stmt=stmt->parent);
+	opt_addItem(&stmt->cmplxVals, &stmt->countCmplxVals, &stmt->sizeCmplxVals, v);
+}
+
+
+//------------------------//
+//    Constant Folding    //
+//------------------------//
+
+// Fold arithmetic on two number literals. Int division is only folded when
+// exact, since it truncates in some targets and not in others, and the same
+// goes for ints raised to negative powers
+void opt_foldArithmetic(ASTnode* n){
+	double a, b, r;
+	long long x, y, z;
+	if(!opt_number(n->children[0], &a) || !opt_number(n->children[1], &b)) return;
+	if(n->dataType == TYPE_INT){
+		x = a;
+		y = b;
+		switch(n->which){
+		case OPERATOR_PLUS: opt_makeInt(n, x + y); break;
+		case OPERATOR_MINUS: opt_makeInt(n, x - y); break;
+		case OPERATOR_TIMES: opt_makeInt(n, x * y); break;
+		case OPERATOR_DIVBY: if(y && !(x % y)) opt_makeInt(n, x / y); break;
+		case OPERATOR_MOD: if(y) opt_makeInt(n, x % y); break;
+		case OPERATOR_EXP:
+			if(y < 0) break;
+			if(x == 0 || x == 1) opt_makeInt(n, (y ? x : 1));
+			else if(x == -1) opt_makeInt(n, (y%2 ? -1 : 1));
+			else{
+				for(z=1; y-- > 0 && z >= INT_MIN && z <= INT_MAX; z *= x);
+				opt_makeInt(n, z);
+			}
+			break;
+		}
+	}else if(n->dataType == TYPE_FLOAT){
+		switch(n->which){
+		case OPERATOR_PLUS: r = a + b; break;
+		case OPERATOR_MINUS: r = a - b; break;
+		case OPERATOR_TIMES: r = a * b; break;
+		case OPERATOR_DIVBY: if(!b) return; r = a / b; break;
+		case OPERATOR_EXP: r = pow(a, b); break;
+		default: return;
+		}
+		opt_makeFloat(n, r);
+	}
+}
+
+// Fold a comparison of two number, bool or string literals
+void opt_foldComparison(ASTnode* n){
+	double a, b;
+	bool p, q;
+	int cmp;
+	if(opt_number(n->children[0], &a) && opt_number(n->children[1], &b)){
+		cmp = (a > b) - (a < b);
+	}else if(opt_bool(n->children[0], &p) && opt_bool(n->children[1], &q)){
+		if(n->which != OPERATOR_EQUIV && n->which != OPERATOR_NOTEQ) return;
+		cmp = (p != q);
+	}else if(opt_plainString(n->children[0]) && opt_plainString(n->children[1])){
+		cmp = strcmp(n->children[0]->value, n->children[1]->value);
+	}else return;
+	switch(n->which){
+	case OPERATOR_EQUIV: opt_makeBool(n, cmp == 0); break;
+	case OPERATOR_NOTEQ: opt_makeBool(n, cmp != 0); break;
+	case OPERATOR_GRTTN: opt_makeBool(n, cmp > 0); break;
+	case OPERATOR_LESTN: opt_makeBool(n, cmp < 0); break;
+	case OPERATOR_GRTEQ: opt_makeBool(n, cmp >= 0); break;
+	case OPERATOR_LESEQ: opt_makeBool(n, cmp <= 0); break;
+	}
+}
+
+// Fold logic on bool literals
+void opt_foldLogic(ASTnode* n){
+	bool p, q;
+	if(!opt_bool(n->children[0], &p)) return;
+	if(n->which == OPERATOR_NOT){
+		opt_makeBool(n, !p);
+		return;
+	}
+	if(!opt_bool(n->children[1], &q)) return;
+	opt_makeBool(n, (n->which == OPERATOR_AND ? p && q : p || q));
+}
+
+// Fold a ternary with a literal condition into the branch it picks, as long
+// as that branch has the ternary's type
+void opt_foldTernary(ASTnode* n){
+	bool p;
+	ASTnode* pick;
+	if(!opt_bool(n->children[0], &p)) return;
+	pick = n->children[p ? 1 : 2];
+	if(pick->dataType != n->dataType) return;
+	opt_replaceNode(n, pick);
+}
+
+// Fold concat, substring and size when given only literals. Strings must
+// be plain, and concat only takes strings and ints since targets print
+// floats and bools differently
+void opt_foldSystem(ASTnode* n){
+	int i, len, index, count;
+	char* buf;
+	if(opt_isSystem(n, "concat")){
+		len = 1;
+		for(i=0; i<n->countChildren; ++i){
+			if(opt_plainString(n->children[i])) len += strlen(n->children[i]->value);
+			else if(n->children[i]->which == LITERAL_INT) len += 12;
+			else return;
+		}
+		buf = malloc(len);
+		*buf = '\0';
+		for(i=0; i<n->countChildren; ++i){
+			if(n->children[i]->which == LITERAL_INT){
+				sprintf(buf+strlen(buf), "%d", atoi(n->children[i]->value));
+			}else{
+				strcat(buf, n->children[i]->value);
+			}
+		}
+		opt_makeLiteral(n, LITERAL_STRNG, TYPE_STRNG, buf);
+
+	// Substrings are clipped to the end of the string like adhoc_substring
+	}else if(opt_isSystem(n, "substring")){
+		if(n->countChildren != 3
+				|| !opt_plainString(n->children[0])
+				|| n->children[1]->which != LITERAL_INT
+				|| n->children[2]->which != LITERAL_INT
+			) return;
+		len = strlen(n->children[0]->value);
+		index = atoi(n->children[1]->value);
+		count = atoi(n->children[2]->value);
+		if(index < 0) return;
+		if(index > len || count < 0) count = 0;
+		else if(count > len-index) count = len-index;
+		buf = malloc(count+1);
+		memcpy(buf, n->children[0]->value+(count ? index : 0), count);
+		buf[count] = '\0';
+		opt_makeLiteral(n, LITERAL_STRNG, TYPE_STRNG, buf);
+
+	}else if(opt_isSystem(n, "size")){
+		if(n->countChildren != 1 || !opt_plainString(n->children[0])) return;
+		opt_makeInt(n, strlen(n->children[0]->value));
+	}
+}
+
+
+//----------------------------//
+//    Constant Propagation    //
+//----------------------------//
+
+// Count the places a variable is stored to: its assignments, plus any
+// prompts that read into it
+int opt_countStores(ASTnode* n, ASTnode* def){
+	int i, ret = 0;
+	if(n->which == VARIABLE_ASIGN && (n == def || n->reference == def)) ++ret;
+	if(n->which == VARIABLE_EVAL && n->reference == def && opt_isSystem(n->parent, "prompt")) ++ret;
+	for(i=0; i<n->countChildren; ++i){
+		ret += opt_countStores(n->children[i], def);
+	}
+	return ret;
+}
+
+// Find the literal a variable evaluation must read. The variable must be
+// stored to only once, by a statement directly in its action that assigns
+// it a literal, and the evaluation must come in a later statement of that
+// same action
+ASTnode* opt_constantOf(ASTnode* n){
+	ASTnode* def = n->reference,* stmt,* val,* p,* root;
+	if(!def || def->which != VARIABLE_ASIGN || def->childType != STORAGE) return NULL;
+	stmt = def->parent;
+	if(stmt->which != ASSIGNMENT_EQUAL || stmt->childType != STATEMENT) return NULL;
+	if(!stmt->parent || stmt->parent->which != ACTION_DEFIN) return NULL;
+	val = stmt->children[1];
+	if(val->which != LITERAL_BOOL && val->which != LITERAL_INT && val->which != LITERAL_FLOAT) return NULL;
+	for(p=n; p->parent && p->parent!=stmt->parent; p=p->parent){
+		if(p->which == ACTION_DEFIN) return NULL;
+	}
+	if(p->parent != stmt->parent) return NULL;
+	if(adhoc_getNodeIndexOfChild(stmt->parent, p) <= adhoc_getNodeIndexOfChild(stmt->parent, stmt)){
+		return NULL;
+	}
+	for(root=def; root->parent; root=root->parent);
+	if(opt_countStores(root, def) != 1) return NULL;
+	return val;
+}
+
+// Post-walkable constant folding and propagation. Children are folded
+// first, so literals bubble up through whole expressions
+void opt_foldNode(ASTnode* n, int d, char* errBuf){
+	ASTnode* val;
+	if(n->childType == STATEMENT) return;
+	switch(n->which){
+	case VARIABLE_EVAL:
+		if((val = opt_constantOf(n))){
+			opt_makeLiteral(n, val->which, val->dataType, strdup(val->value));
+		}
+		break;
+
+	case OPERATOR_PLUS:
+	case OPERATOR_MINUS:
+	case OPERATOR_TIMES:
+	case OPERATOR_DIVBY:
+	case OPERATOR_MOD:
+	case OPERATOR_EXP:
+		opt_foldArithmetic(n);
+		break;
+
+	case OPERATOR_EQUIV:
+	case OPERATOR_NOTEQ:
+	case OPERATOR_GRTTN:
+	case OPERATOR_LESTN:
+	case OPERATOR_GRTEQ:
+	case OPERATOR_LESEQ:
+		opt_foldComparison(n);
+		break;
+
+	case OPERATOR_OR:
+	case OPERATOR_AND:
+	case OPERATOR_NOT:
+		opt_foldLogic(n);
+		break;
+
+	case OPERATOR_TRNIF:
+		opt_foldTernary(n);
+		break;
+
+	case ACTION_CALL:
+		opt_foldSystem(n);
+		break;
+	}
+}
+
+
+//-----------------------------//
+//    Dead Code Elimination    //
+//-----------------------------//
+
+// Remove a node from a list of nodes
+void opt_removeItem(ASTnode** list, unsigned short* count, ASTnode* n){
+	int i;
+	for(i=0; i<*count && list[i]!=n; ++i);
+	if(i == *count) return;
+	memmove(list+i, list+i+1, (*count-i-1)*sizeof(ASTnode*));
+	--*count;
+}
+
+// Check whether a node is inside a subtree
+bool opt_isWithin(ASTnode* n, ASTnode* sub){
+	for(; n; n=n->parent) if(n == sub) return true;
+	return false;
+}
+
+// Check whether an action is called from anywhere outside a subtree
+bool opt_isCalledOutside(ASTnode* n, ASTnode* def, ASTnode* sub){
+	int i;
+	if(n == sub) return false;
+	if(n->which == ACTION_CALL && n->refId == def->id) return true;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_isCalledOutside(n->children[i], def, sub)) return true;
+	}
+	return false;
+}
+
+// Check whether a subtree defines an action that is called from elsewhere,
+// and so cannot be removed
+bool opt_keepsAction(ASTnode* root, ASTnode* sub, ASTnode* n){
+	int i;
+	if(n->which == ACTION_DEFIN && opt_isCalledOutside(root, n, sub)) return true;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_keepsAction(root, sub, n->children[i])) return true;
+	}
+	return false;
+}
+
+// Drop the scope vars and complex values registered by the literals of a
+// subtree about to be removed, so nothing is declared for them
+void opt_forget(ASTnode* n){
+	int i;
+	ASTnode* stmt;
+	for(i=0; i<n->countChildren; ++i){
+		opt_forget(n->children[i]);
+	}
+	if(n->nodeType != LITERAL) return;
+	if(n->scope) opt_removeItem(n->scope->scopeVars, &n->scope->countScopeVars, n);
+	for(stmt=n->parent; stmt && stmt->childType!=STATEMENT; stmt=stmt->parent);
+	if(stmt) opt_removeItem(stmt->cmplxVals, &stmt->countCmplxVals, n);
+}
+
+// Remove a node and everything under it from its parent
+void opt_removeNode(ASTnode* n){
+	opt_forget(n);
+	opt_removeItem(n->parent->children, &n->parent->countChildren, n);
+}
+
+// Check whether an expression can be dropped without changing anything.
+// The only actions it may call are pure System actions
+bool opt_isPure(ASTnode* n){
+	int i;
+	if(n->nodeType == ASSIGNMENT || n->nodeType == CONTROL) return false;
+	if(n->nodeType == ACTION && adhoc_getSystemEffect(n, opt_libraryPrepend) != EFFECT_PURE) return false;
+	for(i=0; i<n->countChildren; ++i){
+		if(!opt_isPure(n->children[i])) return false;
+	}
+	return true;
+}
+
+// Check whether the children of a node run one after another, so any
+// following a jump out of them cannot run
+bool opt_isSequence(ASTnode* n){
+	switch(n->which){
+	case ACTION_DEFIN:
+	case GROUP_SERIAL:
+	case CONTROL_IF:
+	case CONTROL_LOOP:
+	case CONTROL_CASE:
+		return true;
+	}
+	return false;
+}
+
+// Replace an IF whose condition is a literal by the statements of the
+// branch it always takes. Complex values that were initialized ahead of
+// the IF move to the statements that now hold them
+void opt_foldIf(ASTnode* root, ASTnode* n){
+	int i, j, k, count = 0;
+	bool taken;
+	nodeChildType keep;
+	ASTnode* p = n->parent,* cond = NULL;
+	ASTnode** children;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == CONDITION) cond = n->children[i];
+	}
+	if(!cond || !opt_bool(cond, &taken)) return;
+	keep = (taken ? IF : ELSE);
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == keep) ++count;
+		else if(opt_keepsAction(root, n->children[i], n->children[i])) return;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType != keep) opt_forget(n->children[i]);
+	}
+
+	// Splice the kept statements into the IF's place
+	children = malloc((p->countChildren-1+count)*sizeof(ASTnode*));
+	for(i=0, k=0; i<p->countChildren; ++i){
+		if(p->children[i] != n){
+			children[k++] = p->children[i];
+			continue;
+		}
+		for(j=0; j<n->countChildren; ++j){
+			if(n->children[j]->childType != keep) continue;
+			n->children[j]->childType = n->childType;
+			n->children[j]->parent = p;
+			children[k++] = n->children[j];
+		}
+	}
+	free(p->children);
+	p->children = children;
+	p->countChildren = p->sizeChildren = k;
+	n->countChildren = 0;
+	for(i=0; i<n->countCmplxVals; ++i){
+		if(opt_isWithin(n->cmplxVals[i], p)) opt_rehome(n->cmplxVals[i]);
+	}
+	n->countCmplxVals = 0;
+}
+
+// Remove unreachable statements: those following a RETURN, BREAK or
+// CONTINUE in the same sequence, and the branches of IFs on literals
+void opt_pruneStatements(ASTnode* root, ASTnode* n){
+	int i, j;
+	for(i=0; i<n->countChildren; ++i){
+		opt_pruneStatements(root, n->children[i]);
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->which == CONTROL_IF){
+			j = n->countChildren;
+			opt_foldIf(root, n->children[i]);
+			if(n->countChildren != j){
+				i += n->countChildren - j;
+				continue;
+			}
+		}
+	}
+	if(!opt_isSequence(n)) return;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->which != CONTROL_RETRN
+				&& n->children[i]->which != CONTROL_BREAK
+				&& n->children[i]->which != CONTROL_CNTNU
+			) continue;
+		for(j=n->countChildren-1; j>i; --j){
+			if(n->children[j]->childType != n->children[i]->childType) continue;
+			if(opt_keepsAction(root, n->children[j], n->children[j])) continue;
+			opt_removeNode(n->children[j]);
+		}
+	}
+}
+
+// Check whether a store to a variable is a plain assignment statement that
+// could be dropped along with its value
+bool opt_isDeadStore(ASTnode* n){
+	ASTnode* stmt = n->parent;
+	if(n->childType != STORAGE || stmt->which != ASSIGNMENT_EQUAL) return false;
+	if(stmt->childType != STATEMENT && stmt->childType != IF && stmt->childType != ELSE) return false;
+	if(stmt->parent->which == CONTROL_FORK) return false;
+	return opt_isPure(stmt->children[1]);
+}
+
+// Check whether a variable is read anywhere, or stored to in a way that
+// cannot be dropped
+bool opt_isUsed(ASTnode* n, ASTnode* def){
+	int i;
+	if(n->which == VARIABLE_EVAL && n->reference == def) return true;
+	if(n->which == VARIABLE_ASIGN && (n == def || n->reference == def) && !opt_isDeadStore(n)){
+		return true;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_isUsed(n->children[i], def)) return true;
+	}
+	return false;
+}
+
+// Remove every store to a variable
+void opt_removeStores(ASTnode* n, ASTnode* def){
+	int i;
+	if(n->which == VARIABLE_ASIGN && (n == def || n->reference == def)){
+		opt_removeNode(n->parent);
+		return;
+	}
+	for(i=n->countChildren-1; i>=0; --i){
+		opt_removeStores(n->children[i], def);
+	}
+}
+
+// Remove the variables of every scope that are never read, along with the
+// statements storing to them. Returns whether anything was removed
+bool opt_pruneVariables(ASTnode* root, ASTnode* n){
+	int i;
+	bool ret = false;
+	ASTnode* v;
+	for(i=n->countScopeVars-1; i>=0; --i){
+		v = n->scopeVars[i];
+		if(v->which != VARIABLE_ASIGN || v->childType == PARAMETER) continue;
+		if(opt_isUsed(root, v)) continue;
+		opt_removeStores(root, v);
+		opt_removeItem(n->scopeVars, &n->countScopeVars, v);
+		ret = true;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_pruneVariables(root, n->children[i])) ret = true;
+	}
+	return ret;
+}
+
+// Remove code that can never run and variables that are never read.
+// Removing one variable's stores can leave others unread, so repeat until
+// nothing changes
+void opt_eliminateDeadCode(ASTnode* root){
+	opt_pruneStatements(root, root);
+	while(opt_pruneVariables(root, root));
+}
+
+
+//----------------//
+//    Profiles    //
+//----------------//
+
+// How many times a call, or a loop's body, must have run in a profile for
+// it to count as hot
+unsigned long long opt_hotCount = 1000;
+
+// The hint a condition's counts call for: usually true or usually false
+// when at least nine runs in ten went that way, and none otherwise
+signed char opt_expectation(unsigned long long t, unsigned long long f){
+	if(t+f == 0) return 0;
+	if(t >= 9*f) return 1;
+	if(f >= 9*t) return -1;
+	return 0;
+}
+
+// Read a profile written by an instrumented executable, and give the nodes
+// it counted hints for inlining and code generation: which way IF and loop
+// conditions usually go, which loops run hot, and which calls run hot or
+// never run. Nodes are matched by id and kind, so ones made by later passes
+// of the instrumented build are left alone
+void opt_applyProfile(const char* path, hashMap* nodes, char* errBuf){
+	int id;
+	char kind;
+	unsigned long long a, b;
+	ASTnode* n;
+	FILE* f = fopen(path, "r");
+	if(!f){
+		sprintf(errBuf, "Could not read profile %.50s", path);
+		return;
+	}
+	while(fscanf(f, "%d %c %llu %llu", &id, &kind, &a, &b) == 4){
+		n = (ASTnode*) hashMap_retrieve(nodes, id);
+		if(!n) continue;
+		if(kind == 'I' && n->which == CONTROL_IF){
+			n->expect = opt_expectation(a, b);
+		}else if(kind == 'L' && n->which == CONTROL_LOOP){
+			n->expect = opt_expectation(a, b);
+			n->heat = (a >= opt_hotCount);
+		}else if(kind == 'C' && (n->which == ACTION_CALL || n->which == ACTION_DEFIN)){
+			n->heat = (a >= opt_hotCount ? 1 : (a ? 0 : -1));
+		}
+	}
+	if(!feof(f)) sprintf(errBuf, "Profile %.50s is malformed", path);
+	fclose(f);
+}
+
+
+//----------------//
+//    Inlining    //
+//----------------//
+
+// The most nodes an action's body may have for it to be inlined (0 to
+// never inline)
+int opt_inlineSize = 40;
+
+// The node map that new nodes join, and the next id free for them
+hashMap** opt_nodeMap;
+int opt_nextId;
+
+// Start making new nodes for a node map, with ids past any it holds
+void opt_useNodeMap(hashMap** nodes){
+	hashMap_uint i;
+	ASTnode* n;
+	opt_nodeMap = nodes;
+	opt_nextId = 0;
+	for(i=0; i<(*nodes)->size; ++i){
+		if(!(*nodes)->items[i]) continue;
+		n = (ASTnode*) (*nodes)->items[i]->value;
+		if(n->id >= opt_nextId) opt_nextId = n->id+1;
+	}
+}
+
+// The nodes copied while inlining, and the copies made of them
+typedef struct opt_copyMap {
+	ASTnode** from;
+	ASTnode** to;
+	int count, size;
+} opt_copyMap;
+
+// Note that a node was copied
+void opt_mapCopy(opt_copyMap* map, ASTnode* from, ASTnode* to){
+	if(map->count == map->size){
+		map->size = (map->size ? map->size*2 : 8);
+		map->from = realloc(map->from, map->size*sizeof(ASTnode*));
+		map->to = realloc(map->to, map->size*sizeof(ASTnode*));
+	}
+	map->from[map->count] = from;
+	map->to[map->count++] = to;
+}
+
+// Find the copy made of a node, if there is one
+ASTnode* opt_copyOf(opt_copyMap* map, ASTnode* n){
+	int i;
+	for(i=0; i<map->count; ++i) if(map->from[i] == n) return map->to[i];
+	return NULL;
+}
+
+// Make a new node under a parent. It takes its scope the way the parser
+// would give it one
+ASTnode* opt_newNode(ASTnode* parent, nodeType t, nodeWhich which, nodeChildType ct, dataType dt){
+	ASTnode* n = adhoc_createBlankNode();
+	n->id = opt_nextId++;
+	n->parentId = parent->id;
+	n->parent = parent;
+	n->scope = (parent->which == ACTION_DEFIN ? parent : parent->scope);
+	n->nodeType = t;
+	n->which = which;
+	n->childType = ct;
+	n->dataType = dt;
+	n->package = strdup(parent->package);
+	n->name = strdup("");
+	n->value = strdup("");
+	hashMap_add(opt_nodeMap, (void*) n);
+	return n;
+}
+
+// Copy a node, without its children, to go under a new parent
+ASTnode* opt_copyBare(ASTnode* n, ASTnode* parent, opt_copyMap* map){
+	ASTnode* c = opt_newNode(parent, n->nodeType, n->which, n->childType, n->dataType);
+	c->refId = n->refId;
+	c->reference = n->reference;
+	c->layout = n->layout;
+	c->childDataType = n->childDataType;
+	c->defined = n->defined;
+	c->expect = n->expect;
+	c->heat = n->heat;
+	free(c->package);
+	free(c->name);
+	free(c->value);
+	c->package = strdup(n->package);
+	c->name = strdup(n->name);
+	c->value = strdup(n->value);
+	opt_mapCopy(map, n, c);
+	return c;
+}
+
+// Copy a subtree to go under a new parent, noting every copy made
+ASTnode* opt_copyNode(ASTnode* n, ASTnode* parent, opt_copyMap* map){
+	int i;
+	ASTnode* c = opt_copyBare(n, parent, map);
+	for(i=0; i<n->countChildren; ++i){
+		opt_addItem(&c->children, &c->countChildren, &c->sizeChildren, opt_copyNode(n->children[i], c, map));
+	}
+	return c;
+}
+
+// Give a variable a name that no other variable in its new scope has
+void opt_rename(ASTnode* n){
+	char* name = malloc(strlen(n->name)+13);
+	sprintf(name, "%s_%d", n->name, n->id);
+	free(n->name);
+	n->name = name;
+}
+
+// Settle copies of an action's nodes into the scope they were copied to.
+// Copied variables point at copied definitions, which are declared in the
+// new scope under new names, and copied complex literals are initialized
+// by the statements now holding them
+void opt_adoptCopies(opt_copyMap* map, ASTnode* def, ASTnode* scope){
+	int i;
+	ASTnode* v,* c;
+	for(i=0; i<map->count; ++i){
+		c = map->to[i];
+		if(c->reference && (v = opt_copyOf(map, c->reference))) c->reference = v;
+	}
+	for(i=0; i<def->countScopeVars; ++i){
+		v = def->scopeVars[i];
+		if(v->childType == PARAMETER || !(c = opt_copyOf(map, v))) continue;
+		opt_addItem(&scope->scopeVars, &scope->countScopeVars, &scope->sizeScopeVars, c);
+		if(c->which == VARIABLE_ASIGN) opt_rename(c);
+	}
+	for(i=0; i<map->count; ++i){
+		c = map->to[i];
+		if(c->nodeType == VARIABLE && c->reference){
+			c->scope = c->reference->scope;
+			free(c->name);
+			c->name = strdup(c->reference->name);
+		}
+		if(c->which == LITERAL_ARRAY || c->which == LITERAL_HASH || c->which == LITERAL_STRCT){
+			opt_rehome(c);
+		}
+	}
+}
+
+// Count the nodes in a subtree
+int opt_countNodes(ASTnode* n){
+	int i, ret = 1;
+	for(i=0; i<n->countChildren; ++i){
+		ret += opt_countNodes(n->children[i]);
+	}
+	return ret;
+}
+
+// Check whether a subtree returns
+bool opt_hasReturn(ASTnode* n){
+	int i;
+	if(n->which == CONTROL_RETRN) return true;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_hasReturn(n->children[i])) return true;
+	}
+	return false;
+}
+
+// Check whether an action is a leaf that can be copied into its callers: it
+// must not define or call other user actions, nor use any variable from
+// outside itself
+bool opt_isLeaf(ASTnode* def, ASTnode* n){
+	int i;
+	if(n != def && n->which == ACTION_DEFIN) return false;
+	if(n->which == ACTION_CALL && strcmp(n->package, "System")) return false;
+	if(n->nodeType == VARIABLE && !opt_isWithin(n->reference ? n->reference : n, def)){
+		return false;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(n == def && n->children[i]->childType == PARAMETER) continue;
+		if(!opt_isLeaf(def, n->children[i])) return false;
+	}
+	return true;
+}
+
+// Find which parameter of an action a node is, if any
+int opt_paramIndex(ASTnode* def, ASTnode* n){
+	int i;
+	for(i=0; i<def->countChildren && def->children[i]->childType==PARAMETER; ++i){
+		if(def->children[i] == n) return i;
+	}
+	return -1;
+}
+
+// Count the evaluations of a variable in a subtree
+int opt_countUses(ASTnode* n, ASTnode* def){
+	int i, ret = (n->which == VARIABLE_EVAL && n->reference == def);
+	for(i=0; i<n->countChildren; ++i){
+		ret += opt_countUses(n->children[i], def);
+	}
+	return ret;
+}
+
+// Check whether a subtree makes any arrays, hashes or structs
+bool opt_hasContainer(ASTnode* n){
+	int i;
+	if(n->which == LITERAL_ARRAY || n->which == LITERAL_HASH || n->which == LITERAL_STRCT) return true;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_hasContainer(n->children[i])) return true;
+	}
+	return false;
+}
+
+// Check whether a node is inside a loop of its own action
+bool opt_inLoop(ASTnode* n){
+	for(n=n->parent; n && n->which!=ACTION_DEFIN; n=n->parent){
+		if(n->which == CONTROL_LOOP) return true;
+	}
+	return false;
+}
+
+// Check whether a data type is held by value
+bool opt_isScalar(dataType t){
+	return t == TYPE_BOOL || t == TYPE_INT || t == TYPE_FLOAT;
+}
+
+// Put the statements of a group in its place under its parent
+void opt_spliceGroup(ASTnode* n){
+	int i, j, k;
+	ASTnode* p = n->parent;
+	ASTnode** children = malloc((p->countChildren-1+n->countChildren ? p->countChildren-1+n->countChildren : 1)*sizeof(ASTnode*));
+	for(i=0, k=0; i<p->countChildren; ++i){
+		if(p->children[i] != n){
+			children[k++] = p->children[i];
+			continue;
+		}
+		for(j=0; j<n->countChildren; ++j){
+			n->children[j]->parent = p;
+			n->children[j]->parentId = p->id;
+			children[k++] = n->children[j];
+		}
+	}
+	free(p->children);
+	p->children = children;
+	p->countChildren = p->sizeChildren = k;
+	n->countChildren = 0;
+}
+
+// Inline a call made as a statement. The call becomes a group that stores
+// each argument to a new variable standing in for its parameter, then runs
+// a copy of the action's body
+void opt_inlineStatement(ASTnode* site, ASTnode* def, ASTnode** args){
+	int i, j = 0;
+	opt_copyMap map = {NULL, NULL, 0, 0};
+	ASTnode* scope = site->scope,* group,* p,* eq,* v;
+	group = opt_newNode(site->parent, GROUP, GROUP_SERIAL, site->childType, TYPE_VOID);
+	free(group->name);
+	group->name = strdup(def->name);
+	opt_replaceNode(site, group);
+	for(i=0; i<def->countChildren; ++i){
+		p = def->children[i];
+		if(p->childType != PARAMETER){
+			opt_addItem(&group->children, &group->countChildren, &group->sizeChildren, opt_copyNode(p, group, &map));
+			continue;
+		}
+		eq = opt_newNode(group, ASSIGNMENT, ASSIGNMENT_EQUAL, STATEMENT, p->dataType);
+		eq->childDataType = p->childDataType;
+		eq->layout = p->layout;
+		opt_addItem(&group->children, &group->countChildren, &group->sizeChildren, eq);
+		v = opt_newNode(eq, VARIABLE, VARIABLE_ASIGN, STORAGE, p->dataType);
+		v->childDataType = p->childDataType;
+		v->layout = p->layout;
+		v->defined = true;
+		free(v->name);
+		v->name = strdup(p->name);
+		opt_rename(v);
+		opt_addItem(&eq->children, &eq->countChildren, &eq->sizeChildren, v);
+		opt_addItem(&scope->scopeVars, &scope->countScopeVars, &scope->sizeScopeVars, v);
+		args[j]->parent = eq;
+		args[j]->parentId = eq->id;
+		args[j]->childType = EXPRESSION;
+		opt_addItem(&eq->children, &eq->countChildren, &eq->sizeChildren, args[j++]);
+		opt_mapCopy(&map, p, v);
+	}
+
+	// Complex arguments are now initialized by the statements storing them
+	for(i=0; i<site->countCmplxVals; ++i){
+		opt_rehome(site->cmplxVals[i]);
+	}
+	site->countCmplxVals = 0;
+	opt_adoptCopies(&map, def, scope);
+	free(map.from);
+	free(map.to);
+
+	// Only IF and ELSE branches need the group to hold their statements
+	if(group->childType == STATEMENT) opt_spliceGroup(group);
+}
+
+// Put arguments in the place of a copied expression's parameters. An
+// argument is moved to its first use, and copied to any others
+ASTnode* opt_substitute(ASTnode* n, ASTnode* def, ASTnode** args, bool* used, opt_copyMap* map){
+	int i, k;
+	ASTnode* a;
+	if(n->which == VARIABLE_EVAL && (k = opt_paramIndex(def, n->reference)) >= 0){
+		a = (used[k] ? opt_copyNode(args[k], n->parent, map) : args[k]);
+		used[k] = true;
+		a->parent = n->parent;
+		a->parentId = n->parentId;
+		a->childType = n->childType;
+		return a;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		n->children[i] = opt_substitute(n->children[i], def, args, used, map);
+	}
+	return n;
+}
+
+// Check whether a call made within an expression can be inlined. The action
+// must only return a pure expression of the call's scalar type, and each
+// argument must be safe to evaluate as many times as its parameter is
+bool opt_canInlineExpression(ASTnode* site, ASTnode* def, ASTnode** args, int count){
+	int i, uses;
+	ASTnode* e,* p;
+	if(def->countChildren != count+1 || def->children[count]->which != CONTROL_RETRN) return false;
+	if(def->children[count]->countChildren != 1) return false;
+	e = def->children[count]->children[0];
+	if(!opt_isScalar(site->dataType) || e->dataType != site->dataType || !opt_isPure(e)) return false;
+	for(i=0; i<count; ++i){
+		p = def->children[i];
+		if(!opt_isPure(args[i]) || args[i]->dataType != p->dataType) return false;
+		if(!opt_isScalar(p->dataType)){
+			if(args[i]->which != VARIABLE_EVAL) return false;
+			continue;
+		}
+		uses = opt_countUses(e, p);
+		if(uses > 1 && args[i]->which != VARIABLE_EVAL && args[i]->nodeType != LITERAL) return false;
+	}
+	return true;
+}
+
+// Inline a call made within an expression by putting a copy of the
+// action's returned expression in its place
+void opt_inlineExpression(ASTnode* site, ASTnode* def, ASTnode** args, int count){
+	int i;
+	bool* used = calloc(count, sizeof(bool));
+	opt_copyMap map = {NULL, NULL, 0, 0};
+	ASTnode* e = opt_copyNode(def->children[count]->children[0], site->parent, &map);
+	e = opt_substitute(e, def, args, used, &map);
+	opt_replaceNode(site, e);
+	for(i=0; i<count; ++i){
+		if(!used[i]) opt_forget(args[i]);
+	}
+	opt_adoptCopies(&map, def, site->scope);
+	free(used);
+	free(map.from);
+	free(map.to);
+}
+
+// Inline small leaf actions where they are called: at calls to them, and
+// where nested definitions run in place if nothing else calls them. Sites
+// are handled innermost first. Returns whether anything was inlined
+bool opt_inlineSites(ASTnode* root, ASTnode* n){
+	int i, count, size = 0;
+	bool ret = false, ok = true;
+	ASTnode* def = NULL;
+	ASTnode** args;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_inlineSites(root, n->children[i])) ret = true;
+	}
+
+	// Each statement of a FORK is a branch of its own, so those stay whole
+	if(!n->parent || n->parent->which == CONTROL_FORK) return ret;
+	if(n->which == ACTION_CALL && strcmp(n->package, "System")){
+		def = (ASTnode*) hashMap_retrieve(*opt_nodeMap, n->refId);
+	}else if(n->which == ACTION_DEFIN && !opt_isCalledOutside(root, n, n)){
+		def = n;
+	}
+	if(!def || def->which != ACTION_DEFIN || !def->parent || !opt_isLeaf(def, def)) return ret;
+
+	// Check the body is small enough, and gather the arguments
+	for(count=0; count<def->countChildren && def->children[count]->childType==PARAMETER; ++count);
+	for(i=count; i<def->countChildren; ++i){
+		size += opt_countNodes(def->children[i]);
+	}
+	// A profile may have found the site hot, which lets a larger body in, or
+	// never run, which is not worth the code
+	if(n->heat < 0 || size > opt_inlineSize * (n->heat > 0 ? 4 : 1)) return ret;
+	if(n != def && n->countChildren != count) return ret;
+	args = malloc((count ? count : 1)*sizeof(ASTnode*));
+	for(i=0; i<count; ++i){
+		if(n == def){
+			if(def->children[i]->countChildren != 1) ok = false;
+			else args[i] = def->children[i]->children[0];
+		}else{
+			args[i] = n->children[i];
+		}
+	}
+
+	// Statements take a copy of the whole body, expressions just the value.
+	// Container literals are made once per action, so a copy in a loop would
+	// hand back the same container on every pass
+	if(ok && (n->childType == STATEMENT || n->childType == IF || n->childType == ELSE)){
+		for(i=count; i<def->countChildren && ok; ++i){
+			if(opt_hasReturn(def->children[i])) ok = false;
+			if(opt_inLoop(n) && opt_hasContainer(def->children[i])) ok = false;
+		}
+		if(ok){
+			opt_inlineStatement(n, def, args);
+			ret = true;
+		}
+	}else if(ok && opt_canInlineExpression(n, def, args, count)){
+		opt_inlineExpression(n, def, args, count);
+		ret = true;
+	}
+	free(args);
+	return ret;
+}
+
+// Inline small leaf actions at their call sites. Inlining an action's
+// calls can make it a leaf in turn, so repeat until nothing changes
+void opt_inlineActions(ASTnode* root, hashMap** nodes){
+	if(opt_inlineSize <= 0) return;
+	opt_useNodeMap(nodes);
+	while(opt_inlineSites(root, root));
+}
+
+
+//----------------------------------//
+//    Loop Invariant Code Motion    //
+//----------------------------------//
+
+// Put a new node under the parent of another, just ahead of it
+void opt_insertBefore(ASTnode* n, ASTnode* before){
+	ASTnode* p = before->parent;
+	int i = adhoc_getNodeIndexOfChild(p, before);
+	opt_addItem(&p->children, &p->countChildren, &p->sizeChildren, n);
+	memmove(p->children+i+1, p->children+i, (p->countChildren-i-1)*sizeof(ASTnode*));
+	p->children[i] = n;
+}
+
+// Check whether a subtree calls or defines user actions, which could store
+// to any variable they can see
+bool opt_hasUserAction(ASTnode* n){
+	int i;
+	if(n->which == ACTION_DEFIN) return true;
+	if(n->which == ACTION_CALL && strcmp(n->package, "System")) return true;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_hasUserAction(n->children[i])) return true;
+	}
+	return false;
+}
+
+// Check whether a subtree may change what is in a string, array, hash or
+// struct: by storing at an index, or calling an action that changes things
+bool opt_changesData(ASTnode* n){
+	int i;
+	if(n->nodeType == ACTION && adhoc_getSystemEffect(n, opt_libraryPrepend) == EFFECT_CHANGE) return true;
+	if(n->nodeType == ASSIGNMENT && n->children[0]->which == OPERATOR_ARIND) return true;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_changesData(n->children[i])) return true;
+	}
+	return false;
+}
+
+// Check whether a variable is sure to hold a value by the time a loop
+// starts: it is a parameter, or a plain assignment to it comes before the
+// loop in a sequence holding it
+bool opt_isSetBefore(ASTnode* loop, ASTnode* def){
+	int i;
+	ASTnode* n,* s;
+	if(def->childType == PARAMETER) return true;
+	for(n=loop; n->parent && n->which!=ACTION_DEFIN; n=n->parent){
+		if(n->parent->which == CONTROL_FORK) continue;
+		for(i=0; n->parent->children[i]!=n; ++i){
+			s = n->parent->children[i];
+			if(s->which != ASSIGNMENT_EQUAL || s->childType != n->childType) continue;
+			if(s->children[0] == def || s->children[0]->reference == def) return true;
+		}
+	}
+	return false;
+}
+
+// Check whether an expression has the same value on every pass of a loop,
+// and is safe to work out ahead of it even if the loop would not have.
+// Complex variables must already be set, and hold data the loop leaves be
+bool opt_isInvariant(ASTnode* loop, ASTnode* n, bool changes){
+	int i;
+	switch(n->nodeType){
+	case LITERAL:
+		if(n->which == LITERAL_ARRAY || n->which == LITERAL_HASH || n->which == LITERAL_STRCT){
+			return false;
+		}
+		break;
+
+	case VARIABLE:
+		if(n->which != VARIABLE_EVAL || !n->reference) return false;
+		if(opt_countStores(loop, n->reference)) return false;
+		if(!opt_isScalar(n->dataType)
+				&& (changes || !opt_isSetBefore(loop, n->reference))
+			) return false;
+		break;
+
+	// Indexes and divisors might not be valid until the loop checks them
+	case OPERATOR:
+		if(n->which == OPERATOR_ARIND
+				|| n->which == OPERATOR_DIVBY
+				|| n->which == OPERATOR_MOD
+			) return false;
+		break;
+
+	case ACTION:
+		if(adhoc_getSystemEffect(n, opt_libraryPrepend) != EFFECT_PURE) return false;
+		break;
+
+	default:
+		return false;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(!opt_isInvariant(loop, n->children[i], changes)) return false;
+	}
+	return true;
+}
+
+// Work out an expression once ahead of a loop, storing it to a new variable
+// that the loop reads instead
+void opt_hoist(ASTnode* loop, ASTnode* n, const char* name){
+	ASTnode* eq,* v,* e;
+	eq = opt_newNode(loop->parent, ASSIGNMENT, ASSIGNMENT_EQUAL, loop->childType, n->dataType);
+	eq->childDataType = n->childDataType;
+	eq->layout = n->layout;
+	opt_insertBefore(eq, loop);
+	v = opt_newNode(eq, VARIABLE, VARIABLE_ASIGN, STORAGE, n->dataType);
+	v->childDataType = n->childDataType;
+	v->layout = n->layout;
+	v->defined = true;
+	free(v->name);
+	v->name = strdup(name);
+	opt_rename(v);
+	opt_addItem(&eq->children, &eq->countChildren, &eq->sizeChildren, v);
+	opt_addItem(&v->scope->scopeVars, &v->scope->countScopeVars, &v->scope->sizeScopeVars, v);
+	e = opt_newNode(n->parent, VARIABLE, VARIABLE_EVAL, n->childType, n->dataType);
+	e->childDataType = n->childDataType;
+	e->layout = n->layout;
+	e->reference = v;
+	e->refId = v->id;
+	e->scope = v->scope;
+	free(e->name);
+	e->name = strdup(v->name);
+	opt_replaceNode(n, e);
+	n->parent = eq;
+	n->parentId = eq->id;
+	n->childType = EXPRESSION;
+	opt_addItem(&eq->children, &eq->countChildren, &eq->sizeChildren, n);
+}
+
+// Hoist what a loop works out the same way on every pass: calls to pure
+// System actions that return scalars. FORK branches are left whole, since
+// they would share what is hoisted between threads
+void opt_hoistFrom(ASTnode* loop, ASTnode* n, bool changes){
+	int i;
+	if(n->which == CONTROL_FORK) return;
+	if(n->which == ACTION_CALL
+			&& opt_isScalar(n->dataType)
+			&& adhoc_getSystemEffect(n, opt_libraryPrepend) == EFFECT_PURE
+			&& opt_isInvariant(loop, n, changes)
+		){
+		opt_hoist(loop, n, n->name+strlen(opt_libraryPrepend));
+		return;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		opt_hoistFrom(loop, n->children[i], changes);
+	}
+}
+
+// Hoist invariant work out of the loops under a node. Outer loops go first
+// so work moves as far out as it can. Loops calling user actions are left
+// alone, as are loops that are FORK branches themselves
+void opt_hoistLoops(ASTnode* n){
+	int i, j;
+	ASTnode* c;
+	if(n->which == CONTROL_FORK) return;
+	for(i=0; i<n->countChildren; ++i){
+		c = n->children[i];
+		if(c->which == CONTROL_LOOP
+				&& (c->childType == STATEMENT || c->childType == IF || c->childType == ELSE)
+				&& !opt_hasUserAction(c)
+			){
+			for(j=0; j<c->countChildren; ++j){
+				if(c->children[j]->childType == INITIALIZATION) continue;
+				opt_hoistFrom(c, c->children[j], opt_changesData(c));
+			}
+			i = adhoc_getNodeIndexOfChild(n, c);
+		}
+		opt_hoistLoops(c);
+	}
+}
+
+// Move work that loops repeat unchanged on every pass to just ahead of them
+void opt_hoistInvariants(ASTnode* root, hashMap** nodes){
+	opt_useNodeMap(nodes);
+	opt_hoistLoops(root);
+}
+
+
+//-----------------------------//
+//    Tail Call Elimination    //
+//-----------------------------//
+
+// Check whether an action can loop in place of calling itself. Its own
+// variables must all be held by value, since each pass would store over
+// the last one's, and it must not make containers
+bool opt_canLoop(ASTnode* def){
+	int i;
+	for(i=0; i<def->countScopeVars; ++i){
+		if(def->scopeVars[i]->which != VARIABLE_ASIGN) continue;
+		if(def->scopeVars[i]->childType == PARAMETER) continue;
+		if(!opt_isScalar(def->scopeVars[i]->dataType)) return false;
+	}
+	return !opt_hasContainer(def);
+}
+
+// Check whether a call is one an action makes to itself that can become a
+// jump back to its start. Every parameter must be passed, and complex ones
+// must be passed on as they are
+bool opt_isSelfCall(ASTnode* def, ASTnode* n){
+	int i;
+	if(n->which != ACTION_CALL || !strcmp(n->package, "System") || n->refId != def->id) return false;
+	for(i=0; i<def->countChildren && def->children[i]->childType==PARAMETER; ++i);
+	if(n->countChildren != i) return false;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_isScalar(def->children[i]->dataType)) continue;
+		if(n->children[i]->which != VARIABLE_EVAL || n->children[i]->reference != def->children[i]) return false;
+	}
+	return true;
+}
+
+// Store a value to a variable in a new statement ahead of another
+void opt_storeBefore(ASTnode* before, ASTnode* def, ASTnode* value){
+	ASTnode* eq,* v;
+	eq = opt_newNode(before->parent, ASSIGNMENT, ASSIGNMENT_EQUAL, before->childType, def->dataType);
+	opt_insertBefore(eq, before);
+	v = opt_newNode(eq, VARIABLE, VARIABLE_ASIGN, STORAGE, def->dataType);
+	v->reference = def;
+	v->refId = def->id;
+	v->scope = def->scope;
+	free(v->name);
+	v->name = strdup(def->name);
+	opt_addItem(&eq->children, &eq->countChildren, &eq->sizeChildren, v);
+	value->parent = eq;
+	value->parentId = eq->id;
+	value->childType = EXPRESSION;
+	opt_addItem(&eq->children, &eq->countChildren, &eq->sizeChildren, value);
+}
+
+// Check whether a variable of an action is sure to be stored to before it
+// is read on each pass through the action: the first statement to use it
+// stores it plainly, or starts a loop counting with it
+bool opt_isStoredFirst(ASTnode* def, ASTnode* v){
+	int i;
+	ASTnode* c;
+	for(i=0; i<def->countChildren; ++i){
+		c = def->children[i];
+		if(c->childType != STATEMENT) continue;
+		if(c->which == ASSIGNMENT_EQUAL
+				&& (c->children[0] == v || c->children[0]->reference == v)
+			) return !opt_countUses(c->children[1], v);
+		if(c->which == CONTROL_LOOP && v->parent == c) return v->childType == INITIALIZATION;
+		if(opt_countUses(c, v) || opt_countStores(c, v)) return false;
+	}
+	return false;
+}
+
+// Turn a call an action makes to itself as its last step into stores to
+// its parameters and a jump back to its start. Each parameter is stored
+// once no argument left to store reads it, and arguments that read each
+// other in a cycle are worked out ahead of the stores. Of the action's own
+// variables, which are the first vars in its scope, those that might be
+// read before being stored are set back to zero
+void opt_jumpBack(ASTnode* def, ASTnode* site, ASTnode* call, int vars){
+	int i, j, left = 0, count = call->countChildren;
+	bool* changed = calloc(count, sizeof(bool));
+	ASTnode* v,* z;
+	for(i=0; i<count; ++i){
+		changed[i] = call->children[i]->which != VARIABLE_EVAL
+			|| call->children[i]->reference != def->children[i];
+		if(changed[i]) ++left;
+	}
+	while(left){
+		for(i=0; i<count; ++i){
+			if(!changed[i]) continue;
+			for(j=0; j<count; ++j){
+				if(j != i && changed[j] && opt_countUses(call->children[j], def->children[i])) break;
+			}
+			if(j == count) break;
+		}
+		if(i < count){
+			opt_storeBefore(site, def->children[i], call->children[i]);
+			changed[i] = false;
+			--left;
+			continue;
+		}
+		for(i=0; i<count; ++i){
+			if(changed[i]) opt_hoist(site, call->children[i], def->children[i]->name);
+		}
+	}
+	for(i=0; i<vars; ++i){
+		v = def->scopeVars[i];
+		if(v->which != VARIABLE_ASIGN || v->childType == PARAMETER) continue;
+		if(opt_isStoredFirst(def, v)) continue;
+		switch(v->dataType){
+		case TYPE_BOOL:
+			z = opt_newNode(site, LITERAL, LITERAL_BOOL, EXPRESSION, TYPE_BOOL);
+			free(z->value);
+			z->value = strdup("false");
+			break;
+		case TYPE_FLOAT:
+			z = opt_newNode(site, LITERAL, LITERAL_FLOAT, EXPRESSION, TYPE_FLOAT);
+			free(z->value);
+			z->value = strdup("0.0");
+			break;
+		default:
+			z = opt_newNode(site, LITERAL, LITERAL_INT, EXPRESSION, TYPE_INT);
+			free(z->value);
+			z->value = strdup("0");
+		}
+		opt_storeBefore(site, v, z);
+	}
+	opt_replaceNode(site, opt_newNode(site->parent, CONTROL, CONTROL_CNTNU, site->childType, TYPE_VOID));
+	free(changed);
+}
+
+// Rewrite the self calls an action makes last among a sequence of
+// statements of one child type. The last statement of a sequence is last
+// in the action when the sequence is, and the value of a returned call is
+// always the action's last step. IF branches are followed, but not loops
+// or switches, whose own jumps would take the place of the action's
+bool opt_tailCalls(ASTnode* def, ASTnode* n, nodeChildType ct, bool tail, int vars){
+	int i, last = -1;
+	bool ret = false;
+	ASTnode* c;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == ct) last = i;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		c = n->children[i];
+		if(c->childType != ct) continue;
+		if(c->which == CONTROL_IF){
+			ret |= opt_tailCalls(def, c, IF, tail && i == last, vars);
+			ret |= opt_tailCalls(def, c, ELSE, tail && i == last, vars);
+		}else if(c->which == CONTROL_RETRN
+				&& c->countChildren
+				&& opt_isSelfCall(def, c->children[0])
+			){
+			opt_jumpBack(def, c, c->children[0], vars);
+			ret = true;
+		}else if(tail && i == last
+				&& def->dataType == TYPE_VOID
+				&& opt_isSelfCall(def, c)
+			){
+			opt_jumpBack(def, c, c, vars);
+			ret = true;
+		}
+	}
+	return ret;
+}
+
+// Check whether a statement always returns or jumps back to the start of
+// its action: it does so itself, or is an IF whose branches both end so
+bool opt_alwaysJumps(ASTnode* n){
+	int i;
+	ASTnode* last[2] = {NULL, NULL};
+	if(n->which == CONTROL_RETRN || n->which == CONTROL_CNTNU) return true;
+	if(n->which != CONTROL_IF) return false;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == IF) last[0] = n->children[i];
+		if(n->children[i]->childType == ELSE) last[1] = n->children[i];
+	}
+	return last[0] && last[1] && opt_alwaysJumps(last[0]) && opt_alwaysJumps(last[1]);
+}
+
+// Put the statements of an action in a loop that its jumps back to the
+// start continue. Reaching the end of the statements leaves the loop
+void opt_loopAction(ASTnode* def){
+	int i, k;
+	ASTnode* loop = opt_newNode(def, CONTROL, CONTROL_LOOP, STATEMENT, TYPE_VOID),* c;
+	for(i=0, k=0; i<def->countChildren; ++i){
+		c = def->children[i];
+		if(c->childType != STATEMENT){
+			def->children[k++] = c;
+			continue;
+		}
+		c->parent = loop;
+		c->parentId = loop->id;
+		opt_addItem(&loop->children, &loop->countChildren, &loop->sizeChildren, c);
+	}
+	def->children[k++] = loop;
+	def->countChildren = k;
+	if(!opt_alwaysJumps(loop->children[loop->countChildren-1])){
+		opt_addItem(&loop->children, &loop->countChildren, &loop->sizeChildren, opt_newNode(loop, CONTROL, CONTROL_BREAK, STATEMENT, TYPE_VOID));
+	}
+}
+
+// Find the actions under a node that call themselves last, and loop them
+void opt_loopActions(ASTnode* n){
+	int i;
+	if(n->which == ACTION_DEFIN
+			&& opt_canLoop(n)
+			&& opt_tailCalls(n, n, STATEMENT, true, n->countScopeVars)
+		){
+		opt_loopAction(n);
+	}
+	for(i=0; i<n->countChildren; ++i){
+		opt_loopActions(n->children[i]);
+	}
+}
+
+// Turn calls actions make to themselves as their last step into loops, so
+// deep recursion runs in one frame
+void opt_eliminateTailCalls(ASTnode* root, hashMap** nodes){
+	opt_useNodeMap(nodes);
+	opt_loopActions(root);
+}
+
+
+//--------------------------//
+//    Strength Reduction    //
+//--------------------------//
+
+// The highest constant power of an int written out as multiplies. Floats
+// are only squared this way, since longer chains round unlike pow does
+int opt_maxChain = 4;
+
+// The int variables being checked for ever going negative, which are taken
+// not to while the variables they are stored from are checked in turn
+ASTnode* opt_naturals[16];
+int opt_countNaturals;
+
+// Get k where a node is the int literal 2^k, or -1 if it is not one
+int opt_powerOfTwo(ASTnode* n){
+	int v, k;
+	if(n->which != LITERAL_INT) return -1;
+	v = atoi(n->value);
+	if(v <= 0 || (v & (v-1))) return -1;
+	for(k=0; v>1; v>>=1) ++k;
+	return k;
+}
+
+bool opt_isNaturalVariable(ASTnode* def);
+
+// Check whether an int expression can never be negative. Overflow is left
+// out, as it is undefined for C ints anyway
+bool opt_isNatural(ASTnode* n){
+	if(n->dataType != TYPE_INT) return false;
+	switch(n->which){
+	case LITERAL_INT:
+		return atoi(n->value) >= 0;
+
+	case OPERATOR_PLUS:
+	case OPERATOR_TIMES:
+	case OPERATOR_DIVBY:
+		return opt_isNatural(n->children[0]) && opt_isNatural(n->children[1]);
+
+	// The remainder takes its sign from the left side
+	case OPERATOR_MOD:
+		return opt_isNatural(n->children[0]);
+
+	case OPERATOR_TRNIF:
+		return opt_isNatural(n->children[1]) && opt_isNatural(n->children[2]);
+
+	case VARIABLE_EVAL:
+		return n->reference && opt_isNaturalVariable(n->reference);
+
+	case ACTION_CALL:
+		return opt_isSystem(n, "size")
+			|| opt_isSystem(n, "count")
+			|| opt_isSystem(n, "count_occurrences")
+			|| opt_isSystem(n, "count_greater_than");
+	}
+	return false;
+}
+
+// Check whether every store to a variable under a node leaves it at zero
+// or more. Parameters and prompts could store anything
+bool opt_storesNatural(ASTnode* n, ASTnode* def){
+	int i;
+	ASTnode* p = n->parent;
+	if(n->which == VARIABLE_EVAL && n->reference == def && opt_isSystem(p, "prompt")) return false;
+	if(n->which == VARIABLE_ASIGN && (n == def || n->reference == def)){
+		if(n->childType == PARAMETER) return false;
+		if(n->childType == INITIALIZATION){
+			if(n->countChildren && !opt_isNatural(n->children[0])) return false;
+		}else switch(p->which){
+		case ASSIGNMENT_INCPR:
+		case ASSIGNMENT_INCPS:
+		case ASSIGNMENT_MOD:
+			break;
+		case ASSIGNMENT_EQUAL:
+		case ASSIGNMENT_PLUS:
+		case ASSIGNMENT_TIMES:
+		case ASSIGNMENT_DIVBY:
+			if(!opt_isNatural(p->children[1])) return false;
+			break;
+		default:
+			return false;
+		}
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(!opt_storesNatural(n->children[i], def)) return false;
+	}
+	return true;
+}
+
+// Check whether an int variable can never be negative. Variables start out
+// at zero in C, so it is enough that every store keeps it there or above
+bool opt_isNaturalVariable(ASTnode* def){
+	int i;
+	bool ret;
+	ASTnode* root;
+	if(def->dataType != TYPE_INT) return false;
+	for(i=0; i<opt_countNaturals; ++i) if(opt_naturals[i] == def) return true;
+	if(opt_countNaturals == sizeof(opt_naturals)/sizeof(ASTnode*)) return false;
+	for(root=def; root->parent; root=root->parent);
+	opt_naturals[opt_countNaturals++] = def;
+	ret = opt_storesNatural(root, def);
+	--opt_countNaturals;
+	return ret;
+}
+
+// Move a node's children under a new node, which becomes its first child
+void opt_pushDown(ASTnode* n, ASTnode* t){
+	int i;
+	t->children = n->children;
+	t->countChildren = n->countChildren;
+	t->sizeChildren = n->sizeChildren;
+	for(i=0; i<t->countChildren; ++i){
+		t->children[i]->parent = t;
+		t->children[i]->parentId = t->id;
+	}
+	n->children = NULL;
+	n->countChildren = n->sizeChildren = 0;
+	opt_addItem(&n->children, &n->countChildren, &n->sizeChildren, t);
+}
+
+// Write a variable or literal raised to a small constant power out as a
+// chain of multiplies
+void opt_powerChain(ASTnode* n, int k){
+	int i;
+	opt_copyMap map = {0};
+	ASTnode* base = n->children[0];
+	if(k == 0){
+		if(n->dataType == TYPE_INT) opt_makeInt(n, 1);
+		else opt_makeFloat(n, 1.0);
+		return;
+	}
+	if(k == 1){
+		opt_replaceNode(n, base);
+		return;
+	}
+	n->which = OPERATOR_TIMES;
+	n->countChildren = 1;
+	opt_addItem(&n->children, &n->countChildren, &n->sizeChildren, opt_copyNode(base, n, &map));
+	for(i=2; i<k; ++i){
+		opt_pushDown(n, opt_newNode(n, OPERATOR, OPERATOR_TIMES, EXPRESSION, n->dataType));
+		opt_addItem(&n->children, &n->countChildren, &n->sizeChildren, opt_copyNode(base, n, &map));
+	}
+	free(map.from);
+	free(map.to);
+}
+
+// Turn a power assignment to a variable into a plain assignment of a power
+// of that variable
+void opt_expandPower(ASTnode* n){
+	ASTnode* v = n->children[0],* def,* p,* e;
+	def = (v->reference ? v->reference : v);
+	p = opt_newNode(n, OPERATOR, OPERATOR_EXP, EXPRESSION, n->dataType);
+	e = opt_newNode(p, VARIABLE, VARIABLE_EVAL, EXPRESSION, def->dataType);
+	e->reference = def;
+	e->refId = def->id;
+	e->scope = def->scope;
+	free(e->name);
+	e->name = strdup(def->name);
+	opt_addItem(&p->children, &p->countChildren, &p->sizeChildren, e);
+	opt_addItem(&p->children, &p->countChildren, &p->sizeChildren, n->children[1]);
+	n->children[1]->parent = p;
+	n->children[1]->parentId = p->id;
+	n->children[1] = p;
+	n->which = ASSIGNMENT_EQUAL;
+}
+
+// Post-walkable strength reduction. Small constant powers of variables and
+// literals become multiplies, and ints that can never be negative are
+// multiplied, divided and taken modulo powers of two bitwise
+void opt_reduceNode(ASTnode* n, int d, char* errBuf){
+	int k;
+	ASTnode* t;
+	switch(n->which){
+	case ASSIGNMENT_EXP:
+		if(n->children[0]->which != VARIABLE_ASIGN) break;
+		if(n->dataType != TYPE_INT && n->dataType != TYPE_FLOAT) break;
+		opt_expandPower(n);
+		n = n->children[1];
+	case OPERATOR_EXP:
+		if(n->children[0]->nodeType != VARIABLE && n->children[0]->nodeType != LITERAL) break;
+		if(n->children[1]->which != LITERAL_INT) break;
+		k = atoi(n->children[1]->value);
+		if(n->dataType == TYPE_INT && k >= 0 && k <= opt_maxChain) opt_powerChain(n, k);
+		else if(n->dataType == TYPE_FLOAT && k >= 0 && k <= 2) opt_powerChain(n, k);
+		break;
+
+	// Multiplies by a power of two are kept with the power on the right
+	case OPERATOR_TIMES:
+		if(n->dataType != TYPE_INT) break;
+		if(opt_powerOfTwo(n->children[0]) > 0 && n->children[1]->nodeType != LITERAL){
+			t = n->children[0];
+			n->children[0] = n->children[1];
+			n->children[1] = t;
+		}
+	case OPERATOR_DIVBY:
+	case OPERATOR_MOD:
+		n->bitwise = n->dataType == TYPE_INT
+			&& opt_powerOfTwo(n->children[1]) > 0
+			&& opt_isNatural(n->children[0]);
+		break;
+
+	case ASSIGNMENT_TIMES:
+	case ASSIGNMENT_DIVBY:
+	case ASSIGNMENT_MOD:
+		t = n->children[0];
+		n->bitwise = t->which == VARIABLE_ASIGN
+			&& opt_powerOfTwo(n->children[1]) > 0
+			&& opt_isNaturalVariable(t->reference ? t->reference : t);
+		break;
+	}
+}
+
+// Replace arithmetic with cheaper arithmetic that has the same result
+void opt_reduceStrength(ASTnode* root, hashMap** nodes){
+	char errBuf[1] = "";
+	opt_useNodeMap(nodes);
+	adhoc_treePostWalk(opt_reduceNode, root, 0, errBuf);
+}
+
+
+//---------------------------//
+//    Type Specialization    //
+//---------------------------//
+
+// The most copies an action may be specialized into, and the most times
+// calls are looked over before settling for the copies they have
+int opt_maxSpecials = 8;
+int opt_maxSpecialRounds = 16;
+
+// The actions that were specialized, and each copy made of them
+opt_copyMap opt_specials;
+
+// Check whether a value's type is known well enough to specialize for
+bool opt_isKnownType(ASTnode* n){
+	switch(n->dataType){
+	case TYPE_VOID:
+	case TYPE_ACTN:
+	case TYPE_MIXED:
+		return false;
+	case TYPE_ARRAY:
+	case TYPE_HASH:
+		return n->childDataType != TYPE_VOID
+			&& n->childDataType != TYPE_ACTN
+			&& n->childDataType != TYPE_MIXED;
+	}
+	return true;
+}
+
+// Check whether an argument has exactly the type of a parameter
+bool opt_sameType(ASTnode* a, ASTnode* p){
+	if(a->dataType != p->dataType) return false;
+	switch(a->dataType){
+	case TYPE_ARRAY:
+	case TYPE_HASH:
+		if(a->childDataType != p->childDataType) return false;
+		return a->childDataType != TYPE_STRCT || a->layout == p->layout;
+	case TYPE_STRCT:
+		return a->layout == p->layout;
+	}
+	return true;
+}
+
+// Check whether an argument can be passed to a parameter as it is: it has
+// the parameter's type, or is a scalar every target widens to it exactly
+bool opt_fitsType(ASTnode* a, ASTnode* p){
+	if(opt_sameType(a, p)) return true;
+	if(p->dataType == TYPE_FLOAT) return a->dataType == TYPE_INT || a->dataType == TYPE_BOOL;
+	return p->dataType == TYPE_INT && a->dataType == TYPE_BOOL;
+}
+
+// Check whether each argument of a call fits, or exactly matches, the
+// parameter of an action it is passed to
+bool opt_fitsAction(ASTnode* site, ASTnode* def, bool exact){
+	int i;
+	for(i=0; i<site->countChildren; ++i){
+		if(exact && !opt_sameType(site->children[i], def->children[i])) return false;
+		if(!exact && !opt_fitsType(site->children[i], def->children[i])) return false;
+	}
+	return true;
+}
+
+// Check whether an action can be copied whole: it must not define other
+// actions, whose copies would share their names, nor use any variable from
+// outside itself
+bool opt_isStandalone(ASTnode* def, ASTnode* n){
+	int i;
+	if(n != def && n->which == ACTION_DEFIN) return false;
+	if(n->nodeType == VARIABLE && !opt_isWithin(n->reference ? n->reference : n, def)){
+		return false;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(n == def && n->children[i]->childType == PARAMETER) continue;
+		if(!opt_isStandalone(def, n->children[i])) return false;
+	}
+	return true;
+}
+
+// Find the action a specialized copy was made from
+ASTnode* opt_specialOrigin(ASTnode* def){
+	int i;
+	for(i=0; i<opt_specials.count; ++i) if(opt_specials.to[i] == def) return opt_specials.from[i];
+	return def;
+}
+
+// Find the action or copy of it that a call's arguments match exactly, or
+// failing that one they fit, preferring the action itself
+ASTnode* opt_specialFor(ASTnode* site, ASTnode* def, bool exact){
+	int i;
+	if(opt_fitsAction(site, def, exact)) return def;
+	for(i=0; i<opt_specials.count; ++i){
+		if(opt_specials.from[i] != def) continue;
+		if(opt_fitsAction(site, opt_specials.to[i], exact)) return opt_specials.to[i];
+	}
+	return NULL;
+}
+
+// Specialize an action for a call by defining a copy of it where the call
+// was, taking the call's arguments under its parameters. The copy's types
+// follow from those arguments once it is retyped
+void opt_specialize(ASTnode* site, ASTnode* def){
+	int i;
+	opt_copyMap map = {NULL, NULL, 0, 0};
+	ASTnode* spec = opt_copyBare(def, site->parent, &map),* p,* c;
+	for(i=0; i<def->countChildren; ++i){
+		p = def->children[i];
+		c = (p->childType == PARAMETER ? opt_copyBare(p, spec, &map) : opt_copyNode(p, spec, &map));
+		opt_addItem(&spec->children, &spec->countChildren, &spec->sizeChildren, c);
+	}
+
+	// The call may be within the action, so it is only taken apart once
+	// the action has been copied
+	for(i=0; i<site->countChildren; ++i){
+		c = spec->children[i];
+		site->children[i]->parent = c;
+		site->children[i]->parentId = c->id;
+		site->children[i]->childType = EXPRESSION;
+		opt_addItem(&c->children, &c->countChildren, &c->sizeChildren, site->children[i]);
+		c->dataType = site->children[i]->dataType;
+		c->childDataType = site->children[i]->childDataType;
+		c->layout = site->children[i]->layout;
+	}
+	site->countChildren = 0;
+	opt_rename(spec);
+	spec->parentId = site->parentId;
+	opt_replaceNode(site, spec);
+
+	// Copies point at copied definitions, and the action's calls to itself
+	// become the copy's calls to itself
+	for(i=0; i<map.count; ++i){
+		c = map.to[i];
+		if(c->which == ACTION_CALL && c->refId == def->id){
+			c->refId = spec->id;
+			c->reference = spec;
+			free(c->name);
+			c->name = strdup(spec->name);
+		}else if(c->reference && (p = opt_copyOf(&map, c->reference))){
+			c->reference = p;
+		}
+		if(c->which == LITERAL_ARRAY || c->which == LITERAL_HASH || c->which == LITERAL_STRCT){
+			opt_rehome(c);
+		}
+	}
+	for(i=0; i<def->countScopeVars; ++i){
+		if(!(c = opt_copyOf(&map, def->scopeVars[i]))) continue;
+		opt_addItem(&spec->scopeVars, &spec->countScopeVars, &spec->sizeScopeVars, c);
+	}
+	opt_mapCopy(&opt_specials, def, spec);
+	free(map.from);
+	free(map.to);
+}
+
+// Find the value every return of an action agrees on the type of, leaving
+// out those returning its calls to itself, whose types follow its own.
+// Returns whether they agree
+bool opt_agreedReturn(ASTnode* def, ASTnode* n, ASTnode** ret){
+	int i;
+	if(n != def && n->which == ACTION_DEFIN) return true;
+	if(n->which == CONTROL_RETRN && n->countChildren
+			&& (n->children[0]->which != ACTION_CALL || n->children[0]->refId != def->id)
+		){
+		if(*ret && !opt_sameType(n->children[0], *ret)) return false;
+		*ret = n->children[0];
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(!opt_agreedReturn(def, n->children[i], ret)) return false;
+	}
+	return true;
+}
+
+// Give each copy the type its returns agree on. The copy's own calls to
+// itself may be all that tie its type to the action it was copied from.
+// Returns whether any copy changed type
+bool opt_typeSpecials(){
+	int i;
+	bool ret = false;
+	ASTnode* spec,* r;
+	for(i=0; i<opt_specials.count; ++i){
+		spec = opt_specials.to[i];
+		r = NULL;
+		if(!opt_agreedReturn(spec, spec, &r) || !r || !opt_isKnownType(r)) continue;
+		if(opt_sameType(r, spec)) continue;
+		spec->dataType = r->dataType;
+		spec->childDataType = r->childDataType;
+		spec->layout = r->layout;
+		ret = true;
+	}
+	return ret;
+}
+
+// Point a call at the copy of its action made for its argument types,
+// making that copy if there is none yet. Calls whose arguments fit the
+// action they already call are left alone. Returns whether a copy was made
+bool opt_specializeCall(ASTnode* site, bool* moved){
+	int i, count, copies = 0;
+	ASTnode* def,* origin,* to;
+	if(site->which != ACTION_CALL || !strcmp(site->package, "System")) return false;
+	def = (ASTnode*) hashMap_retrieve(*opt_nodeMap, site->refId);
+	if(!def || def->which != ACTION_DEFIN || !def->parent) return false;
+	for(count=0; count<def->countChildren && def->children[count]->childType==PARAMETER; ++count);
+	if(site->countChildren != count || opt_fitsAction(site, def, true)) return false;
+	for(i=0; i<count; ++i){
+		if(!opt_isKnownType(site->children[i])) return false;
+	}
+
+	// Use the closest copy there is
+	origin = opt_specialOrigin(def);
+	if(!(to = opt_specialFor(site, origin, true))) to = opt_specialFor(site, origin, false);
+	if(to){
+		if(to == def) return false;
+		site->refId = to->id;
+		site->reference = to;
+		free(site->name);
+		site->name = strdup(to->name);
+		*moved = true;
+		return false;
+	}
+
+	// Otherwise make one. Complex arguments of a call made as a statement
+	// are initialized by the call itself, which a definition cannot do
+	for(i=0; i<opt_specials.count; ++i) if(opt_specials.from[i] == origin) ++copies;
+	if(copies >= opt_maxSpecials || site->countCmplxVals || !opt_isStandalone(origin, origin)){
+		return false;
+	}
+	opt_specialize(site, origin);
+	return true;
+}
+
+// Specialize the calls in a subtree, innermost first. Returns whether any
+// copies were made
+bool opt_specializeCalls(ASTnode* n, bool* moved){
+	int i;
+	bool ret = false;
+	for(i=0; i<n->countChildren; ++i){
+		if(opt_specializeCalls(n->children[i], moved)) ret = true;
+	}
+	return opt_specializeCall(n, moved) || ret;
+}
+
+// Give each action a copy for every other set of argument types it is
+// called with, so each copy is generated with fully known types. Typing a
+// copy and the calls moved to it can change the types passed on to other
+// calls, so retype and repeat until the calls settle
+void opt_specializeActions(ASTnode* root, hashMap** nodes, walk_func retype, char* errBuf){
+	int round;
+	bool moved;
+	opt_useNodeMap(nodes);
+	for(round=0; round<opt_maxSpecialRounds; ++round){
+		moved = opt_typeSpecials();
+		if(!opt_specializeCalls(root, &moved) && !moved) break;
+		adhoc_treePostWalk(retype, root, 0, errBuf);
+		if(strlen(errBuf)) break;
+	}
+	free(opt_specials.from);
+	free(opt_specials.to);
+	opt_specials.from = opt_specials.to = NULL;
+	opt_specials.count = opt_specials.size = 0;
+}
+
+#pragma clang diagnostic pop
+#endif
@@ -0,0 +1,2416 @@
+#ifndef VM_H
+#define VM_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "hashmap.h"
+#include "adhoc_types.h"
+#include "libadhoc.h"
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+#define VM_NATIVE
+#endif
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#pragma clang diagnostic ignored "-Wswitch"
+#pragma clang diagnostic ignored "-Wgnu-label-as-value"
+
+
+//----------------//
+//    Bytecode    //
+//----------------//
+// Each action compiles to a function for a register machine. A call gets a
+// frame with two files of registers: scalars, where bools and ints are held
+// as ints and floats as doubles, and complex data. A complex register holds
+// one reference to its data, so writing one drops the reference it held and
+// leaving a frame drops them all. Values are libadhoc's throughout.
+
+// A scalar register
+typedef union vm_value {
+	int i;
+	double f;
+} vm_value;
+
+// The machine's operations. Each writes register a from operands b and c
+// unless noted. Typed groups follow the order of the AST operators or data
+// types they stand for.
+//   LDI loads int b, LDF float constant b, and LDS a new string of constant b
+//   MOVF rounds a float to the precision of a stored float
+//   ADDK adds the int c to b
+//   JMP jumps to a, JZ and JNZ to b on a being zero or not, and JEQ to c
+//   when a equals b
+//   CLRD clears the b complex registers from a
+//   NEWARR and NEWHASH make a container of item type b with room for c
+//   ASET, HSET and GST store c (b for GST) at index or key b of a, or in
+//   global a. Hash keys are strings when k is set, and ints otherwise
+//   SWS finds which label of switch table c string b matches
+//   CALL calls function b and SYS System action b, with arguments from c in
+//   the function's argument list (k of them for SYS). a is -1 for no result
+//   RETS and RETD return a
+#define VM_OPS(X) \
+	X(NOP) X(LDI) X(LDF) X(MOV) X(MOVF) \
+	X(I2F) X(F2I) X(I2B) X(F2B) X(NOT) \
+	X(ADDI) X(SUBI) X(MULI) X(DIVI) X(MODI) X(POWI) X(ADDK) \
+	X(ADDF) X(SUBF) X(MULF) X(DIVF) X(MODF) X(POWF) \
+	X(EQI) X(GTI) X(LTI) X(GEI) X(LEI) X(NEI) \
+	X(EQF) X(GTF) X(LTF) X(GEF) X(LEF) X(NEF) \
+	X(EQS) X(GTS) X(LTS) X(GES) X(LES) X(NES) \
+	X(JMP) X(JZ) X(JNZ) X(JEQ) \
+	X(LDS) X(MOVD) X(CLRD) X(NEWARR) X(NEWHASH) \
+	X(AGETB) X(AGETI) X(AGETF) X(AGETD) \
+	X(ASETB) X(ASETI) X(ASETF) X(ASETD) \
+	X(HGETB) X(HGETI) X(HGETF) X(HGETD) \
+	X(HSETB) X(HSETI) X(HSETF) X(HSETD) \
+	X(SWS) X(GLD) X(GST) X(GLDD) X(GSTD) \
+	X(CALL) X(SYS) X(RET) X(RETS) X(RETD)
+#define VM_ENUM(o) VM_##o,
+#define VM_NAME(o) #o,
+typedef enum vm_op {
+	VM_OPS(VM_ENUM)
+} vm_op;
+const char* vm_op_names[] = {
+	VM_OPS(VM_NAME)
+};
+
+// System actions, in the same order as their names
+typedef enum vm_system {
+	VM_SYS_TYPE
+	,VM_SYS_SIZE
+	,VM_SYS_COUNT
+	,VM_SYS_TOSTRING
+	,VM_SYS_PRINT
+	,VM_SYS_PRINTLN
+	,VM_SYS_PROMPT
+	,VM_SYS_APPEND_TO_STRING
+	,VM_SYS_CONCAT
+	,VM_SYS_SUBSTRING
+	,VM_SYS_SPLICE_STRING
+	,VM_SYS_FIND_IN_STRING
+	,VM_SYS_FIND_ALL_IN_STRING
+	,VM_SYS_COUNT_OCCURRENCES
+	,VM_SYS_ISSET_ARRAY
+	,VM_SYS_APPEND_TO_ARRAY
+	,VM_SYS_FIND_MAX_VALUE
+	,VM_SYS_FIND_MAX_VALUE_INDEX
+	,VM_SYS_FIND_MIN_VALUE
+	,VM_SYS_FIND_MIN_VALUE_INDEX
+	,VM_SYS_SUM_ARRAY
+	,VM_SYS_COUNT_GREATER_THAN
+	,VM_SYS_ISSET_HASH
+	,VM_SYS_REMOVE_FROM_HASH
+} vm_system;
+
+// How many arguments each System action needs, and the type its first one
+// must have (void for any)
+int vm_system_arities[] = {1,1,1,1,0,0,1,2,0,3,4,2,2,2,2,2,1,1,1,1,1,2,2,2};
+dataType vm_system_firsts[] = {
+	TYPE_VOID, TYPE_VOID, TYPE_VOID, TYPE_VOID, TYPE_VOID, TYPE_VOID
+	,TYPE_VOID, TYPE_STRNG, TYPE_VOID, TYPE_STRNG, TYPE_STRNG, TYPE_STRNG
+	,TYPE_STRNG, TYPE_STRNG, TYPE_ARRAY, TYPE_ARRAY, TYPE_ARRAY, TYPE_ARRAY
+	,TYPE_ARRAY, TYPE_ARRAY, TYPE_ARRAY, TYPE_ARRAY, TYPE_HASH, TYPE_HASH
+};
+
+// One instruction
+typedef struct vm_instr {
+	short op;
+	short k;
+	int a, b, c;
+} vm_instr;
+
+// A value passed to a function or System action: its type and register. A
+// literal search target is passed as the number of its needle, typed void
+typedef struct vm_arg {
+	dataType type;
+	int reg;
+} vm_arg;
+
+// An action compiled to a function. nodes holds the id of the AST node each
+// instruction came from, for reporting errors while running. Once it has
+// been called or has jumped back often enough, it is also compiled to native
+// code, which entries says where each instruction starts in
+typedef struct vm_function {
+	ASTnode* def;
+	vm_instr* code;
+	int* nodes;
+	int countCode, sizeCode;
+	vm_arg* params;
+	int countParams, sizeParams;
+	vm_arg* args;
+	int countArgs, sizeArgs;
+	int countS, countD;
+	int calls, loops;
+	unsigned char* native;
+	size_t sizeNative;
+	int* entries;
+} vm_function;
+
+// A compiled program: its functions (the root action's first), constants,
+// the label tables of its string SWITCHes, the needles of its literal search
+// targets, and its globals. slots and funcs
+// map node ids to registers and functions, offset by one so 0 means none
+typedef struct vm_program {
+	vm_function** functions;
+	int countFunctions, sizeFunctions;
+	double* floats;
+	int countFloats, sizeFloats;
+	char** strings;
+	int countStrings, sizeStrings;
+	adhoc_switchTable** switches;
+	int countSwitches, sizeSwitches;
+	adhoc_needle** needles;
+	int countNeedles, sizeNeedles;
+	vm_value* globalS;
+	adhoc_data** globalD;
+	int countGlobalS, countGlobalD;
+	int* slots;
+	int* funcs;
+	hashMap* nodes;
+	int hot;
+	bool debug;
+	char* errBuf;
+} vm_program;
+
+// A running function's frame, as native code sees it: its registers, where
+// it returns to, and the instruction it stopped at on a fault
+typedef struct vm_frame {
+	vm_value* S;
+	adhoc_data** D;
+	vm_value* retS;
+	adhoc_data** retD;
+	int pc;
+} vm_frame;
+
+// Native code for a function, entered at the code of some instruction. It
+// returns a fault, or 0 once the function returns
+typedef int (*vm_native)(vm_frame* f, unsigned char* entry);
+
+// Why running stopped. A failed call has already reported its error
+typedef enum vm_fault {
+	VM_FINE
+	,VM_FAILED
+	,VM_DIVIDE
+	,VM_INDEX
+	,VM_UNSET
+} vm_fault;
+const char* vm_faults[] = {NULL, NULL, "Division by zero", "Negative array index", "Value was never set"};
+
+// The loops and SWITCHes around what is being compiled, innermost first,
+// with the jumps out of each that still need their target
+typedef struct vm_exit {
+	bool loop;
+	int top;
+	int* breaks;
+	int countBreaks, sizeBreaks;
+	struct vm_exit* outer;
+} vm_exit;
+
+// Where a value is stored: a register of the frame, a global, or an item of
+// the array or hash in register reg
+typedef struct vm_target {
+	dataType type;
+	int reg;
+	int key;
+	bool global;
+	bool item;
+	bool hash;
+	bool strKey;
+} vm_target;
+
+// The program being compiled, its root action, and the action being
+// compiled into the function vm_fn
+vm_program* vm_prog;
+ASTnode* vm_root;
+ASTnode* vm_def;
+vm_function* vm_fn;
+
+// What System action names were prefixed with for the target language
+const char* vm_libraryPrepend;
+
+// How many calls, or jumps back, make a function hot enough to compile to
+// native code (0 to never)
+int vm_nativeHeat = 1000;
+
+// The first temporary registers after the action's variables, the next
+// free ones, and the highest complex one the current statement has used
+int vm_firstS, vm_firstD, vm_tempS, vm_tempD, vm_highD;
+
+// The last instruction to write a fresh temporary and which register file
+// it wrote, and the last place jumped to
+int vm_lastResult, vm_lastLabel;
+bool vm_lastComplex;
+
+// The container literals of the action being compiled
+ASTnode** vm_literals;
+int vm_countLiterals, vm_sizeLiterals;
+
+// The loops and SWITCHes around what is being compiled
+vm_exit* vm_exits;
+
+// Headers for master functions
+int vm_expr(ASTnode*, dataType*);
+void vm_statement(ASTnode*);
+void vm_exec(vm_program*, vm_function*, vm_value*, adhoc_data**, vm_arg*, vm_value*, adhoc_data**);
+bool vm_nativeCompile(vm_program*, vm_function*);
+
+
+//-----------------//
+//    Utilities    //
+//-----------------//
+
+// Make room for one more item at the end of a list
+void vm_grow(void** list, int count, int* size, size_t itemSize){
+	if(count < *size) return;
+	*size = (*size ? *size*2 : 8);
+	*list = realloc(*list, *size*itemSize);
+}
+
+// Check whether values of a type are held in complex registers
+static inline bool vm_isComplex(dataType t){
+	return t == TYPE_STRNG || t == TYPE_ARRAY || t == TYPE_HASH || t == TYPE_STRCT;
+}
+
+// Check whether values of a type can be held in registers at all
+bool vm_isHeld(dataType t){
+	return t == TYPE_BOOL || t == TYPE_INT || t == TYPE_FLOAT
+		|| t == TYPE_STRNG || t == TYPE_ARRAY || t == TYPE_HASH;
+}
+
+// Check whether a node's value goes unused
+bool vm_isStatement(ASTnode* n){
+	return n->childType == STATEMENT || n->childType == IF || n->childType == ELSE;
+}
+
+// Find the first child of a node connected as a certain child type
+ASTnode* vm_part(ASTnode* n, nodeChildType t){
+	int i;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == t) return n->children[i];
+	}
+	return NULL;
+}
+
+// Read a bool literal the way the C target prints it
+bool vm_bool(const char* v){
+	return !strcmp(v, "true") || (strcmp(v, "false") && atoi(v));
+}
+
+// Work out the escape sequences of a string literal as a C compiler would
+char* vm_unescape(const char* s, int* length){
+	char* ret = malloc(strlen(s)+1);
+	char* o = ret;
+	int k, v;
+	for(; *s; ++s){
+		if(*s != '\\' || !s[1]){
+			*o++ = *s;
+			continue;
+		}
+		switch(*++s){
+		case 'n': *o++ = '\n'; break;
+		case 't': *o++ = '\t'; break;
+		case 'r': *o++ = '\r'; break;
+		case 'a': *o++ = '\a'; break;
+		case 'b': *o++ = '\b'; break;
+		case 'f': *o++ = '\f'; break;
+		case 'v': *o++ = '\v'; break;
+		case 'x':
+			for(v=0; isxdigit(s[1]); ++s){
+				v = v*16 + (isdigit(s[1]) ? s[1]-'0' : tolower(s[1])-'a'+10);
+			}
+			*o++ = v;
+			break;
+		default:
+			if(*s < '0' || *s > '7'){
+				*o++ = *s;
+				break;
+			}
+			for(v=0, k=0; k<3 && *s>='0' && *s<='7'; ++k, ++s) v = v*8 + *s-'0';
+			--s;
+			*o++ = v;
+		}
+	}
+	*o = '\0';
+	if(length) *length = o-ret;
+	return ret;
+}
+
+// Stop compiling with an error at a node, keeping the first error found
+void vm_error(ASTnode* n, const char* msg){
+	if(*vm_prog->errBuf) return;
+	adhoc_errorNode = n;
+	snprintf(vm_prog->errBuf, 80, "Node %d: %s", n->id, msg);
+}
+
+// Stop compiling at a value of a type the machine cannot hold
+void vm_typeError(ASTnode* n, dataType t){
+	vm_error(n, (t == TYPE_STRCT
+		? "Structs are not supported by --run"
+		: "Value has no type that --run can hold"
+	));
+}
+
+
+//-----------------------//
+//    Compiling Parts    //
+//-----------------------//
+
+// Add an instruction to the function being compiled, from a node
+int vm_emit(ASTnode* n, vm_op op, int a, int b, int c){
+	if(vm_fn->countCode == vm_fn->sizeCode){
+		vm_fn->sizeCode = (vm_fn->sizeCode ? vm_fn->sizeCode*2 : 32);
+		vm_fn->code = realloc(vm_fn->code, vm_fn->sizeCode*sizeof(vm_instr));
+		vm_fn->nodes = realloc(vm_fn->nodes, vm_fn->sizeCode*sizeof(int));
+	}
+	vm_fn->code[vm_fn->countCode] = (vm_instr){op, 0, a, b, c};
+	vm_fn->nodes[vm_fn->countCode] = n->id;
+	return vm_fn->countCode++;
+}
+
+// Mark the next instruction as a place jumped to, and return where it is
+int vm_label(){
+	return vm_lastLabel = vm_fn->countCode;
+}
+
+// Point a jump at its target
+void vm_patch(int pc, int target){
+	vm_instr* i = vm_fn->code + pc;
+	switch(i->op){
+	case VM_JMP: i->a = target; break;
+	case VM_JZ: case VM_JNZ: i->b = target; break;
+	case VM_JEQ: i->c = target; break;
+	}
+}
+
+// Take a free temporary register for a value of a type
+int vm_temp(dataType t){
+	if(!vm_isComplex(t)){
+		if(++vm_tempS > vm_fn->countS) vm_fn->countS = vm_tempS;
+		return vm_tempS-1;
+	}
+	if(++vm_tempD > vm_fn->countD) vm_fn->countD = vm_tempD;
+	if(vm_tempD > vm_highD) vm_highD = vm_tempD;
+	return vm_tempD-1;
+}
+
+// Note that an instruction wrote a fresh temporary of a type
+void vm_fresh(int pc, dataType t){
+	vm_lastResult = pc;
+	vm_lastComplex = vm_isComplex(t);
+}
+
+// Add an instruction whose result of a type goes to a new temporary
+int vm_result(ASTnode* n, vm_op op, dataType t, int b, int c){
+	int a = vm_temp(t);
+	vm_fresh(vm_emit(n, op, a, b, c), t);
+	return a;
+}
+
+// Copy a value of a type between registers. When the value was just worked
+// out into a temporary, the instruction that did so writes dst instead
+void vm_move(ASTnode* n, int dst, int src, dataType t){
+	bool complex = vm_isComplex(t);
+	int last = vm_fn->countCode-1;
+	if(dst == src) return;
+	if(t != TYPE_FLOAT
+			&& last >= 0
+			&& vm_lastResult == last
+			&& vm_lastLabel != vm_fn->countCode
+			&& vm_lastComplex == complex
+			&& vm_fn->code[last].a == src
+			&& src >= (complex ? vm_firstD : vm_firstS)
+		){
+		vm_fn->code[last].a = dst;
+		return;
+	}
+	vm_emit(n, (complex ? VM_MOVD : (t == TYPE_FLOAT ? VM_MOVF : VM_MOV)), dst, src, 0);
+}
+
+// Convert a value from one type to another as C would when storing it
+int vm_convert(ASTnode* n, int r, dataType from, dataType to){
+	if(from == to || *vm_prog->errBuf) return r;
+	if(!vm_isHeld(from) || !vm_isHeld(to) || vm_isComplex(from) || vm_isComplex(to)){
+		vm_error(n, "Value cannot be converted to the type it is used as");
+		return r;
+	}
+	switch(to){
+	case TYPE_BOOL:
+		return vm_result(n, (from == TYPE_FLOAT ? VM_F2B : VM_I2B), to, r, 0);
+	case TYPE_INT:
+		return (from == TYPE_FLOAT ? vm_result(n, VM_F2I, to, r, 0) : r);
+	default:
+		return vm_result(n, VM_I2F, to, r, 0);
+	}
+}
+
+// Round a float to the precision C keeps it at once stored
+int vm_round(ASTnode* n, int r, dataType t){
+	return (t == TYPE_FLOAT ? vm_result(n, VM_MOVF, t, r, 0) : r);
+}
+
+// Pick the variant of a typed group of operations (bool, int, float, then
+// complex) for a type
+vm_op vm_typed(vm_op first, dataType t){
+	switch(t){
+	case TYPE_BOOL: return first;
+	case TYPE_INT: return first+1;
+	case TYPE_FLOAT: return first+2;
+	default: return first+3;
+	}
+}
+
+// Add a float constant to the program
+int vm_float(double f){
+	vm_grow((void**)&vm_prog->floats, vm_prog->countFloats, &vm_prog->sizeFloats, sizeof(double));
+	vm_prog->floats[vm_prog->countFloats] = f;
+	return vm_prog->countFloats++;
+}
+
+// Add a string constant to the program
+int vm_string(const char* s){
+	vm_grow((void**)&vm_prog->strings, vm_prog->countStrings, &vm_prog->sizeStrings, sizeof(char*));
+	vm_prog->strings[vm_prog->countStrings] = vm_unescape(s, NULL);
+	return vm_prog->countStrings++;
+}
+
+// Add a list of arguments to the function being compiled
+int vm_arguments(vm_arg* args, int count){
+	int i;
+	for(i=0; i<count; ++i){
+		vm_grow((void**)&vm_fn->args, vm_fn->countArgs, &vm_fn->sizeArgs, sizeof(vm_arg));
+		vm_fn->args[vm_fn->countArgs++] = args[i];
+	}
+	return vm_fn->countArgs-count;
+}
+
+// Get the function an action compiles to, queueing it to be compiled
+int vm_functionOf(ASTnode* def){
+	vm_function* f;
+	if(vm_prog->funcs[def->id]) return vm_prog->funcs[def->id]-1;
+	f = calloc(1, sizeof(vm_function));
+	f->def = def;
+	vm_grow((void**)&vm_prog->functions, vm_prog->countFunctions, &vm_prog->sizeFunctions, sizeof(vm_function*));
+	vm_prog->functions[vm_prog->countFunctions++] = f;
+	vm_prog->funcs[def->id] = vm_prog->countFunctions;
+	return vm_prog->countFunctions-1;
+}
+
+// Find the node that defines a variable
+ASTnode* vm_definition(ASTnode* n){
+	return n->reference ? n->reference : n;
+}
+
+// Check whether a variable definition is a global: a parameter of the root
+bool vm_isGlobal(ASTnode* def){
+	return def->parent == vm_root && def->childType == PARAMETER;
+}
+
+// The register of a variable or container literal, or -1 if it has none
+int vm_slot(ASTnode* n){
+	return vm_prog->slots[n->id]-1;
+}
+
+// The register of a global, given one on first use
+int vm_global(ASTnode* def){
+	if(!vm_prog->slots[def->id]){
+		vm_prog->slots[def->id] = 1 + (vm_isComplex(def->dataType)
+			? vm_prog->countGlobalD++
+			: vm_prog->countGlobalS++
+		);
+	}
+	return vm_slot(def);
+}
+
+// Give a variable definition or container literal its own register
+void vm_own(ASTnode* n, dataType t){
+	vm_prog->slots[n->id] = 1 + (vm_isComplex(t) ? vm_fn->countD++ : vm_fn->countS++);
+}
+
+// Give registers to the variables and container literals of the action
+// being compiled. Nested actions are only called from here, so only the
+// arguments of those calls are looked through
+void vm_scan(ASTnode* n){
+	int i;
+	ASTnode* def;
+	if(n->nodeType == VARIABLE){
+		def = vm_definition(n);
+		if(def->scope == vm_def
+				&& !vm_isGlobal(def)
+				&& vm_slot(def) < 0
+				&& vm_isHeld(def->dataType)
+			){
+			vm_own(def, def->dataType);
+		}
+	}
+	if((n->which == LITERAL_ARRAY || n->which == LITERAL_HASH) && vm_slot(n) < 0){
+		vm_own(n, n->dataType);
+		vm_grow((void**)&vm_literals, vm_countLiterals, &vm_sizeLiterals, sizeof(ASTnode*));
+		vm_literals[vm_countLiterals++] = n;
+	}
+	for(i=0; i<n->countChildren; ++i){
+		if(n->which == ACTION_DEFIN && n->children[i]->childType != PARAMETER) continue;
+		vm_scan(n->children[i]);
+	}
+}
+
+
+//------------------------//
+//    Compiling Values    //
+//------------------------//
+
+// Work out where a variable or indexed item is stored
+bool vm_resolve(ASTnode* n, vm_target* t){
+	dataType kt;
+	ASTnode* def;
+	memset(t, 0, sizeof(vm_target));
+	if(n->nodeType == VARIABLE){
+		def = vm_definition(n);
+		t->type = def->dataType;
+		if(!vm_isHeld(t->type)){
+			vm_typeError(n, t->type);
+			return false;
+		}
+		if(vm_isGlobal(def)){
+			t->global = true;
+			t->reg = vm_global(def);
+			return true;
+		}
+		if((t->reg = vm_slot(def)) < 0){
+			vm_error(n, "Variable belongs to another action");
+			return false;
+		}
+		return true;
+	}
+	if(n->which != OPERATOR_ARIND){
+		vm_error(n, "Value cannot be assigned to");
+		return false;
+	}
+	t->item = true;
+	t->reg = vm_expr(n->children[0], &kt);
+	if(*vm_prog->errBuf) return false;
+	if(kt != TYPE_ARRAY && kt != TYPE_HASH){
+		vm_error(n, "Only arrays and hashes can be indexed");
+		return false;
+	}
+	t->hash = (kt == TYPE_HASH);
+	t->type = n->children[0]->childDataType;
+	if(!vm_isHeld(t->type)){
+		vm_typeError(n, t->type);
+		return false;
+	}
+	t->key = vm_expr(n->children[1], &kt);
+	if(t->hash && kt == TYPE_STRNG){
+		t->strKey = true;
+	}else if(t->hash && kt != TYPE_INT && kt != TYPE_BOOL){
+		vm_error(n->children[1], "Hash keys must be strings or integers");
+	}else if(!t->hash){
+		t->key = vm_convert(n->children[1], t->key, kt, TYPE_INT);
+	}
+	return !*vm_prog->errBuf;
+}
+
+// Get the value at a target into a register
+int vm_load(ASTnode* n, vm_target* t){
+	int r;
+	if(t->item){
+		r = vm_result(n, vm_typed((t->hash ? VM_HGETB : VM_AGETB), t->type), t->type, t->reg, t->key);
+		vm_fn->code[vm_lastResult].k = t->strKey;
+		return r;
+	}
+	if(t->global) return vm_result(n, (vm_isComplex(t->type) ? VM_GLDD : VM_GLD), t->type, t->reg, 0);
+	return t->reg;
+}
+
+// Store a value of a type at a target, and return a register holding what
+// was stored
+int vm_store(ASTnode* n, vm_target* t, int r, dataType from){
+	int pc;
+	r = vm_convert(n, r, from, t->type);
+	if(t->item){
+		pc = vm_emit(n, vm_typed((t->hash ? VM_HSETB : VM_ASETB), t->type), t->reg, t->key, r);
+		vm_fn->code[pc].k = t->strKey;
+		return r;
+	}
+	if(t->global){
+		r = vm_round(n, r, t->type);
+		vm_emit(n, (vm_isComplex(t->type) ? VM_GSTD : VM_GST), t->reg, r, 0);
+		return r;
+	}
+	vm_move(n, t->reg, r, t->type);
+	return t->reg;
+}
+
+// Fill the container literals a statement holds, as each run of it does
+void vm_fill(ASTnode* n){
+	int i, j, r, key, pc;
+	bool hash;
+	dataType t;
+	ASTnode* lit;
+	ASTnode* item;
+	for(i=0; i<n->countCmplxVals; ++i){
+		lit = n->cmplxVals[i];
+		hash = (lit->which == LITERAL_HASH);
+		if(lit->which == LITERAL_STRCT){
+			vm_typeError(lit, TYPE_STRCT);
+			return;
+		}
+		if(vm_slot(lit) < 0){
+			vm_error(lit, "Literal belongs to another action");
+			return;
+		}
+		for(j=0; j<lit->countChildren; ++j){
+			item = lit->children[j];
+			r = vm_expr(item->children[0], &t);
+			r = vm_convert(item, r, t, lit->childDataType);
+			if(!hash){
+				key = vm_result(item, VM_LDI, TYPE_INT, atoi(item->value), 0);
+			}else if(item->dataType == TYPE_STRNG){
+				key = vm_result(item, VM_LDS, TYPE_STRNG, vm_string(item->value), 0);
+			}else if(item->dataType == TYPE_INT || item->dataType == TYPE_BOOL){
+				key = vm_result(item, VM_LDI, TYPE_INT, (item->dataType == TYPE_BOOL ? vm_bool(item->value) : atoi(item->value)), 0);
+			}else{
+				vm_error(item, "Hash keys must be strings or integers");
+				return;
+			}
+			pc = vm_emit(item, vm_typed((hash ? VM_HSETB : VM_ASETB), lit->childDataType), vm_slot(lit), key, r);
+			vm_fn->code[pc].k = (hash && item->dataType == TYPE_STRNG);
+		}
+	}
+}
+
+// Do arithmetic on two values in the type C would: int or float
+int vm_arithmetic(ASTnode* n, int op, int l, dataType lt, int r, dataType rt, dataType* t){
+	*t = adhoc_resolveTypes(lt, rt);
+	if(*t == TYPE_BOOL) *t = TYPE_INT;
+	if(*t != TYPE_INT && *t != TYPE_FLOAT){
+		vm_error(n, "Only numbers can be used in arithmetic");
+		return 0;
+	}
+	l = vm_convert(n, l, lt, *t);
+	r = vm_convert(n, r, rt, *t);
+	return vm_result(n, (*t == TYPE_INT ? VM_ADDI : VM_ADDF)+op, *t, l, r);
+}
+
+// Compare two values: strings by their bytes, and anything else as numbers
+int vm_compare(ASTnode* n, int op, int l, dataType lt, int r, dataType rt){
+	dataType t;
+	if(lt == TYPE_STRNG && rt == TYPE_STRNG) return vm_result(n, VM_EQS+op, TYPE_BOOL, l, r);
+	t = adhoc_resolveTypes(lt, rt);
+	if(t == TYPE_BOOL) t = TYPE_INT;
+	if(t != TYPE_INT && t != TYPE_FLOAT){
+		vm_error(n, "Only numbers and strings can be compared");
+		return 0;
+	}
+	l = vm_convert(n, l, lt, t);
+	r = vm_convert(n, r, rt, t);
+	return vm_result(n, (t == TYPE_INT ? VM_EQI : VM_EQF)+op, TYPE_BOOL, l, r);
+}
+
+// Work out a bool into register r, short-circuiting AND and OR: the right
+// side is only worked out when the left one (already in r) does not decide
+void vm_shortCircuit(ASTnode* n, ASTnode* right, int r, bool isOr){
+	int l, pc;
+	dataType t;
+	pc = vm_emit(n, (isOr ? VM_JNZ : VM_JZ), r, -1, 0);
+	l = vm_expr(right, &t);
+	vm_move(n, r, vm_convert(right, l, t, TYPE_BOOL), TYPE_BOOL);
+	vm_patch(pc, vm_label());
+}
+
+// Step, or negate, a stored value. Postfix forms copy the old value out
+// first when it is used
+int vm_step(ASTnode* n, dataType* t){
+	int l, r, old;
+	bool post = (n->which == ASSIGNMENT_INCPS || n->which == ASSIGNMENT_DECPS || n->which == ASSIGNMENT_NEGPS);
+	int step = (n->which == ASSIGNMENT_INCPR || n->which == ASSIGNMENT_INCPS) ? 1 : -1;
+	vm_target target;
+	if(!vm_resolve(n->children[0], &target)) return 0;
+	*t = target.type;
+	old = l = vm_load(n, &target);
+	if(post && !vm_isStatement(n) && !target.item && !target.global){
+		old = vm_temp(*t);
+		vm_emit(n, VM_MOV, old, l, 0);
+	}
+	if(n->which == ASSIGNMENT_NEGPR || n->which == ASSIGNMENT_NEGPS){
+		r = vm_result(n, VM_NOT, TYPE_BOOL, vm_convert(n, l, *t, TYPE_BOOL), 0);
+		r = vm_store(n, &target, r, TYPE_BOOL);
+	}else if(*t == TYPE_FLOAT){
+		r = vm_result(n, VM_LDF, TYPE_FLOAT, vm_float(step), 0);
+		r = vm_result(n, VM_ADDF, TYPE_FLOAT, l, r);
+		r = vm_store(n, &target, r, TYPE_FLOAT);
+	}else if(*t == TYPE_INT || *t == TYPE_BOOL){
+		r = vm_result(n, VM_ADDK, TYPE_INT, l, step);
+		r = vm_store(n, &target, r, TYPE_INT);
+	}else{
+		vm_error(n, "Only numbers can be stepped");
+		return 0;
+	}
+	return post ? old : r;
+}
+
+// Find the expression given as the i-th argument of a call. A definition
+// that stands where it is first called holds its arguments under its
+// parameters
+ASTnode* vm_argument(ASTnode* n, int i){
+	int j;
+	ASTnode* c;
+	for(j=0; j<n->countChildren; ++j){
+		c = n->children[j];
+		if(c->childType != ARGUMENT && c->childType != PARAMETER) continue;
+		if(i--) continue;
+		if(c->childType == ARGUMENT) return c;
+		return (c->countChildren ? c->children[0] : NULL);
+	}
+	return NULL;
+}
+
+// Compile a call to an action. Arguments are converted to the types of
+// its parameters
+int vm_call(ASTnode* n, dataType* t){
+	int i, count, start, r = 0;
+	vm_arg* args;
+	ASTnode* a;
+	ASTnode* def = (n->which == ACTION_DEFIN)
+		? n
+		: (ASTnode*) hashMap_retrieve(vm_prog->nodes, n->refId);
+	dataType at;
+	if(!def || def->which != ACTION_DEFIN){
+		vm_error(n, "Action has no definition");
+		return 0;
+	}
+	for(count=0; count<def->countChildren && def->children[count]->childType == PARAMETER; ++count);
+	args = malloc((count ? count : 1)*sizeof(vm_arg));
+	for(i=0; i<count && !*vm_prog->errBuf; ++i){
+		if(!(a = vm_argument(n, i))){
+			vm_error(n, "Too few arguments in call");
+			break;
+		}
+		args[i].type = def->children[i]->dataType;
+		if(!vm_isHeld(args[i].type)){
+			vm_typeError(def->children[i], args[i].type);
+			break;
+		}
+		args[i].reg = vm_expr(a, &at);
+		args[i].reg = vm_round(a, vm_convert(a, args[i].reg, at, args[i].type), args[i].type);
+	}
+	if(!*vm_prog->errBuf){
+		start = vm_arguments(args, count);
+		*t = def->dataType;
+		if(vm_isHeld(*t)){
+			r = vm_result(n, VM_CALL, *t, vm_functionOf(def), start);
+		}else if(*t == TYPE_VOID){
+			vm_emit(n, VM_CALL, -1, vm_functionOf(def), start);
+		}else{
+			vm_typeError(def, *t);
+		}
+	}
+	free(args);
+	return r;
+}
+
+// Make the needle of a literal search target, as the C target declares it
+int vm_needle(ASTnode* n){
+	adhoc_needle* needle = malloc(sizeof(adhoc_needle));
+	int length;
+	char* data = vm_unescape(n->value, &length);
+	*needle = (adhoc_needle){data, length, 0, false, 0, 0};
+	vm_grow((void**)&vm_prog->needles, vm_prog->countNeedles, &vm_prog->sizeNeedles, sizeof(adhoc_needle*));
+	vm_prog->needles[vm_prog->countNeedles] = needle;
+	return vm_prog->countNeedles++;
+}
+
+// Compile a call to a System action. Arguments keep their own types, which
+// say how they are handed to libadhoc
+int vm_callSystem(ASTnode* n, dataType* t){
+	int i, id, count, start, pc, r = 0;
+	int len = strlen(vm_libraryPrepend);
+	const char* name = n->name + (strncmp(n->name, vm_libraryPrepend, len) ? 0 : len);
+	vm_arg* args;
+	ASTnode* a;
+	vm_target target;
+	for(id=0; adhoc_systemAction_names[id]; ++id){
+		if(!strcmp(name, adhoc_systemAction_names[id])) break;
+	}
+	if(!adhoc_systemAction_names[id]){
+		vm_error(n, "Unrecognized library function");
+		return 0;
+	}
+	for(count=0; vm_argument(n, count); ++count);
+	if(count < vm_system_arities[id]){
+		vm_error(n, "Too few arguments in call");
+		return 0;
+	}
+	*t = TYPE_VOID;
+
+	// Prompting writes a variable, so it works on a copy that is stored back
+	if(id == VM_SYS_PROMPT){
+		a = vm_argument(n, 0);
+		if(a->nodeType != VARIABLE){
+			vm_error(a, "Only variables can be prompted for");
+			return 0;
+		}
+		if(!vm_resolve(a, &target)) return 0;
+		if(vm_isComplex(target.type) && target.type != TYPE_STRNG){
+			vm_error(a, "Only bools, ints, floats and strings can be prompted for");
+			return 0;
+		}
+		r = vm_temp(target.type);
+		vm_emit(a, (vm_isComplex(target.type) ? VM_MOVD : VM_MOV), r, vm_load(a, &target), 0);
+		start = vm_arguments(&(vm_arg){target.type, r}, 1);
+		pc = vm_emit(n, VM_SYS, r, id, start);
+		vm_fn->code[pc].k = 1;
+		vm_fresh(pc, target.type);
+		vm_store(a, &target, r, target.type);
+		return 0;
+	}
+
+	// Work out the arguments, converting those libadhoc takes as numbers
+	args = malloc(count*sizeof(vm_arg));
+	for(i=0; i<count && !*vm_prog->errBuf; ++i){
+		a = vm_argument(n, i);
+		if(i == 1 && a->which == LITERAL_STRNG && (id == VM_SYS_FIND_IN_STRING
+				|| id == VM_SYS_FIND_ALL_IN_STRING || id == VM_SYS_COUNT_OCCURRENCES)
+			){
+			args[i] = (vm_arg){TYPE_VOID, vm_needle(a)};
+			continue;
+		}
+		args[i].reg = vm_expr(a, &args[i].type);
+		if(!vm_isHeld(args[i].type)){
+			vm_typeError(a, args[i].type);
+		}else if(i == 0 && vm_system_firsts[id] && args[i].type != vm_system_firsts[id]){
+			vm_error(a, "Argument has the wrong type for this library function");
+		}else if(i == 0 && id == VM_SYS_TYPE && !vm_isComplex(args[i].type)){
+			vm_error(a, "Only complex values have a type to get");
+		}else if(i == 1 && (id == VM_SYS_ISSET_HASH || id == VM_SYS_REMOVE_FROM_HASH)){
+			if(args[i].type != TYPE_STRNG) args[i].reg = vm_convert(a, args[i].reg, args[i].type, TYPE_INT);
+			if(args[i].type != TYPE_STRNG) args[i].type = TYPE_INT;
+		}else if((i == 1 && id == VM_SYS_ISSET_ARRAY)
+				|| (i > 0 && id == VM_SYS_SUBSTRING)
+				|| (i > 1 && id == VM_SYS_SPLICE_STRING)
+			){
+			args[i].reg = vm_convert(a, args[i].reg, args[i].type, TYPE_INT);
+			args[i].type = TYPE_INT;
+		}else if(i == 1 && id == VM_SYS_COUNT_GREATER_THAN){
+			args[i].reg = vm_convert(a, args[i].reg, args[i].type, TYPE_FLOAT);
+			args[i].type = TYPE_FLOAT;
+		}else if(i == 1 && (id == VM_SYS_SPLICE_STRING || id == VM_SYS_FIND_IN_STRING
+				|| id == VM_SYS_FIND_ALL_IN_STRING || id == VM_SYS_COUNT_OCCURRENCES)
+				&& args[i].type != TYPE_STRNG
+			){
+			vm_error(a, "Argument has the wrong type for this library function");
+		}
+	}
+
+	// Work out the type of the result
+	switch(id){
+	case VM_SYS_TYPE:
+	case VM_SYS_SIZE:
+	case VM_SYS_COUNT:
+	case VM_SYS_FIND_IN_STRING:
+	case VM_SYS_COUNT_OCCURRENCES:
+	case VM_SYS_FIND_MAX_VALUE_INDEX:
+	case VM_SYS_FIND_MIN_VALUE_INDEX:
+	case VM_SYS_COUNT_GREATER_THAN:
+		*t = TYPE_INT;
+		break;
+	case VM_SYS_TOSTRING:
+	case VM_SYS_CONCAT:
+	case VM_SYS_SUBSTRING:
+		*t = TYPE_STRNG;
+		break;
+	case VM_SYS_SPLICE_STRING:
+		*t = (vm_isStatement(n) ? TYPE_VOID : TYPE_STRNG);
+		break;
+	case VM_SYS_FIND_ALL_IN_STRING:
+		*t = TYPE_ARRAY;
+		break;
+	case VM_SYS_ISSET_ARRAY:
+	case VM_SYS_ISSET_HASH:
+	case VM_SYS_REMOVE_FROM_HASH:
+		*t = TYPE_BOOL;
+		break;
+	case VM_SYS_FIND_MAX_VALUE:
+	case VM_SYS_FIND_MIN_VALUE:
+	case VM_SYS_SUM_ARRAY:
+		*t = vm_argument(n, 0)->childDataType;
+		if(*t != TYPE_BOOL && *t != TYPE_INT && *t != TYPE_FLOAT){
+			vm_error(n, "Only arrays of numbers can be searched or summed");
+		}
+		break;
+	}
+
+	if(!*vm_prog->errBuf){
+		start = vm_arguments(args, count);
+		if(*t == TYPE_VOID){
+			pc = vm_emit(n, VM_SYS, -1, id, start);
+		}else{
+			r = vm_result(n, VM_SYS, *t, id, start);
+			pc = vm_lastResult;
+		}
+		vm_fn->code[pc].k = count;
+	}
+	free(args);
+	return r;
+}
+
+// Compile a node's value into a register, and give the value's type
+int vm_expr(ASTnode* n, dataType* t){
+	int l, r, pc, end;
+	dataType lt, rt;
+	vm_target target;
+	*t = TYPE_VOID;
+	if(*vm_prog->errBuf) return 0;
+	switch(n->which){
+	case LITERAL_BOOL:
+		*t = TYPE_BOOL;
+		return vm_result(n, VM_LDI, TYPE_BOOL, vm_bool(n->value), 0);
+	case LITERAL_INT:
+		*t = TYPE_INT;
+		return vm_result(n, VM_LDI, TYPE_INT, atoi(n->value), 0);
+	case LITERAL_FLOAT:
+		*t = TYPE_FLOAT;
+		return vm_result(n, VM_LDF, TYPE_FLOAT, vm_float(strtod(n->value, NULL)), 0);
+	case LITERAL_STRNG:
+		*t = TYPE_STRNG;
+		return vm_result(n, VM_LDS, TYPE_STRNG, vm_string(n->value), 0);
+	case LITERAL_ARRAY:
+	case LITERAL_HASH:
+		*t = n->dataType;
+		if((r = vm_slot(n)) < 0) vm_error(n, "Literal belongs to another action");
+		return r;
+	case LITERAL_STRCT:
+		vm_typeError(n, TYPE_STRCT);
+		return 0;
+
+	case VARIABLE_ASIGN:
+	case VARIABLE_EVAL:
+		if(!vm_resolve(n, &target)) return 0;
+		*t = target.type;
+		if(n->which == VARIABLE_ASIGN && n->countChildren){
+			r = vm_expr(n->children[0], &rt);
+			return vm_store(n, &target, r, rt);
+		}
+		return vm_load(n, &target);
+
+	case ACTION_CALL:
+	case ACTION_DEFIN:
+		if(n->which == ACTION_CALL && !strcmp(n->package, "System")) return vm_callSystem(n, t);
+		return vm_call(n, t);
+
+	case OPERATOR_PLUS:
+	case OPERATOR_MINUS:
+	case OPERATOR_TIMES:
+	case OPERATOR_DIVBY:
+	case OPERATOR_MOD:
+	case OPERATOR_EXP:
+		l = vm_expr(n->children[0], &lt);
+		r = vm_expr(n->children[1], &rt);
+		return vm_arithmetic(n, n->which-OPERATOR_PLUS, l, lt, r, rt, t);
+	case OPERATOR_EQUIV:
+	case OPERATOR_GRTTN:
+	case OPERATOR_LESTN:
+	case OPERATOR_GRTEQ:
+	case OPERATOR_LESEQ:
+	case OPERATOR_NOTEQ:
+		*t = TYPE_BOOL;
+		l = vm_expr(n->children[0], &lt);
+		r = vm_expr(n->children[1], &rt);
+		return vm_compare(n, n->which-OPERATOR_EQUIV, l, lt, r, rt);
+	case OPERATOR_OR:
+	case OPERATOR_AND:
+		*t = TYPE_BOOL;
+		r = vm_temp(TYPE_BOOL);
+		l = vm_expr(n->children[0], &lt);
+		vm_move(n, r, vm_convert(n, l, lt, TYPE_BOOL), TYPE_BOOL);
+		vm_shortCircuit(n, n->children[1], r, n->which == OPERATOR_OR);
+		return r;
+	case OPERATOR_NOT:
+		*t = TYPE_BOOL;
+		l = vm_expr(n->children[0], &lt);
+		return vm_result(n, VM_NOT, TYPE_BOOL, vm_convert(n, l, lt, TYPE_BOOL), 0);
+	case OPERATOR_ARIND:
+		if(!vm_resolve(n, &target)) return 0;
+		*t = target.type;
+		return vm_load(n, &target);
+	case OPERATOR_TRNIF:
+		*t = adhoc_resolveTypes(n->children[1]->dataType, n->children[2]->dataType);
+		if(!vm_isHeld(*t)){
+			vm_typeError(n, *t);
+			return 0;
+		}
+		l = vm_expr(n->children[0], &lt);
+		pc = vm_emit(n, VM_JZ, vm_convert(n, l, lt, TYPE_BOOL), -1, 0);
+		r = vm_temp(*t);
+		l = vm_expr(n->children[1], &lt);
+		vm_move(n, r, vm_convert(n, l, lt, *t), *t);
+		end = vm_emit(n, VM_JMP, -1, 0, 0);
+		vm_patch(pc, vm_label());
+		l = vm_expr(n->children[2], &lt);
+		vm_move(n, r, vm_convert(n, l, lt, *t), *t);
+		vm_patch(end, vm_label());
+		return r;
+
+	case ASSIGNMENT_INCPR:
+	case ASSIGNMENT_INCPS:
+	case ASSIGNMENT_DECPR:
+	case ASSIGNMENT_DECPS:
+	case ASSIGNMENT_NEGPR:
+	case ASSIGNMENT_NEGPS:
+		return vm_step(n, t);
+	case ASSIGNMENT_EQUAL:
+		if(!vm_resolve(n->children[0], &target)) return 0;
+		*t = target.type;
+		r = vm_expr(n->children[1], &rt);
+		return vm_store(n, &target, r, rt);
+	case ASSIGNMENT_PLUS:
+	case ASSIGNMENT_MINUS:
+	case ASSIGNMENT_TIMES:
+	case ASSIGNMENT_DIVBY:
+	case ASSIGNMENT_MOD:
+	case ASSIGNMENT_EXP:
+		if(!vm_resolve(n->children[0], &target)) return 0;
+		*t = target.type;
+		l = vm_load(n, &target);
+		r = vm_expr(n->children[1], &rt);
+		r = vm_arithmetic(n, n->which-ASSIGNMENT_PLUS, l, target.type, r, rt, &lt);
+		return vm_store(n, &target, r, lt);
+	case ASSIGNMENT_OR:
+	case ASSIGNMENT_AND:
+		if(!vm_resolve(n->children[0], &target)) return 0;
+		*t = target.type;
+		r = vm_temp(TYPE_BOOL);
+		l = vm_load(n, &target);
+		vm_move(n, r, vm_convert(n, l, target.type, TYPE_BOOL), TYPE_BOOL);
+		vm_shortCircuit(n, n->children[1], r, n->which == ASSIGNMENT_OR);
+		return vm_store(n, &target, r, TYPE_BOOL);
+	}
+	vm_error(n, (n->nodeType == TYPE_NULL
+		? "Null nodes should be removed before running"
+		: "Node cannot be used as a value"
+	));
+	return 0;
+}
+
+
+//----------------------------//
+//    Compiling Statements    //
+//----------------------------//
+
+// Jump out of a loop or SWITCH once its end is known
+void vm_break(ASTnode* n, vm_exit* e){
+	vm_grow((void**)&e->breaks, e->countBreaks, &e->sizeBreaks, sizeof(int));
+	e->breaks[e->countBreaks++] = vm_emit(n, VM_JMP, -1, 0, 0);
+}
+
+// Point the jumps out of a loop or SWITCH at its end
+void vm_close(vm_exit* e){
+	int i, end = vm_label();
+	for(i=0; i<e->countBreaks; ++i) vm_patch(e->breaks[i], end);
+	free(e->breaks);
+	vm_exits = e->outer;
+}
+
+// Compile the children of a node that are connected as a certain type
+void vm_block(ASTnode* n, nodeChildType t){
+	int i;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i]->childType == t) vm_statement(n->children[i]);
+	}
+}
+
+// Compile a condition into a bool register
+int vm_condition(ASTnode* n){
+	int r;
+	dataType t;
+	r = vm_expr(n, &t);
+	return vm_convert(n, r, t, TYPE_BOOL);
+}
+
+// Compile an IF, with its ELSE if it has one
+void vm_if(ASTnode* n){
+	int pc, end;
+	ASTnode* cond = vm_part(n, CONDITION);
+	if(!cond){
+		vm_error(n, "IF has no condition");
+		return;
+	}
+	pc = vm_emit(n, VM_JZ, vm_condition(cond), -1, 0);
+	vm_block(n, IF);
+	if(!vm_part(n, ELSE)){
+		vm_patch(pc, vm_label());
+		return;
+	}
+	end = vm_emit(n, VM_JMP, -1, 0, 0);
+	vm_patch(pc, vm_label());
+	vm_block(n, ELSE);
+	vm_patch(end, vm_label());
+}
+
+// Compile a loop. CONTINUE goes back to its condition, as in a C for loop.
+// Parallel loops run their iterations in order
+void vm_loop(ASTnode* n){
+	int i, pc = -1;
+	dataType t;
+	ASTnode* init = vm_part(n, INITIALIZATION);
+	ASTnode* cond = vm_part(n, CONDITION);
+	vm_exit e = {true, 0, NULL, 0, 0, vm_exits};
+	if(init) vm_expr(init, &t);
+	e.top = vm_label();
+	if(cond) pc = vm_emit(n, VM_JZ, vm_condition(cond), -1, 0);
+	vm_exits = &e;
+	for(i=0; i<n->countChildren; ++i){
+		if(n->children[i] != init && n->children[i] != cond) vm_statement(n->children[i]);
+	}
+	vm_emit(n, VM_JMP, e.top, 0, 0);
+	if(pc >= 0) vm_patch(pc, vm_fn->countCode);
+	vm_close(&e);
+}
+
+// Make the label table of a SWITCH on strings, as the C target declares it
+int vm_switchTable(ASTnode* n){
+	int i, j, count = 0, size = 2;
+	adhoc_switchLabel* labels;
+	adhoc_switchTable* table;
+	ASTnode* c;
+	for(i=0; i<n->countChildren; ++i){
+		c = n->children[i];
+		if(c->which != CONTROL_CASE) continue;
+		for(j=0; j<c->countChildren; ++j) count += (c->children[j]->childType == CASE);
+	}
+	labels = malloc((count ? count : 1)*sizeof(adhoc_switchLabel));
+	for(count=0, i=0; i<n->countChildren; ++i){
+		c = n->children[i];
+		if(c->which != CONTROL_CASE) continue;
+		for(j=0; j<c->countChildren; ++j){
+			if(c->children[j]->childType != CASE) continue;
+			labels[count].data = vm_unescape(c->children[j]->value, &labels[count].length);
+			++count;
+		}
+	}
+	while(size < count*2) size *= 2;
+	table = malloc(sizeof(adhoc_switchTable));
+	*table = (adhoc_switchTable){labels, count, calloc(size, sizeof(adhoc_switchSlot)), size, 0, 0};
+	vm_grow((void**)&vm_prog->switches, vm_prog->countSwitches, &vm_prog->sizeSwitches, sizeof(adhoc_switchTable*));
+	vm_prog->switches[vm_prog->countSwitches] = table;
+	return vm_prog->countSwitches++;
+}
+
+// Compile a SWITCH as a run of compare-and-jumps. Strings are first turned
+// into the number of the label they match. Cases fall through as in C
+void vm_switch(ASTnode* n){
+	int i, j, r, m, count = 0, label = 0, fallback = -1, other;
+	int* jumps;
+	int* cases;
+	dataType t;
+	ASTnode* c;
+	ASTnode* cond = vm_part(n, CONDITION);
+	vm_exit e = {false, 0, NULL, 0, 0, vm_exits};
+	if(!cond){
+		vm_error(n, "SWITCH has no condition");
+		return;
+	}
+	r = vm_expr(cond, &t);
+	if(t == TYPE_STRNG){
+		r = vm_result(n, VM_SWS, TYPE_INT, r, vm_switchTable(n));
+	}else if(t != TYPE_INT && t != TYPE_BOOL){
+		vm_error(cond, "Only bools, ints and strings can be switched on");
+		return;
+	}
+	for(i=0; i<n->countChildren; ++i) count += n->children[i]->countChildren;
+	jumps = malloc((count ? count : 1)*sizeof(int));
+	cases = malloc((count ? count : 1)*sizeof(int));
+
+	// Jump to the case whose label matches, or else to the default
+	for(count=0, i=0; i<n->countChildren; ++i){
+		c = n->children[i];
+		if(c->which != CONTROL_CASE) continue;
+		if(!vm_part(c, CASE)) fallback = i;
+		for(j=0; j<c->countChildren; ++j){
+			if(c->children[j]->childType != CASE) continue;
+			cases[count] = i;
+			jumps[count++] = vm_emit(c->children[j], VM_JEQ, r, (t == TYPE_STRNG
+				? label++
+				: (c->children[j]->which == LITERAL_BOOL
+					? vm_bool(c->children[j]->value)
+					: atoi(c->children[j]->value)
+				)
+			), -1);
+		}
+	}
+	other = vm_emit(n, VM_JMP, -1, 0, 0);
+	if(fallback < 0){
+		vm_grow((void**)&e.breaks, e.countBreaks, &e.sizeBreaks, sizeof(int));
+		e.breaks[e.countBreaks++] = other;
+	}
+
+	// Then lay out the cases in order
+	vm_exits = &e;
+	for(i=0; i<n->countChildren; ++i){
+		c = n->children[i];
+		if(c->which != CONTROL_CASE) continue;
+		vm_label();
+		for(m=0; m<count; ++m){
+			if(cases[m] == i) vm_patch(jumps[m], vm_fn->countCode);
+		}
+		if(fallback == i) vm_patch(other, vm_fn->countCode);
+		for(j=0; j<c->countChildren; ++j){
+			if(c->children[j]->childType != CASE) vm_statement(c->children[j]);
+		}
+	}
+	vm_close(&e);
+	free(jumps);
+	free(cases);
+}
+
+// Compile a CONTINUE, BREAK or RETURN
+void vm_jump(ASTnode* n){
+	int r;
+	dataType t;
+	vm_exit* e;
+	switch(n->which){
+	case CONTROL_CNTNU:
+		for(e=vm_exits; e && !e->loop; e=e->outer);
+		if(!e){
+			vm_error(n, "CONTINUE must be inside a loop");
+			return;
+		}
+		vm_emit(n, VM_JMP, e->top, 0, 0);
+		return;
+	case CONTROL_BREAK:
+		if(!vm_exits){
+			vm_error(n, "BREAK must be inside a loop or SWITCH");
+			return;
+		}
+		vm_break(n, vm_exits);
+		return;
+	}
+	if(!n->countChildren){
+		vm_emit(n, VM_RET, 0, 0, 0);
+		return;
+	}
+	r = vm_expr(n->children[0], &t);
+	if(vm_def->dataType == TYPE_VOID){
+		vm_emit(n, VM_RET, 0, 0, 0);
+		return;
+	}
+	if(!vm_isHeld(vm_def->dataType)){
+		vm_typeError(vm_def, vm_def->dataType);
+		return;
+	}
+	r = vm_round(n, vm_convert(n, r, t, vm_def->dataType), vm_def->dataType);
+	vm_emit(n, (vm_isComplex(vm_def->dataType) ? VM_RETD : VM_RETS), r, 0, 0);
+}
+
+// Compile a statement. Any complex temporaries it used are cleared after it,
+// and its scalar ones are free for the next
+void vm_statement(ASTnode* n){
+	int i, s = vm_tempS, d = vm_tempD, high = vm_highD;
+	dataType t;
+	if(*vm_prog->errBuf) return;
+	vm_highD = d;
+	vm_fill(n);
+	switch(n->which){
+	case CONTROL_IF: vm_if(n); break;
+	case CONTROL_LOOP: vm_loop(n); break;
+	case CONTROL_SWITCH: vm_switch(n); break;
+	case CONTROL_CNTNU:
+	case CONTROL_BREAK:
+	case CONTROL_RETRN:
+		vm_jump(n);
+		break;
+	// FORK branches run one after another
+	case GROUP_SERIAL:
+	case CONTROL_FORK:
+		for(i=0; i<n->countChildren; ++i) vm_statement(n->children[i]);
+		break;
+	case CONTROL_CASE:
+		vm_error(n, "CASE must be inside a SWITCH");
+		break;
+	default:
+		vm_expr(n, &t);
+	}
+	if(vm_highD > d) vm_emit(n, VM_CLRD, d, vm_highD-d, 0);
+	vm_tempS = s;
+	vm_tempD = d;
+	vm_highD = high;
+}
+
+// Compile an action into its function. Parameters take the first registers
+// in order, then the action's other variables and its container literals.
+// The root action sets the globals first
+void vm_compile(vm_function* f){
+	int i, j;
+	ASTnode* c;
+	vm_fn = f;
+	vm_def = f->def;
+	vm_countLiterals = 0;
+	vm_exits = NULL;
+	vm_lastResult = vm_lastLabel = -1;
+	for(i=0; i<vm_def->countChildren; ++i){
+		c = vm_def->children[i];
+		if(c->childType != PARAMETER){
+			vm_scan(c);
+		}else if(vm_def == vm_root){
+			for(j=0; j<c->countChildren; ++j) vm_scan(c->children[j]);
+		}else if(!vm_isHeld(c->dataType)){
+			vm_typeError(c, c->dataType);
+			return;
+		}else{
+			vm_own(c, c->dataType);
+			vm_grow((void**)&f->params, f->countParams, &f->sizeParams, sizeof(vm_arg));
+			f->params[f->countParams++] = (vm_arg){c->dataType, vm_slot(c)};
+		}
+	}
+	vm_firstS = vm_tempS = f->countS;
+	vm_firstD = vm_tempD = vm_highD = f->countD;
+
+	// Container literals are made on entry, as the C target declares them
+	for(i=0; i<vm_countLiterals; ++i){
+		c = vm_literals[i];
+		if(c->childDataType != TYPE_VOID && !vm_isHeld(c->childDataType)){
+			vm_typeError(c, c->childDataType);
+			return;
+		}
+		vm_emit(c, (c->which == LITERAL_HASH ? VM_NEWHASH : VM_NEWARR), vm_slot(c), c->childDataType, c->countChildren);
+	}
+
+	// Then the globals are set, and the body compiled
+	for(i=0; i<vm_def->countChildren && !*vm_prog->errBuf; ++i){
+		c = vm_def->children[i];
+		if(c->childType != PARAMETER || (vm_def == vm_root && c->countChildren)) vm_statement(c);
+	}
+	vm_emit(vm_def, VM_RET, 0, 0, 0);
+}
+
+
+//-----------------------//
+//    Running Actions    //
+//-----------------------//
+
+// Add a reference to data that may not be there
+static inline adhoc_data* vm_ref(adhoc_data* d){
+	return d ? adhoc_referenceData(d) : d;
+}
+
+// Store data in a complex register, which takes over a reference the
+// caller holds and drops its old one
+static inline void vm_setD(adhoc_data** r, adhoc_data* d){
+	adhoc_data* old = *r;
+	*r = d;
+	adhoc_unreferenceData(old);
+}
+
+// Get a scalar argument as a number
+static inline double vm_number(vm_arg* a, vm_value* S){
+	return (a->type == TYPE_FLOAT ? S[a->reg].f : S[a->reg].i);
+}
+
+// The libadhoc format for printing a value of a type
+char* vm_format(dataType t, bool newline){
+	switch(t){
+	case TYPE_BOOL: return (newline ? "%b\n" : "%b");
+	case TYPE_INT: return (newline ? "%d\n" : "%d");
+	case TYPE_FLOAT: return (newline ? "%f\n" : "%f");
+	case TYPE_STRNG: return (newline ? "%s\n" : "%s");
+	default: return (newline ? "%_\n" : "%_");
+	}
+}
+
+// Concatenate one argument onto a string (NULL to start one), the way one
+// piece of a concat call is
+adhoc_data* vm_concat(adhoc_data* s, vm_arg* a, vm_value* S, adhoc_data** D){
+	adhoc_data* piece;
+	switch(a->type){
+	case TYPE_BOOL:
+	case TYPE_INT: piece = adhoc_concat(vm_format(a->type, false), S[a->reg].i); break;
+	case TYPE_FLOAT: piece = adhoc_concat(vm_format(a->type, false), S[a->reg].f); break;
+	default: piece = adhoc_concat(vm_format(a->type, false), D[a->reg]);
+	}
+	if(!s) return adhoc_referenceData(piece);
+	adhoc_referenceData(piece);
+	adhoc_append_to_string("%s", s, piece);
+	adhoc_unreferenceData(piece);
+	return s;
+}
+
+// Get an item found in an array of bools, ints or floats, as a scalar
+static inline void vm_found(vm_value* r, adhoc_dataType t, void* item){
+	switch(t){
+	case DATA_BOOL: r->i = (item ? *(bool*)item : 0); break;
+	case DATA_INT: r->i = (item ? *(int*)item : 0); break;
+	default: r->f = (item ? *(float*)item : 0.0);
+	}
+}
+
+// Run a System action through libadhoc. Registers already hold references,
+// so the borrowing variants are used throughout
+void vm_runSystem(vm_program* p, vm_function* fn, vm_instr* i, vm_value* S, adhoc_data** D){
+	int k;
+	bool b;
+	float f;
+	double sum;
+	vm_arg* args = fn->args + i->c;
+	adhoc_data* ret = NULL;
+	adhoc_data* d0 = (vm_isComplex(args[0].type) ? D[args[0].reg] : NULL);
+	adhoc_data* d1 = (i->k > 1 && vm_isComplex(args[1].type) ? D[args[1].reg] : NULL);
+	switch(i->b){
+	case VM_SYS_TYPE:
+		S[i->a].i = adhoc_type(d0);
+		break;
+	case VM_SYS_SIZE:
+		S[i->a].i = (d0 ? adhoc_sizeC_borrowed(d0) : adhoc_sizeS(vm_number(args, S)));
+		break;
+	case VM_SYS_COUNT:
+		S[i->a].i = (d0 ? adhoc_countC(d0) : adhoc_countS(vm_number(args, S)));
+		break;
+	case VM_SYS_TOSTRING:
+		ret = (d0
+			? adhoc_toStringC_borrowed(d0)
+			: adhoc_toStringS((adhoc_dataType)args[0].type, vm_number(args, S))
+		);
+		break;
+	case VM_SYS_PRINT:
+	case VM_SYS_PRINTLN:
+		for(k=0; k<i->k; ++k){
+			switch(args[k].type){
+			case TYPE_BOOL:
+			case TYPE_INT: adhoc_print(vm_format(args[k].type, i->b == VM_SYS_PRINTLN), S[args[k].reg].i); break;
+			case TYPE_FLOAT: adhoc_print(vm_format(args[k].type, i->b == VM_SYS_PRINTLN), S[args[k].reg].f); break;
+			default: adhoc_print(vm_format(args[k].type, i->b == VM_SYS_PRINTLN), D[args[k].reg]);
+			}
+		}
+		break;
+	case VM_SYS_PROMPT:
+		switch(args[0].type){
+		case TYPE_BOOL:
+			b = S[i->a].i;
+			adhoc_prompt(DATA_BOOL, &b);
+			S[i->a].i = b;
+			break;
+		case TYPE_INT:
+			adhoc_prompt(DATA_INT, &S[i->a].i);
+			break;
+		case TYPE_FLOAT:
+			f = S[i->a].f;
+			adhoc_prompt(DATA_FLOAT, &f);
+			S[i->a].f = f;
+			break;
+		default:
+			adhoc_prompt(DATA_STRING, D+i->a);
+		}
+		break;
+	case VM_SYS_APPEND_TO_STRING:
+		switch(args[1].type){
+		case TYPE_BOOL:
+		case TYPE_INT: adhoc_append_to_string(vm_format(args[1].type, false), d0, S[args[1].reg].i); break;
+		case TYPE_FLOAT: adhoc_append_to_string(vm_format(args[1].type, false), d0, S[args[1].reg].f); break;
+		default: adhoc_append_to_string(vm_format(args[1].type, false), d0, d1);
+		}
+		break;
+	case VM_SYS_CONCAT:
+		for(k=0; k<i->k; ++k) ret = vm_concat(ret, args+k, S, D);
+		vm_setD(D+i->a, (ret ? ret : adhoc_referenceData(adhoc_createString(""))));
+		return;
+	case VM_SYS_SUBSTRING:
+		ret = adhoc_substring_borrowed(d0, S[args[1].reg].i, S[args[2].reg].i);
+		break;
+	case VM_SYS_SPLICE_STRING:
+		if(i->a < 0){
+			adhoc_splice_string_discard_borrowed(d0, d1, S[args[2].reg].i, S[args[3].reg].i);
+		}else{
+			ret = adhoc_splice_string_borrowed(d0, d1, S[args[2].reg].i, S[args[3].reg].i);
+		}
+		break;
+	case VM_SYS_FIND_IN_STRING:
+		S[i->a].i = (d1
+			? adhoc_find_in_string_borrowed(d0, d1)
+			: adhoc_find_needle_borrowed(d0, p->needles[args[1].reg])
+		);
+		break;
+	case VM_SYS_FIND_ALL_IN_STRING:
+		ret = (d1
+			? adhoc_find_all_in_string_borrowed(d0, d1)
+			: adhoc_find_all_needle_borrowed(d0, p->needles[args[1].reg])
+		);
+		break;
+	case VM_SYS_COUNT_OCCURRENCES:
+		S[i->a].i = (d1
+			? adhoc_count_occurrences_borrowed(d0, d1)
+			: adhoc_count_needle_borrowed(d0, p->needles[args[1].reg])
+		);
+		break;
+	case VM_SYS_ISSET_ARRAY:
+		S[i->a].i = adhoc_isset_array(d0, S[args[1].reg].i);
+		break;
+	case VM_SYS_APPEND_TO_ARRAY:
+		switch(args[1].type){
+		case TYPE_BOOL:
+		case TYPE_INT: adhoc_append_to_array(vm_format(args[1].type, false), d0, S[args[1].reg].i); break;
+		case TYPE_FLOAT: adhoc_append_to_array(vm_format(args[1].type, false), d0, S[args[1].reg].f); break;
+		default: adhoc_append_to_array(vm_format(args[1].type, false), d0, d1);
+		}
+		break;
+	case VM_SYS_FIND_MAX_VALUE:
+		vm_found(S+i->a, d0->dataType, adhoc_find_max_value_borrowed(d0));
+		break;
+	case VM_SYS_FIND_MAX_VALUE_INDEX:
+		S[i->a].i = adhoc_find_max_value_index_borrowed(d0);
+		break;
+	case VM_SYS_FIND_MIN_VALUE:
+		vm_found(S+i->a, d0->dataType, adhoc_find_min_value_borrowed(d0));
+		break;
+	case VM_SYS_FIND_MIN_VALUE_INDEX:
+		S[i->a].i = adhoc_find_min_value_index_borrowed(d0);
+		break;
+	case VM_SYS_SUM_ARRAY:
+		sum = adhoc_sum_array_borrowed(d0);
+		if(d0->dataType == DATA_FLOAT) S[i->a].f = (float)sum;
+		else S[i->a].i = (int)sum;
+		break;
+	case VM_SYS_COUNT_GREATER_THAN:
+		S[i->a].i = adhoc_count_greater_than_borrowed(d0, S[args[1].reg].f);
+		break;
+	case VM_SYS_ISSET_HASH:
+		S[i->a].i = adhoc_isset_hash(d0, d1, (d1 ? 0 : S[args[1].reg].i));
+		break;
+	case VM_SYS_REMOVE_FROM_HASH:
+		k = adhoc_remove_from_hash(d0, d1, (d1 ? 0 : S[args[1].reg].i));
+		if(i->a >= 0) S[i->a].i = k;
+		break;
+	}
+	if(ret && i->a >= 0) vm_setD(D+i->a, adhoc_referenceData(ret));
+}
+
+// Run an instruction that works on complex data or calls out of the
+// function. The interpreter and native code share these, as their cost is
+// in libadhoc or the call rather than in dispatching to them
+int vm_runComplex(vm_program* p, vm_function* fn, vm_instr* i, vm_value* S, adhoc_data** D){
+	int k, n;
+	vm_function* callee;
+	vm_value rs;
+	adhoc_data* rd;
+	adhoc_data* c;
+	switch(i->op){
+	case VM_EQS: case VM_GTS: case VM_LTS: case VM_GES: case VM_LES: case VM_NES:
+		if(!D[i->b] || !D[i->c]) return VM_UNSET;
+		n = strcmp(D[i->b]->data, D[i->c]->data);
+		switch(i->op){
+		case VM_EQS: S[i->a].i = (n == 0); break;
+		case VM_GTS: S[i->a].i = (n > 0); break;
+		case VM_LTS: S[i->a].i = (n < 0); break;
+		case VM_GES: S[i->a].i = (n >= 0); break;
+		case VM_LES: S[i->a].i = (n <= 0); break;
+		case VM_NES: S[i->a].i = (n != 0); break;
+		}
+		break;
+
+	case VM_LDS: vm_setD(D+i->a, adhoc_referenceData(adhoc_createString(p->strings[i->b]))); break;
+	case VM_MOVD: vm_setD(D+i->a, vm_ref(D[i->b])); break;
+	case VM_CLRD:
+		for(k=0; k<i->b; ++k) vm_setD(D+i->a+k, NULL);
+		break;
+	case VM_NEWARR: vm_setD(D+i->a, adhoc_referenceData(adhoc_createArray(i->b, i->c))); break;
+	case VM_NEWHASH: vm_setD(D+i->a, adhoc_referenceData(adhoc_createHash(i->b, i->c))); break;
+
+	// Complex items of arrays, and items of hashes. Unset ones read as 0 or
+	// NULL
+	case VM_AGETD:
+		if(!(c = D[i->b])) return VM_UNSET;
+		vm_setD(D+i->a, ((n = S[i->c].i) >= 0 ? vm_ref(adhoc_getCArrayData(c, n)) : NULL));
+		break;
+	case VM_ASETD:
+		if(!(c = D[i->a])) return VM_UNSET;
+		if((n = S[i->b].i) < 0) return VM_INDEX;
+		adhoc_assignArrayData_borrowed(c, n, D[i->c], 0);
+		break;
+	case VM_HGETB:
+		if(!(c = D[i->b])) return VM_UNSET;
+		S[i->a].i = (i->k ? adhoc_hash_get_bool(c, D[i->c], 0) : adhoc_hash_get_bool(c, NULL, S[i->c].i));
+		break;
+	case VM_HGETI:
+		if(!(c = D[i->b])) return VM_UNSET;
+		S[i->a].i = (i->k ? adhoc_hash_get_int(c, D[i->c], 0) : adhoc_hash_get_int(c, NULL, S[i->c].i));
+		break;
+	case VM_HGETF:
+		if(!(c = D[i->b])) return VM_UNSET;
+		S[i->a].f = (i->k ? adhoc_hash_get_float(c, D[i->c], 0) : adhoc_hash_get_float(c, NULL, S[i->c].i));
+		break;
+	case VM_HGETD:
+		if(!(c = D[i->b])) return VM_UNSET;
+		vm_setD(D+i->a, vm_ref(i->k ? adhoc_getCHashData(c, D[i->c], 0) : adhoc_getCHashData(c, NULL, S[i->c].i)));
+		break;
+	case VM_HSETB:
+		if(!(c = D[i->a])) return VM_UNSET;
+		if(i->k) adhoc_hash_set_bool(c, D[i->b], 0, S[i->c].i);
+		else adhoc_hash_set_bool(c, NULL, S[i->b].i, S[i->c].i);
+		break;
+	case VM_HSETI:
+		if(!(c = D[i->a])) return VM_UNSET;
+		if(i->k) adhoc_hash_set_int(c, D[i->b], 0, S[i->c].i);
+		else adhoc_hash_set_int(c, NULL, S[i->b].i, S[i->c].i);
+		break;
+	case VM_HSETF:
+		if(!(c = D[i->a])) return VM_UNSET;
+		if(i->k) adhoc_hash_set_float(c, D[i->b], 0, S[i->c].f);
+		else adhoc_hash_set_float(c, NULL, S[i->b].i, S[i->c].f);
+		break;
+	case VM_HSETD:
+		if(!(c = D[i->a])) return VM_UNSET;
+		if(i->k) adhoc_assignHashData_borrowed(c, D[i->b], 0, D[i->c], 0);
+		else adhoc_assignHashData_borrowed(c, NULL, S[i->b].i, D[i->c], 0);
+		break;
+
+	case VM_SWS:
+		if(!D[i->b]) return VM_UNSET;
+		S[i->a].i = adhoc_switchString_borrowed(p->switches[i->c], D[i->b]);
+		break;
+	case VM_GLDD: vm_setD(D+i->a, vm_ref(p->globalD[i->b])); break;
+	case VM_GSTD: vm_setD(p->globalD+i->a, vm_ref(D[i->b])); break;
+
+	case VM_CALL:
+		callee = p->functions[i->b];
+		rs.f = 0;
+		rd = NULL;
+		vm_exec(p, callee, S, D, fn->args + i->c, &rs, &rd);
+		if(*p->errBuf){
+			adhoc_unreferenceData(rd);
+			return VM_FAILED;
+		}
+		if(i->a < 0) adhoc_unreferenceData(rd);
+		else if(vm_isComplex(callee->def->dataType)) vm_setD(D+i->a, rd);
+		else S[i->a] = rs;
+		break;
+	case VM_SYS:
+		for(k=0; k<i->k; ++k){
+			if(vm_isComplex(fn->args[i->c+k].type) && !D[fn->args[i->c+k].reg]
+					&& i->b != VM_SYS_PROMPT && i->b != VM_SYS_TYPE){
+				return VM_UNSET;
+			}
+		}
+		vm_runSystem(p, fn, i, S, D);
+		break;
+	}
+	return VM_FINE;
+}
+
+// Count a call or a jump back in a function, and compile it to native code
+// once either count gets hot enough
+static inline bool vm_heat(vm_program* p, vm_function* fn, int* count){
+	return *count < p->hot && ++*count == p->hot && vm_nativeCompile(p, fn);
+}
+
+// Stop running with an error at the node an instruction came from
+void vm_fail(vm_program* p, vm_function* fn, vm_instr* i, const char* msg){
+	int id = fn->nodes[i - fn->code];
+	adhoc_errorNode = (ASTnode*) hashMap_retrieve(p->nodes, id);
+	snprintf(p->errBuf, 80, "Node %d: %s", id, msg);
+}
+
+// Dispatch straight from one instruction's code to the next where labels
+// can be taken as values, and through a switch elsewhere
+#ifdef __GNUC__
+#define VM_LABEL(o) &&vm_op_##o,
+#define VM_CASE(o) vm_op_##o:
+#define VM_NEXT goto *vm_labels[(i = ip++)->op];
+#define VM_START static void* vm_labels[] = {VM_OPS(VM_LABEL)}; VM_NEXT
+#define VM_END
+#else
+#define VM_CASE(o) case VM_##o:
+#define VM_NEXT continue;
+#define VM_START for(;;){ switch((i = ip++)->op){
+#define VM_END }}
+#endif
+
+// Run a function in a new frame, with arguments from its caller's frame.
+// What it returns goes to retS or retD, which then holds a reference
+void vm_exec(vm_program* p, vm_function* fn, vm_value* cS, adhoc_data** cD, vm_arg* args, vm_value* retS, adhoc_data** retD){
+	int k, n;
+	vm_value S[fn->countS+1];
+	adhoc_data* D[fn->countD+1];
+	vm_instr* ip = fn->code;
+	vm_instr* i = ip;
+	adhoc_data* c;
+	vm_frame frame = {S, D, retS, retD, 0};
+	memset(S, 0, sizeof(S));
+	memset(D, 0, sizeof(D));
+	for(k=0; k<fn->countParams; ++k){
+		if(vm_isComplex(fn->params[k].type)) D[fn->params[k].reg] = vm_ref(cD[args[k].reg]);
+		else S[fn->params[k].reg] = cS[args[k].reg];
+	}
+	if(fn->native || vm_heat(p, fn, &fn->calls)) goto native;
+
+	VM_START
+	VM_CASE(NOP) VM_NEXT
+	VM_CASE(LDI) S[i->a].i = i->b; VM_NEXT
+	VM_CASE(LDF) S[i->a].f = p->floats[i->b]; VM_NEXT
+	VM_CASE(MOV) S[i->a] = S[i->b]; VM_NEXT
+	VM_CASE(MOVF) S[i->a].f = (float)S[i->b].f; VM_NEXT
+	VM_CASE(I2F) S[i->a].f = S[i->b].i; VM_NEXT
+	VM_CASE(F2I) S[i->a].i = (int)S[i->b].f; VM_NEXT
+	VM_CASE(I2B) S[i->a].i = (S[i->b].i != 0); VM_NEXT
+	VM_CASE(F2B) S[i->a].i = (S[i->b].f != 0); VM_NEXT
+	VM_CASE(NOT) S[i->a].i = !S[i->b].i; VM_NEXT
+
+	// Ints wrap around as they do in generated code
+	VM_CASE(ADDI) S[i->a].i = (unsigned int)S[i->b].i + (unsigned int)S[i->c].i; VM_NEXT
+	VM_CASE(SUBI) S[i->a].i = (unsigned int)S[i->b].i - (unsigned int)S[i->c].i; VM_NEXT
+	VM_CASE(MULI) S[i->a].i = (unsigned int)S[i->b].i * (unsigned int)S[i->c].i; VM_NEXT
+	VM_CASE(DIVI)
+		if(!S[i->c].i) goto divide;
+		S[i->a].i = (S[i->c].i == -1 ? (int)-(unsigned int)S[i->b].i : S[i->b].i / S[i->c].i);
+		VM_NEXT
+	VM_CASE(MODI)
+		if(!S[i->c].i) goto divide;
+		S[i->a].i = (S[i->c].i == -1 ? 0 : S[i->b].i % S[i->c].i);
+		VM_NEXT
+	VM_CASE(POWI) S[i->a].i = adhoc_ipow(S[i->b].i, S[i->c].i); VM_NEXT
+	VM_CASE(ADDK) S[i->a].i = (unsigned int)S[i->b].i + (unsigned int)i->c; VM_NEXT
+	VM_CASE(ADDF) S[i->a].f = S[i->b].f + S[i->c].f; VM_NEXT
+	VM_CASE(SUBF) S[i->a].f = S[i->b].f - S[i->c].f; VM_NEXT
+	VM_CASE(MULF) S[i->a].f = S[i->b].f * S[i->c].f; VM_NEXT
+	VM_CASE(DIVF) S[i->a].f = S[i->b].f / S[i->c].f; VM_NEXT
+	VM_CASE(MODF) S[i->a].f = fmod(S[i->b].f, S[i->c].f); VM_NEXT
+	VM_CASE(POWF) S[i->a].f = pow(S[i->b].f, S[i->c].f); VM_NEXT
+
+	VM_CASE(EQI) S[i->a].i = (S[i->b].i == S[i->c].i); VM_NEXT
+	VM_CASE(GTI) S[i->a].i = (S[i->b].i > S[i->c].i); VM_NEXT
+	VM_CASE(LTI) S[i->a].i = (S[i->b].i < S[i->c].i); VM_NEXT
+	VM_CASE(GEI) S[i->a].i = (S[i->b].i >= S[i->c].i); VM_NEXT
+	VM_CASE(LEI) S[i->a].i = (S[i->b].i <= S[i->c].i); VM_NEXT
+	VM_CASE(NEI) S[i->a].i = (S[i->b].i != S[i->c].i); VM_NEXT
+	VM_CASE(EQF) S[i->a].i = (S[i->b].f == S[i->c].f); VM_NEXT
+	VM_CASE(GTF) S[i->a].i = (S[i->b].f > S[i->c].f); VM_NEXT
+	VM_CASE(LTF) S[i->a].i = (S[i->b].f < S[i->c].f); VM_NEXT
+	VM_CASE(GEF) S[i->a].i = (S[i->b].f >= S[i->c].f); VM_NEXT
+	VM_CASE(LEF) S[i->a].i = (S[i->b].f <= S[i->c].f); VM_NEXT
+	VM_CASE(NEF) S[i->a].i = (S[i->b].f != S[i->c].f); VM_NEXT
+
+	// Jumping back to a loop's top counts towards compiling the function to
+	// native code, which then runs the rest of the call
+	VM_CASE(JMP)
+		ip = fn->code + i->a;
+		if(ip <= i && (fn->native || vm_heat(p, fn, &fn->loops))) goto native;
+		VM_NEXT
+
+	VM_CASE(JZ) if(!S[i->a].i) ip = fn->code + i->b; VM_NEXT
+	VM_CASE(JNZ) if(S[i->a].i) ip = fn->code + i->b; VM_NEXT
+	VM_CASE(JEQ) if(S[i->a].i == i->b) ip = fn->code + i->c; VM_NEXT
+
+	// Items of arrays and hashes. Unset ones read as 0 or NULL
+	VM_CASE(AGETB)
+		if(!(c = D[i->b])) goto unset;
+		S[i->a].i = ((n = S[i->c].i) >= 0 ? adhoc_get_bool(c, n) : 0);
+		VM_NEXT
+	VM_CASE(AGETI)
+		if(!(c = D[i->b])) goto unset;
+		S[i->a].i = ((n = S[i->c].i) >= 0 ? adhoc_get_int(c, n) : 0);
+		VM_NEXT
+	VM_CASE(AGETF)
+		if(!(c = D[i->b])) goto unset;
+		S[i->a].f = ((n = S[i->c].i) >= 0 ? adhoc_get_float(c, n) : 0.0);
+		VM_NEXT
+	VM_CASE(ASETB)
+		if(!(c = D[i->a])) goto unset;
+		if((n = S[i->b].i) < 0) goto index;
+		adhoc_set_bool(c, n, S[i->c].i);
+		VM_NEXT
+	VM_CASE(ASETI)
+		if(!(c = D[i->a])) goto unset;
+		if((n = S[i->b].i) < 0) goto index;
+		adhoc_set_int(c, n, S[i->c].i);
+		VM_NEXT
+	VM_CASE(ASETF)
+		if(!(c = D[i->a])) goto unset;
+		if((n = S[i->b].i) < 0) goto index;
+		adhoc_set_float(c, n, S[i->c].f);
+		VM_NEXT
+
+	VM_CASE(GLD) S[i->a] = p->globalS[i->b]; VM_NEXT
+	VM_CASE(GST) p->globalS[i->a] = S[i->b]; VM_NEXT
+
+	// Everything else works on complex data or calls out
+	VM_CASE(EQS) VM_CASE(GTS) VM_CASE(LTS) VM_CASE(GES) VM_CASE(LES) VM_CASE(NES)
+	VM_CASE(LDS) VM_CASE(MOVD) VM_CASE(CLRD) VM_CASE(NEWARR) VM_CASE(NEWHASH)
+	VM_CASE(AGETD) VM_CASE(ASETD)
+	VM_CASE(HGETB) VM_CASE(HGETI) VM_CASE(HGETF) VM_CASE(HGETD)
+	VM_CASE(HSETB) VM_CASE(HSETI) VM_CASE(HSETF) VM_CASE(HSETD)
+	VM_CASE(SWS) VM_CASE(GLDD) VM_CASE(GSTD) VM_CASE(CALL) VM_CASE(SYS)
+		if((k = vm_runComplex(p, fn, i, S, D))) goto fault;
+		VM_NEXT
+	VM_CASE(RET) goto leave;
+	VM_CASE(RETS) *retS = S[i->a]; goto leave;
+	VM_CASE(RETD) *retD = vm_ref(D[i->a]); goto leave;
+	VM_END
+
+native:
+	frame.pc = ip - fn->code;
+	if(!(k = ((vm_native)fn->native)(&frame, fn->native + fn->entries[frame.pc]))) goto leave;
+	i = fn->code + frame.pc;
+	goto fault;
+divide:
+	k = VM_DIVIDE;
+	goto fault;
+index:
+	k = VM_INDEX;
+	goto fault;
+unset:
+	k = VM_UNSET;
+fault:
+	if(vm_faults[k]) vm_fail(p, fn, i, vm_faults[k]);
+leave:
+	for(k=0; k<fn->countD; ++k) adhoc_unreferenceData(D[k]);
+}
+
+
+//-------------------//
+//    Native Code    //
+//-------------------//
+// On x86-64, hot functions are compiled to machine code one instruction at
+// a time, from a template for each operation. Registers stay in the frame
+// rather than in machine registers, so native code can be entered at any
+// instruction and shares the frame with the interpreter: rbx holds its
+// scalar registers, r14 its complex ones, and r15 the frame itself. Work on
+// complex data and calls go through vm_runComplex as in the interpreter
+
+// A place in the code being made that jumps to the code of an instruction,
+// or to a stub that stops with a fault there (0 for the one in eax)
+typedef struct vm_link {
+	int at;
+	int pc;
+	bool stub;
+	int fault;
+} vm_link;
+
+// The machine code being made, and the jumps in it still to point
+unsigned char* vm_out;
+int vm_countOut, vm_sizeOut;
+vm_link* vm_links;
+int vm_countLinks, vm_sizeLinks;
+
+// Add bytes of machine code
+void vm_code(const char* bytes, int count){
+	int i;
+	for(i=0; i<count; ++i){
+		vm_grow((void**) &vm_out, vm_countOut, &vm_sizeOut, sizeof(unsigned char));
+		vm_out[vm_countOut++] = bytes[i];
+	}
+}
+#define VM_CODE(s) vm_code(s, sizeof(s)-1)
+
+// Add a 32-bit or 64-bit value to the machine code
+void vm_int32(int v){
+	vm_code((char*) &v, 4);
+}
+void vm_int64(long long v){
+	vm_code((char*) &v, 8);
+}
+
+// Add the operand for scalar register r, or complex register r, to an
+// instruction working on machine register m. Complex ones need a REX.B
+void vm_slotS(int m, int r){
+	char b = 0x83 | m<<3;
+	vm_code(&b, 1);
+	vm_int32(r * sizeof(vm_value));
+}
+void vm_slotD(int m, int r){
+	char b = 0x86 | m<<3;
+	vm_code(&b, 1);
+	vm_int32(r * sizeof(adhoc_data*));
+}
+
+// Load a 64-bit value into machine register m (rax to rdi, then r8)
+void vm_imm64(int m, long long v){
+	char b[2] = {(m < 8 ? 0x48 : 0x49), 0xB8 + (m & 7)};
+	vm_code(b, 2);
+	vm_int64(v);
+}
+
+// Call a C function
+void vm_callC(void* f){
+	vm_imm64(0, (long long) f);
+	VM_CODE("\xFF\xD0");
+}
+
+// Add a jump, or a conditional one with condition code cc, to the code of
+// an instruction or to a fault stub
+void vm_jumpTo(int cc, int pc, bool stub, int fault){
+	char b[2] = {0x0F, 0x80 | cc};
+	if(cc < 0) VM_CODE("\xE9");
+	else vm_code(b, 2);
+	vm_grow((void**) &vm_links, vm_countLinks, &vm_sizeLinks, sizeof(vm_link));
+	vm_links[vm_countLinks++] = (vm_link){vm_countOut, pc, stub, fault};
+	vm_int32(0);
+}
+
+// Add a short jump within an instruction's code, and later point it here
+int vm_skip(int op){
+	char b[2] = {op, 0};
+	vm_code(b, 2);
+	return vm_countOut;
+}
+void vm_land(int at){
+	vm_out[at-1] = vm_countOut - at;
+}
+
+// Set al from condition code cc and widen it into eax
+void vm_setcc(int cc){
+	char b[3] = {0x0F, 0x90 | cc, 0xC0};
+	vm_code(b, 3);
+	VM_CODE("\x0F\xB6\xC0");
+}
+
+// Condition codes
+#define VM_CC_B 0x2
+#define VM_CC_AE 0x3
+#define VM_CC_E 0x4
+#define VM_CC_NE 0x5
+#define VM_CC_A 0x7
+#define VM_CC_S 0x8
+#define VM_CC_L 0xC
+#define VM_CC_GE 0xD
+#define VM_CC_LE 0xE
+#define VM_CC_G 0xF
+
+// Load array register r into rdi and index register x into esi, stopping
+// when the array was never set, and when writing at a negative index. The
+// short jumps added to misses are taken when the item is not within the
+// array and set, and otherwise rdx points to the array's items
+int vm_nativeItem(int pc, int r, int x, bool set, int* misses){
+	int count = 0;
+	VM_CODE("\x49\x8B"); vm_slotD(7, r);
+	VM_CODE("\x48\x85\xFF");
+	vm_jumpTo(VM_CC_E, pc, true, VM_UNSET);
+	VM_CODE("\x8B"); vm_slotS(6, x);
+	VM_CODE("\x85\xF6");
+	if(set) vm_jumpTo(VM_CC_S, pc, true, VM_INDEX);
+	else misses[count++] = vm_skip(0x78);
+	VM_CODE("\x3B\xB7"); vm_int32(offsetof(adhoc_data, sizeData));
+	misses[count++] = vm_skip(0x7D);
+
+	// The bit for item i is bit i%8 of byte i/8 of the map
+	VM_CODE("\x48\x8B\x97"); vm_int32(offsetof(adhoc_data, mappedData));
+	VM_CODE("\x89\xF1\xC1\xE9\x03\x0F\xB6\x14\x0A");
+	VM_CODE("\x89\xF1\x83\xE1\x07\x0F\xA3\xCA");
+	misses[count++] = vm_skip(0x73);
+	VM_CODE("\x48\x8B\x97"); vm_int32(offsetof(adhoc_data, data));
+	return count;
+}
+
+// Add the code for one instruction
+void vm_nativeOp(vm_program* p, vm_function* fn, int pc){
+	vm_instr* i = fn->code + pc;
+	int k, skip, done, count, misses[3];
+	switch(i->op){
+	case VM_NOP: break;
+	case VM_LDI:
+		VM_CODE("\xC7"); vm_slotS(0, i->a); vm_int32(i->b);
+		break;
+	case VM_LDF:
+		vm_imm64(0, *(long long*) (p->floats + i->b));
+		VM_CODE("\x48\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_MOV:
+		VM_CODE("\x48\x8B"); vm_slotS(0, i->b);
+		VM_CODE("\x48\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_MOVF:
+		VM_CODE("\xF2\x0F\x5A"); vm_slotS(0, i->b);
+		VM_CODE("\xF3\x0F\x5A\xC0");
+		VM_CODE("\xF2\x0F\x11"); vm_slotS(0, i->a);
+		break;
+	case VM_I2F:
+		VM_CODE("\xF2\x0F\x2A"); vm_slotS(0, i->b);
+		VM_CODE("\xF2\x0F\x11"); vm_slotS(0, i->a);
+		break;
+	case VM_F2I:
+		VM_CODE("\xF2\x0F\x2C"); vm_slotS(0, i->b);
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_I2B:
+	case VM_NOT:
+		VM_CODE("\x81"); vm_slotS(7, i->b); vm_int32(0);
+		vm_setcc(i->op == VM_NOT ? VM_CC_E : VM_CC_NE);
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_F2B:
+		VM_CODE("\x66\x0F\x57\xC9");
+		VM_CODE("\x66\x0F\x2E"); vm_slotS(1, i->b);
+		VM_CODE("\x0F\x95\xC0\x0F\x9A\xC1\x08\xC8\x0F\xB6\xC0");
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+
+	// Ints wrap around, and the checks on dividing are the interpreter's
+	case VM_ADDI:
+	case VM_SUBI:
+	case VM_MULI:
+		VM_CODE("\x8B"); vm_slotS(0, i->b);
+		if(i->op == VM_ADDI) VM_CODE("\x03");
+		else if(i->op == VM_SUBI) VM_CODE("\x2B");
+		else VM_CODE("\x0F\xAF");
+		vm_slotS(0, i->c);
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_DIVI:
+	case VM_MODI:
+		VM_CODE("\x8B"); vm_slotS(1, i->c);
+		VM_CODE("\x85\xC9");
+		vm_jumpTo(VM_CC_E, pc, true, VM_DIVIDE);
+		VM_CODE("\x8B"); vm_slotS(0, i->b);
+		VM_CODE("\x83\xF9\xFF");
+		skip = vm_skip(0x74);
+		VM_CODE("\x99\xF7\xF9");
+		if(i->op == VM_MODI) VM_CODE("\x89\xD0");
+		done = vm_skip(0xEB);
+		vm_land(skip);
+		if(i->op == VM_MODI) VM_CODE("\x31\xC0");
+		else VM_CODE("\xF7\xD8");
+		vm_land(done);
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_POWI:
+		VM_CODE("\x8B"); vm_slotS(7, i->b);
+		VM_CODE("\x8B"); vm_slotS(6, i->c);
+		vm_callC((void*) &adhoc_ipow);
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_ADDK:
+		VM_CODE("\x8B"); vm_slotS(0, i->b);
+		VM_CODE("\x05"); vm_int32(i->c);
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_ADDF:
+	case VM_SUBF:
+	case VM_MULF:
+	case VM_DIVF:
+		VM_CODE("\xF2\x0F\x10"); vm_slotS(0, i->b);
+		if(i->op == VM_ADDF) VM_CODE("\xF2\x0F\x58");
+		else if(i->op == VM_SUBF) VM_CODE("\xF2\x0F\x5C");
+		else if(i->op == VM_MULF) VM_CODE("\xF2\x0F\x59");
+		else VM_CODE("\xF2\x0F\x5E");
+		vm_slotS(0, i->c);
+		VM_CODE("\xF2\x0F\x11"); vm_slotS(0, i->a);
+		break;
+	case VM_MODF:
+	case VM_POWF:
+		VM_CODE("\xF2\x0F\x10"); vm_slotS(0, i->b);
+		VM_CODE("\xF2\x0F\x10"); vm_slotS(1, i->c);
+		vm_callC(i->op == VM_MODF ? (void*) &fmod : (void*) &pow);
+		VM_CODE("\xF2\x0F\x11"); vm_slotS(0, i->a);
+		break;
+
+	case VM_EQI: case VM_GTI: case VM_LTI: case VM_GEI: case VM_LEI: case VM_NEI:
+		VM_CODE("\x8B"); vm_slotS(0, i->b);
+		VM_CODE("\x3B"); vm_slotS(0, i->c);
+		vm_setcc((int[]){VM_CC_E, VM_CC_G, VM_CC_L, VM_CC_GE, VM_CC_LE, VM_CC_NE}[i->op - VM_EQI]);
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+
+	// Unordered floats compare false, except as not equal. Less than is
+	// greater than the other way around, which ucomisd gets right for NaNs
+	case VM_EQF: case VM_GTF: case VM_LTF: case VM_GEF: case VM_LEF: case VM_NEF:
+		skip = (i->op == VM_LTF || i->op == VM_LEF);
+		VM_CODE("\xF2\x0F\x10"); vm_slotS(0, skip ? i->c : i->b);
+		VM_CODE("\x66\x0F\x2E"); vm_slotS(0, skip ? i->b : i->c);
+		if(i->op == VM_EQF) VM_CODE("\x0F\x94\xC0\x0F\x9B\xC1\x20\xC8\x0F\xB6\xC0");
+		else if(i->op == VM_NEF) VM_CODE("\x0F\x95\xC0\x0F\x9A\xC1\x08\xC8\x0F\xB6\xC0");
+		else vm_setcc(i->op == VM_GTF || i->op == VM_LTF ? VM_CC_A : VM_CC_AE);
+		VM_CODE("\x89"); vm_slotS(0, i->a);
+		break;
+
+	case VM_JMP:
+		vm_jumpTo(-1, i->a, false, 0);
+		break;
+	case VM_JZ:
+	case VM_JNZ:
+		VM_CODE("\x81"); vm_slotS(7, i->a); vm_int32(0);
+		vm_jumpTo((i->op == VM_JZ ? VM_CC_E : VM_CC_NE), i->b, false, 0);
+		break;
+	case VM_JEQ:
+		VM_CODE("\x81"); vm_slotS(7, i->a); vm_int32(i->b);
+		vm_jumpTo(VM_CC_E, i->c, false, 0);
+		break;
+
+	// Items of unboxed arrays are read and written in place when they are
+	// within the array and set. Unset ones read as 0, and writing one goes
+	// through libadhoc to grow the array
+	case VM_AGETB:
+	case VM_AGETI:
+	case VM_AGETF:
+		if(i->op == VM_AGETF) VM_CODE("\x66\x0F\x57\xC0");
+		else VM_CODE("\x31\xC0");
+		count = vm_nativeItem(pc, i->b, i->c, false, misses);
+		if(i->op == VM_AGETB) VM_CODE("\x0F\xB6\x04\x32");
+		else if(i->op == VM_AGETI) VM_CODE("\x8B\x04\xB2");
+		else VM_CODE("\xF3\x0F\x5A\x04\xB2");
+		for(k=0; k<count; ++k) vm_land(misses[k]);
+		if(i->op == VM_AGETF) VM_CODE("\xF2\x0F\x11");
+		else VM_CODE("\x89");
+		vm_slotS(0, i->a);
+		break;
+	case VM_ASETB:
+	case VM_ASETI:
+	case VM_ASETF:
+		count = vm_nativeItem(pc, i->a, i->b, true, misses);
+		if(i->op == VM_ASETB){
+			VM_CODE("\x8B"); vm_slotS(1, i->c);
+			VM_CODE("\x85\xC9\x0F\x95\xC1\x88\x0C\x32");
+		}else if(i->op == VM_ASETI){
+			VM_CODE("\x8B"); vm_slotS(1, i->c);
+			VM_CODE("\x89\x0C\xB2");
+		}else{
+			VM_CODE("\xF2\x0F\x5A"); vm_slotS(0, i->c);
+			VM_CODE("\xF3\x0F\x11\x04\xB2");
+		}
+		done = vm_skip(0xEB);
+		for(k=0; k<count; ++k) vm_land(misses[k]);
+		if(i->op == VM_ASETB){
+			VM_CODE("\x8B"); vm_slotS(2, i->c);
+			VM_CODE("\x85\xD2\x0F\x95\xC2\x0F\xB6\xD2");
+			vm_callC((void*) &adhoc_set_bool);
+		}else if(i->op == VM_ASETI){
+			VM_CODE("\x8B"); vm_slotS(2, i->c);
+			vm_callC((void*) &adhoc_set_int);
+		}else{
+			VM_CODE("\xF2\x0F\x5A"); vm_slotS(0, i->c);
+			vm_callC((void*) &adhoc_set_float);
+		}
+		vm_land(done);
+		break;
+
+	case VM_GLD:
+		vm_imm64(0, (long long) (p->globalS + i->b));
+		VM_CODE("\x48\x8B\x00");
+		VM_CODE("\x48\x89"); vm_slotS(0, i->a);
+		break;
+	case VM_GST:
+		vm_imm64(0, (long long) (p->globalS + i->a));
+		VM_CODE("\x48\x8B"); vm_slotS(1, i->b);
+		VM_CODE("\x48\x89\x08");
+		break;
+
+	// Returning leaves through the epilogue at the end of the code
+	case VM_RET:
+		VM_CODE("\x31\xC0");
+		vm_jumpTo(-1, fn->countCode, false, 0);
+		break;
+	case VM_RETS:
+		VM_CODE("\x48\x8B"); vm_slotS(0, i->a);
+		VM_CODE("\x49\x8B\x4F"); vm_code((char[]){offsetof(vm_frame, retS)}, 1);
+		VM_CODE("\x48\x89\x01\x31\xC0");
+		vm_jumpTo(-1, fn->countCode, false, 0);
+		break;
+	case VM_RETD:
+		VM_CODE("\x49\x8B"); vm_slotD(7, i->a);
+		vm_callC((void*) &vm_ref);
+		VM_CODE("\x49\x8B\x4F"); vm_code((char[]){offsetof(vm_frame, retD)}, 1);
+		VM_CODE("\x48\x89\x01\x31\xC0");
+		vm_jumpTo(-1, fn->countCode, false, 0);
+		break;
+
+	// Everything else goes through the function the interpreter uses
+	default:
+		vm_imm64(7, (long long) p);
+		vm_imm64(6, (long long) fn);
+		vm_imm64(2, (long long) i);
+		VM_CODE("\x48\x89\xD9\x4D\x89\xF0");
+		vm_callC((void*) &vm_runComplex);
+		VM_CODE("\x85\xC0");
+		vm_jumpTo(VM_CC_NE, pc, true, 0);
+		break;
+	}
+}
+
+// Compile a function to native code, which runs it from then on. Not every
+// machine can run what is made, so this says whether it worked
+bool vm_nativeCompile(vm_program* p, vm_function* fn){
+#ifdef VM_NATIVE
+	int pc, k, to, *entries;
+	unsigned char* code;
+	vm_link* l;
+
+	// Take the frame into rbx, r14 and r15, and jump to the entry given.
+	// The epilogue follows the code of the last instruction
+	vm_countOut = vm_countLinks = 0;
+	VM_CODE("\x53\x41\x56\x41\x57\x49\x89\xFF\x48\x8B\x1F\x4C\x8B\x77\x08\xFF\xE6");
+	entries = malloc((fn->countCode+1) * sizeof(int));
+	for(pc=0; pc<fn->countCode; ++pc){
+		entries[pc] = vm_countOut;
+		vm_nativeOp(p, fn, pc);
+	}
+	entries[pc] = vm_countOut;
+	VM_CODE("\x41\x5F\x41\x5E\x5B\xC3");
+
+	// Point the jumps, adding a stub for each that stops with a fault
+	for(k=0; k<vm_countLinks; ++k){
+		l = vm_links + k;
+		to = entries[l->pc];
+		if(l->stub){
+			to = vm_countOut;
+			VM_CODE("\x41\xC7\x47"); vm_code((char[]){offsetof(vm_frame, pc)}, 1); vm_int32(l->pc);
+			if(l->fault){
+				VM_CODE("\xB8"); vm_int32(l->fault);
+			}
+			VM_CODE("\xE9"); vm_int32(entries[fn->countCode] - (vm_countOut + 4));
+		}
+		to -= l->at + 4;
+		memcpy(vm_out + l->at, &to, 4);
+	}
+
+	// Copy it where it can run, and never write there again
+	code = mmap(NULL, vm_countOut, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(code == MAP_FAILED){
+		free(entries);
+		return false;
+	}
+	memcpy(code, vm_out, vm_countOut);
+	if(mprotect(code, vm_countOut, PROT_READ|PROT_EXEC)){
+		munmap(code, vm_countOut);
+		free(entries);
+		return false;
+	}
+	fn->native = code;
+	fn->sizeNative = vm_countOut;
+	fn->entries = entries;
+	if(p->debug){
+		fprintf(stderr, "-- (vm) %s: compiled to %d bytes of native code --\n"
+			,fn->def->name
+			,vm_countOut
+		);
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+//-------------------------//
+//    Running Programs    //
+//-------------------------//
+
+// Print a program's bytecode, for debugging
+void vm_printProgram(vm_program* p){
+	int i, j;
+	vm_function* f;
+	vm_instr* c;
+	for(i=0; i<p->countFunctions; ++i){
+		f = p->functions[i];
+		fprintf(stderr, "-- (vm) %s: %d scalar, %d complex registers --\n"
+			,f->def->name
+			,f->countS
+			,f->countD
+		);
+		for(j=0; j<f->countCode; ++j){
+			c = f->code + j;
+			fprintf(stderr, "%5d  %-8s%6d%6d%6d%4d   node %d\n"
+				,j
+				,vm_op_names[c->op]
+				,c->a
+				,c->b
+				,c->c
+				,c->k
+				,f->nodes[j]
+			);
+		}
+	}
+}
+
+// Free a compiled program
+void vm_free(vm_program* p){
+	int i, j;
+	for(i=0; i<p->countFunctions; ++i){
+		free(p->functions[i]->code);
+		free(p->functions[i]->nodes);
+		free(p->functions[i]->params);
+		free(p->functions[i]->args);
+#ifdef VM_NATIVE
+		if(p->functions[i]->native) munmap(p->functions[i]->native, p->functions[i]->sizeNative);
+#endif
+		free(p->functions[i]->entries);
+		free(p->functions[i]);
+	}
+	for(i=0; i<p->countStrings; ++i) free(p->strings[i]);
+	for(i=0; i<p->countSwitches; ++i){
+		for(j=0; j<p->switches[i]->countLabels; ++j) free((char*)p->switches[i]->labels[j].data);
+		free((adhoc_switchLabel*)p->switches[i]->labels);
+		free(p->switches[i]->slots);
+		free(p->switches[i]);
+	}
+	for(i=0; i<p->countNeedles; ++i){
+		free((char*)p->needles[i]->data);
+		free(p->needles[i]);
+	}
+	free(p->functions);
+	free(p->floats);
+	free(p->strings);
+	free(p->switches);
+	free(p->needles);
+	free(p->globalS);
+	free(p->globalD);
+	free(p->slots);
+	free(p->funcs);
+	free(vm_literals);
+	vm_literals = NULL;
+	vm_countLiterals = vm_sizeLiterals = 0;
+	free(vm_out);
+	vm_out = NULL;
+	vm_countOut = vm_sizeOut = 0;
+	free(vm_links);
+	vm_links = NULL;
+	vm_countLinks = vm_sizeLinks = 0;
+}
+
+// Find the highest node id in a tree
+int vm_maxId(ASTnode* n){
+	int i, ret = n->id, m;
+	for(i=0; i<n->countChildren; ++i){
+		if((m = vm_maxId(n->children[i])) > ret) ret = m;
+	}
+	return ret;
+}
+
+// Compile the validated AST to bytecode, and run its root action the way
+// the main function of an executable would
+void vm_run(ASTnode* root, hashMap* nodes, const char* prepend, bool debug, char* errBuf){
+	int i, maxId = vm_maxId(root);
+	hashMap_uint j;
+	vm_program p;
+	vm_value retS;
+	adhoc_data* retD = NULL;
+	memset(&p, 0, sizeof(vm_program));
+	p.nodes = nodes;
+	p.hot = vm_nativeHeat;
+	p.debug = debug;
+	p.errBuf = errBuf;
+	for(j=0; j<nodes->size; ++j){
+		if(nodes->items[j] && ((ASTnode*)nodes->items[j]->value)->id > maxId){
+			maxId = ((ASTnode*)nodes->items[j]->value)->id;
+		}
+	}
+	p.slots = calloc(maxId+1, sizeof(int));
+	p.funcs = calloc(maxId+1, sizeof(int));
+	vm_prog = &p;
+	vm_root = root;
+	vm_libraryPrepend = prepend;
+
+	// Compile the root action, and every action it reaches
+	vm_functionOf(root);
+	for(i=0; i<p.countFunctions && !*errBuf; ++i) vm_compile(p.functions[i]);
+	if(debug && !*errBuf) vm_printProgram(&p);
+
+	// Run it
+	if(!*errBuf){
+		p.globalS = calloc(p.countGlobalS+1, sizeof(vm_value));
+		p.globalD = calloc(p.countGlobalD+1, sizeof(adhoc_data*));
+		vm_exec(&p, p.functions[0], NULL, NULL, NULL, &retS, &retD);
+		adhoc_unreferenceData(retD);
+		for(i=0; i<p.countGlobalD; ++i) adhoc_unreferenceData(p.globalD[i]);
+		fflush(stdout);
+	}
+	vm_free(&p);
+}
+
+#pragma clang diagnostic pop
+#endif